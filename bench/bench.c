@@ -0,0 +1,21 @@
+#include "bench.h"
+#include <stdio.h>
+#include <time.h>
+
+double now_seconds()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+void print_throughput(const char *label,
+                      uint32_t num_assets,
+                      uint64_t input_bytes,
+                      double time)
+{
+    printf("%-16s %7u assets %9.2f MB %10.3f ms %9.2f MB/s %11.1f assets/s\n",
+           label, num_assets, input_bytes / 1e6, time * 1e3,
+           time > 0.0 ? input_bytes / 1e6 / time : 0.0,
+           time > 0.0 ? num_assets / time : 0.0);
+}
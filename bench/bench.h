@@ -0,0 +1,12 @@
+#ifndef OSP_BENCH_H
+#define OSP_BENCH_H
+
+#include <stdint.h>
+
+// Helpers shared by the benchmarks: a monotonic clock in seconds and the
+// throughput line of a timed set of assets (input MB/s and assets/s).
+
+extern double now_seconds();
+extern void print_throughput(const char *label, uint32_t num_assets, uint64_t input_bytes, double time);
+
+#endif
@@ -0,0 +1,210 @@
+// Content build benchmark: runs every processor over a content corpus (see
+// corpus_gen) in process, then times full bundle builds running
+// c_content_processor, serial and on every CPU. Throughput is reported in
+// input MB/s and assets/s, best of a few runs.
+//
+// Usage: build_bench corpus_dir processor_binary [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "input.h"
+#include "walk.h"
+#include "writer.h"
+#include "processors/png_to_png.h"
+#include "processors/ldtk_to_map.h"
+#include "processors/fst_to_fst.h"
+
+#define DEFAULT_RUNS 3
+#define MAX_PATH 4096
+#define ASSET_WRITER_CAPACITY 4096
+
+typedef int (*processor_t)(const osp_input_t* input,
+                           osp_writer_t writer,
+                           void* params);
+
+// A benchmarked processor and its corpus inputs
+typedef struct _bench_processor
+{
+    const char *extension;
+    processor_t processor;
+    uint32_t num_assets;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    uint32_t failures;
+    double best_time;
+} bench_processor_t;
+
+#define NUM_PROCESSORS 3
+bench_processor_t processors[NUM_PROCESSORS] =
+{
+    { .extension = "png", .processor = &png_to_png },
+    { .extension = "ldtk", .processor = &ldtk_to_map },
+    { .extension = "fst", .processor = &fst_to_fst }
+};
+
+int bench_processors(const char *corpus_dir, osp_dynarray_t files, uint32_t runs)
+{
+    char **paths = (char **)osp_dynarray_get_data(files);
+    size_t num_files = osp_dynarray_get_count(files);
+
+    // Inputs are opened once, only the processing is timed
+    osp_input_t *inputs = calloc(num_files, sizeof(osp_input_t));
+    int32_t *processor_idx = malloc(num_files * sizeof(int32_t));
+    for(size_t i_file = 0; i_file < num_files; ++i_file)
+    {
+        processor_idx[i_file] = -1;
+        const char *last_dot = rindex(paths[i_file], '.');
+        for(int32_t i_processor = 0; i_processor < NUM_PROCESSORS; ++i_processor)
+            if(last_dot != NULL &&
+               strcmp(last_dot + 1, processors[i_processor].extension) == 0)
+                processor_idx[i_file] = i_processor;
+        if(processor_idx[i_file] < 0)
+            continue;
+
+        char path[MAX_PATH];
+        snprintf(path, MAX_PATH, "%s/%s", corpus_dir, paths[i_file]);
+        if(osp_input_open(&(inputs[i_file]), path) != 0)
+        {
+            printf("Unable to open %s\n", path);
+            processor_idx[i_file] = -1;
+            continue;
+        }
+        bench_processor_t *processor = &(processors[processor_idx[i_file]]);
+        processor->num_assets++;
+        processor->input_bytes += inputs[i_file].size;
+    }
+
+    for(int32_t i_processor = 0; i_processor < NUM_PROCESSORS; ++i_processor)
+    {
+        bench_processor_t *processor = &(processors[i_processor]);
+        for(uint32_t i_run = 0; i_run < runs; ++i_run)
+        {
+            uint64_t output_bytes = 0;
+            uint32_t failures = 0;
+            double start = now_seconds();
+            for(size_t i_file = 0; i_file < num_files; ++i_file)
+            {
+                if(processor_idx[i_file] != i_processor)
+                    continue;
+                osp_writer_t writer = osp_writer_new(ASSET_WRITER_CAPACITY);
+                failures += processor->processor(&(inputs[i_file]), writer, NULL) != 0;
+                output_bytes += osp_writer_get_size(writer);
+                osp_writer_delete(writer);
+            }
+            double time = now_seconds() - start;
+            if(i_run == 0 || time < processor->best_time)
+                processor->best_time = time;
+            processor->output_bytes = output_bytes;
+            processor->failures = failures;
+        }
+
+        print_throughput(processor->extension, processor->num_assets,
+                         processor->input_bytes, processor->best_time);
+        if(processor->failures > 0)
+            printf("%-16s %7u failed\n", "", processor->failures);
+    }
+
+    for(size_t i_file = 0; i_file < num_files; ++i_file)
+        if(processor_idx[i_file] >= 0)
+            osp_input_close(&(inputs[i_file]));
+    free(processor_idx);
+    free(inputs);
+
+    return 0;
+}
+
+// Run c_content_processor once, with its output discarded
+int run_build(const char *binary, const char *corpus_dir, const char *threads)
+{
+    pid_t pid = fork();
+    if(pid < 0)
+        return 1;
+    if(pid == 0)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+        execl(binary, binary, corpus_dir, "-o", "../build_bench.cnt",
+              "-j", threads, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    if(waitpid(pid, &status, 0) < 0)
+        return 1;
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+int bench_builds(const char *binary, const char *corpus_dir, uint32_t runs)
+{
+    uint32_t num_assets = 0;
+    uint64_t input_bytes = 0;
+    for(int32_t i_processor = 0; i_processor < NUM_PROCESSORS; ++i_processor)
+    {
+        num_assets += processors[i_processor].num_assets;
+        input_bytes += processors[i_processor].input_bytes;
+    }
+
+    // Serial, then one thread for every CPU
+    const char *threads[] = { "1", "0" };
+    const char *labels[] = { "build -j 1", "build -j 0" };
+    for(int i_build = 0; i_build < 2; ++i_build)
+    {
+        double best_time = 0.0;
+        for(uint32_t i_run = 0; i_run < runs; ++i_run)
+        {
+            double start = now_seconds();
+            if(run_build(binary, corpus_dir, threads[i_build]) != 0)
+            {
+                printf("Unable to run %s on %s\n", binary, corpus_dir);
+                return 1;
+            }
+            double time = now_seconds() - start;
+            if(i_run == 0 || time < best_time)
+                best_time = time;
+        }
+        print_throughput(labels[i_build], num_assets, input_bytes, best_time);
+    }
+
+    char bundle_path[MAX_PATH];
+    snprintf(bundle_path, MAX_PATH, "%s/../build_bench.cnt", corpus_dir);
+    unlink(bundle_path);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 3)
+    {
+        printf("Usage: build_bench corpus_dir processor_binary [runs]\n");
+        return 1;
+    }
+    const char *corpus_dir = argv[1];
+    const char *binary = argv[2];
+    uint32_t runs = argc > 3 ? (uint32_t)strtoul(argv[3], NULL, 10) : DEFAULT_RUNS;
+    if(runs == 0)
+        runs = DEFAULT_RUNS;
+
+    osp_dynarray_t files = osp_walk(corpus_dir, "", 1);
+    if(files == NULL)
+    {
+        printf("Unable to open %s\n", corpus_dir);
+        return 1;
+    }
+
+    printf("Corpus %s, best of %u runs\n", corpus_dir, runs);
+    int result = bench_processors(corpus_dir, files, runs);
+    if(result == 0)
+        result = bench_builds(binary, corpus_dir, runs);
+
+    osp_walk_free(files);
+    return result;
+}
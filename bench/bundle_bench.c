@@ -0,0 +1,182 @@
+// Bundle reader microbenchmark: writes synthetic bundles with many small
+// assets, in both content table layouts, then measures cold and warm open
+// times and lookup latency.
+//
+// Usage: bundle_bench [num_entries] [bundle_path]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bundle.h"
+#include "content_table.h"
+#include "writer.h"
+
+#define DEFAULT_NUM_ENTRIES 100000
+#define DEFAULT_BUNDLE_PATH "/tmp/osp_bundle_bench.cnt"
+#define ASSET_SIZE 16
+#define NUM_OPENS 5
+#define NUM_LOOKUPS 1000000
+#define MAX_NAME 64
+
+void asset_name(char *name, uint32_t idx)
+{
+    snprintf(name, MAX_NAME, "levels/world_%03u/asset_%07u", idx / 1000, idx);
+}
+
+int write_bundle(const char *path, uint32_t num_entries, uint8_t legacy)
+{
+    FILE *file = fopen(path, "wb");
+    if(file == NULL)
+        return -1;
+
+    osp_writer_t writer = osp_writer_new_file(file, 1 << 20);
+    osp_writer_put_u64(writer, 0);
+
+    // Payloads first, every one different
+    uint8_t payload[ASSET_SIZE];
+    for(uint32_t i_entry = 0; i_entry < num_entries; ++i_entry)
+    {
+        memset(payload, 0, ASSET_SIZE);
+        memcpy(payload, &i_entry, sizeof(i_entry));
+        osp_writer_put_bytes(writer, payload, ASSET_SIZE);
+    }
+
+    // Then the content table, written as c_content_processor does
+    osp_cnt_table_entry_t *entries =
+        malloc(sizeof(osp_cnt_table_entry_t) * num_entries);
+    for(uint32_t i_entry = 0; i_entry < num_entries; ++i_entry)
+    {
+        entries[i_entry].name = malloc(MAX_NAME);
+        asset_name(entries[i_entry].name, i_entry);
+        entries[i_entry].type = 0;
+        entries[i_entry].start = sizeof(uint64_t) + (uint64_t)i_entry * ASSET_SIZE;
+        entries[i_entry].size = ASSET_SIZE;
+        entries[i_entry].codec = OSP_CNT_CODEC_NONE;
+        entries[i_entry].raw_size = ASSET_SIZE;
+    }
+    uint64_t table_pos = legacy
+        ? osp_cnt_write_legacy_table(writer, entries, num_entries)
+        : osp_cnt_write_table(writer, entries, num_entries);
+    osp_writer_delete(writer);
+    for(uint32_t i_entry = 0; i_entry < num_entries; ++i_entry)
+        free(entries[i_entry].name);
+    free(entries);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(&table_pos, sizeof(table_pos), 1, file);
+    fclose(file);
+
+    return 0;
+}
+
+void drop_page_cache(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+int run_bench(const char *path,
+              uint32_t num_entries,
+              char (*names)[MAX_NAME],
+              uint8_t legacy)
+{
+    if(write_bundle(path, num_entries, legacy) != 0)
+    {
+        printf("Unable to write %s\n", path);
+        return 1;
+    }
+    printf("Bundle %s with %u entries, %s content table\n", path, num_entries,
+           legacy ? "legacy" : "fixed size records");
+
+    // Open times, dropping the bundle pages from the page cache first for
+    // the cold ones (best effort, the kernel can ignore the advice).
+    double cold_total = 0.0;
+    double warm_total = 0.0;
+    for(int i_open = 0; i_open < NUM_OPENS; ++i_open)
+    {
+        drop_page_cache(path);
+        double start = now_seconds();
+        osp_bundle_t bundle = osp_bundle_open(path);
+        cold_total += now_seconds() - start;
+        osp_bundle_close(bundle);
+
+        start = now_seconds();
+        bundle = osp_bundle_open(path);
+        warm_total += now_seconds() - start;
+        if(bundle == NULL)
+        {
+            printf("Unable to open %s\n", path);
+            return 1;
+        }
+        osp_bundle_close(bundle);
+    }
+    printf("open (cold):    %10.3f ms\n", cold_total * 1000.0 / NUM_OPENS);
+    printf("open (warm):    %10.3f ms\n", warm_total * 1000.0 / NUM_OPENS);
+
+    // Lookups of random existing names, and of missing ones
+    osp_bundle_t bundle = osp_bundle_open(path);
+
+    uint32_t seed = 12345;
+    uint64_t checksum = 0;
+    double start = now_seconds();
+    for(uint32_t i_lookup = 0; i_lookup < NUM_LOOKUPS; ++i_lookup)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        osp_bundle_asset_t asset;
+        if(osp_bundle_find(bundle, names[seed % num_entries], &asset))
+            checksum += *(const uint8_t *)asset.data;
+    }
+    double hit_time = now_seconds() - start;
+
+    uint32_t misses = 0;
+    start = now_seconds();
+    for(uint32_t i_lookup = 0; i_lookup < NUM_LOOKUPS; ++i_lookup)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        char *name = names[seed % num_entries];
+        // Same length, last character changed: a realistic near miss
+        size_t length = strlen(name);
+        char last = name[length - 1];
+        name[length - 1] = 'x';
+        misses += !osp_bundle_find(bundle, name, NULL);
+        name[length - 1] = last;
+    }
+    double miss_time = now_seconds() - start;
+
+    printf("lookup (hit):   %10.1f ns\n", hit_time * 1e9 / NUM_LOOKUPS);
+    printf("lookup (miss):  %10.1f ns\n", miss_time * 1e9 / NUM_LOOKUPS);
+    printf("(checksum %lu, misses %u)\n", (unsigned long)checksum, misses);
+
+    osp_bundle_close(bundle);
+    unlink(path);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t num_entries = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10)
+                                    : DEFAULT_NUM_ENTRIES;
+    const char *path = argc > 2 ? argv[2] : DEFAULT_BUNDLE_PATH;
+    if(num_entries == 0)
+        num_entries = DEFAULT_NUM_ENTRIES;
+
+    char (*names)[MAX_NAME] = malloc((size_t)num_entries * MAX_NAME);
+    for(uint32_t i_entry = 0; i_entry < num_entries; ++i_entry)
+        asset_name(names[i_entry], i_entry);
+
+    int result = run_bench(path, num_entries, names, 1);
+    if(result == 0)
+        result = run_bench(path, num_entries, names, 0);
+
+    free(names);
+    return result;
+}
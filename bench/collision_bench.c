@@ -0,0 +1,127 @@
+// Collision rectangles extraction benchmark: merges 1024x1024 noisy bitset grids
+// with extract_collision_rectangles, checking the rectangles cover every
+// solid cell exactly once.
+//
+// Usage: collision_bench [size] [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "mem.h"
+#include "processors/ldtk_to_map.h"
+
+#define DEFAULT_SIZE 1024
+#define DEFAULT_RUNS 5
+
+// Solid cells with the given probability, plus solid horizontal platforms
+void fill_grid(int32_t *grid, uint32_t size, uint32_t noise_percent, uint32_t seed)
+{
+    for(size_t i_cell = 0; i_cell < (size_t)size * size; ++i_cell)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        grid[i_cell] = (seed >> 16) % 100 < noise_percent;
+    }
+    for(uint32_t i_platform = 0; i_platform < size * size / 256; ++i_platform)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t x = (seed >> 8) % size;
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t y = (seed >> 8) % size;
+        for(uint32_t i_cell = 0; i_cell < 16 && x + i_cell < size; ++i_cell)
+            grid[(size_t)y * size + x + i_cell] = 1;
+    }
+}
+
+// Pack a grid as the row aligned bitset extract_collision_rectangles takes
+void pack_grid(const int32_t *grid, uint32_t size, uint64_t *bits)
+{
+    size_t words_per_row = ((size_t)size + 63) / 64;
+    memset(bits, 0, words_per_row * size * sizeof(uint64_t));
+    for(uint32_t y = 0; y < size; ++y)
+        for(uint32_t x = 0; x < size; ++x)
+            if(grid[(size_t)y * size + x] > 0)
+                bits[y * words_per_row + x / 64] |= 1ull << (x % 64);
+}
+
+// Every solid cell must be covered by exactly one rectangle
+int check_rectangles(const int32_t *grid,
+                     uint32_t size,
+                     const collision_rect_t *rectangles,
+                     uint32_t num_rectangles)
+{
+    uint8_t *coverage = calloc((size_t)size * size, 1);
+    int result = 0;
+    for(uint32_t i_rect = 0; i_rect < num_rectangles && result == 0; ++i_rect)
+    {
+        const collision_rect_t *rect = &(rectangles[i_rect]);
+        if(rect->w == 0 || rect->h == 0 ||
+           rect->x + rect->w > size || rect->y + rect->h > size)
+            result = 1;
+        for(uint32_t y = rect->y; y < rect->y + rect->h && result == 0; ++y)
+            for(uint32_t x = rect->x; x < rect->x + rect->w; ++x)
+                coverage[(size_t)y * size + x]++;
+    }
+    for(size_t i_cell = 0; i_cell < (size_t)size * size && result == 0; ++i_cell)
+        result = coverage[i_cell] != (grid[i_cell] > 0);
+    free(coverage);
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t size = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_SIZE;
+    uint32_t runs = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : DEFAULT_RUNS;
+    if(size == 0)
+        size = DEFAULT_SIZE;
+    if(runs == 0)
+        runs = DEFAULT_RUNS;
+
+    size_t num_cells = (size_t)size * size;
+    int32_t *source = malloc(num_cells * sizeof(int32_t));
+    size_t num_words = ((size_t)size + 63) / 64 * size;
+    uint64_t *packed = malloc(num_words * sizeof(uint64_t));
+    uint64_t *grid = malloc(num_words * sizeof(uint64_t));
+
+    printf("Collision grids %ux%u, best of %u runs\n", size, size, runs);
+    const uint32_t noise_levels[] = { 1, 10, 30, 50, 90 };
+    int result = 0;
+    for(size_t i_noise = 0; i_noise < sizeof(noise_levels) / sizeof(noise_levels[0]); ++i_noise)
+    {
+        fill_grid(source, size, noise_levels[i_noise], 12345);
+        pack_grid(source, size, packed);
+        double best_time = 0.0;
+        collision_rect_t *rectangles = NULL;
+        uint32_t num_rectangles = 0;
+        for(uint32_t i_run = 0; i_run < runs; ++i_run)
+        {
+            // The grid is cleared while merging
+            memcpy(grid, packed, num_words * sizeof(uint64_t));
+            osp_mem_free(rectangles);
+            double start = now_seconds();
+            num_rectangles = extract_collision_rectangles(grid, size, size,
+                                                          &rectangles);
+            double time = now_seconds() - start;
+            if(i_run == 0 || time < best_time)
+                best_time = time;
+        }
+
+        if(check_rectangles(source, size, rectangles, num_rectangles) != 0)
+        {
+            printf("%2u%% noise: rectangles don't cover the grid\n",
+                   noise_levels[i_noise]);
+            result = 1;
+        }
+        osp_mem_free(rectangles);
+        printf("%2u%% noise: %8u rectangles %9.3f ms %8.1f Mcells/s\n",
+               noise_levels[i_noise], num_rectangles, best_time * 1e3,
+               num_cells / best_time * 1e-6);
+    }
+
+    free(grid);
+    free(packed);
+    free(source);
+    return result;
+}
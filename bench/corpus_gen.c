@@ -0,0 +1,462 @@
+// Synthetic content corpus generator for the benchmarks. Every run with the
+// same options writes the same files:
+//  - maps/map_NNN.ldtk: LDtk projects with a tiles layer, an IntGrid
+//    collision layer of platforms plus noise and an entities layer with
+//    decor entities and entities holding Int, Float, String and EntityRef
+//    fields.
+//  - anims/anim_NNN.fst: FST files with many frame sequences.
+//  - sprites/NN/sprite_NNN.png: a directory tree of small RGBA PNGs.
+//
+// Usage: corpus_gen out_dir [-s scale] [-m width height] [-n noise_percent]
+//                           [-e entities] [-r seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#define MAX_PATH 4096
+#define TILE_SIZE 16
+#define TILESET_COLUMNS 16
+#define TILESET_ROWS 16
+#define MAPS_PER_SCALE 4
+#define ANIMS_PER_SCALE 16
+#define SEQUENCES_PER_ANIM 256
+#define SPRITES_PER_SCALE 256
+#define SPRITE_DIRS 16
+#define SPRITE_SIZE 32
+
+// Generator options
+typedef struct _corpus_options
+{
+    const char *out_dir;
+    uint32_t scale;
+    uint32_t map_width;
+    uint32_t map_height;
+    uint32_t noise_percent;
+    uint32_t num_entities;
+    uint64_t seed;
+} corpus_options_t;
+
+uint64_t rng_state;
+
+// xorshift64*, deterministic on every platform
+uint32_t rng_next()
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+uint32_t rng_range(uint32_t range)
+{
+    return range > 0 ? rng_next() % range : 0;
+}
+
+int make_dir(const char *path)
+{
+    if(mkdir(path, 0755) != 0 && errno != EEXIST)
+    {
+        printf("Unable to create %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+void write_entity_iid(FILE *file, uint32_t map_idx, uint32_t entity_idx)
+{
+    fprintf(file, "\"%08x-0000-4000-8000-%012x\"", map_idx, entity_idx);
+}
+
+void write_tiles_layer(FILE *file, const corpus_options_t *options)
+{
+    fprintf(file,
+        "    {\n"
+        "     \"__identifier\": \"Tiles\",\n"
+        "     \"__type\": \"Tiles\",\n"
+        "     \"__cWid\": %u,\n"
+        "     \"__cHei\": %u,\n"
+        "     \"__gridSize\": %u,\n"
+        "     \"__tilesetDefUid\": 1,\n"
+        "     \"__tilesetRelPath\": \"tilesets/dungeon.png\",\n"
+        "     \"gridTiles\": [",
+        options->map_width, options->map_height, TILE_SIZE);
+
+    // Three quarters of the cells have a tile
+    const char *separator = "\n";
+    for(uint32_t y = 0; y < options->map_height; ++y)
+        for(uint32_t x = 0; x < options->map_width; ++x)
+        {
+            if(rng_range(4) == 0)
+                continue;
+            uint32_t tile = rng_range(TILESET_COLUMNS * TILESET_ROWS);
+            fprintf(file,
+                "%s      { \"px\": [%u,%u], \"src\": [%u,%u], \"f\": 0, "
+                "\"t\": %u, \"d\": [%u], \"a\": 1 }",
+                separator, x * TILE_SIZE, y * TILE_SIZE,
+                (tile % TILESET_COLUMNS) * TILE_SIZE,
+                (tile / TILESET_COLUMNS) * TILE_SIZE,
+                tile, y * options->map_width + x);
+            separator = ",\n";
+        }
+    fprintf(file, "\n     ]\n    }");
+}
+
+void write_collisions_layer(FILE *file, const corpus_options_t *options)
+{
+    uint32_t width = options->map_width;
+    uint32_t height = options->map_height;
+    uint8_t *grid = calloc((size_t)width * height, 1);
+
+    // Solid borders, some platforms and blocks, then random noise
+    for(uint32_t x = 0; x < width; ++x)
+        grid[x] = grid[(size_t)(height - 1) * width + x] = 1;
+    for(uint32_t y = 0; y < height; ++y)
+        grid[(size_t)y * width] = grid[(size_t)y * width + width - 1] = 1;
+    uint32_t num_platforms = width * height / 64;
+    for(uint32_t i_platform = 0; i_platform < num_platforms; ++i_platform)
+    {
+        uint32_t w = 2 + rng_range(10);
+        uint32_t h = 1 + (rng_range(4) == 0 ? rng_range(6) : 0);
+        uint32_t x0 = rng_range(width);
+        uint32_t y0 = rng_range(height);
+        for(uint32_t y = y0; y < y0 + h && y < height; ++y)
+            for(uint32_t x = x0; x < x0 + w && x < width; ++x)
+                grid[(size_t)y * width + x] = 1;
+    }
+    for(size_t i_cell = 0; i_cell < (size_t)width * height; ++i_cell)
+        if(rng_range(100) < options->noise_percent)
+            grid[i_cell] ^= 1;
+
+    fprintf(file,
+        "    {\n"
+        "     \"__identifier\": \"Collisions\",\n"
+        "     \"__type\": \"IntGrid\",\n"
+        "     \"__cWid\": %u,\n"
+        "     \"__cHei\": %u,\n"
+        "     \"__gridSize\": %u,\n"
+        "     \"intGridCsv\": [",
+        width, height, TILE_SIZE);
+    for(size_t i_cell = 0; i_cell < (size_t)width * height; ++i_cell)
+        fprintf(file, "%s%s%u", i_cell > 0 ? "," : "",
+                i_cell % width == 0 ? "\n      " : "", grid[i_cell]);
+    fprintf(file, "\n     ]\n    }");
+
+    free(grid);
+}
+
+void write_entities_layer(FILE *file,
+                          const corpus_options_t *options,
+                          uint32_t map_idx)
+{
+    fprintf(file,
+        "    {\n"
+        "     \"__identifier\": \"Entities\",\n"
+        "     \"__type\": \"Entities\",\n"
+        "     \"__cWid\": %u,\n"
+        "     \"__cHei\": %u,\n"
+        "     \"__gridSize\": %u,\n"
+        "     \"entityInstances\": [",
+        options->map_width, options->map_height, TILE_SIZE);
+
+    for(uint32_t i_entity = 0; i_entity < options->num_entities; ++i_entity)
+    {
+        // A quarter of the entities are decor
+        uint8_t decor = rng_range(4) == 0;
+        uint32_t tile = rng_range(TILESET_COLUMNS * TILESET_ROWS);
+        fprintf(file,
+            "%s\n      {\n"
+            "       \"__identifier\": \"%s\",\n"
+            "       \"__tags\": [%s],\n"
+            "       \"iid\": ",
+            i_entity > 0 ? "," : "",
+            decor ? "Decor" : (rng_range(2) ? "Enemy" : "Switch"),
+            decor ? "\"decor\"" : "");
+        write_entity_iid(file, map_idx, i_entity);
+        fprintf(file,
+            ",\n"
+            "       \"px\": [%u,%u],\n"
+            "       \"width\": %u,\n"
+            "       \"height\": %u,\n"
+            "       \"__tile\": { \"tilesetUid\": 1, \"x\": %u, \"y\": %u, "
+            "\"w\": %u, \"h\": %u },\n"
+            "       \"fieldInstances\": [",
+            rng_range(options->map_width) * TILE_SIZE,
+            rng_range(options->map_height) * TILE_SIZE,
+            TILE_SIZE, TILE_SIZE,
+            (tile % TILESET_COLUMNS) * TILE_SIZE,
+            (tile / TILESET_COLUMNS) * TILE_SIZE,
+            TILE_SIZE, TILE_SIZE);
+        if(!decor)
+        {
+            fprintf(file,
+                "\n"
+                "        { \"__identifier\": \"hp\", \"__type\": \"Int\", "
+                "\"__value\": %u, \"defUid\": 10 },\n"
+                "        { \"__identifier\": \"speed\", \"__type\": \"Float\", "
+                "\"__value\": %u.%02u, \"defUid\": 11 },\n"
+                "        { \"__identifier\": \"label\", \"__type\": \"String\", "
+                "\"__value\": \"entity_%u_%u\", \"defUid\": 12 },\n"
+                "        { \"__identifier\": \"target\", \"__type\": \"EntityRef\", "
+                "\"__value\": { \"entityIid\": ",
+                rng_range(100), rng_range(8), rng_range(100), map_idx, i_entity);
+            write_entity_iid(file, map_idx, rng_range(options->num_entities));
+            fprintf(file,
+                ", \"layerIid\": \"layer\", \"levelIid\": \"level\", "
+                "\"worldIid\": \"world\" }, \"defUid\": 13 }\n"
+                "       ");
+        }
+        fprintf(file, "]\n      }");
+    }
+    fprintf(file, "\n     ]\n    }");
+}
+
+int write_map(const corpus_options_t *options, const char *path, uint32_t map_idx)
+{
+    FILE *file = fopen(path, "w");
+    if(file == NULL)
+    {
+        printf("Unable to write %s\n", path);
+        return 1;
+    }
+
+    fprintf(file,
+        "{\n"
+        " \"jsonVersion\": \"1.5.3\",\n"
+        " \"defs\": { \"tilesets\": [ { \"uid\": 1, \"identifier\": \"Dungeon\", "
+        "\"relPath\": \"tilesets/dungeon.png\", \"tileGridSize\": %u, "
+        "\"__cWid\": %u, \"pxWid\": %u, \"spacing\": 0, \"padding\": 0 } ] },\n"
+        " \"levels\": [\n"
+        "  {\n"
+        "   \"identifier\": \"Level_%u\",\n"
+        "   \"iid\": \"level\",\n"
+        "   \"pxWid\": %u,\n"
+        "   \"pxHei\": %u,\n"
+        "   \"layerInstances\": [\n",
+        TILE_SIZE, TILESET_COLUMNS, TILESET_COLUMNS * TILE_SIZE, map_idx,
+        options->map_width * TILE_SIZE, options->map_height * TILE_SIZE);
+    // Entities on top, then collisions and tiles, as LDtk sorts them
+    write_entities_layer(file, options, map_idx);
+    fprintf(file, ",\n");
+    // The map size comes from the tiles layer, which has to come first
+    write_tiles_layer(file, options);
+    fprintf(file, ",\n");
+    write_collisions_layer(file, options);
+    fprintf(file, "\n   ]\n  }\n ]\n}\n");
+
+    return fclose(file) != 0;
+}
+
+int write_anim(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if(file == NULL)
+    {
+        printf("Unable to write %s\n", path);
+        return 1;
+    }
+
+    // Full pixel rectangles first, then grid rows of fixed size frames: rows
+    // can't be unset. The parser skips the character after a number, so
+    // tuples close after a space.
+    for(uint32_t i_sequence = 0; i_sequence < SEQUENCES_PER_ANIM; ++i_sequence)
+    {
+        uint32_t num_frames = 1 + rng_range(12);
+        if(i_sequence < SEQUENCES_PER_ANIM / 2)
+        {
+            fprintf(file, "0.%02u ", 1 + rng_range(20));
+            for(uint32_t i_frame = 0; i_frame < num_frames; ++i_frame)
+                fprintf(file, "(%u %u %u %u )", rng_range(512), rng_range(512),
+                        8 + rng_range(24), 8 + rng_range(24));
+        }
+        else
+        {
+            if(i_sequence == SEQUENCES_PER_ANIM / 2)
+                fprintf(file, "width 1\nheight 1\ngrid 16 16\n");
+            fprintf(file, "row %u\n0.%02u", rng_range(32), 1 + rng_range(20));
+            for(uint32_t i_frame = 0; i_frame < num_frames; ++i_frame)
+                fprintf(file, " %u", rng_range(32));
+        }
+        fprintf(file, "\n");
+    }
+
+    return fclose(file) != 0;
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for(size_t i_byte = 0; i_byte < size; ++i_byte)
+    {
+        crc ^= data[i_byte];
+        for(int i_bit = 0; i_bit < 8; ++i_bit)
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+void put_u32_be(uint8_t *data, uint32_t value)
+{
+    data[0] = value >> 24;
+    data[1] = value >> 16;
+    data[2] = value >> 8;
+    data[3] = value;
+}
+
+void write_png_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t size)
+{
+    uint8_t header[8];
+    put_u32_be(header, size);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = crc32_update(0, header + 4, 4);
+    crc = crc32_update(crc, data, size);
+    uint8_t footer[4];
+    put_u32_be(footer, crc);
+
+    fwrite(header, 1, sizeof(header), file);
+    if(size > 0)
+        fwrite(data, 1, size, file);
+    fwrite(footer, 1, sizeof(footer), file);
+}
+
+int write_png(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if(file == NULL)
+    {
+        printf("Unable to write %s\n", path);
+        return 1;
+    }
+
+    // Noisy RGBA pixels, as hard to compress as real PNG data
+    const uint32_t row_size = 1 + SPRITE_SIZE * 4;
+    const uint32_t raw_size = row_size * SPRITE_SIZE;
+    uint8_t raw[(1 + SPRITE_SIZE * 4) * SPRITE_SIZE];
+    for(uint32_t i_byte = 0; i_byte < raw_size; ++i_byte)
+        raw[i_byte] = i_byte % row_size == 0 ? 0 : (uint8_t)rng_next();
+
+    // A zlib stream of a single stored deflate block
+    uint8_t idat[2 + 5 + sizeof(raw) + 4];
+    idat[0] = 0x78;
+    idat[1] = 0x01;
+    idat[2] = 1;
+    idat[3] = raw_size & 0xFF;
+    idat[4] = raw_size >> 8;
+    idat[5] = ~raw_size & 0xFF;
+    idat[6] = (~raw_size >> 8) & 0xFF;
+    memcpy(idat + 7, raw, raw_size);
+    uint32_t adler_a = 1, adler_b = 0;
+    for(uint32_t i_byte = 0; i_byte < raw_size; ++i_byte)
+    {
+        adler_a = (adler_a + raw[i_byte]) % 65521;
+        adler_b = (adler_b + adler_a) % 65521;
+    }
+    put_u32_be(idat + 7 + raw_size, (adler_b << 16) | adler_a);
+
+    uint8_t ihdr[13];
+    put_u32_be(ihdr, SPRITE_SIZE);
+    put_u32_be(ihdr + 4, SPRITE_SIZE);
+    ihdr[8] = 8;  // Bit depth
+    ihdr[9] = 6;  // RGBA
+    ihdr[10] = 0; // Deflate
+    ihdr[11] = 0; // Adaptive filtering
+    ihdr[12] = 0; // No interlace
+
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, sizeof(signature), file);
+    write_png_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+    write_png_chunk(file, "IDAT", idat, sizeof(idat));
+    write_png_chunk(file, "IEND", NULL, 0);
+
+    return fclose(file) != 0;
+}
+
+int main(int argc, char **argv)
+{
+    corpus_options_t options =
+    {
+        .out_dir = NULL,
+        .scale = 1,
+        .map_width = 128,
+        .map_height = 128,
+        .noise_percent = 5,
+        .num_entities = 1000,
+        .seed = 0x5EED
+    };
+
+    for(int i_arg = 1; i_arg < argc; ++i_arg)
+    {
+        if(strcmp(argv[i_arg], "-s") == 0 && i_arg + 1 < argc)
+            options.scale = (uint32_t)strtoul(argv[++i_arg], NULL, 10);
+        else if(strcmp(argv[i_arg], "-m") == 0 && i_arg + 2 < argc)
+        {
+            options.map_width = (uint32_t)strtoul(argv[++i_arg], NULL, 10);
+            options.map_height = (uint32_t)strtoul(argv[++i_arg], NULL, 10);
+        }
+        else if(strcmp(argv[i_arg], "-n") == 0 && i_arg + 1 < argc)
+            options.noise_percent = (uint32_t)strtoul(argv[++i_arg], NULL, 10);
+        else if(strcmp(argv[i_arg], "-e") == 0 && i_arg + 1 < argc)
+            options.num_entities = (uint32_t)strtoul(argv[++i_arg], NULL, 10);
+        else if(strcmp(argv[i_arg], "-r") == 0 && i_arg + 1 < argc)
+            options.seed = strtoull(argv[++i_arg], NULL, 10);
+        else
+            options.out_dir = argv[i_arg];
+    }
+    if(options.out_dir == NULL || options.map_width == 0 ||
+       options.map_height == 0)
+    {
+        printf("Usage: corpus_gen out_dir [-s scale] [-m width height] "
+               "[-n noise_percent] [-e entities] [-r seed]\n");
+        return 1;
+    }
+    // xorshift never leaves the zero state
+    rng_state = options.seed != 0 ? options.seed : 0x5EED;
+
+    char path[MAX_PATH];
+    int result = make_dir(options.out_dir);
+    snprintf(path, MAX_PATH, "%s/maps", options.out_dir);
+    result |= make_dir(path);
+    snprintf(path, MAX_PATH, "%s/anims", options.out_dir);
+    result |= make_dir(path);
+    snprintf(path, MAX_PATH, "%s/sprites", options.out_dir);
+    result |= make_dir(path);
+    for(uint32_t i_dir = 0; i_dir < SPRITE_DIRS; ++i_dir)
+    {
+        snprintf(path, MAX_PATH, "%s/sprites/%02u", options.out_dir, i_dir);
+        result |= make_dir(path);
+    }
+    if(result != 0)
+        return result;
+
+    uint32_t num_maps = MAPS_PER_SCALE * options.scale;
+    for(uint32_t i_map = 0; i_map < num_maps && result == 0; ++i_map)
+    {
+        snprintf(path, MAX_PATH, "%s/maps/map_%03u.ldtk", options.out_dir, i_map);
+        result = write_map(&options, path, i_map);
+    }
+    uint32_t num_anims = ANIMS_PER_SCALE * options.scale;
+    for(uint32_t i_anim = 0; i_anim < num_anims && result == 0; ++i_anim)
+    {
+        snprintf(path, MAX_PATH, "%s/anims/anim_%03u.fst", options.out_dir, i_anim);
+        result = write_anim(path);
+    }
+    uint32_t num_sprites = SPRITES_PER_SCALE * options.scale;
+    for(uint32_t i_sprite = 0; i_sprite < num_sprites && result == 0; ++i_sprite)
+    {
+        snprintf(path, MAX_PATH, "%s/sprites/%02u/sprite_%03u.png",
+                 options.out_dir, i_sprite % SPRITE_DIRS, i_sprite);
+        result = write_png(path);
+    }
+
+    if(result == 0)
+        printf("Corpus %s: %u maps (%ux%u, %u%% noise, %u entities), "
+               "%u animations, %u sprites\n",
+               options.out_dir, num_maps, options.map_width,
+               options.map_height, options.noise_percent,
+               options.num_entities, num_anims, num_sprites);
+
+    return result;
+}
@@ -0,0 +1,336 @@
+// JSON engines benchmark: parses every LDtk project and level of a content
+// corpus (see corpus_gen) with cJSON, cJSON in an arena and json_tape, then
+// reads what ldtk_to_map reads from the trees (layers, intGridCsv, tiles
+// px/src, entities). Parse, read and free times are the best of a few runs,
+// throughput is in input MB/s, and every engine must read the same values.
+//
+// Usage: json_bench corpus_dir [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "bench.h"
+#include "cJSON.h"
+#include "input.h"
+#include "json_tape.h"
+#include "walk.h"
+
+#define DEFAULT_RUNS 5
+#define MAX_PATH 4096
+#define JSON_ARENA_BLOCK_SIZE 65536
+
+typedef enum
+{
+    ENGINE_CJSON,
+    ENGINE_CJSON_ARENA,
+    ENGINE_TAPE,
+    NUM_ENGINES
+} engine_t;
+
+const char *engine_names[NUM_ENGINES] = { "cJSON", "cJSON arena", "json_tape" };
+
+// A parsed input, whichever the engine
+typedef struct _bench_tree
+{
+    cJSON *json;
+    cJSON_Arena *arena;
+    osp_json_tape_t tape;
+} bench_tree_t;
+
+static inline void mix(uint64_t *checksum, double value)
+{
+    *checksum = *checksum * 31 + (uint64_t)(int64_t)value;
+}
+
+void read_cjson_tiles(const cJSON *tiles, uint64_t *checksum)
+{
+    const cJSON *tile;
+    cJSON_ArrayForEach(tile, tiles)
+    {
+        const cJSON *px = cJSON_GetObjectItemCaseSensitive(tile, "px");
+        const cJSON *src = cJSON_GetObjectItemCaseSensitive(tile, "src");
+        mix(checksum, cJSON_GetNumberValue(cJSON_GetArrayItem(px, 0)));
+        mix(checksum, cJSON_GetNumberValue(cJSON_GetArrayItem(px, 1)));
+        mix(checksum, cJSON_GetNumberValue(cJSON_GetArrayItem(src, 0)));
+        mix(checksum, cJSON_GetNumberValue(cJSON_GetArrayItem(src, 1)));
+        mix(checksum, cJSON_GetNumberValue(
+            cJSON_GetObjectItemCaseSensitive(tile, "t")));
+    }
+}
+
+void read_cjson_level(const cJSON *level, uint64_t *checksum)
+{
+    const cJSON *layer;
+    cJSON_ArrayForEach(layer, cJSON_GetObjectItemCaseSensitive(level, "layerInstances"))
+    {
+        const char *identifier = cJSON_GetStringValue(
+            cJSON_GetObjectItemCaseSensitive(layer, "__identifier"));
+        mix(checksum, identifier != NULL ? strlen(identifier) : 0);
+
+        const cJSON *value;
+        cJSON_ArrayForEach(value, cJSON_GetObjectItemCaseSensitive(layer, "intGridCsv"))
+            mix(checksum, cJSON_GetNumberValue(value));
+        read_cjson_tiles(cJSON_GetObjectItemCaseSensitive(layer, "gridTiles"), checksum);
+        read_cjson_tiles(cJSON_GetObjectItemCaseSensitive(layer, "autoLayerTiles"), checksum);
+
+        const cJSON *entity;
+        cJSON_ArrayForEach(entity, cJSON_GetObjectItemCaseSensitive(layer, "entityInstances"))
+        {
+            const cJSON *px = cJSON_GetObjectItemCaseSensitive(entity, "px");
+            mix(checksum, cJSON_GetNumberValue(cJSON_GetArrayItem(px, 0)));
+            mix(checksum, cJSON_GetNumberValue(cJSON_GetArrayItem(px, 1)));
+            mix(checksum, cJSON_GetArraySize(
+                cJSON_GetObjectItemCaseSensitive(entity, "fieldInstances")));
+        }
+    }
+}
+
+// Projects have levels, external level files are a level
+void read_cjson(const cJSON *root, uint64_t *checksum)
+{
+    const cJSON *tileset;
+    const cJSON *defs = cJSON_GetObjectItemCaseSensitive(root, "defs");
+    cJSON_ArrayForEach(tileset, cJSON_GetObjectItemCaseSensitive(defs, "tilesets"))
+        mix(checksum, cJSON_GetNumberValue(
+            cJSON_GetObjectItemCaseSensitive(tileset, "uid")));
+
+    const cJSON *levels = cJSON_GetObjectItemCaseSensitive(root, "levels");
+    if(!cJSON_IsArray(levels))
+    {
+        read_cjson_level(root, checksum);
+        return;
+    }
+    const cJSON *level;
+    cJSON_ArrayForEach(level, levels)
+        read_cjson_level(level, checksum);
+}
+
+void read_tape_tiles(osp_json_tape_t tape, osp_json_node_t tiles, uint64_t *checksum)
+{
+    for(osp_json_node_t tile = osp_json_tape_first(tape, tiles); tile != 0;
+        tile = osp_json_tape_next(tape, tile))
+    {
+        osp_json_node_t px = osp_json_tape_get_member(tape, tile, "px");
+        osp_json_node_t src = osp_json_tape_get_member(tape, tile, "src");
+        mix(checksum, osp_json_tape_get_item_number(tape, px, 0));
+        mix(checksum, osp_json_tape_get_item_number(tape, px, 1));
+        mix(checksum, osp_json_tape_get_item_number(tape, src, 0));
+        mix(checksum, osp_json_tape_get_item_number(tape, src, 1));
+        mix(checksum, osp_json_tape_get_number(
+            tape, osp_json_tape_get_member(tape, tile, "t")));
+    }
+}
+
+void read_tape_level(osp_json_tape_t tape, osp_json_node_t level, uint64_t *checksum)
+{
+    osp_json_node_t layers = osp_json_tape_get_member(tape, level, "layerInstances");
+    for(osp_json_node_t layer = osp_json_tape_first(tape, layers); layer != 0;
+        layer = osp_json_tape_next(tape, layer))
+    {
+        const char *identifier = osp_json_tape_get_string(
+            tape, osp_json_tape_get_member(tape, layer, "__identifier"));
+        mix(checksum, identifier != NULL ? strlen(identifier) : 0);
+
+        // Read as a span when every value is an int32_t
+        osp_json_node_t int_grid = osp_json_tape_get_member(tape, layer, "intGridCsv");
+        size_t num_values;
+        const int32_t *values = osp_json_tape_get_int32s(tape, int_grid, &num_values);
+        for(size_t i_value = 0; i_value < num_values; ++i_value)
+            mix(checksum, values[i_value]);
+        if(values == NULL)
+            for(osp_json_node_t value = osp_json_tape_first(tape, int_grid);
+                value != 0; value = osp_json_tape_next(tape, value))
+                mix(checksum, osp_json_tape_get_number(tape, value));
+        read_tape_tiles(tape, osp_json_tape_get_member(tape, layer, "gridTiles"), checksum);
+        read_tape_tiles(tape, osp_json_tape_get_member(tape, layer, "autoLayerTiles"), checksum);
+
+        osp_json_node_t entities = osp_json_tape_get_member(tape, layer, "entityInstances");
+        for(osp_json_node_t entity = osp_json_tape_first(tape, entities);
+            entity != 0; entity = osp_json_tape_next(tape, entity))
+        {
+            osp_json_node_t px = osp_json_tape_get_member(tape, entity, "px");
+            mix(checksum, osp_json_tape_get_item_number(tape, px, 0));
+            mix(checksum, osp_json_tape_get_item_number(tape, px, 1));
+            mix(checksum, osp_json_tape_get_count(
+                tape, osp_json_tape_get_member(tape, entity, "fieldInstances")));
+        }
+    }
+}
+
+void read_tape(osp_json_tape_t tape, uint64_t *checksum)
+{
+    osp_json_node_t root = osp_json_tape_root(tape);
+    osp_json_node_t defs = osp_json_tape_get_member(tape, root, "defs");
+    osp_json_node_t tilesets = osp_json_tape_get_member(tape, defs, "tilesets");
+    for(osp_json_node_t tileset = osp_json_tape_first(tape, tilesets);
+        tileset != 0; tileset = osp_json_tape_next(tape, tileset))
+        mix(checksum, osp_json_tape_get_number(
+            tape, osp_json_tape_get_member(tape, tileset, "uid")));
+
+    osp_json_node_t levels = osp_json_tape_get_member(tape, root, "levels");
+    if(osp_json_tape_get_type(tape, levels) != OSP_JSON_TYPE_ARRAY)
+    {
+        read_tape_level(tape, root, checksum);
+        return;
+    }
+    for(osp_json_node_t level = osp_json_tape_first(tape, levels); level != 0;
+        level = osp_json_tape_next(tape, level))
+        read_tape_level(tape, level, checksum);
+}
+
+uint8_t parse_tree(engine_t engine, const osp_input_t *input, bench_tree_t *tree)
+{
+    *tree = (bench_tree_t){ 0 };
+    switch(engine)
+    {
+        case ENGINE_CJSON:
+            tree->json = cJSON_ParseWithLength(input->data, input->size);
+            return tree->json != NULL;
+        case ENGINE_CJSON_ARENA:
+            // As ldtk_to_map sizes its arenas
+            tree->arena = cJSON_CreateArena(input->size > JSON_ARENA_BLOCK_SIZE
+                                            ? input->size
+                                            : JSON_ARENA_BLOCK_SIZE);
+            tree->json = cJSON_ParseWithArena(input->data, input->size,
+                                              tree->arena);
+            return tree->json != NULL;
+        default:
+            tree->tape = osp_json_tape_parse(input->data, input->size);
+            return tree->tape != NULL;
+    }
+}
+
+void read_tree(const bench_tree_t *tree, uint64_t *checksum)
+{
+    if(tree->tape != NULL)
+        read_tape(tree->tape, checksum);
+    else if(tree->json != NULL)
+        read_cjson(tree->json, checksum);
+}
+
+void free_tree(bench_tree_t *tree)
+{
+    if(tree->arena != NULL)
+        cJSON_DeleteArena(tree->arena);
+    else
+        cJSON_Delete(tree->json);
+    osp_json_tape_delete(tree->tape);
+}
+
+int bench_engines(const osp_input_t *inputs, size_t num_inputs, uint32_t runs)
+{
+    uint64_t input_bytes = 0;
+    for(size_t i_input = 0; i_input < num_inputs; ++i_input)
+        input_bytes += inputs[i_input].size;
+    bench_tree_t *trees = calloc(num_inputs, sizeof(bench_tree_t));
+
+    int result = 0;
+    uint64_t reference_checksum = 0;
+    for(engine_t engine = 0; engine < NUM_ENGINES; ++engine)
+    {
+        double best_parse = 0.0;
+        double best_read = 0.0;
+        double best_free = 0.0;
+        uint64_t checksum = 0;
+        uint32_t failures = 0;
+        for(uint32_t i_run = 0; i_run < runs; ++i_run)
+        {
+            // Trees are all kept until they are read, as a bundle build does
+            double start = now_seconds();
+            failures = 0;
+            for(size_t i_input = 0; i_input < num_inputs; ++i_input)
+                failures += !parse_tree(engine, &(inputs[i_input]), &(trees[i_input]));
+            double parse_time = now_seconds() - start;
+
+            start = now_seconds();
+            checksum = 0;
+            for(size_t i_input = 0; i_input < num_inputs; ++i_input)
+                read_tree(&(trees[i_input]), &checksum);
+            double read_time = now_seconds() - start;
+
+            start = now_seconds();
+            for(size_t i_input = 0; i_input < num_inputs; ++i_input)
+                free_tree(&(trees[i_input]));
+            double free_time = now_seconds() - start;
+
+            if(i_run == 0 || parse_time < best_parse)
+                best_parse = parse_time;
+            if(i_run == 0 || read_time < best_read)
+                best_read = read_time;
+            if(i_run == 0 || free_time < best_free)
+                best_free = free_time;
+        }
+
+        printf("%-12s %6zu files %8.2f MB parse %9.3f ms %8.2f MB/s "
+               "read %8.3f ms free %8.3f ms\n",
+               engine_names[engine], num_inputs, input_bytes / 1e6,
+               best_parse * 1e3,
+               best_parse > 0.0 ? input_bytes / 1e6 / best_parse : 0.0,
+               best_read * 1e3, best_free * 1e3);
+        if(failures > 0)
+            printf("%-12s %6u failed\n", "", failures);
+        if(engine == 0)
+            reference_checksum = checksum;
+        else if(checksum != reference_checksum)
+        {
+            printf("%-12s read values differ from %s\n", "", engine_names[0]);
+            result = 1;
+        }
+    }
+
+    free(trees);
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        printf("Usage: json_bench corpus_dir [runs]\n");
+        return 1;
+    }
+    const char *corpus_dir = argv[1];
+    uint32_t runs = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 10) : DEFAULT_RUNS;
+    if(runs == 0)
+        runs = DEFAULT_RUNS;
+
+    osp_dynarray_t files = osp_walk(corpus_dir, "", 1);
+    if(files == NULL)
+    {
+        printf("Unable to open %s\n", corpus_dir);
+        return 1;
+    }
+
+    // LDtk projects and external levels, opened once
+    char **paths = (char **)osp_dynarray_get_data(files);
+    size_t num_files = osp_dynarray_get_count(files);
+    osp_input_t *inputs = calloc(num_files, sizeof(osp_input_t));
+    size_t num_inputs = 0;
+    for(size_t i_file = 0; i_file < num_files; ++i_file)
+    {
+        const char *last_dot = rindex(paths[i_file], '.');
+        if(last_dot == NULL ||
+           (strcmp(last_dot, ".ldtk") != 0 && strcmp(last_dot, ".ldtkl") != 0))
+            continue;
+
+        char path[MAX_PATH];
+        snprintf(path, MAX_PATH, "%s/%s", corpus_dir, paths[i_file]);
+        if(osp_input_open(&(inputs[num_inputs]), path) != 0)
+        {
+            printf("Unable to open %s\n", path);
+            continue;
+        }
+        ++num_inputs;
+    }
+
+    printf("Corpus %s, best of %u runs\n", corpus_dir, runs);
+    int result = bench_engines(inputs, num_inputs, runs);
+
+    for(size_t i_input = 0; i_input < num_inputs; ++i_input)
+        osp_input_close(&(inputs[i_input]));
+    free(inputs);
+    osp_walk_free(files);
+    return result;
+}
@@ -4,13 +4,18 @@
 #include <stdint.h>
 
 /// @brief Constant representing the content type for PNG images
-const uint8_t OSP_CNT_TYPE_PNG = 0;
+static const uint8_t OSP_CNT_TYPE_PNG = 0;
 /// @brief Constant representing the content type for tilemaps
-const uint8_t OSP_CNT_TYPE_MAP = 1;
+static const uint8_t OSP_CNT_TYPE_MAP = 1;
 /// @brief Constant representing the content type for framesets
-const uint8_t OSP_CNT_TYPE_FST = 2;
+static const uint8_t OSP_CNT_TYPE_FST = 2;
 /// @brief Constant representing the maximum number of definable content types
-const uint8_t OSP_CNT_MAX_TYPES = 255;
+static const uint8_t OSP_CNT_MAX_TYPES = 255;
+
+/// @brief Asset data stored as is
+static const uint8_t OSP_CNT_CODEC_NONE = 0;
+/// @brief Asset data stored as a single LZ4 block
+static const uint8_t OSP_CNT_CODEC_LZ4 = 1;
 
 /// @brief Content table entry for asset bundle content table definition
 typedef struct _osp_cnt_table_entry
@@ -23,6 +28,85 @@ typedef struct _osp_cnt_table_entry
     uint64_t start;
     /// @brief Asset data size in bundle file
     uint64_t size;
+    /// @brief Asset data codec byte ID
+    uint8_t codec;
+    /// @brief Asset data size once decoded, the same as size if not encoded
+    uint64_t raw_size;
 } osp_cnt_table_entry_t;
 
-#endif
\ No newline at end of file
+/// Bundle file layout (all values little endian):
+/// - uint64_t content table position
+/// - asset data
+/// - padding up to the next multiple of 8 bytes
+/// - content table header (osp_cnt_table_header_t)
+/// - content table records (osp_cnt_table_record_t), header.record_size bytes
+///   each, sorted by name hash and then name
+/// - bucket directory, (1 << header.bucket_bits) + 1 uint32_t record indices:
+///   the records with the top bucket_bits bits of their name hash equal to b
+///   are the ones in [buckets[b], buckets[b + 1])
+/// - string pool with all the asset names, each one zero terminated
+///
+/// Record, bucket and pool offsets are relative to the content table
+/// position, and name hashes are osp_hash64 (XXH64) values of the names with
+/// seed 0. Readers can hash probe the bucket directory, or binary search the
+/// records, straight from the mapped file.
+///
+/// Version 1 records have no raw_size and codec fields (40 bytes, type
+/// followed by 7 reserved bytes) and their data is never encoded.
+///
+/// Legacy bundles start the content table with a uint32_t entry count,
+/// followed by every entry as a size_t name length, the name bytes, the
+/// uint8_t type and the uint64_t start and size. Their data is never encoded.
+
+/// @brief Content table header magic
+#define OSP_CNT_TABLE_MAGIC "OSPT"
+/// @brief Content table layout version
+static const uint16_t OSP_CNT_TABLE_VERSION = 2;
+
+/// @brief Content table header, 8 bytes aligned in the bundle file
+typedef struct _osp_cnt_table_header
+{
+    /// @brief OSP_CNT_TABLE_MAGIC, not zero terminated
+    char magic[4];
+    /// @brief Content table layout version
+    uint16_t version;
+    /// @brief Size of a single record in bytes
+    uint16_t record_size;
+    /// @brief Number of records
+    uint32_t count;
+    /// @brief Number of name hash bits used to select a bucket
+    uint32_t bucket_bits;
+    /// @brief Records array offset from the content table position
+    uint64_t records_offset;
+    /// @brief Bucket directory offset from the content table position
+    uint64_t buckets_offset;
+    /// @brief String pool offset from the content table position
+    uint64_t strings_offset;
+    /// @brief String pool size in bytes
+    uint64_t strings_size;
+} osp_cnt_table_header_t;
+
+/// @brief Fixed size content table record, 8 bytes aligned in the bundle file
+typedef struct _osp_cnt_table_record
+{
+    /// @brief Asset name hash
+    uint64_t name_hash;
+    /// @brief Asset data start position in bundle file
+    uint64_t start;
+    /// @brief Asset data size in bundle file
+    uint64_t size;
+    /// @brief Asset data size once decoded (since version 2)
+    uint64_t raw_size;
+    /// @brief Asset name offset in the string pool
+    uint32_t name_offset;
+    /// @brief Asset name length, without the terminating zero
+    uint32_t name_length;
+    /// @brief Asset content type byte ID
+    uint8_t type;
+    /// @brief Asset data codec byte ID (since version 2)
+    uint8_t codec;
+    /// @brief Reserved, always 0
+    uint8_t reserved[6];
+} osp_cnt_table_record_t;
+
+#endif
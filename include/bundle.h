@@ -0,0 +1,78 @@
+/**
+ * @file bundle.h
+ * @author OldSchoolPixels.com
+ * @brief Runtime asset bundle reader
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_BUNDLE_H
+#define OSP_BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The bundle file is memory mapped read only and validated when opened.
+// Assets are returned as views into the mapping, valid until the bundle is
+// closed, and encoded ones decompressed on demand into caller buffers.
+// Fixed size records tables are hash probed in place through their
+// bucket directory, without allocating; legacy tables are indexed when opened.
+
+typedef struct _osp_bundle *osp_bundle_t;
+
+/// @brief Asset view
+typedef struct _osp_bundle_asset
+{
+    /// @brief Asset name w/o ext and directory prefix relative to bundle root,
+    ///        zero terminated only in fixed size records tables
+    const char *name;
+    /// @brief Asset name length
+    size_t name_length;
+    /// @brief Asset content type byte ID
+    uint8_t type;
+    /// @brief Asset data, pointing into the bundle mapping
+    const void *data;
+    /// @brief Asset data size
+    uint64_t size;
+    /// @brief Asset data codec byte ID, data is encoded if not OSP_CNT_CODEC_NONE
+    uint8_t codec;
+    /// @brief Asset data size once decoded
+    uint64_t raw_size;
+} osp_bundle_asset_t;
+
+/// @brief Open and validate a bundle file
+/// @param path Bundle file path
+/// @return Bundle handle, NULL if the file can't be opened or is not valid
+extern osp_bundle_t osp_bundle_open(const char *path);
+/// @brief Find an asset by name
+/// @param bundle Bundle handle
+/// @param name Asset name
+/// @param asset Filled with the asset view if found
+/// @return 1 if found, 0 otherwise
+extern uint8_t osp_bundle_find(osp_bundle_t bundle, const char *name, osp_bundle_asset_t *asset);
+/// @brief Number of assets in the bundle
+/// @param bundle Bundle handle
+/// @return Number of assets
+extern size_t osp_bundle_get_count(osp_bundle_t bundle);
+/// @brief Get an asset by content table index
+/// @param bundle Bundle handle
+/// @param idx Content table index
+/// @param asset Filled with the asset view
+/// @return 1 if the index is valid, 0 otherwise
+extern uint8_t osp_bundle_get(osp_bundle_t bundle, size_t idx, osp_bundle_asset_t *asset);
+/// @brief Decode asset data, or copy it if not encoded
+/// @param asset Asset view
+/// @param buffer Decoded data buffer
+/// @param buffer_size Decoded data buffer size, at least asset->raw_size
+/// @return 1 if raw_size bytes were decoded, 0 on unknown codec or corrupted data
+extern uint8_t osp_bundle_decompress(const osp_bundle_asset_t *asset,
+                                     void *buffer,
+                                     size_t buffer_size);
+/// @brief Close a bundle, invalidating all of its asset views
+/// @param bundle Bundle handle
+extern void osp_bundle_close(osp_bundle_t bundle);
+
+#endif
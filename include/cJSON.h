@@ -98,6 +98,8 @@ then using the CJSON_API_VISIBILITY flag to "export" the same symbols the way CJ
 
 #define cJSON_IsReference 256
 #define cJSON_StringIsConst 512
+/* The item and its strings were allocated from a cJSON_Arena, cJSON_Delete leaves them (and their children) to it */
+#define cJSON_InArena 1024
 
 /* The cJSON structure: */
 typedef struct cJSON
@@ -131,6 +133,9 @@ typedef struct cJSON_Hooks
 
 typedef int cJSON_bool;
 
+/* Bump allocator for whole parsed trees, see cJSON_ParseWithArena */
+typedef struct cJSON_Arena cJSON_Arena;
+
 /* Limits how deeply nested arrays/objects can be before cJSON rejects to parse them.
  * This is to prevent stack overflows. */
 #ifndef CJSON_NESTING_LIMIT
@@ -152,6 +157,18 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLength(const char *value, size_t buffer_len
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return_parse_end, cJSON_bool require_null_terminated);
 CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated);
 
+/* Arena parsing: every node and string of the tree is carved out of blocks of the arena instead of being malloc'ed on its own, and
+ * the whole tree is released at once by cJSON_ResetArena or cJSON_DeleteArena instead of cJSON_Delete (which leaves arena items alone).
+ * Unlike cJSON_InitHooks the arena belongs to a single parse, so concurrent parses each with their own arena are safe. An arena is
+ * not thread safe itself. Keys and strings set later on arena items with the regular functions are not freed with the arena.
+ * block_size is the size of every block the arena allocates from the cJSON hooks, 0 for a default one. */
+CJSON_PUBLIC(cJSON_Arena *) cJSON_CreateArena(size_t block_size);
+/* Release every tree parsed in the arena, keeping one block to parse again */
+CJSON_PUBLIC(void) cJSON_ResetArena(cJSON_Arena *arena);
+CJSON_PUBLIC(void) cJSON_DeleteArena(cJSON_Arena *arena);
+/* cJSON_ParseWithLength allocating from the arena, or from the hooks if arena is NULL */
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithArena(const char *value, size_t buffer_length, cJSON_Arena *arena);
+
 /* Render a cJSON entity to text for transfer/storage. */
 CJSON_PUBLIC(char *) cJSON_Print(const cJSON *item);
 /* Render a cJSON entity to text for transfer/storage without any formatting. */
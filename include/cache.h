@@ -0,0 +1,104 @@
+/**
+ * @file cache.h
+ * @author OldSchoolPixels.com
+ * @brief Persistent on-disk cache of processed asset data
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_CACHE_H
+#define OSP_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dynarray.h"
+
+// The cache directory holds an index file and one blob file per processed
+// asset. The blob key is a hash of the input path, the input content hash,
+// the processor, its version and parameters, so any change to one of them is
+// a miss.
+// The index remembers the size, modification time and content hash of every
+// input of the last build, so unchanged inputs don't even need rehashing.
+// Blobs not referenced by the last build are pruned when closing the cache.
+
+typedef struct _osp_cache *osp_cache_t;
+
+/// @brief Open (and create if needed) a cache directory, loading its index
+/// @param directory Cache directory path
+/// @return Cache handle, NULL on error
+extern osp_cache_t osp_cache_open(const char *directory);
+/// @brief Fetch an input content hash from the index of the last build,
+///        thread safe.
+/// @param cache Cache handle
+/// @param path Input file path
+/// @param size Current input file size
+/// @param mtime Current input file modification time in nanoseconds
+/// @param content_hash Filled with the content hash if found
+/// @return 1 if the input is unchanged since the last build, 0 otherwise
+extern uint8_t osp_cache_find_content_hash(osp_cache_t cache,
+                                           const char *path,
+                                           uint64_t size,
+                                           int64_t mtime,
+                                           uint64_t *content_hash);
+/// @brief Calculate the blob key of a processed asset
+/// @param path Input file path
+/// @param content_hash Input content hash
+/// @param processor Processor name (i.e. its input extension)
+/// @param version Processor version
+/// @param params Processor parameters, NULL if none
+/// @param params_size Processor parameters size in bytes
+/// @return Blob key
+extern uint64_t osp_cache_key(const char *path,
+                              uint64_t content_hash,
+                              const char *processor,
+                              uint32_t version,
+                              const void *params,
+                              size_t params_size);
+/// @brief Load a processed asset blob, thread safe.
+/// @param cache Cache handle
+/// @param key Blob key
+/// @param data Filled with a malloc'ed copy of the blob data
+/// @param size Filled with the blob data size
+/// @param dependencies Filled with a new osp_input_dependency_t array of the
+///        other files read to process the asset, NULL if none. A blob whose
+///        dependencies changed is a miss.
+/// @return 1 on cache hit, 0 on miss
+extern uint8_t osp_cache_load(osp_cache_t cache,
+                              uint64_t key,
+                              char **data,
+                              size_t *size,
+                              osp_dynarray_t *dependencies);
+/// @brief Store a processed asset blob, thread safe.
+/// @param cache Cache handle
+/// @param key Blob key
+/// @param data Blob data
+/// @param size Blob data size
+/// @param dependencies osp_input_dependency_t array of the other files read
+///        to process the asset, can be NULL
+extern void osp_cache_store(osp_cache_t cache,
+                            uint64_t key,
+                            const char *data,
+                            size_t size,
+                            osp_dynarray_t dependencies);
+/// @brief Record an input of the current build for the next index, not
+///        thread safe (call it while committing).
+/// @param cache Cache handle
+/// @param path Input file path
+/// @param size Input file size
+/// @param mtime Input file modification time in nanoseconds
+/// @param content_hash Input content hash
+/// @param key Processed asset blob key
+extern void osp_cache_record(osp_cache_t cache,
+                             const char *path,
+                             uint64_t size,
+                             int64_t mtime,
+                             uint64_t content_hash,
+                             uint64_t key);
+/// @brief Write the new index, prune unused blobs and free the cache
+/// @param cache Cache handle
+extern void osp_cache_close(osp_cache_t cache);
+
+#endif
@@ -0,0 +1,48 @@
+/**
+ * @file compress.h
+ * @author OldSchoolPixels.com
+ * @brief LZ4 block format payload compression
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_COMPRESS_H
+#define OSP_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Both compressors write standard LZ4 blocks (no frame, no checksum), read
+// back by the same decompressor: the fast one is greedy with a single hash
+// table, the high ratio one searches hash chains for the longest match.
+
+/// @brief Maximum compressed size for a given input size
+/// @param size Input size in bytes
+/// @return Worst case compressed size in bytes
+extern size_t osp_lz4_compress_bound(size_t size);
+/// @brief Fast LZ4 block compression
+/// @param src Data to compress
+/// @param size Data size in bytes
+/// @param dst Compressed data buffer
+/// @param capacity Compressed data buffer size
+/// @return Compressed size in bytes, 0 if it doesn't fit in capacity
+extern size_t osp_lz4_compress_fast(const void *src, size_t size, void *dst, size_t capacity);
+/// @brief High ratio LZ4 block compression, slower than the fast one
+/// @param src Data to compress
+/// @param size Data size in bytes
+/// @param dst Compressed data buffer
+/// @param capacity Compressed data buffer size
+/// @return Compressed size in bytes, 0 if it doesn't fit in capacity
+extern size_t osp_lz4_compress_high(const void *src, size_t size, void *dst, size_t capacity);
+/// @brief LZ4 block decompression, safe on corrupted input
+/// @param src Compressed data
+/// @param size Compressed data size in bytes
+/// @param dst Decompressed data buffer
+/// @param raw_size Exact decompressed data size
+/// @return 0 on success, -1 if the data is corrupted or its size is not raw_size
+extern int osp_lz4_decompress(const void *src, size_t size, void *dst, size_t raw_size);
+
+#endif
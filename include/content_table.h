@@ -0,0 +1,39 @@
+/**
+ * @file content_table.h
+ * @author OldSchoolPixels.com
+ * @brief Bundle content table serialization
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_CONTENT_TABLE_H
+#define OSP_CONTENT_TABLE_H
+
+#include <stdint.h>
+#include "OSP_content.h"
+#include "writer.h"
+
+/// @brief Write a content table in the fixed size records layout (see
+///        OSP_content.h), padding the bundle first so the table is 8 bytes
+///        aligned.
+/// @param writer Bundle writer
+/// @param entries Content table entries
+/// @param count Number of entries
+/// @return Content table position in the bundle
+extern uint64_t osp_cnt_write_table(osp_writer_t writer,
+                                    const osp_cnt_table_entry_t *entries,
+                                    uint32_t count);
+/// @brief Write a content table in the legacy variable size layout, which
+///        can't describe encoded asset data
+/// @param writer Bundle writer
+/// @param entries Content table entries
+/// @param count Number of entries
+/// @return Content table position in the bundle
+extern uint64_t osp_cnt_write_legacy_table(osp_writer_t writer,
+                                           const osp_cnt_table_entry_t *entries,
+                                           uint32_t count);
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ * @file hash.h
+ * @author OldSchoolPixels.com
+ * @brief Fast non-cryptographic 64 bit hashing
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_HASH_H
+#define OSP_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief 64 bit hash of a memory block (XXH64 algorithm)
+/// @param data Pointer to the data to hash
+/// @param size Data size in bytes
+/// @param seed Hash seed, use it to chain hashes of several blocks
+/// @return 64 bit hash value
+extern uint64_t osp_hash64(const void *data, size_t size, uint64_t seed);
+/// @brief 64 bit hash of a zero terminated string
+/// @param string String to hash
+/// @param seed Hash seed
+/// @return 64 bit hash value
+extern uint64_t osp_hash64_string(const char *string, uint64_t seed);
+
+#endif
@@ -0,0 +1,31 @@
+/**
+ * @file hashmap.h
+ * @author OldSchoolPixels.com
+ * @brief An open addressing hash multimap of 64 bit keys to 64 bit values
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_HASHMAP_H
+#define OSP_HASHMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Keys are usually already hashes (see hash.h), values are usually indices
+// into an array holding the real data. The same key can be inserted more
+// than once, osp_hashmap_find iterates all the values stored for a key.
+
+typedef struct _osp_hashmap *osp_hashmap_t;
+
+extern osp_hashmap_t osp_hashmap_new(const size_t initial_capacity);
+extern void osp_hashmap_insert(osp_hashmap_t map, uint64_t key, uint64_t value);
+extern uint8_t osp_hashmap_find(osp_hashmap_t map, uint64_t key, size_t *cursor, uint64_t *value);
+extern size_t osp_hashmap_get_count(osp_hashmap_t map);
+extern void osp_hashmap_clear(osp_hashmap_t map);
+extern void osp_hashmap_delete(osp_hashmap_t map);
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file input.h
+ * @author OldSchoolPixels.com
+ * @brief Read only, memory mapped asset input
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_INPUT_H
+#define OSP_INPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dynarray.h"
+
+/// @brief Another file read to process an input
+typedef struct _osp_input_dependency
+{
+    /// @brief Dependency file path
+    char *path;
+    /// @brief Dependency file size in bytes
+    uint64_t size;
+    /// @brief Dependency file modification time in nanoseconds
+    int64_t mtime;
+    /// @brief Dependency content hash
+    uint64_t content_hash;
+} osp_input_dependency_t;
+
+/// @brief Read only view of a whole input file. Regular files are memory
+///        mapped, small files and anything that can't be mapped (like pipes)
+///        are read into memory instead. Either way data is always followed
+///        by a zero byte, not counted in size, so text parsers can rely on
+///        a terminated string.
+typedef struct _osp_input
+{
+    /// @brief Input data, followed by a zero byte
+    const char *data;
+    /// @brief Input data size in bytes
+    size_t size;
+    /// @brief Input file path, NULL if unknown
+    const char *path;
+    /// @brief Input file modification time in nanoseconds, 0 if unknown
+    int64_t mtime;
+    /// @brief Mapped memory (private)
+    void *mapping;
+    /// @brief Mapped memory size (private)
+    size_t mapping_size;
+    /// @brief Read memory buffer (private)
+    char *buffer;
+    /// @brief Other files opened with osp_input_open_dependency, an array of
+    ///        osp_input_dependency_t. Processors only get a const input, but
+    ///        can still record them here.
+    osp_dynarray_t dependencies;
+} osp_input_t;
+
+/// @brief Open an input file
+/// @param input Input structure to fill
+/// @param path Input file path
+/// @return 0 on success, -1 on error
+extern int osp_input_open(osp_input_t *input, const char *path);
+/// @brief Open an input from an already open file descriptor, which is not
+///        needed anymore when the function returns.
+/// @param input Input structure to fill
+/// @param fd Input file descriptor
+/// @param path Input file path, can be NULL
+/// @return 0 on success, -1 on error
+extern int osp_input_open_fd(osp_input_t *input, int fd, const char *path);
+/// @brief Wrap a memory block as an input, without copying it. The block
+///        must be followed by a zero byte.
+/// @param input Input structure to fill
+/// @param data Input data
+/// @param size Input data size
+extern void osp_input_from_memory(osp_input_t *input, const char *data, size_t size);
+/// @brief Open another file an input depends on, relative to the input
+///        directory, and record it in the input dependencies. Not thread safe
+///        for the same input.
+/// @param input Input the file is needed for
+/// @param dependency Input structure to fill, its path is valid as long as
+///        input is open
+/// @param relative_path Dependency path relative to the input directory
+/// @return 0 on success, -1 on error
+extern int osp_input_open_dependency(const osp_input_t *input,
+                                     osp_input_t *dependency,
+                                     const char *relative_path);
+/// @brief Check whether a recorded dependency is unchanged
+/// @param dependency Recorded dependency
+/// @return 1 if the file is still the same, 0 otherwise
+extern uint8_t osp_input_dependency_unchanged(const osp_input_dependency_t *dependency);
+/// @brief Free an array of osp_input_dependency_t
+/// @param dependencies Dependencies array, can be NULL
+extern void osp_input_free_dependencies(osp_dynarray_t dependencies);
+/// @brief Release an input
+/// @param input Input to release
+extern void osp_input_close(osp_input_t *input);
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * @file json_reader.h
+ * @author OldSchoolPixels.com
+ * @brief A streaming (pull) JSON reader that never builds a tree
+ * @version 0.1
+ * @date 2025-02-07
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef OSP_JSON_READER_H
+#define OSP_JSON_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The reader returns the document one token at a time, the caller keeps
+// whatever it needs and skips the values it doesn't care about without any
+// allocation. Object keys are returned as OSP_JSON_KEY tokens, followed by
+// their value. Separators are checked as cJSON does, exactly one between
+// values and none before a container end, but skipped values only have
+// their brackets matched.
+//
+// Strings (and keys) are unescaped into a buffer owned by the reader, zero
+// terminated and valid until the next token is read. Numbers are converted
+// the same way cJSON does, so both give the very same values.
+
+typedef struct _osp_json_reader *osp_json_reader_t;
+
+typedef enum
+{
+    OSP_JSON_ERROR,
+    OSP_JSON_END,
+    OSP_JSON_OBJECT,
+    OSP_JSON_OBJECT_END,
+    OSP_JSON_ARRAY,
+    OSP_JSON_ARRAY_END,
+    OSP_JSON_KEY,
+    OSP_JSON_STRING,
+    OSP_JSON_NUMBER,
+    OSP_JSON_TRUE,
+    OSP_JSON_FALSE,
+    OSP_JSON_NULL
+} osp_json_token_t;
+
+extern osp_json_reader_t osp_json_reader_new(const char *data, size_t size);
+extern osp_json_token_t osp_json_reader_next(osp_json_reader_t reader);
+// Skip the rest of the object or array the last token opened, nothing for
+// other tokens
+extern void osp_json_reader_skip(osp_json_reader_t reader);
+extern const char *osp_json_reader_get_string(osp_json_reader_t reader, size_t *length);
+extern uint8_t osp_json_reader_string_equals(osp_json_reader_t reader, const char *string);
+extern double osp_json_reader_get_number(osp_json_reader_t reader);
+// Offset of the first byte not read yet
+extern size_t osp_json_reader_tell(osp_json_reader_t reader);
+extern void osp_json_reader_delete(osp_json_reader_t reader);
+
+#endif
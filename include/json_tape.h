@@ -0,0 +1,73 @@
+/**
+ * @file json_tape.h
+ * @author OldSchoolPixels.com
+ * @brief A compact JSON DOM on a flat tape, built from a SIMD structural index
+ * @version 0.1
+ * @date 2025-02-07
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef OSP_JSON_TAPE_H
+#define OSP_JSON_TAPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The document is parsed in two passes. The first one finds every structural
+// character outside of strings 64 bytes at a time, with AVX2 or SSE2 when the
+// CPU has them. The second one walks that index to build a tape: every value
+// is one or two 64 bit words in document order, containers know where they
+// end, so skipping one is a single jump.
+//
+// Arrays of integers that fit an int32_t (intGridCsv, px, src...) are not on
+// the tape but in a contiguous buffer, read with osp_json_tape_get_int32s or
+// osp_json_tape_get_item_number: such an array has no item nodes.
+//
+// Nodes are tape positions, 0 is no node, and every accessor accepts it.
+// Strings are unescaped and zero terminated, numbers are converted the same
+// way cJSON does so both give the very same values. Like cJSON_ParseWithLength
+// whatever follows the root value is ignored.
+
+typedef struct _osp_json_tape *osp_json_tape_t;
+typedef size_t osp_json_node_t;
+
+typedef enum
+{
+    OSP_JSON_TYPE_NONE,
+    OSP_JSON_TYPE_NULL,
+    OSP_JSON_TYPE_FALSE,
+    OSP_JSON_TYPE_TRUE,
+    OSP_JSON_TYPE_NUMBER,
+    OSP_JSON_TYPE_STRING,
+    OSP_JSON_TYPE_ARRAY,
+    OSP_JSON_TYPE_OBJECT
+} osp_json_type_t;
+
+// NULL if the document is not valid
+extern osp_json_tape_t osp_json_tape_parse(const char *data, size_t size);
+extern void osp_json_tape_delete(osp_json_tape_t tape);
+extern osp_json_node_t osp_json_tape_root(osp_json_tape_t tape);
+extern osp_json_type_t osp_json_tape_get_type(osp_json_tape_t tape, osp_json_node_t node);
+// Array items or object members
+extern size_t osp_json_tape_get_count(osp_json_tape_t tape, osp_json_node_t node);
+// Object member value by key, first match
+extern osp_json_node_t osp_json_tape_get_member(osp_json_tape_t tape, osp_json_node_t object, const char *key);
+// First item of an array or first member value of an object, then the next
+// ones until 0
+extern osp_json_node_t osp_json_tape_first(osp_json_tape_t tape, osp_json_node_t node);
+extern osp_json_node_t osp_json_tape_next(osp_json_tape_t tape, osp_json_node_t node);
+extern osp_json_node_t osp_json_tape_get_item(osp_json_tape_t tape, osp_json_node_t array, size_t index);
+// Key of an object member value, NULL for other nodes
+extern const char *osp_json_tape_get_key(osp_json_tape_t tape, osp_json_node_t node);
+// NAN if the node is not a number, as cJSON_GetNumberValue
+extern double osp_json_tape_get_number(osp_json_tape_t tape, osp_json_node_t node);
+// NULL if the node is not a string
+extern const char *osp_json_tape_get_string(osp_json_tape_t tape, osp_json_node_t node);
+// The items of an int32_t array, NULL (and 0 items) for any other node
+extern const int32_t *osp_json_tape_get_int32s(osp_json_tape_t tape, osp_json_node_t node, size_t *count);
+// Array item as a number, whichever way the array is stored, NAN if missing
+extern double osp_json_tape_get_item_number(osp_json_tape_t tape, osp_json_node_t array, size_t index);
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * @file mem.h
+ * @author OldSchoolPixels.com
+ * @brief Heap allocation wrappers tracking per thread usage
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_MEM_H
+#define OSP_MEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// The wrappers count the usable size of the blocks they allocate and free in
+/// thread local counters, so the peak memory of a task can be measured while
+/// other threads run their own. Blocks are plain malloc ones: free and
+/// osp_mem_free can be used interchangeably, only osp_mem_free updates the
+/// counters.
+
+extern void *osp_mem_malloc(size_t size);
+extern void *osp_mem_calloc(size_t count, size_t size);
+extern void *osp_mem_realloc(void *ptr, size_t size);
+extern char *osp_mem_strdup(const char *string);
+extern void osp_mem_free(void *ptr);
+/// @brief Start measuring the calling thread peak allocation
+/// @return Current allocation, to pass to osp_mem_peak
+extern int64_t osp_mem_mark();
+/// @brief Get the calling thread peak allocation since a mark
+/// @param mark Value returned by osp_mem_mark
+/// @return Peak bytes allocated on top of the ones allocated at mark time
+extern uint64_t osp_mem_peak(int64_t mark);
+
+#endif
@@ -0,0 +1,41 @@
+/**
+ * @file parallel.h
+ * @author OldSchoolPixels.com
+ * @brief A minimal worker pool running indexed tasks with in-order commits
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_PARALLEL_H
+#define OSP_PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Task function, called once for every index, possibly concurrently
+typedef void (*osp_task_fn)(void *context, size_t index);
+/// @brief Commit function, always called on the calling thread in index order
+typedef void (*osp_commit_fn)(void *context, size_t index);
+
+/// @brief Runs count tasks on num_threads worker threads. Every finished task
+///        is passed to commit (if not NULL) on the calling thread, strictly in
+///        index order, so results can be consumed deterministically.
+///        With num_threads <= 1 everything runs serially on the calling thread.
+/// @param count Number of tasks to run
+/// @param num_threads Number of worker threads to use
+/// @param task Task function
+/// @param commit Optional in-order commit function
+/// @param context User context passed to both functions
+extern void osp_parallel_run(size_t count,
+                             uint32_t num_threads,
+                             osp_task_fn task,
+                             osp_commit_fn commit,
+                             void *context);
+/// @brief Number of online processors, used to resolve "-j 0"
+/// @return Number of online processors, at least 1
+extern uint32_t osp_parallel_num_cpus();
+
+#endif
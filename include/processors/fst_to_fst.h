@@ -1,8 +1,9 @@
 #ifndef FST_TO_FST_H
 #define FST_TO_FST_H
 
-#include <stdio.h>
 #include <stdint.h>
+#include "input.h"
+#include "writer.h"
 
 /// FST frame sequence text file format.
 /// The parser will work with states and will parse the text file line by line trimming every white leading or trailing
@@ -53,10 +54,10 @@
 #define COLUMN_OFFSET_CMD   "col_off"
 
 /// @brief FST text definition file to frame sequence data asset converter.
-/// @param readFile Input FILE containing the FST text
-/// @param writeFIle Output bundle FILE to write data to
+/// @param input Input containing the FST text
+/// @param writer Output sink to write asset data to
 /// @param params Optional converter parameters
 /// @return 0 on successful conversion, error value otherwise
-int fst_to_fst(FILE* readFile, FILE* writeFIle, void* params);
+int fst_to_fst(const osp_input_t* input, osp_writer_t writer, void* params);
 
 #endif
\ No newline at end of file
@@ -1,8 +1,116 @@
 #ifndef LDTK_TO_MAP_H
 #define LDTK_TO_MAP_H
 
-#include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
+#include "input.h"
+#include "writer.h"
+
+/// MAP tilemap asset format (all values little endian, strings are a uint64_t
+/// length followed by the characters, not zero terminated):
+/// - Optional extended header: uint64_t MAP_EXTENDED_HEADER, in place of the
+///   tileset name length, followed by uint32_t MAP_FLAG_* flags. Only written
+///   when a flag is set, so maps without it read as before.
+/// - Tileset name string, tile size in pixels, width and height in tiles as
+///   uint32_t.
+/// - uint8_t number of tile layers, then for every layer its uint16_t order
+///   and its tiles:
+///   - by default the uint32_t number of tiles and the tile_source_t array;
+///   - with MAP_FLAG_TILES_DENSE width * height uint16_t tileset indices, row
+///     major, each one the tileset tile index plus 1, 0 for no tile;
+///   - with MAP_FLAG_TILES_RLE the same indices as uint32_t number of runs
+///     followed by every run as uint16_t length and uint16_t index.
+///   The tileset index of a tile is its tileset column plus row times the
+///   tileset columns, as LDtk numbers them. Both grids only keep the last of
+///   the tiles stacked on the same cell.
+/// - uint8_t number of collision layers, then for every layer its uint16_t
+///   order, uint32_t number of rectangles and the collision_rect_t array,
+///   followed with MAP_FLAG_COLLISION_GRID by its collision grid: height rows
+///   of (width + 63) / 64 uint64_t, bit x % 64 of word x / 64 of a row set if
+///   tile x is solid. With MAP_FLAG_COLLISION_INDEX the collision index of the
+///   layer comes next: uint32_t cell size in pixels, uint32_t columns and
+///   rows, columns * rows + 1 uint32_t offsets and the uint32_t rectangle
+///   indices. The rectangles overlapping cell (c, r) are the indices in
+///   [offsets[r * columns + c], offsets[r * columns + c + 1]), sorted, so a
+///   rectangle overlapping several cells of a query is listed in all of them.
+/// - uint8_t number of entity layers, then for every layer its uint16_t order,
+///   decor entities and entities. Entity references are numbers of decor or
+///   other entities of the same layer (ENTITY_DATA_ENTITY). References to
+///   entities of other layers or levels (ENTITY_DATA_FOREIGN_ENTITY) add the
+///   uint32_t level and uint8_t entities layer numbers first. Unresolved
+///   references are written as ENTITY_DATA_UNKNOWN.
+///
+/// With MAP_FLAG_LEVELS, only ever set alone, the extended header is followed
+/// by uint32_t number of levels and a level directory: for every level, in
+/// project order, its uint64_t offset from the end of the directory and
+/// uint64_t size. Every level is its identifier string followed by a MAP
+/// asset of its own, with its own extended header if needed, and foreign
+/// entity references use these level numbers.
+///
+/// With MAP_FLAG_CHUNKS the layers are split in square chunks of tiles. The
+/// tileset name, tile size, width and height are followed by uint32_t chunk
+/// size in tiles, chunk columns and rows, and a chunk directory: for every
+/// chunk, row major, its uint64_t offset from the end of the directory and
+/// uint64_t size. Every chunk holds the three layer sections above for its
+/// own area, as a map of its own: the width and height are the chunk ones
+/// (smaller on the right and bottom edges) and every position is relative
+/// to the chunk origin. Collision rectangles are clipped to the chunk, and
+/// entities go to the chunk of their position. Entity layers start with
+/// uint32_t numbers of the first decor entity and the first entity of the
+/// chunk, as entity references, foreign ones included, number the entities
+/// of the whole layer they point to, sorted by chunk.
+
+/// @brief Extended header marker, an impossible tileset name length
+#define MAP_EXTENDED_HEADER UINT64_MAX
+/// @brief Collision layers carry a 1 bit per tile collision grid
+#define MAP_FLAG_COLLISION_GRID 0x00000001u
+/// @brief Collision layers carry a uniform grid index of their rectangles
+#define MAP_FLAG_COLLISION_INDEX 0x00000002u
+/// @brief Tile layers are dense tileset index grids
+#define MAP_FLAG_TILES_DENSE 0x00000004u
+/// @brief Tile layers are run length encoded tileset index grids
+#define MAP_FLAG_TILES_RLE 0x00000008u
+/// @brief Layers are split in chunks
+#define MAP_FLAG_CHUNKS 0x00000010u
+/// @brief The asset holds every level of the project
+#define MAP_FLAG_LEVELS 0x00000020u
+
+/// @brief Tile layers encodings
+typedef enum
+{
+    /// @brief Tile sources list
+    MAP_TILES_LIST,
+    /// @brief Dense tileset index grid, see MAP_FLAG_TILES_DENSE
+    MAP_TILES_DENSE,
+    /// @brief Run length encoded tileset index grid, see MAP_FLAG_TILES_RLE
+    MAP_TILES_RLE
+} map_tiles_encoding_t;
+
+/// @brief ldtk_to_map converter parameters
+typedef struct _ldtk_to_map_params
+{
+    /// @brief Collision index cell size in tiles, 0 to not write it
+    uint32_t collision_index_cell;
+    /// @brief Chunk size in tiles, 0 to not split the layers
+    uint32_t chunk_size;
+    /// @brief Write the collision grid of every collision layer
+    uint8_t collision_grid;
+    /// @brief Tile layers encoding, a map_tiles_encoding_t
+    uint8_t tiles_encoding;
+    /// @brief Convert every level instead of the first one only
+    uint8_t all_levels;
+    /// @brief Number of threads converting levels and loading level files,
+    ///        the share of the build threads a project gets. After the output
+    ///        options as it doesn't change the output (see
+    ///        LDTK_TO_MAP_PARAMS_KEY_SIZE)
+    uint32_t num_threads;
+    /// @brief Read the project with the streaming reader instead of building
+    ///        its json tree, same output
+    uint8_t streaming;
+} ldtk_to_map_params_t;
+
+/// @brief Size of the ldtk_to_map_params_t part that changes the output
+#define LDTK_TO_MAP_PARAMS_KEY_SIZE offsetof(ldtk_to_map_params_t, num_threads)
 
 /// @brief Tile data structure
 typedef struct _tile_source
@@ -34,7 +142,8 @@ typedef enum
     ENTITY_DATA_FLOAT,
     ENTITY_DATA_STRING,
     ENTITY_DATA_ENTITY,
-    ENTITY_DATA_UNKNOWN
+    ENTITY_DATA_UNKNOWN,
+    ENTITY_DATA_FOREIGN_ENTITY
 } entity_data_type_t;
 
 typedef struct _entity_data
@@ -53,6 +162,10 @@ typedef struct _entity_data
     uint32_t entity_number;
     /// @brief Referenced entity type
     uint8_t entity_is_decor;
+    /// @brief Referenced entity level, for foreign entities
+    uint32_t entity_level;
+    /// @brief Referenced entity entities layer, for foreign entities
+    uint8_t entity_layer;
 } entity_data_t;
 
 /// @brief Entity data structure
@@ -104,9 +217,26 @@ typedef struct _entities_layer
     uint32_t num_entities;
     /// @brief Entities data array
     entity_t* entities;
+    /// @brief Number of the first decor entity, in chunks
+    uint32_t first_decor_entity;
+    /// @brief Number of the first entity, in chunks
+    uint32_t first_entity;
 } entities_layer_t;
 
-#define MAX_DEFINABLE_COLLISION_RECTS 4096
+/// @brief Collision rectangles uniform grid index, see MAP_FLAG_COLLISION_INDEX
+typedef struct _collision_index
+{
+    /// @brief Cell size in pixels
+    uint32_t cell_size;
+    /// @brief Number of cell columns
+    uint32_t columns;
+    /// @brief Number of cell rows
+    uint32_t rows;
+    /// @brief Rectangle indices start of every cell, columns * rows + 1
+    uint32_t *offsets;
+    /// @brief Rectangle indices of all cells
+    uint32_t *rect_indices;
+} collision_index_t;
 
 /// @brief Tilemap collisions layer data structure
 typedef struct _collisions_layer
@@ -116,7 +246,12 @@ typedef struct _collisions_layer
     /// @brief Number of collision rectangles defined in this layer
     uint32_t num_rectangles;
     /// @brief Collisions data array
-    collision_rect_t rectangles[MAX_DEFINABLE_COLLISION_RECTS];
+    collision_rect_t *rectangles;
+    /// @brief Row aligned collision bitset, see MAP_FLAG_COLLISION_GRID, NULL
+    ///        if not requested
+    uint64_t *grid;
+    /// @brief Rectangles index, offsets NULL if not requested
+    collision_index_t index;
 } collisions_layer_t;
 
 /// @brief Tilemap tiles layer data structure
@@ -128,11 +263,19 @@ typedef struct _tiles_layer
     uint32_t num_tiles;
     /// @brief Tiles data array
     tile_source_t* tiles;
+    /// @brief Tileset index + 1 of every cell, NULL if not requested
+    uint16_t* tile_ids;
 } tiles_layer_t;
 
 /// @brief Tilemap asset data structure
 typedef struct _tilemap_data
 {
+    /// @brief MAP_FLAG_* flags, written in the extended header if not 0
+    uint32_t flags;
+    /// @brief Chunk size in tiles, with MAP_FLAG_CHUNKS
+    uint32_t chunk_size;
+    /// @brief Level number in the project
+    uint32_t level;
     /// @brief Tileset image asset name
     char* tile_set;
     /// @brief Tile size in pixels (only square tiles are supported)
@@ -155,14 +298,48 @@ typedef struct _tilemap_data
     entities_layer_t* entity_layers;
 } tilemap_data_t;
 
+/// @brief Merge the solid cells of a collision grid into rectangles. The
+///        first solid cell not covered yet, in row major order, starts a
+///        rectangle as wide as its horizontal run, extended downwards as long
+///        as the next line is solid for the whole width. Runs in a single
+///        pass, linear in the number of cells.
+/// @param grid Row major collision bitset, bit x % 64 of word x / 64 of a
+///        row is cell x, every row starts on a new word and set bits are
+///        solid. Cleared while merging.
+/// @param width Grid width in cells
+/// @param height Grid height in cells
+/// @param rectangles Returned rectangles array, in cells, free it with
+///        osp_mem_free
+/// @return Number of rectangles
+uint32_t extract_collision_rectangles(uint64_t *grid,
+                                      uint32_t width,
+                                      uint32_t height,
+                                      collision_rect_t **rectangles);
+/// @brief Bucket collision rectangles into a uniform grid of cells, every
+///        rectangle is listed in all the cells it overlaps.
+/// @param index Index to fill, free its arrays with osp_mem_free
+/// @param rectangles Rectangles, in pixels
+/// @param num_rectangles Number of rectangles
+/// @param width Map width in pixels
+/// @param height Map height in pixels
+/// @param cell_size Cell size in pixels
+void build_collision_index(collision_index_t *index,
+                           const collision_rect_t *rectangles,
+                           uint32_t num_rectangles,
+                           uint32_t width,
+                           uint32_t height,
+                           uint32_t cell_size);
+/// @brief Frees the memory of an entity, its fields included
+/// @param entity Entity to be freed
+void free_tilemap_entity(entity_t *entity);
 /// @brief Frees previously allocated tilemap data memory
 /// @param tile_map Tilemap data structure to be freed
 void free_tilemap_layers(tilemap_data_t* tile_map);
 /// @brief LDTK tile map file to tile map MAP asset converter
-/// @param readFile Input FILE containing the LDTK map
-/// @param writeFIle Output bundle FILE to write data to
-/// @param params Optional converter parameters
+/// @param input Input containing the LDTK map
+/// @param writer Output sink to write asset data to
+/// @param params Optional converter parameters (ldtk_to_map_params_t)
 /// @return 0 on successful conversion, error value otherwise
-int ldtk_to_map(FILE* readFile, FILE* writeFIle, void* params);
+int ldtk_to_map(const osp_input_t* input, osp_writer_t writer, void* params);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+/**
+ * @file trace.h
+ * @author OldSchoolPixels.com
+ * @brief Build timeline tracing, in Chrome Trace Event Format
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_TRACE_H
+#define OSP_TRACE_H
+
+#include <stdint.h>
+
+/// Spans are recorded as complete ("X") events, every thread on its own
+/// track, and written as a JSON trace once closed. Without an open trace
+/// recording a span costs a flag check.
+
+/// @brief Start recording spans
+/// @param path Trace JSON file path, written by osp_trace_close
+/// @return 0 on success, error value otherwise
+extern int osp_trace_open(const char *path);
+/// @brief Write the recorded spans and stop recording
+/// @return 0 on success, error value otherwise
+extern int osp_trace_close();
+/// @brief Start a span on the calling thread
+/// @return Span start time, to pass to osp_trace_end
+extern uint64_t osp_trace_begin();
+/// @brief End a span on the calling thread
+/// @param name Span name, a string literal
+/// @param start Value returned by osp_trace_begin
+/// @param detail Optional span detail, like the asset path, copied
+extern void osp_trace_end(const char *name, uint64_t start, const char *detail);
+
+#endif
@@ -0,0 +1,34 @@
+/**
+ * @file walk.h
+ * @author OldSchoolPixels.com
+ * @brief Content directory tree walker
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_WALK_H
+#define OSP_WALK_H
+
+#include <stdint.h>
+#include "dynarray.h"
+
+/// @brief Recursively list the regular files of a directory tree, without
+///        changing the working directory. Directories are opened relative to
+///        the root one and entry types come from readdir, files are only
+///        stat'ed when the file system doesn't report them. Each directory
+///        level is scanned in parallel.
+/// @param root Root directory path
+/// @param prefix Subdirectory to list, relative to root: "" or ending in '/'
+/// @param num_threads Number of threads scanning directories
+/// @return Array of char*, the file paths relative to root (prefix included)
+///         sorted by strcmp, NULL if root can't be opened. Free it with
+///         osp_walk_free.
+extern osp_dynarray_t osp_walk(const char *root, const char *prefix, uint32_t num_threads);
+/// @brief Free a file list returned by osp_walk
+/// @param files File list
+extern void osp_walk_free(osp_dynarray_t files);
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file writer.h
+ * @author OldSchoolPixels.com
+ * @brief Output sink for processed asset and bundle data
+ * @version 0.1
+ * @date 2025-02-07
+ * 
+ * @copyright Copyright (c) 2025
+ * 
+ */
+
+#ifndef OSP_WRITER_H
+#define OSP_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// All the typed put functions write little endian values, whatever the host
+// byte order is. Strings are written as a 64 bit length followed by the
+// string bytes, without the terminating zero.
+//
+// A memory writer grows its buffer as needed and keeps all the data, a file
+// writer uses its buffer to batch writes and flushes it to the file when full
+// and on osp_writer_flush.
+
+typedef struct _osp_writer *osp_writer_t;
+
+extern osp_writer_t osp_writer_new(const size_t initial_capacity);
+extern osp_writer_t osp_writer_new_file(FILE *file, const size_t buffer_size);
+extern void osp_writer_put_u8(osp_writer_t writer, uint8_t value);
+extern void osp_writer_put_u16(osp_writer_t writer, uint16_t value);
+extern void osp_writer_put_u32(osp_writer_t writer, uint32_t value);
+extern void osp_writer_put_u64(osp_writer_t writer, uint64_t value);
+extern void osp_writer_put_i32(osp_writer_t writer, int32_t value);
+extern void osp_writer_put_f32(osp_writer_t writer, float value);
+extern void osp_writer_put_u16_array(osp_writer_t writer, const uint16_t *values, size_t count);
+extern void osp_writer_put_u32_array(osp_writer_t writer, const uint32_t *values, size_t count);
+extern void osp_writer_put_u64_array(osp_writer_t writer, const uint64_t *values, size_t count);
+extern void osp_writer_put_bytes(osp_writer_t writer, const void *data, size_t size);
+extern void osp_writer_put_string(osp_writer_t writer, const char *string);
+extern void osp_writer_put_zeros(osp_writer_t writer, size_t count);
+extern uint64_t osp_writer_tell(osp_writer_t writer);
+extern const char *osp_writer_get_data(osp_writer_t writer);
+extern size_t osp_writer_get_size(osp_writer_t writer);
+extern char *osp_writer_detach(osp_writer_t writer, size_t *size);
+extern void osp_writer_clear(osp_writer_t writer);
+extern int osp_writer_flush(osp_writer_t writer);
+extern void osp_writer_delete(osp_writer_t writer);
+
+#endif
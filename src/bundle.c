@@ -0,0 +1,411 @@
+#include "bundle.h"
+#include "OSP_content.h"
+#include "compress.h"
+#include "hash.h"
+#include "hashmap.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Size of a legacy content table entry besides the name:
+// 64 bit name length, 8 bit type, 64 bit start and 64 bit size
+#define BUNDLE_ENTRY_FIXED_SIZE (8 + 1 + 8 + 8)
+
+typedef struct _bundle_entry
+{
+    const char *name;
+    size_t name_length;
+    uint8_t type;
+    uint64_t start;
+    uint64_t size;
+} bundle_entry_t;
+
+struct _osp_bundle
+{
+    const uint8_t *mapping;
+    size_t mapping_size;
+    size_t count;
+    uint64_t table_pos;
+    // Fixed size records table, NULL for legacy bundles. Records are read
+    // in place from the mapping and checked when accessed.
+    const uint8_t *records;
+    size_t record_size;
+    uint16_t version;
+    const uint8_t *buckets;
+    uint32_t bucket_bits;
+    const char *strings;
+    uint64_t strings_size;
+    // Legacy table entries, parsed when opened
+    bundle_entry_t *entries;
+    // Legacy table name hash to entries index
+    osp_hashmap_t index;
+};
+
+// Bundle data is little endian and unaligned
+static inline uint64_t bundle_read_u64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline uint32_t bundle_read_u32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static inline uint16_t bundle_read_u16(const uint8_t *p)
+{
+    uint16_t value;
+    memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap16(value);
+#endif
+    return value;
+}
+
+// Fixed size records table, see OSP_content.h. Only the header and the
+// array bounds are checked here, so opening doesn't touch every record.
+uint8_t bundle_read_records_table(osp_bundle_t bundle)
+{
+    const uint8_t *table = bundle->mapping + bundle->table_pos;
+    uint64_t table_size = bundle->mapping_size - bundle->table_pos;
+    if(table_size < sizeof(osp_cnt_table_header_t))
+        return 0;
+
+    uint16_t version = bundle_read_u16(table +
+        offsetof(osp_cnt_table_header_t, version));
+    uint16_t record_size = bundle_read_u16(table +
+        offsetof(osp_cnt_table_header_t, record_size));
+    uint32_t count = bundle_read_u32(table +
+        offsetof(osp_cnt_table_header_t, count));
+    uint32_t bucket_bits = bundle_read_u32(table +
+        offsetof(osp_cnt_table_header_t, bucket_bits));
+    uint64_t records_offset = bundle_read_u64(table +
+        offsetof(osp_cnt_table_header_t, records_offset));
+    uint64_t buckets_offset = bundle_read_u64(table +
+        offsetof(osp_cnt_table_header_t, buckets_offset));
+    uint64_t strings_offset = bundle_read_u64(table +
+        offsetof(osp_cnt_table_header_t, strings_offset));
+    uint64_t strings_size = bundle_read_u64(table +
+        offsetof(osp_cnt_table_header_t, strings_size));
+
+    // Version 1 records lack the raw_size and codec fields
+    size_t min_record_size = version < 2
+        ? sizeof(osp_cnt_table_record_t) - sizeof(uint64_t)
+        : sizeof(osp_cnt_table_record_t);
+    if(version < 1 || version > OSP_CNT_TABLE_VERSION ||
+       record_size < min_record_size)
+        return 0;
+    if(records_offset > table_size ||
+       count > (table_size - records_offset) / record_size)
+        return 0;
+    if(bucket_bits > 32 || buckets_offset > table_size ||
+       ((uint64_t)1 << bucket_bits) >=
+       (table_size - buckets_offset) / sizeof(uint32_t))
+        return 0;
+    if(strings_offset > table_size ||
+       strings_size > table_size - strings_offset)
+        return 0;
+
+    bundle->count = count;
+    bundle->records = table + records_offset;
+    bundle->record_size = record_size;
+    bundle->version = version;
+    bundle->buckets = table + buckets_offset;
+    bundle->bucket_bits = bucket_bits;
+    bundle->strings = (const char *)(table + strings_offset);
+    bundle->strings_size = strings_size;
+
+    return 1;
+}
+
+// Legacy variable size entries table, parsed and indexed when opened
+uint8_t bundle_read_legacy_table(osp_bundle_t bundle)
+{
+    const uint8_t *data = bundle->mapping;
+    uint64_t size = bundle->mapping_size;
+    uint64_t table_pos = bundle->table_pos;
+    if(table_pos > size - sizeof(uint32_t))
+        return 0;
+
+    // The table starts with the number of entries
+    const uint8_t *p = data + table_pos;
+    const uint8_t *end = data + size;
+    bundle->count = bundle_read_u32(p);
+    p += sizeof(uint32_t);
+    // Every entry is at least BUNDLE_ENTRY_FIXED_SIZE bytes
+    if(bundle->count > (uint64_t)(end - p) / BUNDLE_ENTRY_FIXED_SIZE)
+        return 0;
+
+    bundle->entries = malloc(sizeof(bundle_entry_t) *
+                             (bundle->count > 0 ? bundle->count : 1));
+    bundle->index = osp_hashmap_new(bundle->count);
+    for(size_t i_entry = 0; i_entry < bundle->count; ++i_entry)
+    {
+        bundle_entry_t *entry = &(bundle->entries[i_entry]);
+        if((uint64_t)(end - p) < BUNDLE_ENTRY_FIXED_SIZE)
+            return 0;
+
+        entry->name_length = bundle_read_u64(p);
+        p += sizeof(uint64_t);
+        if(entry->name_length > (uint64_t)(end - p) - (BUNDLE_ENTRY_FIXED_SIZE - 8))
+            return 0;
+        entry->name = (const char *)p;
+        p += entry->name_length;
+        entry->type = *p;
+        p += sizeof(uint8_t);
+        entry->start = bundle_read_u64(p);
+        p += sizeof(uint64_t);
+        entry->size = bundle_read_u64(p);
+        p += sizeof(uint64_t);
+
+        // Asset data must lie between the header and the table
+        if(entry->start < sizeof(uint64_t) || entry->start > table_pos ||
+           entry->size > table_pos - entry->start)
+            return 0;
+
+        osp_hashmap_insert(bundle->index,
+                           osp_hash64(entry->name, entry->name_length, 0),
+                           i_entry);
+    }
+
+    return 1;
+}
+
+uint8_t bundle_read_table(osp_bundle_t bundle)
+{
+    // The bundle starts with the content table position...
+    if(bundle->mapping_size < sizeof(uint64_t))
+        return 0;
+    bundle->table_pos = bundle_read_u64(bundle->mapping);
+    if(bundle->table_pos < sizeof(uint64_t) ||
+       bundle->table_pos > bundle->mapping_size)
+        return 0;
+
+    // ...which starts with the magic for fixed size records tables
+    if(bundle->mapping_size - bundle->table_pos >= 4 &&
+       memcmp(bundle->mapping + bundle->table_pos, OSP_CNT_TABLE_MAGIC, 4) == 0)
+        return bundle_read_records_table(bundle);
+
+    return bundle_read_legacy_table(bundle);
+}
+
+osp_bundle_t osp_bundle_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return NULL;
+
+    struct stat bundle_stat;
+    if(fstat(fd, &bundle_stat) != 0 || bundle_stat.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *mapping = mmap(NULL, bundle_stat.st_size, PROT_READ, MAP_SHARED,
+                         fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED)
+        return NULL;
+
+    osp_bundle_t bundle = (osp_bundle_t)calloc(1, sizeof(struct _osp_bundle));
+    bundle->mapping = (const uint8_t *)mapping;
+    bundle->mapping_size = bundle_stat.st_size;
+
+    if(!bundle_read_table(bundle))
+    {
+        osp_bundle_close(bundle);
+        return NULL;
+    }
+
+    return bundle;
+}
+
+// Check a record read from the mapping and fill the asset view with it
+uint8_t bundle_fill_record_asset(osp_bundle_t bundle,
+                                 const uint8_t *record,
+                                 osp_bundle_asset_t *asset)
+{
+    uint64_t start = bundle_read_u64(record +
+        offsetof(osp_cnt_table_record_t, start));
+    uint64_t size = bundle_read_u64(record +
+        offsetof(osp_cnt_table_record_t, size));
+    // Version 1 records lack raw_size, the fields after it come earlier
+    size_t shift = bundle->version < 2 ? sizeof(uint64_t) : 0;
+    uint32_t name_offset = bundle_read_u32(record +
+        offsetof(osp_cnt_table_record_t, name_offset) - shift);
+    uint32_t name_length = bundle_read_u32(record +
+        offsetof(osp_cnt_table_record_t, name_length) - shift);
+
+    // Names must be zero terminated inside the string pool, asset data
+    // must lie between the header and the table
+    if(name_offset >= bundle->strings_size ||
+       name_length >= bundle->strings_size - name_offset ||
+       bundle->strings[name_offset + name_length] != '\0')
+        return 0;
+    if(start < sizeof(uint64_t) || start > bundle->table_pos ||
+       size > bundle->table_pos - start)
+        return 0;
+
+    if(asset != NULL)
+    {
+        asset->name = bundle->strings + name_offset;
+        asset->name_length = name_length;
+        asset->type = record[offsetof(osp_cnt_table_record_t, type) - shift];
+        asset->data = bundle->mapping + start;
+        asset->size = size;
+        if(bundle->version < 2)
+        {
+            asset->codec = OSP_CNT_CODEC_NONE;
+            asset->raw_size = size;
+        }
+        else
+        {
+            asset->codec = record[offsetof(osp_cnt_table_record_t, codec)];
+            asset->raw_size = bundle_read_u64(record +
+                offsetof(osp_cnt_table_record_t, raw_size));
+        }
+    }
+    return 1;
+}
+
+// Probe the bucket directory, then compare the bucket records
+uint8_t bundle_find_record(osp_bundle_t bundle,
+                           const char *name,
+                           osp_bundle_asset_t *asset)
+{
+    size_t name_length = strlen(name);
+    uint64_t hash = osp_hash64(name, name_length, 0);
+    uint64_t bucket = bundle->bucket_bits > 0
+                      ? hash >> (64 - bundle->bucket_bits) : 0;
+
+    const uint8_t *bucket_entry = bundle->buckets + bucket * sizeof(uint32_t);
+    uint32_t first = bundle_read_u32(bucket_entry);
+    uint32_t last = bundle_read_u32(bucket_entry + sizeof(uint32_t));
+    if(last > bundle->count)
+        return 0;
+
+    for(; first < last; ++first)
+    {
+        const uint8_t *record = bundle->records + first * bundle->record_size;
+        if(bundle_read_u64(record) != hash)
+            continue;
+
+        osp_bundle_asset_t found;
+        if(bundle_fill_record_asset(bundle, record, &found) &&
+           found.name_length == name_length &&
+           memcmp(found.name, name, name_length) == 0)
+        {
+            if(asset != NULL)
+                *asset = found;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void bundle_fill_asset(osp_bundle_t bundle,
+                       bundle_entry_t *entry,
+                       osp_bundle_asset_t *asset)
+{
+    asset->name = entry->name;
+    asset->name_length = entry->name_length;
+    asset->type = entry->type;
+    asset->data = bundle->mapping + entry->start;
+    asset->size = entry->size;
+    asset->codec = OSP_CNT_CODEC_NONE;
+    asset->raw_size = entry->size;
+}
+
+uint8_t osp_bundle_find(osp_bundle_t bundle, const char *name, osp_bundle_asset_t *asset)
+{
+    if(bundle == NULL || name == NULL)
+        return 0;
+    if(bundle->records != NULL)
+        return bundle_find_record(bundle, name, asset);
+
+    size_t name_length = strlen(name);
+    size_t cursor = 0;
+    uint64_t idx;
+    while(osp_hashmap_find(bundle->index, osp_hash64(name, name_length, 0),
+                           &cursor, &idx))
+    {
+        bundle_entry_t *entry = &(bundle->entries[idx]);
+        if(entry->name_length == name_length &&
+           memcmp(entry->name, name, name_length) == 0)
+        {
+            if(asset != NULL)
+                bundle_fill_asset(bundle, entry, asset);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+size_t osp_bundle_get_count(osp_bundle_t bundle)
+{
+    if(bundle == NULL)
+        return 0;
+
+    return bundle->count;
+}
+
+uint8_t osp_bundle_get(osp_bundle_t bundle, size_t idx, osp_bundle_asset_t *asset)
+{
+    if(bundle == NULL || asset == NULL || idx >= bundle->count)
+        return 0;
+    if(bundle->records != NULL)
+        return bundle_fill_record_asset(bundle,
+            bundle->records + idx * bundle->record_size, asset);
+
+    bundle_fill_asset(bundle, &(bundle->entries[idx]), asset);
+    return 1;
+}
+
+uint8_t osp_bundle_decompress(const osp_bundle_asset_t *asset,
+                              void *buffer,
+                              size_t buffer_size)
+{
+    if(asset == NULL || buffer == NULL || buffer_size < asset->raw_size)
+        return 0;
+
+    if(asset->codec == OSP_CNT_CODEC_NONE)
+    {
+        if(asset->raw_size != asset->size)
+            return 0;
+        memcpy(buffer, asset->data, asset->size);
+        return 1;
+    }
+    if(asset->codec == OSP_CNT_CODEC_LZ4)
+        return osp_lz4_decompress(asset->data, asset->size,
+                                  buffer, asset->raw_size) == 0;
+
+    return 0;
+}
+
+void osp_bundle_close(osp_bundle_t bundle)
+{
+    if(bundle == NULL)
+        return;
+
+    munmap((void *)bundle->mapping, bundle->mapping_size);
+    free(bundle->entries);
+    osp_hashmap_delete(bundle->index);
+    free(bundle);
+}
@@ -158,6 +158,8 @@ typedef struct internal_hooks
     void *(CJSON_CDECL *allocate)(size_t size);
     void (CJSON_CDECL *deallocate)(void *pointer);
     void *(CJSON_CDECL *reallocate)(void *pointer, size_t size);
+    /* parsed items and strings come from here instead, if set */
+    cJSON_Arena *arena;
 } internal_hooks;
 
 #if defined(_MSC_VER)
@@ -183,7 +185,129 @@ static void * CJSON_CDECL internal_realloc(void *pointer, size_t size)
 /* strlen of character literals resolved at compile time */
 #define static_strlen(string_literal) (sizeof(string_literal) - sizeof(""))
 
-static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc };
+static internal_hooks global_hooks = { internal_malloc, internal_free, internal_realloc, NULL };
+
+/* arena blocks are linked, the current one first, and their data follows them */
+typedef struct arena_block
+{
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+} arena_block;
+
+struct cJSON_Arena
+{
+    arena_block *blocks;
+    size_t block_size;
+};
+
+#define ARENA_DEFAULT_BLOCK_SIZE 65536
+/* every allocation is aligned for the cJSON structure members */
+#define ARENA_ALIGNMENT (sizeof(double) > sizeof(void*) ? sizeof(double) : sizeof(void*))
+#define arena_align(size) (((size) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+static void *arena_allocate(cJSON_Arena * const arena, size_t size)
+{
+    arena_block *block = arena->blocks;
+    void *pointer = NULL;
+
+    size = arena_align(size);
+    if ((block == NULL) || ((block->size - block->used) < size))
+    {
+        size_t data_size = (size > arena->block_size) ? size : arena->block_size;
+        arena_block *new_block = (arena_block*)global_hooks.allocate(arena_align(sizeof(arena_block)) + data_size);
+        if (new_block == NULL)
+        {
+            return NULL;
+        }
+        new_block->size = data_size;
+        new_block->used = 0;
+
+        /* a big allocation gets a block of its own, the current block keeps serving the small ones */
+        if ((block != NULL) && (size > arena->block_size))
+        {
+            new_block->next = block->next;
+            block->next = new_block;
+        }
+        else
+        {
+            new_block->next = block;
+            arena->blocks = new_block;
+        }
+        block = new_block;
+    }
+
+    pointer = (unsigned char*)block + arena_align(sizeof(arena_block)) + block->used;
+    block->used += size;
+
+    return pointer;
+}
+
+static void *hooks_allocate(const internal_hooks * const hooks, size_t size)
+{
+    if (hooks->arena != NULL)
+    {
+        return arena_allocate(hooks->arena, size);
+    }
+
+    return hooks->allocate(size);
+}
+
+CJSON_PUBLIC(cJSON_Arena *) cJSON_CreateArena(size_t block_size)
+{
+    cJSON_Arena *arena = (cJSON_Arena*)global_hooks.allocate(sizeof(cJSON_Arena));
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+    arena->blocks = NULL;
+    arena->block_size = (block_size > 0) ? arena_align(block_size) : ARENA_DEFAULT_BLOCK_SIZE;
+
+    return arena;
+}
+
+CJSON_PUBLIC(void) cJSON_ResetArena(cJSON_Arena *arena)
+{
+    arena_block *kept = NULL;
+    arena_block *block = NULL;
+
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    /* keep the current block if it is a regular one, to avoid allocating it again */
+    block = arena->blocks;
+    if ((block != NULL) && (block->size == arena->block_size))
+    {
+        kept = block;
+        block = block->next;
+        kept->next = NULL;
+        kept->used = 0;
+    }
+    while (block != NULL)
+    {
+        arena_block *next = block->next;
+        global_hooks.deallocate(block);
+        block = next;
+    }
+    arena->blocks = kept;
+}
+
+CJSON_PUBLIC(void) cJSON_DeleteArena(cJSON_Arena *arena)
+{
+    if (arena == NULL)
+    {
+        return;
+    }
+
+    cJSON_ResetArena(arena);
+    if (arena->blocks != NULL)
+    {
+        global_hooks.deallocate(arena->blocks);
+    }
+    global_hooks.deallocate(arena);
+}
 
 static unsigned char* cJSON_strdup(const unsigned char* string, const internal_hooks * const hooks)
 {
@@ -240,10 +364,14 @@ CJSON_PUBLIC(void) cJSON_InitHooks(cJSON_Hooks* hooks)
 /* Internal constructor. */
 static cJSON *cJSON_New_Item(const internal_hooks * const hooks)
 {
-    cJSON* node = (cJSON*)hooks->allocate(sizeof(cJSON));
+    cJSON* node = (cJSON*)hooks_allocate(hooks, sizeof(cJSON));
     if (node)
     {
         memset(node, '\0', sizeof(cJSON));
+        if (hooks->arena != NULL)
+        {
+            node->type = cJSON_InArena;
+        }
     }
 
     return node;
@@ -256,6 +384,12 @@ CJSON_PUBLIC(void) cJSON_Delete(cJSON *item)
     while (item != NULL)
     {
         next = item->next;
+        if (item->type & cJSON_InArena)
+        {
+            /* released with its arena, children included */
+            item = next;
+            continue;
+        }
         if (!(item->type & cJSON_IsReference) && (item->child != NULL))
         {
             cJSON_Delete(item->child);
@@ -372,7 +506,7 @@ loop_end:
         item->valueint = (int)number;
     }
 
-    item->type = cJSON_Number;
+    item->type = cJSON_Number | (item->type & cJSON_InArena);
 
     input_buffer->offset += (size_t)(after_end - number_c_string);
     return true;
@@ -415,7 +549,7 @@ CJSON_PUBLIC(char*) cJSON_SetValuestring(cJSON *object, const char *valuestring)
     {
         return NULL;
     }
-    if (object->valuestring != NULL)
+    if ((object->valuestring != NULL) && !(object->type & cJSON_InArena))
     {
         cJSON_free(object->valuestring);
     }
@@ -809,7 +943,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
 
         /* This is at most how much we need for the output */
         allocation_length = (size_t) (input_end - buffer_at_offset(input_buffer)) - skipped_bytes;
-        output = (unsigned char*)input_buffer->hooks.allocate(allocation_length + sizeof(""));
+        output = (unsigned char*)hooks_allocate(&(input_buffer->hooks), allocation_length + sizeof(""));
         if (output == NULL)
         {
             goto fail; /* allocation failure */
@@ -876,7 +1010,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     /* zero terminate the output */
     *output_pointer = '\0';
 
-    item->type = cJSON_String;
+    item->type = cJSON_String | (item->type & cJSON_InArena);
     item->valuestring = (char*)output;
 
     input_buffer->offset = (size_t) (input_end - input_buffer->content);
@@ -885,7 +1019,7 @@ static cJSON_bool parse_string(cJSON * const item, parse_buffer * const input_bu
     return true;
 
 fail:
-    if (output != NULL)
+    if ((output != NULL) && (input_buffer->hooks.arena == NULL))
     {
         input_buffer->hooks.deallocate(output);
     }
@@ -1092,9 +1226,9 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithOpts(const char *value, const char **return
 }
 
 /* Parse an object - create a new root, and populate. */
-CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+static cJSON *parse_with_hooks(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated, const internal_hooks * const hooks)
 {
-    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0 } };
+    parse_buffer buffer = { 0, 0, 0, 0, { 0, 0, 0, 0 } };
     cJSON *item = NULL;
 
     /* reset error position */
@@ -1109,9 +1243,9 @@ CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer
     buffer.content = (const unsigned char*)value;
     buffer.length = buffer_length;
     buffer.offset = 0;
-    buffer.hooks = global_hooks;
+    buffer.hooks = *hooks;
 
-    item = cJSON_New_Item(&global_hooks);
+    item = cJSON_New_Item(hooks);
     if (item == NULL) /* memory fail */
     {
         goto fail;
@@ -1171,6 +1305,19 @@ fail:
     return NULL;
 }
 
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithLengthOpts(const char *value, size_t buffer_length, const char **return_parse_end, cJSON_bool require_null_terminated)
+{
+    return parse_with_hooks(value, buffer_length, return_parse_end, require_null_terminated, &global_hooks);
+}
+
+CJSON_PUBLIC(cJSON *) cJSON_ParseWithArena(const char *value, size_t buffer_length, cJSON_Arena *arena)
+{
+    internal_hooks hooks = global_hooks;
+    hooks.arena = arena;
+
+    return parse_with_hooks(value, buffer_length, NULL, false, &hooks);
+}
+
 /* Default options for cJSON_Parse */
 CJSON_PUBLIC(cJSON *) cJSON_Parse(const char *value)
 {
@@ -1261,7 +1408,7 @@ CJSON_PUBLIC(char *) cJSON_PrintUnformatted(const cJSON *item)
 
 CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON_bool fmt)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0, 0 } };
 
     if (prebuffer < 0)
     {
@@ -1291,7 +1438,7 @@ CJSON_PUBLIC(char *) cJSON_PrintBuffered(const cJSON *item, int prebuffer, cJSON
 
 CJSON_PUBLIC(cJSON_bool) cJSON_PrintPreallocated(cJSON *item, char *buffer, const int length, const cJSON_bool format)
 {
-    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0 } };
+    printbuffer p = { 0, 0, 0, 0, 0, 0, { 0, 0, 0, 0 } };
 
     if ((length < 0) || (buffer == NULL))
     {
@@ -1320,21 +1467,21 @@ static cJSON_bool parse_value(cJSON * const item, parse_buffer * const input_buf
     /* null */
     if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "null", 4) == 0))
     {
-        item->type = cJSON_NULL;
+        item->type = cJSON_NULL | (item->type & cJSON_InArena);
         input_buffer->offset += 4;
         return true;
     }
     /* false */
     if (can_read(input_buffer, 5) && (strncmp((const char*)buffer_at_offset(input_buffer), "false", 5) == 0))
     {
-        item->type = cJSON_False;
+        item->type = cJSON_False | (item->type & cJSON_InArena);
         input_buffer->offset += 5;
         return true;
     }
     /* true */
     if (can_read(input_buffer, 4) && (strncmp((const char*)buffer_at_offset(input_buffer), "true", 4) == 0))
     {
-        item->type = cJSON_True;
+        item->type = cJSON_True | (item->type & cJSON_InArena);
         item->valueint = 1;
         input_buffer->offset += 4;
         return true;
@@ -1519,7 +1666,7 @@ success:
         head->prev = current_item;
     }
 
-    item->type = cJSON_Array;
+    item->type = cJSON_Array | (item->type & cJSON_InArena);
     item->child = head;
 
     input_buffer->offset++;
@@ -1695,7 +1842,7 @@ success:
         head->prev = current_item;
     }
 
-    item->type = cJSON_Object;
+    item->type = cJSON_Object | (item->type & cJSON_InArena);
     item->child = head;
 
     input_buffer->offset++;
@@ -2034,7 +2181,7 @@ static cJSON_bool add_item_to_object(cJSON * const object, const char * const st
         new_type = item->type & ~cJSON_StringIsConst;
     }
 
-    if (!(item->type & cJSON_StringIsConst) && (item->string != NULL))
+    if (!(item->type & (cJSON_StringIsConst | cJSON_InArena)) && (item->string != NULL))
     {
         hooks->deallocate(item->string);
     }
@@ -2356,7 +2503,7 @@ static cJSON_bool replace_item_in_object(cJSON *object, const char *string, cJSO
     }
 
     /* replace the name in the replacement */
-    if (!(replacement->type & cJSON_StringIsConst) && (replacement->string != NULL))
+    if (!(replacement->type & (cJSON_StringIsConst | cJSON_InArena)) && (replacement->string != NULL))
     {
         cJSON_free(replacement->string);
     }
@@ -2722,7 +2869,7 @@ CJSON_PUBLIC(cJSON *) cJSON_Duplicate(const cJSON *item, cJSON_bool recurse)
         goto fail;
     }
     /* Copy over all vars */
-    newitem->type = item->type & (~cJSON_IsReference);
+    newitem->type = item->type & (~(cJSON_IsReference | cJSON_InArena));
     newitem->valueint = item->valueint;
     newitem->valuedouble = item->valuedouble;
     if (item->valuestring)
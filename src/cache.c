@@ -0,0 +1,463 @@
+#include "cache.h"
+#include "dynarray.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "input.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CACHE_INDEX_NAME "index"
+#define CACHE_INDEX_MAGIC "OSPCIDX1"
+#define CACHE_BLOB_MAGIC "OSPBLOB2"
+#define CACHE_MAGIC_SIZE 8
+#define CACHE_MAX_PATH 4096
+// Room for the suffix temporary file paths add to a cache path
+#define CACHE_TEMP_SUFFIX 32
+
+// A single input of a build
+typedef struct _cache_record
+{
+    char *path;
+    uint64_t size;
+    int64_t mtime;
+    uint64_t content_hash;
+    uint64_t key;
+} cache_record_t;
+
+// Processed asset blob file header, followed by the data and then by the
+// dependencies: a u32 count, then size, mtime, content hash, u32 path length
+// and path of every one of them.
+typedef struct _cache_blob_header
+{
+    char magic[CACHE_MAGIC_SIZE];
+    uint64_t key;
+    uint64_t size;
+    uint64_t data_hash;
+} cache_blob_header_t;
+
+struct _osp_cache
+{
+    char *directory;
+    // Inputs of the last build, read only while processing
+    osp_dynarray_t old_records;
+    // Path hash to old_records index
+    osp_hashmap_t old_index;
+    // Inputs of the current build
+    osp_dynarray_t new_records;
+    // Unique blob file suffix for concurrent stores
+    uint32_t store_counter;
+};
+
+void cache_blob_path(osp_cache_t cache, uint64_t key, char *path)
+{
+    snprintf(path, CACHE_MAX_PATH, "%s/%016" PRIx64 ".bin",
+             cache->directory, key);
+}
+
+void cache_load_index(osp_cache_t cache)
+{
+    char index_path[CACHE_MAX_PATH];
+    snprintf(index_path, CACHE_MAX_PATH, "%s/" CACHE_INDEX_NAME,
+             cache->directory);
+
+    FILE *index_file = fopen(index_path, "rb");
+    if(index_file == NULL)
+        return;
+
+    char magic[CACHE_MAGIC_SIZE];
+    uint32_t count = 0;
+    if(fread(magic, 1, CACHE_MAGIC_SIZE, index_file) != CACHE_MAGIC_SIZE ||
+       memcmp(magic, CACHE_INDEX_MAGIC, CACHE_MAGIC_SIZE) != 0 ||
+       fread(&count, sizeof(count), 1, index_file) != 1)
+    {
+        printf("Ignoring invalid cache index %s\n", index_path);
+        fclose(index_file);
+        return;
+    }
+
+    for(uint32_t i_record = 0; i_record < count; ++i_record)
+    {
+        cache_record_t record;
+        uint32_t path_length = 0;
+        if(fread(&record.size, sizeof(record.size), 1, index_file) != 1 ||
+           fread(&record.mtime, sizeof(record.mtime), 1, index_file) != 1 ||
+           fread(&record.content_hash,
+                 sizeof(record.content_hash), 1, index_file) != 1 ||
+           fread(&record.key, sizeof(record.key), 1, index_file) != 1 ||
+           fread(&path_length, sizeof(path_length), 1, index_file) != 1 ||
+           path_length >= CACHE_MAX_PATH)
+            break;
+
+        record.path = malloc(path_length + 1);
+        if(fread(record.path, 1, path_length, index_file) != path_length)
+        {
+            free(record.path);
+            break;
+        }
+        record.path[path_length] = '\0';
+
+        osp_hashmap_insert(cache->old_index,
+                           osp_hash64_string(record.path, 0),
+                           osp_dynarray_get_count(cache->old_records));
+        osp_dynarray_add(cache->old_records, &record);
+    }
+
+    fclose(index_file);
+}
+
+osp_cache_t osp_cache_open(const char *directory)
+{
+    if(directory == NULL)
+        return NULL;
+
+    if(mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        printf("Unable to create cache directory %s\n", directory);
+        return NULL;
+    }
+
+    osp_cache_t cache = (osp_cache_t)calloc(1, sizeof(struct _osp_cache));
+    cache->directory = strdup(directory);
+    cache->old_records = osp_dynarray_new(sizeof(cache_record_t), 256, 256);
+    cache->old_index = osp_hashmap_new(256);
+    cache->new_records = osp_dynarray_new(sizeof(cache_record_t), 256, 256);
+
+    cache_load_index(cache);
+
+    return cache;
+}
+
+uint8_t osp_cache_find_content_hash(osp_cache_t cache,
+                                    const char *path,
+                                    uint64_t size,
+                                    int64_t mtime,
+                                    uint64_t *content_hash)
+{
+    if(cache == NULL || path == NULL)
+        return 0;
+
+    cache_record_t *records =
+        (cache_record_t *)osp_dynarray_get_data(cache->old_records);
+    size_t cursor = 0;
+    uint64_t idx;
+    while(osp_hashmap_find(cache->old_index, osp_hash64_string(path, 0),
+                           &cursor, &idx))
+    {
+        if(strcmp(records[idx].path, path) == 0)
+        {
+            if(records[idx].size != size || records[idx].mtime != mtime)
+                return 0;
+
+            *content_hash = records[idx].content_hash;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+uint64_t osp_cache_key(const char *path,
+                       uint64_t content_hash,
+                       const char *processor,
+                       uint32_t version,
+                       const void *params,
+                       size_t params_size)
+{
+    uint64_t key = osp_hash64_string(path, content_hash);
+    key = osp_hash64_string(processor, key);
+    key = osp_hash64(&version, sizeof(version), key);
+    if(params != NULL && params_size > 0)
+        key = osp_hash64(params, params_size, key);
+    return key;
+}
+
+uint8_t cache_read_dependencies(FILE *blob_file, osp_dynarray_t *dependencies)
+{
+    uint32_t count = 0;
+    if(fread(&count, sizeof(count), 1, blob_file) != 1)
+        return 0;
+    if(count == 0)
+        return 1;
+
+    *dependencies = osp_dynarray_new(sizeof(osp_input_dependency_t), count, 16);
+    for(uint32_t i_dependency = 0; i_dependency < count; ++i_dependency)
+    {
+        osp_input_dependency_t dependency;
+        uint32_t path_length = 0;
+        if(fread(&dependency.size, sizeof(dependency.size), 1, blob_file) != 1 ||
+           fread(&dependency.mtime, sizeof(dependency.mtime), 1, blob_file) != 1 ||
+           fread(&dependency.content_hash,
+                 sizeof(dependency.content_hash), 1, blob_file) != 1 ||
+           fread(&path_length, sizeof(path_length), 1, blob_file) != 1 ||
+           path_length >= CACHE_MAX_PATH)
+            return 0;
+
+        dependency.path = malloc(path_length + 1);
+        if(fread(dependency.path, 1, path_length, blob_file) != path_length)
+        {
+            free(dependency.path);
+            return 0;
+        }
+        dependency.path[path_length] = '\0';
+        osp_dynarray_add(*dependencies, &dependency);
+
+        // The output is stale as soon as one of the files it was made of
+        // changed
+        if(!osp_input_dependency_unchanged(&dependency))
+            return 0;
+    }
+
+    return 1;
+}
+
+uint8_t osp_cache_load(osp_cache_t cache,
+                       uint64_t key,
+                       char **data,
+                       size_t *size,
+                       osp_dynarray_t *dependencies)
+{
+    *dependencies = NULL;
+    if(cache == NULL)
+        return 0;
+
+    char blob_path[CACHE_MAX_PATH];
+    cache_blob_path(cache, key, blob_path);
+
+    FILE *blob_file = fopen(blob_path, "rb");
+    if(blob_file == NULL)
+        return 0;
+
+    cache_blob_header_t header;
+    if(fread(&header, sizeof(header), 1, blob_file) != 1 ||
+       memcmp(header.magic, CACHE_BLOB_MAGIC, CACHE_MAGIC_SIZE) != 0 ||
+       header.key != key)
+    {
+        fclose(blob_file);
+        return 0;
+    }
+
+    // Zero sized outputs are valid, but malloc(0) might return NULL
+    char *blob_data = osp_mem_malloc(header.size > 0 ? header.size : 1);
+    if(fread(blob_data, 1, header.size, blob_file) != header.size ||
+       osp_hash64(blob_data, header.size, key) != header.data_hash)
+    {
+        // Truncated or corrupted blob, treat it as a miss
+        osp_mem_free(blob_data);
+        fclose(blob_file);
+        return 0;
+    }
+
+    if(!cache_read_dependencies(blob_file, dependencies))
+    {
+        osp_input_free_dependencies(*dependencies);
+        *dependencies = NULL;
+        osp_mem_free(blob_data);
+        fclose(blob_file);
+        return 0;
+    }
+
+    fclose(blob_file);
+    *data = blob_data;
+    *size = header.size;
+
+    return 1;
+}
+
+void cache_write_dependencies(FILE *blob_file, osp_dynarray_t dependencies)
+{
+    uint32_t count =
+        dependencies != NULL ? osp_dynarray_get_count(dependencies) : 0;
+    fwrite(&count, sizeof(count), 1, blob_file);
+    for(uint32_t i_dependency = 0; i_dependency < count; ++i_dependency)
+    {
+        osp_input_dependency_t *dependency =
+            &(((osp_input_dependency_t *)
+               osp_dynarray_get_data(dependencies))[i_dependency]);
+        uint32_t path_length = strlen(dependency->path);
+        fwrite(&(dependency->size), sizeof(dependency->size), 1, blob_file);
+        fwrite(&(dependency->mtime), sizeof(dependency->mtime), 1, blob_file);
+        fwrite(&(dependency->content_hash),
+               sizeof(dependency->content_hash), 1, blob_file);
+        fwrite(&path_length, sizeof(path_length), 1, blob_file);
+        fwrite(dependency->path, 1, path_length, blob_file);
+    }
+}
+
+void osp_cache_store(osp_cache_t cache,
+                     uint64_t key,
+                     const char *data,
+                     size_t size,
+                     osp_dynarray_t dependencies)
+{
+    if(cache == NULL)
+        return;
+
+    char blob_path[CACHE_MAX_PATH];
+    char temp_path[CACHE_MAX_PATH + CACHE_TEMP_SUFFIX];
+    cache_blob_path(cache, key, blob_path);
+    // Write to a unique temporary file and rename it, so concurrent stores
+    // and interrupted builds never leave a partial blob behind.
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.%u.tmp", blob_path,
+             (int)getpid(),
+             __sync_fetch_and_add(&cache->store_counter, 1));
+
+    FILE *blob_file = fopen(temp_path, "wb");
+    if(blob_file == NULL)
+        return;
+
+    cache_blob_header_t header;
+    memcpy(header.magic, CACHE_BLOB_MAGIC, CACHE_MAGIC_SIZE);
+    header.key = key;
+    header.size = size;
+    header.data_hash = osp_hash64(data, size, key);
+
+    uint8_t written = fwrite(&header, sizeof(header), 1, blob_file) == 1 &&
+                      fwrite(data, 1, size, blob_file) == size;
+    cache_write_dependencies(blob_file, dependencies);
+    if(ferror(blob_file))
+        written = 0;
+    if(fclose(blob_file) != 0 || !written || rename(temp_path, blob_path) != 0)
+        unlink(temp_path);
+}
+
+void osp_cache_record(osp_cache_t cache,
+                      const char *path,
+                      uint64_t size,
+                      int64_t mtime,
+                      uint64_t content_hash,
+                      uint64_t key)
+{
+    if(cache == NULL || path == NULL)
+        return;
+
+    cache_record_t record =
+    {
+        .path = strdup(path),
+        .size = size,
+        .mtime = mtime,
+        .content_hash = content_hash,
+        .key = key
+    };
+    osp_dynarray_add(cache->new_records, &record);
+}
+
+void cache_write_index(osp_cache_t cache)
+{
+    char index_path[CACHE_MAX_PATH];
+    char temp_path[CACHE_MAX_PATH + CACHE_TEMP_SUFFIX];
+    snprintf(index_path, CACHE_MAX_PATH, "%s/" CACHE_INDEX_NAME,
+             cache->directory);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", index_path);
+
+    FILE *index_file = fopen(temp_path, "wb");
+    if(index_file == NULL)
+    {
+        printf("Unable to write cache index %s\n", index_path);
+        return;
+    }
+
+    uint32_t count = osp_dynarray_get_count(cache->new_records);
+    fwrite(CACHE_INDEX_MAGIC, 1, CACHE_MAGIC_SIZE, index_file);
+    fwrite(&count, sizeof(count), 1, index_file);
+    for(
+        cache_record_t *record =
+            (cache_record_t *)osp_dynarray_fwd_iter_start(cache->new_records);
+        osp_dynarray_iter_check(cache->new_records);
+        osp_dynarray_fwd_iter_next(cache->new_records, (void **)&record)
+    )
+    {
+        uint32_t path_length = strlen(record->path);
+        fwrite(&(record->size), sizeof(record->size), 1, index_file);
+        fwrite(&(record->mtime), sizeof(record->mtime), 1, index_file);
+        fwrite(&(record->content_hash),
+               sizeof(record->content_hash), 1, index_file);
+        fwrite(&(record->key), sizeof(record->key), 1, index_file);
+        fwrite(&path_length, sizeof(path_length), 1, index_file);
+        fwrite(record->path, 1, path_length, index_file);
+    }
+
+    if(fclose(index_file) != 0 || rename(temp_path, index_path) != 0)
+    {
+        printf("Unable to write cache index %s\n", index_path);
+        unlink(temp_path);
+    }
+}
+
+void cache_prune_blobs(osp_cache_t cache)
+{
+    // Collect the keys of the blobs used by the current build
+    osp_hashmap_t used_keys =
+        osp_hashmap_new(osp_dynarray_get_count(cache->new_records));
+    for(
+        cache_record_t *record =
+            (cache_record_t *)osp_dynarray_fwd_iter_start(cache->new_records);
+        osp_dynarray_iter_check(cache->new_records);
+        osp_dynarray_fwd_iter_next(cache->new_records, (void **)&record)
+    )
+        osp_hashmap_insert(used_keys, record->key, 0);
+
+    DIR *directory = opendir(cache->directory);
+    if(directory == NULL)
+    {
+        osp_hashmap_delete(used_keys);
+        return;
+    }
+
+    struct dirent *entry;
+    while((entry = readdir(directory)))
+    {
+        // Only touch files looking like our blobs
+        uint64_t key;
+        char extension[8];
+        if(strlen(entry->d_name) != 20 ||
+           sscanf(entry->d_name, "%16" SCNx64 ".%3s", &key, extension) != 2 ||
+           strcmp(extension, "bin") != 0)
+            continue;
+
+        size_t cursor = 0;
+        if(!osp_hashmap_find(used_keys, key, &cursor, NULL))
+        {
+            char blob_path[CACHE_MAX_PATH];
+            cache_blob_path(cache, key, blob_path);
+            unlink(blob_path);
+        }
+    }
+
+    closedir(directory);
+    osp_hashmap_delete(used_keys);
+}
+
+void cache_free_records(osp_dynarray_t records)
+{
+    for(
+        cache_record_t *record =
+            (cache_record_t *)osp_dynarray_fwd_iter_start(records);
+        osp_dynarray_iter_check(records);
+        osp_dynarray_fwd_iter_next(records, (void **)&record)
+    )
+        free(record->path);
+
+    osp_dynarray_delete(records);
+}
+
+void osp_cache_close(osp_cache_t cache)
+{
+    if(cache == NULL)
+        return;
+
+    cache_write_index(cache);
+    cache_prune_blobs(cache);
+
+    cache_free_records(cache->old_records);
+    cache_free_records(cache->new_records);
+    osp_hashmap_delete(cache->old_index);
+    free(cache->directory);
+    free(cache);
+}
@@ -0,0 +1,357 @@
+#include "compress.h"
+#include <stdlib.h>
+#include <string.h>
+
+// LZ4 block format: a sequence of (token, literals, match) where the token
+// holds the literals length in its high nibble and the match length - 4 in
+// its low one, both continued with 255 valued bytes when 15, and the match
+// is a 16 bit little endian offset back into the decompressed data. The
+// block ends with a literals only sequence.
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5
+#define LZ4_MF_LIMIT        12
+#define LZ4_MAX_OFFSET      65535
+#define LZ4_RUN_MASK        15
+
+// Hash table bits, the fast compressor sizes its table to the input
+#define LZ4_HASH_BITS       16
+#define LZ4_MIN_HASH_BITS   10
+#define LZ4_HASH_SIZE       (1 << LZ4_HASH_BITS)
+// High ratio window and hash chain search depth
+#define LZ4_WINDOW_MASK     0xFFFF
+#define LZ4_MAX_ATTEMPTS    256
+
+static inline uint32_t lz4_read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t lz4_read64(const uint8_t *p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t lz4_hash(uint32_t sequence, int bits)
+{
+    return (sequence * 2654435761u) >> (32 - bits);
+}
+
+// Length of the common prefix of a and b, up to limit bytes, compared a
+// word at a time
+static inline size_t lz4_count(const uint8_t *a, const uint8_t *b, size_t limit)
+{
+    size_t length = 0;
+    while(length + sizeof(uint64_t) <= limit)
+    {
+        uint64_t difference = lz4_read64(a + length) ^ lz4_read64(b + length);
+        if(difference != 0)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            return length + (__builtin_clzll(difference) >> 3);
+#else
+            return length + (__builtin_ctzll(difference) >> 3);
+#endif
+        }
+        length += sizeof(uint64_t);
+    }
+    while(length < limit && a[length] == b[length])
+        ++length;
+    return length;
+}
+
+// Write a length continuation, returns 0 on overflow
+static inline uint8_t lz4_put_length(uint8_t **op, const uint8_t *end, size_t length)
+{
+    for(; length >= 255; length -= 255)
+    {
+        if(*op >= end)
+            return 0;
+        *(*op)++ = 255;
+    }
+    if(*op >= end)
+        return 0;
+    *(*op)++ = (uint8_t)length;
+    return 1;
+}
+
+// Write a sequence, a literals only one if match_length is 0. Returns 0 on
+// overflow.
+static uint8_t lz4_put_sequence(uint8_t **op,
+                                const uint8_t *end,
+                                const uint8_t *literals,
+                                size_t literals_length,
+                                size_t offset,
+                                size_t match_length)
+{
+    if(*op >= end)
+        return 0;
+
+    uint8_t *token = (*op)++;
+    size_t match_code = match_length > 0 ? match_length - LZ4_MIN_MATCH : 0;
+    *token = (uint8_t)((literals_length < LZ4_RUN_MASK
+                        ? literals_length : LZ4_RUN_MASK) << 4);
+    if(literals_length >= LZ4_RUN_MASK &&
+       !lz4_put_length(op, end, literals_length - LZ4_RUN_MASK))
+        return 0;
+    if((size_t)(end - *op) < literals_length)
+        return 0;
+    memcpy(*op, literals, literals_length);
+    *op += literals_length;
+
+    if(match_length == 0)
+        return 1;
+
+    if(end - *op < 2)
+        return 0;
+    *(*op)++ = (uint8_t)offset;
+    *(*op)++ = (uint8_t)(offset >> 8);
+    *token |= (uint8_t)(match_code < LZ4_RUN_MASK ? match_code : LZ4_RUN_MASK);
+    if(match_code >= LZ4_RUN_MASK &&
+       !lz4_put_length(op, end, match_code - LZ4_RUN_MASK))
+        return 0;
+
+    return 1;
+}
+
+size_t osp_lz4_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t osp_lz4_compress_fast(const void *src, size_t size, void *dst, size_t capacity)
+{
+    const uint8_t *in = (const uint8_t *)src;
+    uint8_t *op = (uint8_t *)dst;
+    const uint8_t *end = op + capacity;
+    size_t anchor = 0;
+
+    if(size > LZ4_MF_LIMIT)
+    {
+        // Input positions + 1, 0 for empty slots. Small inputs get a small
+        // table, clearing it would cost more than compressing.
+        int hash_bits = LZ4_MIN_HASH_BITS;
+        while(hash_bits < LZ4_HASH_BITS && ((size_t)1 << hash_bits) < size)
+            ++hash_bits;
+        uint32_t *table = calloc((size_t)1 << hash_bits, sizeof(uint32_t));
+        if(table == NULL)
+            return 0;
+
+        // The last match must start LZ4_MF_LIMIT bytes before the end and
+        // the last LZ4_LAST_LITERALS bytes are always literals
+        size_t match_start_limit = size - LZ4_MF_LIMIT;
+        size_t match_end_limit = size - LZ4_LAST_LITERALS;
+        size_t ip = 0;
+        while(ip <= match_start_limit)
+        {
+            uint32_t sequence = lz4_read32(in + ip);
+            uint32_t hash = lz4_hash(sequence, hash_bits);
+            size_t ref = table[hash];
+            table[hash] = (uint32_t)(ip + 1);
+
+            if(ref == 0 || ip - (ref - 1) > LZ4_MAX_OFFSET ||
+               lz4_read32(in + ref - 1) != sequence)
+            {
+                // Skip faster and faster through incompressible data
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            --ref;
+
+            // Extend the match backwards into the pending literals...
+            while(ip > anchor && ref > 0 && in[ip - 1] == in[ref - 1])
+            {
+                --ip;
+                --ref;
+            }
+            // ...and forwards
+            size_t length = LZ4_MIN_MATCH +
+                lz4_count(in + ip + LZ4_MIN_MATCH, in + ref + LZ4_MIN_MATCH,
+                          match_end_limit - ip - LZ4_MIN_MATCH);
+
+            if(!lz4_put_sequence(&op, end, in + anchor, ip - anchor,
+                                 ip - ref, length))
+            {
+                free(table);
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+
+            // Index a position inside the match too, cheap ratio gain
+            if(ip - 2 <= match_start_limit)
+                table[lz4_hash(lz4_read32(in + ip - 2), hash_bits)] =
+                    (uint32_t)(ip - 1);
+        }
+
+        free(table);
+    }
+
+    if(!lz4_put_sequence(&op, end, in + anchor, size - anchor, 0, 0))
+        return 0;
+    return op - (uint8_t *)dst;
+}
+
+size_t osp_lz4_compress_high(const void *src, size_t size, void *dst, size_t capacity)
+{
+    const uint8_t *in = (const uint8_t *)src;
+    uint8_t *op = (uint8_t *)dst;
+    const uint8_t *end = op + capacity;
+    size_t anchor = 0;
+
+    if(size > LZ4_MF_LIMIT)
+    {
+        // Hash heads hold input positions + 1, 0 for empty slots, and the
+        // chain holds the distance to the previous position with the same
+        // hash inside the window, 0 for none.
+        uint32_t *head = calloc(LZ4_HASH_SIZE, sizeof(uint32_t));
+        uint16_t *chain = calloc(LZ4_WINDOW_MASK + 1, sizeof(uint16_t));
+        if(head == NULL || chain == NULL)
+        {
+            free(head);
+            free(chain);
+            return 0;
+        }
+
+        size_t match_start_limit = size - LZ4_MF_LIMIT;
+        size_t match_end_limit = size - LZ4_LAST_LITERALS;
+        size_t next_insert = 0;
+        size_t ip = 0;
+        while(ip <= match_start_limit)
+        {
+            // Index every position up to the current one
+            for(; next_insert <= ip; ++next_insert)
+            {
+                uint32_t hash = lz4_hash(lz4_read32(in + next_insert),
+                                         LZ4_HASH_BITS);
+                size_t distance = head[hash] > 0
+                                  ? next_insert - (head[hash] - 1) : 0;
+                chain[next_insert & LZ4_WINDOW_MASK] =
+                    (uint16_t)(distance <= LZ4_MAX_OFFSET ? distance : 0);
+                head[hash] = (uint32_t)(next_insert + 1);
+            }
+
+            // Longest match along the chain
+            size_t best_length = 0;
+            size_t best_ref = 0;
+            size_t ref = ip;
+            size_t limit = match_end_limit - ip;
+            for(int i_attempt = 0; i_attempt < LZ4_MAX_ATTEMPTS; ++i_attempt)
+            {
+                size_t distance = chain[ref & LZ4_WINDOW_MASK];
+                if(distance == 0 || ip - (ref - distance) > LZ4_MAX_OFFSET)
+                    break;
+                ref -= distance;
+
+                if(in[ref + best_length] != in[ip + best_length] ||
+                   lz4_read32(in + ref) != lz4_read32(in + ip))
+                    continue;
+                size_t length = lz4_count(in + ip, in + ref, limit);
+                if(length > best_length)
+                {
+                    best_length = length;
+                    best_ref = ref;
+                    if(length == limit)
+                        break;
+                }
+            }
+
+            if(best_length < LZ4_MIN_MATCH)
+            {
+                ++ip;
+                continue;
+            }
+
+            if(!lz4_put_sequence(&op, end, in + anchor, ip - anchor,
+                                 ip - best_ref, best_length))
+            {
+                free(head);
+                free(chain);
+                return 0;
+            }
+            ip += best_length;
+            anchor = ip;
+        }
+
+        free(head);
+        free(chain);
+    }
+
+    if(!lz4_put_sequence(&op, end, in + anchor, size - anchor, 0, 0))
+        return 0;
+    return op - (uint8_t *)dst;
+}
+
+int osp_lz4_decompress(const void *src, size_t size, void *dst, size_t raw_size)
+{
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *in_end = ip + size;
+    uint8_t *out = (uint8_t *)dst;
+    uint8_t *op = out;
+    uint8_t *out_end = out + raw_size;
+
+    while(ip < in_end)
+    {
+        uint8_t token = *ip++;
+
+        // Literals
+        size_t length = token >> 4;
+        if(length == LZ4_RUN_MASK)
+        {
+            uint8_t byte;
+            do
+            {
+                if(ip >= in_end)
+                    return -1;
+                byte = *ip++;
+                length += byte;
+            } while(byte == 255);
+        }
+        if(length > (size_t)(in_end - ip) || length > (size_t)(out_end - op))
+            return -1;
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+
+        // The last sequence has no match
+        if(ip == in_end)
+            break;
+
+        // Match
+        if(in_end - ip < 2)
+            return -1;
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if(offset == 0 || offset > (size_t)(op - out))
+            return -1;
+
+        length = token & LZ4_RUN_MASK;
+        if(length == LZ4_RUN_MASK)
+        {
+            uint8_t byte;
+            do
+            {
+                if(ip >= in_end)
+                    return -1;
+                byte = *ip++;
+                length += byte;
+            } while(byte == 255);
+        }
+        length += LZ4_MIN_MATCH;
+        if(length > (size_t)(out_end - op))
+            return -1;
+
+        const uint8_t *ref = op - offset;
+        if(offset >= length)
+            memcpy(op, ref, length);
+        else // Overlapping match, repeating the last offset bytes
+            for(size_t i_byte = 0; i_byte < length; ++i_byte)
+                op[i_byte] = ref[i_byte];
+        op += length;
+    }
+
+    return op == out_end ? 0 : -1;
+}
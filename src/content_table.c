@@ -0,0 +1,138 @@
+#include "content_table.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Content table entry with its name hash, to sort the records
+typedef struct _table_sort_item
+{
+    uint64_t name_hash;
+    const osp_cnt_table_entry_t *entry;
+} table_sort_item_t;
+
+static int table_sort_compare(const void *a, const void *b)
+{
+    const table_sort_item_t *item_a = (const table_sort_item_t *)a;
+    const table_sort_item_t *item_b = (const table_sort_item_t *)b;
+
+    if(item_a->name_hash != item_b->name_hash)
+        return item_a->name_hash < item_b->name_hash ? -1 : 1;
+    return strcmp(item_a->entry->name, item_b->entry->name);
+}
+
+// Bucket of a name hash, selected by its top bits
+static inline uint64_t table_bucket(uint64_t name_hash, uint32_t bucket_bits)
+{
+    return bucket_bits > 0 ? name_hash >> (64 - bucket_bits) : 0;
+}
+
+// Pad the writer position up to the next multiple of alignment
+static void table_align(osp_writer_t writer, uint64_t alignment)
+{
+    uint64_t misalignment = osp_writer_tell(writer) % alignment;
+    if(misalignment != 0)
+        osp_writer_put_zeros(writer, alignment - misalignment);
+}
+
+uint64_t osp_cnt_write_table(osp_writer_t writer,
+                             const osp_cnt_table_entry_t *entries,
+                             uint32_t count)
+{
+    table_align(writer, sizeof(uint64_t));
+    uint64_t table_pos = osp_writer_tell(writer);
+
+    // Sort the entries by name hash, ties broken by name so the layout
+    // doesn't depend on the processing order
+    table_sort_item_t *items =
+        malloc(sizeof(table_sort_item_t) * (count > 0 ? count : 1));
+    uint64_t strings_size = 0;
+    for(uint32_t i_entry = 0; i_entry < count; ++i_entry)
+    {
+        size_t name_length = strlen(entries[i_entry].name);
+        items[i_entry].name_hash = osp_hash64(entries[i_entry].name,
+                                              name_length, 0);
+        items[i_entry].entry = &(entries[i_entry]);
+        strings_size += name_length + 1;
+    }
+    qsort(items, count, sizeof(table_sort_item_t), table_sort_compare);
+
+    // Around one record per bucket
+    uint32_t bucket_bits = 0;
+    while(bucket_bits < 32 && ((uint64_t)1 << bucket_bits) < count)
+        ++bucket_bits;
+    uint64_t num_buckets = (uint64_t)1 << bucket_bits;
+
+    uint64_t records_offset = sizeof(osp_cnt_table_header_t);
+    uint64_t buckets_offset =
+        records_offset + (uint64_t)count * sizeof(osp_cnt_table_record_t);
+    uint64_t strings_offset =
+        buckets_offset + (num_buckets + 1) * sizeof(uint32_t);
+
+    // Header, field by field to keep the file little endian
+    osp_writer_put_bytes(writer, OSP_CNT_TABLE_MAGIC, 4);
+    osp_writer_put_u16(writer, OSP_CNT_TABLE_VERSION);
+    osp_writer_put_u16(writer, sizeof(osp_cnt_table_record_t));
+    osp_writer_put_u32(writer, count);
+    osp_writer_put_u32(writer, bucket_bits);
+    osp_writer_put_u64(writer, records_offset);
+    osp_writer_put_u64(writer, buckets_offset);
+    osp_writer_put_u64(writer, strings_offset);
+    osp_writer_put_u64(writer, strings_size);
+
+    // Records, with names laid out in the string pool in the same order
+    uint32_t name_offset = 0;
+    for(uint32_t i_entry = 0; i_entry < count; ++i_entry)
+    {
+        const osp_cnt_table_entry_t *entry = items[i_entry].entry;
+        uint32_t name_length = (uint32_t)strlen(entry->name);
+
+        osp_writer_put_u64(writer, items[i_entry].name_hash);
+        osp_writer_put_u64(writer, entry->start);
+        osp_writer_put_u64(writer, entry->size);
+        osp_writer_put_u64(writer, entry->raw_size);
+        osp_writer_put_u32(writer, name_offset);
+        osp_writer_put_u32(writer, name_length);
+        osp_writer_put_u8(writer, entry->type);
+        osp_writer_put_u8(writer, entry->codec);
+        osp_writer_put_zeros(writer, sizeof(((osp_cnt_table_record_t *)0)->reserved));
+        name_offset += name_length + 1;
+    }
+
+    // Bucket directory, the first record of every bucket and the records end
+    uint32_t i_record = 0;
+    for(uint64_t i_bucket = 0; i_bucket < num_buckets; ++i_bucket)
+    {
+        while(i_record < count &&
+              table_bucket(items[i_record].name_hash, bucket_bits) < i_bucket)
+            ++i_record;
+        osp_writer_put_u32(writer, i_record);
+    }
+    osp_writer_put_u32(writer, count);
+
+    // String pool
+    for(uint32_t i_entry = 0; i_entry < count; ++i_entry)
+        osp_writer_put_bytes(writer, items[i_entry].entry->name,
+                             strlen(items[i_entry].entry->name) + 1);
+
+    free(items);
+    return table_pos;
+}
+
+uint64_t osp_cnt_write_legacy_table(osp_writer_t writer,
+                                    const osp_cnt_table_entry_t *entries,
+                                    uint32_t count)
+{
+    uint64_t table_pos = osp_writer_tell(writer);
+
+    // Write the content table size, followed by each entry sequentially
+    osp_writer_put_u32(writer, count);
+    for(uint32_t i_entry = 0; i_entry < count; ++i_entry)
+    {
+        osp_writer_put_string(writer, entries[i_entry].name);
+        osp_writer_put_u8(writer, entries[i_entry].type);
+        osp_writer_put_u64(writer, entries[i_entry].start);
+        osp_writer_put_u64(writer, entries[i_entry].size);
+    }
+
+    return table_pos;
+}
@@ -1,4 +1,5 @@
 #include "dynarray.h"
+#include "mem.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -17,9 +18,9 @@ void osp_dynarray_grow(osp_dynarray_t array)
     if(array == NULL)
         return;
 
-    void *new_array = calloc(array->capacity + array->increment, array->element_size);
+    void *new_array = osp_mem_calloc(array->capacity + array->increment, array->element_size);
     memcpy(new_array, array->data, array->capacity * array->element_size);
-    free(array->data);
+    osp_mem_free(array->data);
     array->data = new_array;
     array->capacity += array->increment;
 }
@@ -33,11 +34,11 @@ osp_dynarray_t osp_dynarray_new(const size_t element_size, const size_t initial_
     if(real_increment <= 0)
         real_increment = 1;
 
-    osp_dynarray_t array = (osp_dynarray_t)calloc(1, sizeof(struct _osp_dynarray));
+    osp_dynarray_t array = (osp_dynarray_t)osp_mem_calloc(1, sizeof(struct _osp_dynarray));
     array->element_size = element_size;
     array->capacity = initial_capacity;
     array->increment = real_increment;
-    array->data = calloc(array->capacity, array->element_size);
+    array->data = osp_mem_calloc(array->capacity, array->element_size);
     array->count = 0;
 
     return array;
@@ -128,14 +129,14 @@ void osp_dynarray_delete(osp_dynarray_t array)
         return;
 
     if(array->data != NULL)
-        free(array->data);
+        osp_mem_free(array->data);
 
     array->capacity = 0;
     array->count = 0;
     array->element_size = 0;
     array->increment = 0;
 
-    free(array);
+    osp_mem_free(array);
 }
 
 void *osp_dynarray_fwd_iter_start(osp_dynarray_t array)
@@ -0,0 +1,134 @@
+#include "hashmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct _osp_hashmap
+{
+    uint64_t *keys;
+    uint64_t *values;
+    uint8_t *used;
+    size_t capacity;
+    size_t count;
+};
+
+// Keys are expected to be hashes already, but mix them once more so
+// sequential keys don't end up in long probing runs.
+static inline size_t osp_hashmap_home(osp_hashmap_t map, uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    return (size_t)key & (map->capacity - 1);
+}
+
+void osp_hashmap_alloc(osp_hashmap_t map, size_t capacity)
+{
+    map->capacity = capacity;
+    map->keys = malloc(capacity * sizeof(uint64_t));
+    map->values = malloc(capacity * sizeof(uint64_t));
+    map->used = calloc(capacity, sizeof(uint8_t));
+    map->count = 0;
+}
+
+void osp_hashmap_grow(osp_hashmap_t map)
+{
+    uint64_t *old_keys = map->keys;
+    uint64_t *old_values = map->values;
+    uint8_t *old_used = map->used;
+    size_t old_capacity = map->capacity;
+
+    osp_hashmap_alloc(map, old_capacity * 2);
+    for(size_t i_slot = 0; i_slot < old_capacity; ++i_slot)
+        if(old_used[i_slot])
+            osp_hashmap_insert(map, old_keys[i_slot], old_values[i_slot]);
+
+    free(old_keys);
+    free(old_values);
+    free(old_used);
+}
+
+osp_hashmap_t osp_hashmap_new(const size_t initial_capacity)
+{
+    // Capacity is always a power of two, so slots can be masked
+    size_t capacity = 16;
+    while(capacity < initial_capacity * 2)
+        capacity *= 2;
+
+    osp_hashmap_t map = (osp_hashmap_t)calloc(1, sizeof(struct _osp_hashmap));
+    osp_hashmap_alloc(map, capacity);
+
+    return map;
+}
+
+void osp_hashmap_insert(osp_hashmap_t map, uint64_t key, uint64_t value)
+{
+    if(map == NULL)
+        return;
+
+    // Keep the load factor under 50%, probing runs stay short
+    if((map->count + 1) * 2 > map->capacity)
+        osp_hashmap_grow(map);
+
+    size_t slot = osp_hashmap_home(map, key);
+    while(map->used[slot])
+        slot = (slot + 1) & (map->capacity - 1);
+
+    map->keys[slot] = key;
+    map->values[slot] = value;
+    map->used[slot] = 1;
+    map->count++;
+}
+
+uint8_t osp_hashmap_find(osp_hashmap_t map, uint64_t key, size_t *cursor, uint64_t *value)
+{
+    if(map == NULL || cursor == NULL)
+        return 0;
+
+    // The cursor is the probing distance from the key home slot, so the
+    // next call starts right after the previously found value.
+    size_t home = osp_hashmap_home(map, key);
+    while(*cursor < map->capacity)
+    {
+        size_t slot = (home + *cursor) & (map->capacity - 1);
+        if(!map->used[slot])
+            return 0;
+
+        ++(*cursor);
+        if(map->keys[slot] == key)
+        {
+            if(value != NULL)
+                *value = map->values[slot];
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+size_t osp_hashmap_get_count(osp_hashmap_t map)
+{
+    if(map == NULL)
+        return 0;
+
+    return map->count;
+}
+
+void osp_hashmap_clear(osp_hashmap_t map)
+{
+    if(map == NULL)
+        return;
+
+    memset(map->used, 0, map->capacity);
+    map->count = 0;
+}
+
+void osp_hashmap_delete(osp_hashmap_t map)
+{
+    if(map == NULL)
+        return;
+
+    free(map->keys);
+    free(map->values);
+    free(map->used);
+    free(map);
+}
@@ -0,0 +1,222 @@
+#include "input.h"
+#include "hash.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Files smaller than this are just read, mapping them costs more than
+// copying them.
+#define INPUT_MIN_MAPPED_SIZE (64 * 1024)
+// Read chunk size for inputs of unknown size
+#define INPUT_READ_CHUNK (64 * 1024)
+// Maximum dependency path length
+#define INPUT_MAX_PATH 4096
+
+static const char empty_input[1] = { '\0' };
+
+int input_map(osp_input_t *input, int fd, size_t size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    // Reserve room for the file and at least one more zero byte...
+    size_t mapping_size = (size + 1 + page_size - 1) & ~(page_size - 1);
+    void *mapping = mmap(NULL, mapping_size, PROT_READ,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED)
+        return -1;
+
+    // ...then map the file over the start of the reserved range. The rest
+    // of the last file page is zero filled by the kernel, and if the file
+    // ends on a page boundary the next page is still the anonymous one.
+    if(mmap(mapping, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+       MAP_FAILED)
+    {
+        munmap(mapping, mapping_size);
+        return -1;
+    }
+
+    // Parsers go through the input front to back
+    madvise(mapping, size, MADV_SEQUENTIAL);
+
+    input->mapping = mapping;
+    input->mapping_size = mapping_size;
+    input->data = (const char *)mapping;
+    input->size = size;
+
+    return 0;
+}
+
+int input_read(osp_input_t *input, int fd, size_t size_hint)
+{
+    size_t capacity = size_hint > 0 ? size_hint + 1 : INPUT_READ_CHUNK;
+    size_t size = 0;
+    char *buffer = osp_mem_malloc(capacity);
+
+    // Read until the end of the stream, the size hint can be wrong for
+    // files being written to and it's missing for pipes.
+    for(;;)
+    {
+        if(size + 1 >= capacity)
+        {
+            capacity *= 2;
+            buffer = osp_mem_realloc(buffer, capacity);
+        }
+
+        ssize_t read_size = read(fd, buffer + size, capacity - size - 1);
+        if(read_size < 0)
+        {
+            osp_mem_free(buffer);
+            return -1;
+        }
+        if(read_size == 0)
+            break;
+
+        size += read_size;
+    }
+
+    buffer[size] = '\0';
+    input->buffer = buffer;
+    input->data = buffer;
+    input->size = size;
+
+    return 0;
+}
+
+int osp_input_open_fd(osp_input_t *input, int fd, const char *path)
+{
+    memset(input, 0, sizeof(osp_input_t));
+    input->path = path;
+    input->data = empty_input;
+    input->dependencies =
+        osp_dynarray_new(sizeof(osp_input_dependency_t), 4, 16);
+
+    struct stat input_stat;
+    if(fstat(fd, &input_stat) != 0)
+        return -1;
+
+    if(!S_ISREG(input_stat.st_mode))
+        return input_read(input, fd, 0);
+
+    input->mtime = (int64_t)input_stat.st_mtim.tv_sec * 1000000000 +
+                   input_stat.st_mtim.tv_nsec;
+
+    size_t size = (size_t)input_stat.st_size;
+    if(size == 0)
+        return 0;
+
+    if(size >= INPUT_MIN_MAPPED_SIZE && input_map(input, fd, size) == 0)
+        return 0;
+
+    return input_read(input, fd, size);
+}
+
+int osp_input_open(osp_input_t *input, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        memset(input, 0, sizeof(osp_input_t));
+        input->data = empty_input;
+        input->dependencies =
+            osp_dynarray_new(sizeof(osp_input_dependency_t), 4, 16);
+        return -1;
+    }
+
+    int result = osp_input_open_fd(input, fd, path);
+    close(fd);
+
+    return result;
+}
+
+void osp_input_from_memory(osp_input_t *input, const char *data, size_t size)
+{
+    memset(input, 0, sizeof(osp_input_t));
+    input->data = data;
+    input->size = size;
+    input->dependencies =
+        osp_dynarray_new(sizeof(osp_input_dependency_t), 4, 16);
+}
+
+int osp_input_open_dependency(const osp_input_t *input,
+                              osp_input_t *dependency,
+                              const char *relative_path)
+{
+    // The dependency path is relative to the input directory
+    char path[INPUT_MAX_PATH];
+    const char *last_slash =
+        input->path != NULL ? strrchr(input->path, '/') : NULL;
+    if(last_slash != NULL)
+        snprintf(path, INPUT_MAX_PATH, "%.*s/%s",
+                 (int)(last_slash - input->path), input->path, relative_path);
+    else
+        snprintf(path, INPUT_MAX_PATH, "%s", relative_path);
+
+    osp_input_dependency_t record = { .path = strdup(path) };
+    if(osp_input_open(dependency, record.path) != 0)
+    {
+        free(record.path);
+        return -1;
+    }
+
+    // Remember what was read, to tell later if the file changed
+    record.size = dependency->size;
+    record.mtime = dependency->mtime;
+    record.content_hash = osp_hash64(dependency->data, dependency->size, 0);
+    osp_dynarray_add(input->dependencies, &record);
+
+    return 0;
+}
+
+uint8_t osp_input_dependency_unchanged(const osp_input_dependency_t *dependency)
+{
+    struct stat dependency_stat;
+    if(stat(dependency->path, &dependency_stat) != 0 ||
+       (uint64_t)dependency_stat.st_size != dependency->size)
+        return 0;
+
+    int64_t mtime = (int64_t)dependency_stat.st_mtim.tv_sec * 1000000000 +
+                    dependency_stat.st_mtim.tv_nsec;
+    if(mtime == dependency->mtime)
+        return 1;
+
+    // Touched, but maybe not changed
+    osp_input_t input;
+    uint8_t unchanged = osp_input_open(&input, dependency->path) == 0 &&
+        osp_hash64(input.data, input.size, 0) == dependency->content_hash;
+    osp_input_close(&input);
+
+    return unchanged;
+}
+
+void osp_input_free_dependencies(osp_dynarray_t dependencies)
+{
+    if(dependencies == NULL)
+        return;
+
+    osp_input_dependency_t *records =
+        (osp_input_dependency_t *)osp_dynarray_get_data(dependencies);
+    for(size_t i_record = 0;
+        i_record < osp_dynarray_get_count(dependencies);
+        ++i_record)
+        free(records[i_record].path);
+    osp_dynarray_delete(dependencies);
+}
+
+void osp_input_close(osp_input_t *input)
+{
+    if(input->mapping != NULL)
+        munmap(input->mapping, input->mapping_size);
+    osp_mem_free(input->buffer);
+
+    osp_input_free_dependencies(input->dependencies);
+
+    input->mapping = NULL;
+    input->buffer = NULL;
+    input->dependencies = NULL;
+    input->data = empty_input;
+    input->size = 0;
+}
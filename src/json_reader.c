@@ -0,0 +1,424 @@
+#include "json_reader.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Containers nested deeper than this are an error
+#define JSON_READER_MAX_DEPTH 1024
+// Longest number text, as cJSON
+#define JSON_READER_MAX_NUMBER 64
+
+struct _osp_json_reader
+{
+    const char *data;
+    size_t size;
+    size_t position;
+    // Open containers, 1 for objects and 0 for arrays
+    uint8_t containers[JSON_READER_MAX_DEPTH];
+    uint32_t depth;
+    // Set when the next string of the current object is a key
+    uint8_t key_next;
+    // Set when a value of the current container was just read, so a
+    // separator or the container end must come next
+    uint8_t value_read;
+    osp_json_token_t last_token;
+    // Last string or key, unescaped and zero terminated
+    char *string;
+    size_t string_length;
+    size_t string_capacity;
+    // Last number
+    double number;
+};
+
+static inline osp_json_token_t json_reader_fail(osp_json_reader_t reader)
+{
+    reader->last_token = OSP_JSON_ERROR;
+    return OSP_JSON_ERROR;
+}
+
+static inline void json_reader_skip_whitespace(osp_json_reader_t reader)
+{
+    while(reader->position < reader->size &&
+          (reader->data[reader->position] == ' ' ||
+           reader->data[reader->position] == '\n' ||
+           reader->data[reader->position] == '\r' ||
+           reader->data[reader->position] == '\t'))
+        ++reader->position;
+}
+
+static inline void json_reader_append(osp_json_reader_t reader,
+                                      const char *data,
+                                      size_t size)
+{
+    if(reader->string_length + size + 1 > reader->string_capacity)
+    {
+        while(reader->string_length + size + 1 > reader->string_capacity)
+            reader->string_capacity *= 2;
+        reader->string = osp_mem_realloc(reader->string,
+                                         reader->string_capacity);
+    }
+    memcpy(reader->string + reader->string_length, data, size);
+    reader->string_length += size;
+}
+
+static inline int32_t json_reader_hex4(const char *data)
+{
+    int32_t value = 0;
+    for(int i_digit = 0; i_digit < 4; ++i_digit)
+    {
+        char digit = data[i_digit];
+        value <<= 4;
+        if(digit >= '0' && digit <= '9')
+            value |= digit - '0';
+        else if(digit >= 'a' && digit <= 'f')
+            value |= digit - 'a' + 10;
+        else if(digit >= 'A' && digit <= 'F')
+            value |= digit - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+uint8_t json_reader_parse_unicode(osp_json_reader_t reader)
+{
+    // position is on the u of \uXXXX
+    if(reader->position + 5 > reader->size)
+        return 0;
+    int32_t code = json_reader_hex4(reader->data + reader->position + 1);
+    reader->position += 5;
+    if(code < 0 || (code >= 0xDC00 && code <= 0xDFFF))
+        return 0;
+
+    // UTF-16 surrogate pairs are a single code point
+    if(code >= 0xD800 && code <= 0xDBFF)
+    {
+        if(reader->position + 6 > reader->size ||
+           reader->data[reader->position] != '\\' ||
+           reader->data[reader->position + 1] != 'u')
+            return 0;
+        int32_t low = json_reader_hex4(reader->data + reader->position + 2);
+        if(low < 0xDC00 || low > 0xDFFF)
+            return 0;
+        code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+        reader->position += 6;
+    }
+
+    char utf8[4];
+    size_t length;
+    if(code < 0x80)
+    {
+        utf8[0] = (char)code;
+        length = 1;
+    }
+    else if(code < 0x800)
+    {
+        utf8[0] = (char)(0xC0 | (code >> 6));
+        utf8[1] = (char)(0x80 | (code & 0x3F));
+        length = 2;
+    }
+    else if(code < 0x10000)
+    {
+        utf8[0] = (char)(0xE0 | (code >> 12));
+        utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (code & 0x3F));
+        length = 3;
+    }
+    else
+    {
+        utf8[0] = (char)(0xF0 | (code >> 18));
+        utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (code & 0x3F));
+        length = 4;
+    }
+    json_reader_append(reader, utf8, length);
+
+    return 1;
+}
+
+uint8_t json_reader_parse_string(osp_json_reader_t reader)
+{
+    // Skip the opening quote
+    ++reader->position;
+    reader->string_length = 0;
+    for(;;)
+    {
+        // Copy everything up to the next quote or escape at once
+        size_t start = reader->position;
+        while(reader->position < reader->size &&
+              reader->data[reader->position] != '"' &&
+              reader->data[reader->position] != '\\')
+            ++reader->position;
+        json_reader_append(reader, reader->data + start,
+                           reader->position - start);
+        if(reader->position + 1 >= reader->size &&
+           (reader->position >= reader->size ||
+            reader->data[reader->position] != '"'))
+            return 0;
+
+        if(reader->data[reader->position] == '"')
+        {
+            ++reader->position;
+            reader->string[reader->string_length] = '\0';
+            return 1;
+        }
+
+        // An escape sequence
+        char escaped = reader->data[++reader->position];
+        char unescaped;
+        switch(escaped)
+        {
+            case 'b': unescaped = '\b'; break;
+            case 'f': unescaped = '\f'; break;
+            case 'n': unescaped = '\n'; break;
+            case 'r': unescaped = '\r'; break;
+            case 't': unescaped = '\t'; break;
+            case '"':
+            case '\\':
+            case '/': unescaped = escaped; break;
+            case 'u':
+                if(!json_reader_parse_unicode(reader))
+                    return 0;
+                continue;
+            default:
+                return 0;
+        }
+        json_reader_append(reader, &unescaped, 1);
+        ++reader->position;
+    }
+}
+
+uint8_t json_reader_parse_number(osp_json_reader_t reader)
+{
+    // Copy the number text to terminate it, the input might not be
+    char number[JSON_READER_MAX_NUMBER];
+    size_t length = 0;
+    while(length < JSON_READER_MAX_NUMBER - 1 &&
+          reader->position + length < reader->size)
+    {
+        char c = reader->data[reader->position + length];
+        if(!((c >= '0' && c <= '9') ||
+             c == '+' || c == '-' || c == '.' || c == 'e' || c == 'E'))
+            break;
+        number[length++] = c;
+    }
+    number[length] = '\0';
+
+    char *end;
+    reader->number = strtod(number, &end);
+    if(end == number)
+        return 0;
+    reader->position += end - number;
+
+    return 1;
+}
+
+static inline uint8_t json_reader_parse_literal(osp_json_reader_t reader,
+                                                const char *literal,
+                                                size_t length)
+{
+    if(reader->position + length > reader->size ||
+       memcmp(reader->data + reader->position, literal, length) != 0)
+        return 0;
+    reader->position += length;
+    return 1;
+}
+
+osp_json_reader_t osp_json_reader_new(const char *data, size_t size)
+{
+    osp_json_reader_t reader = (osp_json_reader_t)osp_mem_calloc(
+        1, sizeof(struct _osp_json_reader));
+    reader->data = data;
+    reader->size = size;
+    reader->last_token = OSP_JSON_END;
+    reader->string_capacity = 256;
+    reader->string = osp_mem_malloc(reader->string_capacity);
+    reader->string[0] = '\0';
+
+    // Skip the UTF-8 byte order mark, as cJSON
+    if(size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0)
+        reader->position = 3;
+
+    return reader;
+}
+
+osp_json_token_t osp_json_reader_next(osp_json_reader_t reader)
+{
+    if(reader->last_token == OSP_JSON_ERROR)
+        return OSP_JSON_ERROR;
+
+    // Exactly one separator between values, as cJSON, a key follows it
+    // inside objects
+    json_reader_skip_whitespace(reader);
+    if(reader->position < reader->size && reader->depth > 0)
+    {
+        char next = reader->data[reader->position];
+        if(next == ',')
+        {
+            if(!reader->value_read)
+                return json_reader_fail(reader);
+            ++reader->position;
+            reader->value_read = 0;
+            reader->key_next = reader->containers[reader->depth - 1];
+            json_reader_skip_whitespace(reader);
+            // No trailing separator
+            if(reader->position < reader->size &&
+               (reader->data[reader->position] == '}' ||
+                reader->data[reader->position] == ']'))
+                return json_reader_fail(reader);
+        }
+        else if(reader->value_read && next != '}' && next != ']')
+            return json_reader_fail(reader);
+    }
+
+    if(reader->position >= reader->size)
+    {
+        if(reader->depth > 0)
+            return json_reader_fail(reader);
+        reader->last_token = OSP_JSON_END;
+        return OSP_JSON_END;
+    }
+
+    osp_json_token_t token;
+    char c = reader->data[reader->position];
+    // Object members start with their key, and a key needs its value
+    if((reader->key_next && c != '"' && c != '}') ||
+       (reader->last_token == OSP_JSON_KEY && (c == '}' || c == ']')))
+        return json_reader_fail(reader);
+    switch(c)
+    {
+        case '{':
+        case '[':
+            if(reader->depth >= JSON_READER_MAX_DEPTH)
+                return json_reader_fail(reader);
+            reader->containers[reader->depth++] = c == '{';
+            reader->key_next = c == '{';
+            reader->value_read = 0;
+            ++reader->position;
+            token = c == '{' ? OSP_JSON_OBJECT : OSP_JSON_ARRAY;
+        break;
+        case '}':
+        case ']':
+            if(reader->depth == 0 ||
+               reader->containers[reader->depth - 1] != (c == '}'))
+                return json_reader_fail(reader);
+            --reader->depth;
+            reader->key_next = 0;
+            ++reader->position;
+            token = c == '}' ? OSP_JSON_OBJECT_END : OSP_JSON_ARRAY_END;
+        break;
+        case '"':
+            if(!json_reader_parse_string(reader))
+                return json_reader_fail(reader);
+            token = OSP_JSON_STRING;
+            if(reader->key_next)
+            {
+                // Keys are followed by their value
+                reader->key_next = 0;
+                json_reader_skip_whitespace(reader);
+                if(reader->position >= reader->size ||
+                   reader->data[reader->position] != ':')
+                    return json_reader_fail(reader);
+                ++reader->position;
+                token = OSP_JSON_KEY;
+            }
+        break;
+        case 't':
+            if(!json_reader_parse_literal(reader, "true", 4))
+                return json_reader_fail(reader);
+            token = OSP_JSON_TRUE;
+        break;
+        case 'f':
+            if(!json_reader_parse_literal(reader, "false", 5))
+                return json_reader_fail(reader);
+            token = OSP_JSON_FALSE;
+        break;
+        case 'n':
+            if(!json_reader_parse_literal(reader, "null", 4))
+                return json_reader_fail(reader);
+            token = OSP_JSON_NULL;
+        break;
+        default:
+            if(!json_reader_parse_number(reader))
+                return json_reader_fail(reader);
+            token = OSP_JSON_NUMBER;
+        break;
+    }
+
+    // Everything but keys and container starts completes a value
+    if(token != OSP_JSON_KEY && token != OSP_JSON_OBJECT &&
+       token != OSP_JSON_ARRAY)
+        reader->value_read = 1;
+
+    reader->last_token = token;
+    return token;
+}
+
+void osp_json_reader_skip(osp_json_reader_t reader)
+{
+    if(reader->last_token != OSP_JSON_OBJECT &&
+       reader->last_token != OSP_JSON_ARRAY)
+        return;
+
+    // Only brackets outside of strings matter, nothing is parsed
+    const char *data = reader->data;
+    size_t position = reader->position;
+    uint32_t depth = 1;
+    while(position < reader->size)
+    {
+        char c = data[position++];
+        if(c == '"')
+        {
+            while(position < reader->size && data[position] != '"')
+                position += data[position] == '\\' ? 2 : 1;
+            ++position;
+        }
+        else if(c == '{' || c == '[')
+            ++depth;
+        else if((c == '}' || c == ']') && --depth == 0)
+        {
+            reader->position = position;
+            --reader->depth;
+            reader->key_next = 0;
+            reader->value_read = 1;
+            reader->last_token = c == '}' ? OSP_JSON_OBJECT_END
+                                          : OSP_JSON_ARRAY_END;
+            return;
+        }
+    }
+
+    reader->position = reader->size;
+    json_reader_fail(reader);
+}
+
+const char *osp_json_reader_get_string(osp_json_reader_t reader, size_t *length)
+{
+    if(length != NULL)
+        *length = reader->string_length;
+    return reader->string;
+}
+
+uint8_t osp_json_reader_string_equals(osp_json_reader_t reader, const char *string)
+{
+    return strcmp(reader->string, string) == 0;
+}
+
+double osp_json_reader_get_number(osp_json_reader_t reader)
+{
+    return reader->number;
+}
+
+size_t osp_json_reader_tell(osp_json_reader_t reader)
+{
+    return reader->position;
+}
+
+void osp_json_reader_delete(osp_json_reader_t reader)
+{
+    if(reader == NULL)
+        return;
+
+    osp_mem_free(reader->string);
+    osp_mem_free(reader);
+}
@@ -0,0 +1,950 @@
+#include "json_tape.h"
+#include "mem.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define JSON_TAPE_AVX2
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define JSON_TAPE_SSE2
+#endif
+
+// Containers nested deeper than this are an error
+#define JSON_TAPE_MAX_DEPTH 1024
+// Longest number text, as cJSON
+#define JSON_TAPE_MAX_NUMBER 64
+// Longest integer read without strtod, its value fits a tape word payload
+#define JSON_TAPE_MAX_INTEGER_DIGITS 15
+
+// Tape words are a type in the top byte and a payload:
+//  - containers take 2 words, the type with the position after their end
+//    (the int32_t buffer offset for int32_t arrays) then their count, and
+//    their items are followed by an end word
+//  - keys and strings are their strings buffer offset
+//  - integers are their value, other numbers their doubles buffer offset
+#define TAPE_TYPE_SHIFT 56
+#define TAPE_PAYLOAD_MASK ((1ull << TAPE_TYPE_SHIFT) - 1)
+
+enum tape_word
+{
+    TAPE_ROOT = 1,
+    TAPE_NULL,
+    TAPE_FALSE,
+    TAPE_TRUE,
+    TAPE_INTEGER,
+    TAPE_NUMBER,
+    TAPE_STRING,
+    TAPE_KEY,
+    TAPE_ARRAY,
+    TAPE_INT32_ARRAY,
+    TAPE_OBJECT,
+    TAPE_COUNT,
+    TAPE_END
+};
+
+struct _osp_json_tape
+{
+    uint64_t *words;
+    size_t num_words;
+    size_t words_capacity;
+    char *strings;
+    size_t strings_size;
+    size_t strings_capacity;
+    double *numbers;
+    size_t num_numbers;
+    size_t numbers_capacity;
+    int32_t *ints;
+    size_t num_ints;
+    size_t ints_capacity;
+};
+
+// Open container while building the tape
+struct tape_container
+{
+    size_t header;
+    size_t count;
+    uint8_t is_object;
+    // Set while every item of an array is an int32_t, kept in the ints buffer
+    uint8_t ints_only;
+    size_t first_int;
+};
+
+struct tape_parser
+{
+    osp_json_tape_t tape;
+    const char *data;
+    size_t size;
+    // Structural character positions, then the document size
+    uint32_t *indices;
+    size_t num_indices;
+    size_t indices_capacity;
+    struct tape_container *containers;
+    uint32_t depth;
+};
+
+// Stage 1: structural characters
+
+// A 64 bytes block, 1 bit per byte
+struct block_masks
+{
+    uint64_t quote;
+    uint64_t backslash;
+    // {}[]:,
+    uint64_t operators;
+};
+
+typedef void (*classify_block_t)(const uint8_t *block, struct block_masks *masks);
+
+void json_tape_classify_block_scalar(const uint8_t *block, struct block_masks *masks)
+{
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t operators = 0;
+    for(int i_byte = 0; i_byte < 64; ++i_byte)
+    {
+        uint8_t c = block[i_byte];
+        uint8_t folded = c | 0x20;
+        quote |= (uint64_t)(c == '"') << i_byte;
+        backslash |= (uint64_t)(c == '\\') << i_byte;
+        operators |= (uint64_t)(c == ':' || c == ',' ||
+                                folded == '{' || folded == '}') << i_byte;
+    }
+    masks->quote = quote;
+    masks->backslash = backslash;
+    masks->operators = operators;
+}
+
+#ifdef JSON_TAPE_SSE2
+void json_tape_classify_block_sse2(const uint8_t *block, struct block_masks *masks)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    // [ and ] are { and } without the 0x20 bit
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+
+    *masks = (struct block_masks){ 0 };
+    for(int i_part = 0; i_part < 4; ++i_part)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(block + i_part * 16));
+        __m128i folded = _mm_or_si128(bytes, case_bit);
+        __m128i operators = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, colon),
+                         _mm_cmpeq_epi8(bytes, comma)),
+            _mm_or_si128(_mm_cmpeq_epi8(folded, open),
+                         _mm_cmpeq_epi8(folded, close)));
+        int shift = i_part * 16;
+        masks->quote |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(bytes, quote)) << shift;
+        masks->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(bytes, backslash)) << shift;
+        masks->operators |= (uint64_t)(uint16_t)_mm_movemask_epi8(operators)
+            << shift;
+    }
+}
+#endif
+
+#ifdef JSON_TAPE_AVX2
+__attribute__((target("avx2")))
+void json_tape_classify_block_avx2(const uint8_t *block, struct block_masks *masks)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+
+    *masks = (struct block_masks){ 0 };
+    for(int i_part = 0; i_part < 2; ++i_part)
+    {
+        __m256i bytes =
+            _mm256_loadu_si256((const __m256i *)(block + i_part * 32));
+        __m256i folded = _mm256_or_si256(bytes, case_bit);
+        __m256i operators = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, colon),
+                            _mm256_cmpeq_epi8(bytes, comma)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(folded, open),
+                            _mm256_cmpeq_epi8(folded, close)));
+        int shift = i_part * 32;
+        masks->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(bytes, quote)) << shift;
+        masks->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(bytes, backslash)) << shift;
+        masks->operators |= (uint64_t)(uint32_t)_mm256_movemask_epi8(operators)
+            << shift;
+    }
+}
+#endif
+
+classify_block_t json_tape_select_block_classifier()
+{
+#ifdef JSON_TAPE_AVX2
+    if(__builtin_cpu_supports("avx2"))
+        return &json_tape_classify_block_avx2;
+#endif
+#ifdef JSON_TAPE_SSE2
+    return &json_tape_classify_block_sse2;
+#else
+    return &json_tape_classify_block_scalar;
+#endif
+}
+
+// Bit i set if an odd number of bits up to i are set
+static inline uint64_t prefix_xor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+void json_tape_index_structurals(struct tape_parser *parser)
+{
+    const uint8_t *data = (const uint8_t *)parser->data;
+    classify_block_t classify_block = json_tape_select_block_classifier();
+    const uint64_t even_bits = 0x5555555555555555ull;
+    // Carried over from the previous block
+    uint64_t prev_escaped = 0;
+    uint64_t prev_in_string = 0;
+    uint8_t last_block[64];
+
+    for(size_t base = 0; base < parser->size; base += 64)
+    {
+        const uint8_t *block = data + base;
+        if(parser->size - base < 64)
+        {
+            memset(last_block, ' ', 64);
+            memcpy(last_block, block, parser->size - base);
+            block = last_block;
+        }
+        struct block_masks masks;
+        classify_block(block, &masks);
+
+        // Characters escaped by an odd backslashes sequence: sequences
+        // starting on odd bits are added to carry into the bit after them,
+        // which flips the even bits mask for those
+        uint64_t backslash = masks.backslash & ~prev_escaped;
+        uint64_t follows_escape = (backslash << 1) | prev_escaped;
+        uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+        uint64_t even_sequences = odd_starts + backslash;
+        prev_escaped = even_sequences < odd_starts;
+        uint64_t escaped = (even_bits ^ (even_sequences << 1)) & follows_escape;
+
+        // Strings are between unescaped quotes, their content is not
+        // structural
+        uint64_t quote = masks.quote & ~escaped;
+        uint64_t in_string = prefix_xor(quote) ^ prev_in_string;
+        prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+        uint64_t structurals = (masks.operators & ~in_string) | quote;
+
+        if(parser->num_indices + 65 > parser->indices_capacity)
+        {
+            parser->indices_capacity *= 2;
+            parser->indices = osp_mem_realloc(
+                parser->indices, sizeof(uint32_t) * parser->indices_capacity);
+        }
+        uint32_t *indices = parser->indices + parser->num_indices;
+        parser->num_indices += __builtin_popcountll(structurals);
+        while(structurals != 0)
+        {
+            *(indices++) = (uint32_t)(base + __builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+
+    // The document end stops the last value, a string left open has no
+    // closing quote to find
+    parser->indices[parser->num_indices] = (uint32_t)parser->size;
+}
+
+// Stage 2: the tape
+
+static inline void json_tape_put(osp_json_tape_t tape, uint64_t type, uint64_t payload)
+{
+    if(tape->num_words == tape->words_capacity)
+    {
+        tape->words_capacity *= 2;
+        tape->words = osp_mem_realloc(tape->words,
+                                      sizeof(uint64_t) * tape->words_capacity);
+    }
+    tape->words[tape->num_words++] = (type << TAPE_TYPE_SHIFT) |
+                                     (payload & TAPE_PAYLOAD_MASK);
+}
+
+static inline void json_tape_put_double(osp_json_tape_t tape, double number)
+{
+    if(tape->num_numbers == tape->numbers_capacity)
+    {
+        tape->numbers_capacity *= 2;
+        tape->numbers = osp_mem_realloc(
+            tape->numbers, sizeof(double) * tape->numbers_capacity);
+    }
+    json_tape_put(tape, TAPE_NUMBER, tape->num_numbers);
+    tape->numbers[tape->num_numbers++] = number;
+}
+
+static inline void json_tape_put_int32(osp_json_tape_t tape, int32_t value)
+{
+    if(tape->num_ints == tape->ints_capacity)
+    {
+        tape->ints_capacity *= 2;
+        tape->ints = osp_mem_realloc(tape->ints,
+                                     sizeof(int32_t) * tape->ints_capacity);
+    }
+    tape->ints[tape->num_ints++] = value;
+}
+
+static inline void json_tape_append_string(osp_json_tape_t tape,
+                                      const char *data,
+                                      size_t size)
+{
+    if(tape->strings_size + size + 1 > tape->strings_capacity)
+    {
+        while(tape->strings_size + size + 1 > tape->strings_capacity)
+            tape->strings_capacity *= 2;
+        tape->strings = osp_mem_realloc(tape->strings,
+                                        tape->strings_capacity);
+    }
+    memcpy(tape->strings + tape->strings_size, data, size);
+    tape->strings_size += size;
+}
+
+static inline uint8_t json_tape_is_blank(char c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Only whitespace from start to end
+static inline uint8_t json_tape_is_blank_range(const char *data, size_t start, size_t end)
+{
+    while(start < end && json_tape_is_blank(data[start]))
+        ++start;
+    return start == end;
+}
+
+static inline int32_t json_tape_hex4(const char *data)
+{
+    int32_t value = 0;
+    for(int i_digit = 0; i_digit < 4; ++i_digit)
+    {
+        char digit = data[i_digit];
+        value <<= 4;
+        if(digit >= '0' && digit <= '9')
+            value |= digit - '0';
+        else if(digit >= 'a' && digit <= 'f')
+            value |= digit - 'a' + 10;
+        else if(digit >= 'A' && digit <= 'F')
+            value |= digit - 'A' + 10;
+        else
+            return -1;
+    }
+    return value;
+}
+
+// Unescaped string content, as UTF-8
+uint8_t json_tape_unescape_string(osp_json_tape_t tape, const char *data, size_t size)
+{
+    size_t position = 0;
+    while(position < size)
+    {
+        const char *escape = memchr(data + position, '\\', size - position);
+        size_t end = escape != NULL ? (size_t)(escape - data) : size;
+        json_tape_append_string(tape, data + position, end - position);
+        position = end;
+        if(position + 1 >= size)
+            return position == size;
+
+        char unescaped;
+        switch(data[position + 1])
+        {
+            case 'b': unescaped = '\b'; break;
+            case 'f': unescaped = '\f'; break;
+            case 'n': unescaped = '\n'; break;
+            case 'r': unescaped = '\r'; break;
+            case 't': unescaped = '\t'; break;
+            case '"':
+            case '\\':
+            case '/': unescaped = data[position + 1]; break;
+            case 'u':
+            {
+                if(position + 6 > size)
+                    return 0;
+                int32_t code = json_tape_hex4(data + position + 2);
+                position += 6;
+                if(code < 0 || (code >= 0xDC00 && code <= 0xDFFF))
+                    return 0;
+                // UTF-16 surrogate pairs are a single code point
+                if(code >= 0xD800 && code <= 0xDBFF)
+                {
+                    if(position + 6 > size ||
+                       data[position] != '\\' || data[position + 1] != 'u')
+                        return 0;
+                    int32_t low = json_tape_hex4(data + position + 2);
+                    if(low < 0xDC00 || low > 0xDFFF)
+                        return 0;
+                    code = 0x10000 + (((code & 0x3FF) << 10) | (low & 0x3FF));
+                    position += 6;
+                }
+
+                char utf8[4];
+                size_t length;
+                if(code < 0x80)
+                {
+                    utf8[0] = (char)code;
+                    length = 1;
+                }
+                else if(code < 0x800)
+                {
+                    utf8[0] = (char)(0xC0 | (code >> 6));
+                    utf8[1] = (char)(0x80 | (code & 0x3F));
+                    length = 2;
+                }
+                else if(code < 0x10000)
+                {
+                    utf8[0] = (char)(0xE0 | (code >> 12));
+                    utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[2] = (char)(0x80 | (code & 0x3F));
+                    length = 3;
+                }
+                else
+                {
+                    utf8[0] = (char)(0xF0 | (code >> 18));
+                    utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+                    utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    utf8[3] = (char)(0x80 | (code & 0x3F));
+                    length = 4;
+                }
+                json_tape_append_string(tape, utf8, length);
+                continue;
+            }
+            default:
+                return 0;
+        }
+        json_tape_append_string(tape, &unescaped, 1);
+        position += 2;
+    }
+
+    return 1;
+}
+
+uint8_t json_tape_put_string(osp_json_tape_t tape,
+                        uint64_t type,
+                        const char *data,
+                        size_t size)
+{
+    json_tape_put(tape, type, tape->strings_size);
+    if(memchr(data, '\\', size) == NULL)
+        json_tape_append_string(tape, data, size);
+    else if(!json_tape_unescape_string(tape, data, size))
+        return 0;
+    tape->strings[tape->strings_size++] = '\0';
+
+    return 1;
+}
+
+// Array items are kept in the ints buffer while they are int32_t, until one
+// is not: they are moved to the tape then
+void json_tape_spill_ints(osp_json_tape_t tape, struct tape_container *container)
+{
+    for(size_t i_int = container->first_int; i_int < tape->num_ints; ++i_int)
+        json_tape_put(tape, TAPE_INTEGER, (uint64_t)(int64_t)tape->ints[i_int]);
+    tape->num_ints = container->first_int;
+    container->ints_only = 0;
+}
+
+// A value that is not an int32_t goes in the current container
+static inline void json_tape_begin_value(struct tape_parser *parser)
+{
+    if(parser->depth == 0)
+        return;
+
+    struct tape_container *container = &(parser->containers[parser->depth - 1]);
+    if(container->is_object)
+        return;
+    if(container->ints_only)
+        json_tape_spill_ints(parser->tape, container);
+    ++container->count;
+}
+
+// Numbers, true, false and null
+uint8_t json_tape_put_scalar(struct tape_parser *parser, const char *text, size_t size)
+{
+    osp_json_tape_t tape = parser->tape;
+    if(text[0] == 't' || text[0] == 'f' || text[0] == 'n')
+    {
+        json_tape_begin_value(parser);
+        if(size == 4 && memcmp(text, "true", 4) == 0)
+            json_tape_put(tape, TAPE_TRUE, 0);
+        else if(size == 5 && memcmp(text, "false", 5) == 0)
+            json_tape_put(tape, TAPE_FALSE, 0);
+        else if(size == 4 && memcmp(text, "null", 4) == 0)
+            json_tape_put(tape, TAPE_NULL, 0);
+        else
+            return 0;
+        return 1;
+    }
+
+    // Plain integers are read directly, as exact as strtod
+    size_t i_char = text[0] == '-' ? 1 : 0;
+    int64_t integer = 0;
+    while(i_char < size && i_char <= JSON_TAPE_MAX_INTEGER_DIGITS &&
+          text[i_char] >= '0' && text[i_char] <= '9')
+        integer = integer * 10 + (text[i_char++] - '0');
+    if(i_char == size && size > (size_t)(text[0] == '-') &&
+       size - (text[0] == '-') <= JSON_TAPE_MAX_INTEGER_DIGITS &&
+       !(text[0] == '-' && integer == 0))
+    {
+        if(text[0] == '-')
+            integer = -integer;
+
+        // Keep int32_t arrays contiguous
+        struct tape_container *container = parser->depth > 0
+            ? &(parser->containers[parser->depth - 1])
+            : NULL;
+        if(container != NULL && container->ints_only &&
+           integer >= INT32_MIN && integer <= INT32_MAX)
+        {
+            json_tape_put_int32(tape, (int32_t)integer);
+            ++container->count;
+            return 1;
+        }
+
+        json_tape_begin_value(parser);
+        json_tape_put(tape, TAPE_INTEGER, (uint64_t)integer);
+        return 1;
+    }
+
+    // Anything else goes through strtod like cJSON, it must take it all
+    char number[JSON_TAPE_MAX_NUMBER];
+    if(size >= JSON_TAPE_MAX_NUMBER ||
+       !(text[0] == '-' || (text[0] >= '0' && text[0] <= '9')))
+        return 0;
+    for(i_char = 0; i_char < size; ++i_char)
+    {
+        char c = text[i_char];
+        if(!((c >= '0' && c <= '9') ||
+             c == '+' || c == '-' || c == '.' || c == 'e' || c == 'E'))
+            return 0;
+        number[i_char] = c;
+    }
+    number[size] = '\0';
+    char *end;
+    double value = strtod(number, &end);
+    if((size_t)(end - number) != size)
+        return 0;
+
+    json_tape_begin_value(parser);
+    json_tape_put_double(tape, value);
+    return 1;
+}
+
+uint8_t json_tape_open_container(struct tape_parser *parser, uint8_t is_object)
+{
+    if(parser->depth >= JSON_TAPE_MAX_DEPTH)
+        return 0;
+
+    json_tape_begin_value(parser);
+    osp_json_tape_t tape = parser->tape;
+    parser->containers[parser->depth++] = (struct tape_container)
+    {
+        .header = tape->num_words,
+        .is_object = is_object,
+        .ints_only = !is_object,
+        .first_int = tape->num_ints
+    };
+    json_tape_put(tape, is_object ? TAPE_OBJECT : TAPE_ARRAY, 0);
+    json_tape_put(tape, TAPE_COUNT, 0);
+
+    return 1;
+}
+
+void json_tape_close_container(struct tape_parser *parser)
+{
+    osp_json_tape_t tape = parser->tape;
+    struct tape_container *container = &(parser->containers[--parser->depth]);
+    // The tape may move when the end word is added
+    json_tape_put(tape, TAPE_END, 0);
+    uint64_t *header = tape->words + container->header;
+    if(container->ints_only && container->count > 0)
+        header[0] = ((uint64_t)TAPE_INT32_ARRAY << TAPE_TYPE_SHIFT) |
+                    container->first_int;
+    else
+        header[0] |= tape->num_words;
+    header[1] = ((uint64_t)TAPE_COUNT << TAPE_TYPE_SHIFT) | container->count;
+}
+
+enum tape_state
+{
+    TAPE_STATE_VALUE,
+    TAPE_STATE_FIRST_ITEM,
+    TAPE_STATE_FIRST_MEMBER,
+    TAPE_STATE_KEY,
+    TAPE_STATE_AFTER_VALUE
+};
+
+uint8_t json_tape_build(struct tape_parser *parser, size_t start)
+{
+    const char *data = parser->data;
+    const uint32_t *indices = parser->indices;
+    size_t num_indices = parser->num_indices;
+    enum tape_state state = TAPE_STATE_VALUE;
+    size_t i_index = 0;
+    // First byte after the last structural character read
+    size_t gap = start;
+
+    for(;;)
+    {
+        size_t position = indices[i_index];
+        char c = position < parser->size ? data[position] : '\0';
+        switch(state)
+        {
+            case TAPE_STATE_FIRST_ITEM:
+            case TAPE_STATE_FIRST_MEMBER:
+                // Empty containers close right away
+                if(c == (state == TAPE_STATE_FIRST_ITEM ? ']' : '}') &&
+                   json_tape_is_blank_range(data, gap, position))
+                {
+                    json_tape_close_container(parser);
+                    ++i_index;
+                    gap = position + 1;
+                    state = TAPE_STATE_AFTER_VALUE;
+                }
+                else
+                    state = state == TAPE_STATE_FIRST_ITEM ? TAPE_STATE_VALUE
+                                                           : TAPE_STATE_KEY;
+            break;
+
+            case TAPE_STATE_KEY:
+            {
+                if(c != '"' || i_index + 2 >= num_indices ||
+                   !json_tape_is_blank_range(data, gap, position))
+                    return 0;
+                size_t end = indices[i_index + 1];
+                size_t colon = indices[i_index + 2];
+                if(data[end] != '"' || data[colon] != ':' ||
+                   !json_tape_is_blank_range(data, end + 1, colon) ||
+                   !json_tape_put_string(parser->tape, TAPE_KEY,
+                                    data + position + 1, end - position - 1))
+                    return 0;
+                ++parser->containers[parser->depth - 1].count;
+                i_index += 3;
+                gap = colon + 1;
+                state = TAPE_STATE_VALUE;
+            }
+            break;
+
+            case TAPE_STATE_VALUE:
+            {
+                // A scalar is the text up to the next structural character
+                size_t scalar = gap;
+                while(scalar < position && json_tape_is_blank(data[scalar]))
+                    ++scalar;
+                if(scalar < position)
+                {
+                    size_t end = position;
+                    while(json_tape_is_blank(data[end - 1]))
+                        --end;
+                    if(!json_tape_put_scalar(parser, data + scalar, end - scalar))
+                        return 0;
+                    gap = position;
+                    state = TAPE_STATE_AFTER_VALUE;
+                }
+                else if(i_index < num_indices && (c == '{' || c == '['))
+                {
+                    if(!json_tape_open_container(parser, c == '{'))
+                        return 0;
+                    ++i_index;
+                    gap = position + 1;
+                    state = c == '{' ? TAPE_STATE_FIRST_MEMBER
+                                     : TAPE_STATE_FIRST_ITEM;
+                }
+                else if(i_index + 1 < num_indices && c == '"')
+                {
+                    size_t end = indices[i_index + 1];
+                    json_tape_begin_value(parser);
+                    if(data[end] != '"' ||
+                       !json_tape_put_string(parser->tape, TAPE_STRING,
+                                        data + position + 1,
+                                        end - position - 1))
+                        return 0;
+                    i_index += 2;
+                    gap = end + 1;
+                    state = TAPE_STATE_AFTER_VALUE;
+                }
+                else
+                    return 0;
+            }
+            break;
+
+            case TAPE_STATE_AFTER_VALUE:
+            {
+                // Whatever follows the root value is ignored
+                if(parser->depth == 0)
+                    return 1;
+                if(i_index >= num_indices ||
+                   !json_tape_is_blank_range(data, gap, position))
+                    return 0;
+                uint8_t is_object =
+                    parser->containers[parser->depth - 1].is_object;
+                if(c == ',')
+                    state = is_object ? TAPE_STATE_KEY : TAPE_STATE_VALUE;
+                else if(c == (is_object ? '}' : ']'))
+                    json_tape_close_container(parser);
+                else
+                    return 0;
+                ++i_index;
+                gap = position + 1;
+            }
+            break;
+        }
+    }
+}
+
+osp_json_tape_t osp_json_tape_parse(const char *data, size_t size)
+{
+    // Positions are 32 bits
+    if(size > UINT32_MAX - 1)
+        return NULL;
+
+    osp_json_tape_t tape = (osp_json_tape_t)osp_mem_calloc(
+        1, sizeof(struct _osp_json_tape));
+    struct tape_parser parser =
+    {
+        .tape = tape,
+        .data = data,
+        .size = size,
+        .indices_capacity = size / 4 + 128,
+        .containers = osp_mem_malloc(sizeof(struct tape_container) *
+                                     JSON_TAPE_MAX_DEPTH)
+    };
+    parser.indices = osp_mem_malloc(sizeof(uint32_t) * parser.indices_capacity);
+
+    tape->words_capacity = size / 8 + 64;
+    tape->words = osp_mem_malloc(sizeof(uint64_t) * tape->words_capacity);
+    tape->strings_capacity = size / 8 + 256;
+    tape->strings = osp_mem_malloc(tape->strings_capacity);
+    tape->numbers_capacity = 64;
+    tape->numbers = osp_mem_malloc(sizeof(double) * tape->numbers_capacity);
+    tape->ints_capacity = size / 4 + 64;
+    tape->ints = osp_mem_malloc(sizeof(int32_t) * tape->ints_capacity);
+    // Node 0 is no node
+    json_tape_put(tape, TAPE_ROOT, 0);
+
+    // Skip the UTF-8 byte order mark, as cJSON
+    size_t start = size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+    json_tape_index_structurals(&parser);
+    uint8_t valid = json_tape_build(&parser, start);
+
+    osp_mem_free(parser.indices);
+    osp_mem_free(parser.containers);
+    if(!valid || tape->num_words < 2)
+    {
+        osp_json_tape_delete(tape);
+        return NULL;
+    }
+
+    return tape;
+}
+
+void osp_json_tape_delete(osp_json_tape_t tape)
+{
+    if(tape == NULL)
+        return;
+
+    osp_mem_free(tape->words);
+    osp_mem_free(tape->strings);
+    osp_mem_free(tape->numbers);
+    osp_mem_free(tape->ints);
+    osp_mem_free(tape);
+}
+
+// Accessors
+
+static inline uint64_t json_tape_word_type(osp_json_tape_t tape, osp_json_node_t node)
+{
+    return node > 0 && node < tape->num_words
+        ? tape->words[node] >> TAPE_TYPE_SHIFT
+        : 0;
+}
+
+static inline uint64_t json_tape_word_payload(osp_json_tape_t tape, osp_json_node_t node)
+{
+    return tape->words[node] & TAPE_PAYLOAD_MASK;
+}
+
+// Position after a value
+static inline size_t json_tape_skip_value(osp_json_tape_t tape, osp_json_node_t node)
+{
+    switch(json_tape_word_type(tape, node))
+    {
+        case TAPE_ARRAY:
+        case TAPE_OBJECT:
+            return json_tape_word_payload(tape, node);
+        case TAPE_INT32_ARRAY:
+            return node + 3;
+        default:
+            return node + 1;
+    }
+}
+
+osp_json_node_t osp_json_tape_root(osp_json_tape_t tape)
+{
+    return tape != NULL && tape->num_words > 1 ? 1 : 0;
+}
+
+osp_json_type_t osp_json_tape_get_type(osp_json_tape_t tape, osp_json_node_t node)
+{
+    switch(json_tape_word_type(tape, node))
+    {
+        case TAPE_NULL: return OSP_JSON_TYPE_NULL;
+        case TAPE_FALSE: return OSP_JSON_TYPE_FALSE;
+        case TAPE_TRUE: return OSP_JSON_TYPE_TRUE;
+        case TAPE_INTEGER:
+        case TAPE_NUMBER: return OSP_JSON_TYPE_NUMBER;
+        case TAPE_STRING: return OSP_JSON_TYPE_STRING;
+        case TAPE_ARRAY:
+        case TAPE_INT32_ARRAY: return OSP_JSON_TYPE_ARRAY;
+        case TAPE_OBJECT: return OSP_JSON_TYPE_OBJECT;
+        default: return OSP_JSON_TYPE_NONE;
+    }
+}
+
+size_t osp_json_tape_get_count(osp_json_tape_t tape, osp_json_node_t node)
+{
+    uint64_t type = json_tape_word_type(tape, node);
+    if(type != TAPE_ARRAY && type != TAPE_INT32_ARRAY && type != TAPE_OBJECT)
+        return 0;
+
+    return json_tape_word_payload(tape, node + 1);
+}
+
+osp_json_node_t osp_json_tape_get_member(osp_json_tape_t tape,
+                                         osp_json_node_t object,
+                                         const char *key)
+{
+    if(json_tape_word_type(tape, object) != TAPE_OBJECT)
+        return 0;
+
+    size_t position = object + 2;
+    while(json_tape_word_type(tape, position) == TAPE_KEY)
+    {
+        if(strcmp(tape->strings + json_tape_word_payload(tape, position), key) == 0)
+            return position + 1;
+        position = json_tape_skip_value(tape, position + 1);
+    }
+
+    return 0;
+}
+
+osp_json_node_t osp_json_tape_first(osp_json_tape_t tape, osp_json_node_t node)
+{
+    uint64_t type = json_tape_word_type(tape, node);
+    if(type == TAPE_ARRAY && json_tape_word_type(tape, node + 2) != TAPE_END)
+        return node + 2;
+    if(type == TAPE_OBJECT && json_tape_word_type(tape, node + 2) == TAPE_KEY)
+        return node + 3;
+
+    return 0;
+}
+
+osp_json_node_t osp_json_tape_next(osp_json_tape_t tape, osp_json_node_t node)
+{
+    // Only items and members have siblings
+    if(node <= 1)
+        return 0;
+
+    size_t position = json_tape_skip_value(tape, node);
+    switch(json_tape_word_type(tape, position))
+    {
+        case 0:
+        case TAPE_END:
+            return 0;
+        case TAPE_KEY:
+            return position + 1;
+        default:
+            return position;
+    }
+}
+
+osp_json_node_t osp_json_tape_get_item(osp_json_tape_t tape,
+                                       osp_json_node_t array,
+                                       size_t index)
+{
+    if(json_tape_word_type(tape, array) != TAPE_ARRAY)
+        return 0;
+
+    osp_json_node_t item = osp_json_tape_first(tape, array);
+    while(item != 0 && index-- > 0)
+        item = osp_json_tape_next(tape, item);
+
+    return item;
+}
+
+const char *osp_json_tape_get_key(osp_json_tape_t tape, osp_json_node_t node)
+{
+    if(node <= 1 || json_tape_word_type(tape, node - 1) != TAPE_KEY)
+        return NULL;
+
+    return tape->strings + json_tape_word_payload(tape, node - 1);
+}
+
+double osp_json_tape_get_number(osp_json_tape_t tape, osp_json_node_t node)
+{
+    switch(json_tape_word_type(tape, node))
+    {
+        case TAPE_INTEGER:
+            // Sign extend the payload
+            return (double)((int64_t)(tape->words[node] << 8) >> 8);
+        case TAPE_NUMBER:
+            return tape->numbers[json_tape_word_payload(tape, node)];
+        default:
+            return NAN;
+    }
+}
+
+const char *osp_json_tape_get_string(osp_json_tape_t tape, osp_json_node_t node)
+{
+    if(json_tape_word_type(tape, node) != TAPE_STRING)
+        return NULL;
+
+    return tape->strings + json_tape_word_payload(tape, node);
+}
+
+const int32_t *osp_json_tape_get_int32s(osp_json_tape_t tape,
+                                        osp_json_node_t node,
+                                        size_t *count)
+{
+    if(json_tape_word_type(tape, node) != TAPE_INT32_ARRAY)
+    {
+        *count = 0;
+        return NULL;
+    }
+
+    *count = json_tape_word_payload(tape, node + 1);
+    return tape->ints + json_tape_word_payload(tape, node);
+}
+
+double osp_json_tape_get_item_number(osp_json_tape_t tape,
+                                     osp_json_node_t array,
+                                     size_t index)
+{
+    size_t count;
+    const int32_t *ints = osp_json_tape_get_int32s(tape, array, &count);
+    if(ints != NULL)
+        return index < count ? ints[index] : NAN;
+
+    return osp_json_tape_get_number(tape,
+                                    osp_json_tape_get_item(tape, array, index));
+}
@@ -4,11 +4,30 @@
 #include <dirent.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <sys/resource.h>
 
 #include "OSP_content.h"
+#include "cache.h"
+#include "cJSON.h"
+#include "compress.h"
+#include "content_table.h"
+#include "dynarray.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "input.h"
+#include "mem.h"
+#include "parallel.h"
+#include "trace.h"
+#include "walk.h"
+#include "writer.h"
 #include "processors/png_to_png.h"
 #include "processors/ldtk_to_map.h"
 #include "processors/fst_to_fst.h"
@@ -18,6 +37,19 @@ const uint32_t MAX_PATH = 4096;
 const uint32_t MAX_FILENAME = 128;
 const uint32_t MAX_EXTENSION = 8;
 
+// Bundle file writer buffer size
+const size_t BUNDLE_WRITER_BUFFER_SIZE = 1 << 20;
+// Asset output writer initial capacity
+const size_t ASSET_WRITER_CAPACITY = 4096;
+
+// Watch mode quiet time after the last change, before building again
+const int WATCH_DEBOUNCE_MS = 50;
+// Watch mode inotify events buffer size
+const size_t WATCH_BUFFER_SIZE = 64 * 1024;
+
+// Set by SIGINT and SIGTERM to leave the watch mode
+volatile sig_atomic_t watch_stop = 0;
+
 // Dynamic sized content table data, starting with four elements and doubling
 // its size on every realloc.
 const uint32_t INITIAL_CONTENT_TABLE_CAPACITY = 4;
@@ -25,8 +57,22 @@ uint32_t content_table_capacity = INITIAL_CONTENT_TABLE_CAPACITY;
 uint32_t content_table_count = 0;
 osp_cnt_table_entry_t *content_table = NULL;
 
+// Payload compression modes, selected with -z
+typedef enum
+{
+    COMPRESSION_NONE,
+    COMPRESSION_FAST,
+    COMPRESSION_HIGH
+} compression_t;
+
+// Compressed payloads are only kept if they save at least 1/16 of the size,
+// anything less isn't worth decoding
+const uint64_t MIN_COMPRESSION_SAVING_SHIFT = 4;
+
 // Content processor function type definition
-typedef int (*processor_t)(FILE* readFile, FILE* writeFile, void* params);
+typedef int (*processor_t)(const osp_input_t* input,
+                           osp_writer_t writer,
+                           void* params);
 
 // Structure defining each supported content type with its processor
 typedef struct _supported_processor
@@ -37,8 +83,19 @@ typedef struct _supported_processor
     processor_t processor;
     // Byte output asset type ID
     uint8_t outputType;
+    // Processor version, bump it whenever the output format changes so
+    // cached outputs of the previous version are not reused.
+    uint32_t version;
+    // Processor parameters set from the command line, NULL if none. They are
+    // part of the cache key, so they must be plain data.
+    void *params;
+    // Processor parameters size in bytes, only the ones changing the output
+    size_t paramsSize;
 } supported_processor_t;
 
+// ldtk_to_map parameters
+ldtk_to_map_params_t map_params = { 0 };
+
 // Currently supported processors table
 const int NUM_PROCESSORS = 3;
 supported_processor_t supported_processors[] =
@@ -46,234 +103,1326 @@ supported_processor_t supported_processors[] =
     {
         .extension = "png",
         .processor = &png_to_png,
-        .outputType = OSP_CNT_TYPE_PNG
+        .outputType = OSP_CNT_TYPE_PNG,
+        .version = 1
     },
     {
         .extension = "ldtk",
         .processor = &ldtk_to_map,
-        .outputType = OSP_CNT_TYPE_MAP
+        .outputType = OSP_CNT_TYPE_MAP,
+        .version = 2,
+        .params = &map_params,
+        .paramsSize = LDTK_TO_MAP_PARAMS_KEY_SIZE
     },
     {
         .extension = "fst",
         .processor = &fst_to_fst,
-        .outputType = OSP_CNT_TYPE_FST
+        .outputType = OSP_CNT_TYPE_FST,
+        .version = 2
     }
 };
 
+// A single asset to process, collected while parsing the directory tree
+typedef struct _asset_job
+{
+    // Input file path, relative to the starting directory
+    char *path;
+    // Asset name w/o ext and directory prefix relative to bundle root
+    char *name;
+    // Supported processors table index
+    int32_t processor_idx;
+    // Set once processed, kept outputs are only processed again when their
+    // input changes
+    uint8_t processed;
+    // Processor result, 0 on success
+    int result;
+    // Private processor output buffer
+    char *data;
+    // Private processor output buffer size
+    size_t size;
+    // Input file size, for the build cache and stats
+    uint64_t input_size;
+    // Input file modification time in nanoseconds, for the build cache
+    int64_t input_mtime;
+    // Input file content hash, for the build cache
+    uint64_t content_hash;
+    // Other files read to process the input, osp_input_dependency_t array
+    // or NULL
+    osp_dynarray_t dependencies;
+    // Build cache blob key
+    uint64_t cache_key;
+    // Set if the output was loaded from the build cache
+    uint8_t cached;
+    // Processed output codec byte ID
+    uint8_t codec;
+    // Processed output size before compression
+    uint64_t raw_size;
+    // Stored (possibly compressed) output hash, to find duplicated payloads
+    uint64_t data_hash;
+    // Set if the last build reused the kept output
+    uint8_t kept;
+    // Processing wall and thread CPU time in nanoseconds, cache lookup and
+    // compression included
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    // Processing peak heap allocation, output buffer included
+    uint64_t peak_alloc;
+} asset_job_t;
+
+// Build stats totals of a processor
+typedef struct _processor_stats
+{
+    size_t assets;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t input_bytes;
+    uint64_t output_bytes;
+    uint64_t stored_bytes;
+    uint64_t peak_alloc;
+} processor_stats_t;
+
+// A content directory watched for changes
+typedef struct _watch_dir
+{
+    // inotify watch descriptor
+    int wd;
+    // Directory path, relative to the starting directory
+    char *path;
+    // Asset name prefix of the directory files, relative to the bundle root
+    char *prefix;
+} watch_dir_t;
+
+// Shared state for processing and committing the collected asset jobs
+typedef struct _build_context
+{
+    // Collected asset jobs array
+    asset_job_t *jobs;
+    // Keep the processed outputs once committed, to build the bundle again
+    // reprocessing only the changed assets
+    uint8_t keepOutputs;
+    // Number of processing threads
+    uint32_t numThreads;
+    // Write the legacy content table layout
+    uint8_t legacyTable;
+    // Output bundle path, relative to the starting directory
+    const char *outputPath;
+    // Bundle FILE, to read committed payloads back
+    FILE *writeFile;
+    // Bundle FILE writer to commit processed assets to
+    osp_writer_t bundleWriter;
+    // Optional persistent build cache
+    osp_cache_t cache;
+    // Number of assets loaded from the build cache
+    size_t cacheHits;
+    // Processed output hash to content table index of the committed payloads
+    osp_hashmap_t payloads;
+    // Number of assets sharing a previously committed payload
+    size_t dedupAssets;
+    // Bundle bytes saved by sharing payloads
+    uint64_t dedupBytes;
+    // Payload compression mode
+    compression_t compression;
+    // Number of compressed assets
+    size_t compressedAssets;
+    // Compressed assets size before and after compression
+    uint64_t compressedRawBytes;
+    uint64_t compressedBytes;
+    // Optional build stats report path
+    const char *statsPath;
+    // Per asset build stats, collected while committing
+    cJSON *statsAssets;
+    // Build stats totals, one per supported processor
+    processor_stats_t *processorStats;
+    // Directory walk, processing, content table writing and whole build
+    // times in nanoseconds
+    uint64_t walkNs;
+    uint64_t processNs;
+    uint64_t tableNs;
+    uint64_t buildNs;
+} build_context_t;
+
 /// @brief Find supported type table entry index by extension
 /// @param extension File extension string to check
 /// @return Processors table index if successful, -1 otherwise
 int32_t find_supported_type(const char* extension);
-/// @brief Parse directory and write bundle data to FILE
-/// @param path Path of the bundle root directory
-/// @param prefix Currently calculated asset prefix, relative to root
-/// @param writeFile FILE pointer to write bundle data to
-void parse_directory(const char* path, char* prefix, FILE* writeFile);
+/// @brief Parse a directory tree and collect the supported assets to process,
+///        sorted by path
+/// @param root Path of the bundle root directory
+/// @param prefix Subdirectory to parse, relative to root: "" or ending in '/'
+/// @param numThreads Number of threads scanning directories
+/// @param jobs Array of asset_job_t to add the found assets to
+void parse_directory(const char* root,
+                     const char* prefix,
+                     uint32_t numThreads,
+                     osp_dynarray_t jobs);
+/// @brief Queue an asset job for a file, if its type is supported
+/// @param root Path of the bundle root directory
+/// @param prefix Asset name prefix of the file directory, relative to root
+/// @param file File name, with extension
+/// @param jobs Array of asset_job_t to add the asset to
+void add_asset_job(const char *root,
+                   const char *prefix,
+                   const char *file,
+                   osp_dynarray_t jobs);
+/// @brief Sort the asset jobs by input path, the order assets are written to
+///        the bundle in
+/// @param jobs Array of asset_job_t
+void sort_asset_jobs(osp_dynarray_t jobs);
+/// @brief Process the pending asset jobs and write all of them to the bundle,
+///        through a temporary file renamed over the output one
+/// @param build Build context
+/// @param jobs Array of asset_job_t
+/// @return 0 on success, error value otherwise
+int build_bundle(build_context_t *build, osp_dynarray_t jobs);
+/// @brief Watch the content directory, building the bundle again on changes
+/// @param build Build context, of an already built bundle
+/// @param jobs Array of asset_job_t, with kept outputs
+/// @param root Path of the bundle root directory
+/// @return 0 on success, error value otherwise
+int watch_content(build_context_t *build,
+                  osp_dynarray_t jobs,
+                  const char *root);
+/// @brief Watch a directory and all of its subdirectories
+/// @param fd inotify file descriptor
+/// @param dirs Array of watch_dir_t to add the watched directories to
+/// @param path Directory path, relative to the starting directory
+/// @param prefix Asset name prefix of the directory files
+void watch_add_tree(int fd,
+                    osp_dynarray_t dirs,
+                    const char *path,
+                    const char *prefix);
+/// @brief Stop watching a directory and all of its subdirectories
+/// @param fd inotify file descriptor
+/// @param dirs Array of watch_dir_t
+/// @param path Directory path, relative to the starting directory
+void watch_remove_tree(int fd, osp_dynarray_t dirs, const char *path);
+/// @brief Update the asset jobs for a change notified by inotify
+/// @param jobs Array of asset_job_t
+/// @param fd inotify file descriptor
+/// @param dirs Array of watch_dir_t
+/// @param root Path of the bundle root directory
+/// @param numThreads Number of threads scanning directories
+/// @param event inotify event
+/// @return 1 if the bundle needs to be built again, 0 otherwise
+uint8_t watch_handle_event(osp_dynarray_t jobs,
+                           int fd,
+                           osp_dynarray_t dirs,
+                           const char *root,
+                           uint32_t numThreads,
+                           const struct inotify_event *event);
+/// @brief Drop the outputs of the asset jobs made of a changed file
+/// @param jobs Array of asset_job_t
+/// @param path Changed file path, relative to the starting directory
+/// @return 1 if an asset job depends on the file, 0 otherwise
+uint8_t watch_dependency_changed(osp_dynarray_t jobs, const char *path);
+/// @brief Find an asset job by input path
+/// @param jobs Array of asset_job_t
+/// @param path Input file path, relative to the starting directory
+/// @return Asset job index, -1 if not found
+int64_t find_asset_job(osp_dynarray_t jobs, const char *path);
+/// @brief Free the asset job memory
+/// @param job Asset job
+void free_asset_job(asset_job_t *job);
+/// @brief Run an asset processor into the job private output buffer
+/// @param context Build context
+/// @param index Asset job index
+void process_asset_job(void *context, size_t index);
+/// @brief Process an asset job, loading it from the build cache if possible
+/// @param build Build context
+/// @param job Asset job
+void run_asset_job(build_context_t *build, asset_job_t *job);
+/// @brief Compress the job output buffer, if it pays
+/// @param build Build context
+/// @param job Asset job with a successfully processed output
+void compress_asset_job(build_context_t *build, asset_job_t *job);
+/// @brief Append a processed asset to the bundle and the content table
+/// @param context Build context
+/// @param index Asset job index
+void commit_asset_job(void *context, size_t index);
+/// @brief Add a committed asset job to the build stats
+/// @param build Build context
+/// @param job Asset job
+/// @param shared Set if the job payload is shared with a previous one
+void add_asset_stats(build_context_t *build, asset_job_t *job, uint8_t shared);
+/// @brief Write the build stats report as JSON, with per processor totals
+/// @param build Build context, of a just built bundle
+/// @return 0 on success, error value otherwise
+int write_build_stats(build_context_t *build);
+/// @brief Read a clock
+/// @param clock Clock ID, CLOCK_MONOTONIC or CLOCK_THREAD_CPUTIME_ID
+/// @return Clock time in nanoseconds
+uint64_t get_time_ns(clockid_t clock);
 /// @brief Add new content table entry
 /// @param name Asset name
 /// @param type Byte asset type ID
 /// @param start Asset data start position in bundle file
 /// @param size Asset data size in bundle file
+/// @param codec Asset data codec byte ID
+/// @param rawSize Asset data size once decoded
 void add_content_table_entry(const char* name,
                              uint8_t type,
                              uint64_t start,
-                             uint64_t size);
+                             uint64_t size,
+                             uint8_t codec,
+                             uint64_t rawSize);
+/// @brief Find an already committed payload identical to the given data
+/// @param build Build context
+/// @param data Processed asset data
+/// @param size Processed asset data size
+/// @param hash Processed asset data hash
+/// @param codec Processed asset data codec byte ID
+/// @return Content table index of the identical payload, -1 if not found
+int64_t find_committed_payload(build_context_t *build,
+                               const char *data,
+                               size_t size,
+                               uint64_t hash,
+                               uint8_t codec);
 /// @brief Realloc content table, doubling its size
 void realloc_content_table();
 /// @brief Free previously allocated content table
 void free_content_table();
+/// @brief Remove all the content table entries, keeping its capacity
+void clear_content_table();
 /// @brief Write content table to bundle file
-/// @param writeFile FILE pointer to write bundle data to
-void write_content_table(FILE* writeFile);
+/// @param writer Bundle writer to write the content table to
+/// @param legacy Write the legacy variable size entries layout if set
+/// @return Content table position in the bundle file
+uint64_t write_content_table(osp_writer_t writer, uint8_t legacy);
 
 int main(int argc, char **argv)
 {
     // Initial content table allocation
     realloc_content_table();
+    // Track the JSON parser allocations too, for the build stats
+    cJSON_Hooks hooks = { .malloc_fn = osp_mem_malloc, .free_fn = osp_mem_free };
+    cJSON_InitHooks(&hooks);
 
     // Some path working strings
-    char startingPath[MAX_PATH + 1];
     char workingPath[MAX_PATH + 1];
     char outputPath[MAX_PATH + 1];
-
-    // Cache the initial path to go back to upon exiting
-    getcwd(startingPath, MAX_PATH);
+    char *outputName = NULL;
+    char *cachePath = NULL;
+    char *statsPath = NULL;
+    char *tracePath = NULL;
+    // Number of processing threads, serial by default
+    uint32_t numThreads = 1;
+    // Write the legacy content table layout, for older readers
+    uint8_t legacyTable = 0;
+    // Fast payload compression by default
+    compression_t compression = COMPRESSION_FAST;
+    // Stay resident and build again when the content changes
+    uint8_t watch = 0;
 
     // Default output filename
     strncpy(outputPath, "./bundle.cnt", MAX_PATH);
+    // Parse the current directory by default
+    strncpy(workingPath, ".", MAX_PATH);
 
-    if(argc > 1)
+    for(int iArg = 1; iArg < argc; ++iArg)
     {
-        // If present, firs argument is the directory to parse for assets
-        strncpy(workingPath, argv[1], MAX_PATH);
-        if(argc > 3)
+        if(strncmp(argv[iArg], "-o", 4) == 0 && iArg + 1 < argc)
         {
-            // Second argument is the optional "-o" option
-            if(strncmp(argv[2], "-o", 4) == 0)
-            {
-                // In this case, the third argument is the output
-                // bundle file name
-                strncpy(outputPath, workingPath, MAX_PATH);
-                strncat(outputPath, "/", MAX_PATH);
-                strncat(outputPath, argv[3], MAX_PATH);
-            }
+            // "-o" is followed by the output bundle file name
+            outputName = argv[++iArg];
         }
+        else if(strncmp(argv[iArg], "-j", 4) == 0 && iArg + 1 < argc)
+        {
+            // "-j" is followed by the number of processing threads,
+            // 0 means one for every available processor
+            numThreads = (uint32_t)strtoul(argv[++iArg], NULL, 10);
+            if(numThreads == 0)
+                numThreads = osp_parallel_num_cpus();
+        }
+        else if(strncmp(argv[iArg], "-c", 4) == 0 && iArg + 1 < argc)
+        {
+            // "-c" is followed by the build cache directory
+            cachePath = argv[++iArg];
+        }
+        else if(strcmp(argv[iArg], "--stats") == 0 && iArg + 1 < argc)
+        {
+            // "--stats" is followed by the build stats report path
+            statsPath = argv[++iArg];
+        }
+        else if(strcmp(argv[iArg], "--trace") == 0 && iArg + 1 < argc)
+        {
+            // "--trace" is followed by the timeline trace path
+            tracePath = argv[++iArg];
+        }
+        else if(strcmp(argv[iArg], "--map-collision-grid") == 0)
+            map_params.collision_grid = 1;
+        else if(strcmp(argv[iArg], "--map-tiles") == 0 && iArg + 1 < argc)
+        {
+            // "--map-tiles" is followed by the tile layers encoding
+            ++iArg;
+            if(strcmp(argv[iArg], "list") == 0)
+                map_params.tiles_encoding = MAP_TILES_LIST;
+            else if(strcmp(argv[iArg], "dense") == 0)
+                map_params.tiles_encoding = MAP_TILES_DENSE;
+            else if(strcmp(argv[iArg], "rle") == 0)
+                map_params.tiles_encoding = MAP_TILES_RLE;
+            else
+                printf("Unknown tiles encoding %s, using list\n", argv[iArg]);
+        }
+        else if(strcmp(argv[iArg], "--map-all-levels") == 0)
+            map_params.all_levels = 1;
+        else if(strcmp(argv[iArg], "--map-streaming") == 0)
+            map_params.streaming = 1;
+        else if(strcmp(argv[iArg], "--map-chunks") == 0 && iArg + 1 < argc)
+        {
+            // "--map-chunks" is followed by the chunk size in tiles
+            map_params.chunk_size = (uint32_t)strtoul(argv[++iArg], NULL, 10);
+        }
+        else if(strcmp(argv[iArg], "--map-collision-index") == 0 &&
+                iArg + 1 < argc)
+        {
+            // "--map-collision-index" is followed by the index cell size in
+            // tiles
+            map_params.collision_index_cell =
+                (uint32_t)strtoul(argv[++iArg], NULL, 10);
+        }
+        else if(strcmp(argv[iArg], "--legacy-table") == 0)
+            legacyTable = 1;
+        else if(strcmp(argv[iArg], "--watch") == 0)
+            watch = 1;
+        else if(strncmp(argv[iArg], "-z", 4) == 0 && iArg + 1 < argc)
+        {
+            // "-z" is followed by the compression mode
+            ++iArg;
+            if(strcmp(argv[iArg], "none") == 0)
+                compression = COMPRESSION_NONE;
+            else if(strcmp(argv[iArg], "fast") == 0)
+                compression = COMPRESSION_FAST;
+            else if(strcmp(argv[iArg], "high") == 0)
+                compression = COMPRESSION_HIGH;
+            else
+                printf("Unknown compression mode %s, using fast\n", argv[iArg]);
+        }
+        else // Any other argument is the directory to parse for assets
+            strncpy(workingPath, argv[iArg], MAX_PATH);
     }
-    else // Parse the current directory by default
-        strncpy(workingPath, ".", MAX_PATH);
 
-    // Open output file for writing and writing
-    FILE* writeFile = fopen(outputPath, "wb+");
-    // Write placeholder content table position
-    uint64_t tablePos = 0;
-    fwrite(&tablePos, sizeof(tablePos), 1, writeFile);
+    // The legacy content table can't describe compressed payloads
+    if(legacyTable && compression != COMPRESSION_NONE)
+    {
+        printf("Legacy content table, payloads won't be compressed\n");
+        compression = COMPRESSION_NONE;
+    }
+
+    if(outputName != NULL)
+    {
+        // The output bundle file name is relative to the parsed directory
+        strncpy(outputPath, workingPath, MAX_PATH);
+        strncat(outputPath, "/", MAX_PATH);
+        strncat(outputPath, outputName, MAX_PATH);
+    }
 
     // Parse the working path directory for supported files
     // with a starting empty asset name prefix
-    // and write processed content to writeFile
-    parse_directory(workingPath, "", writeFile);
+    if(tracePath != NULL && osp_trace_open(tracePath) != 0)
+        printf("Unable to trace to %s\n", tracePath);
+    osp_dynarray_t jobs = osp_dynarray_new(sizeof(asset_job_t), 64, 64);
+    uint64_t walkStart = get_time_ns(CLOCK_MONOTONIC);
+    uint64_t walkTrace = osp_trace_begin();
+    parse_directory(workingPath, "", numThreads, jobs);
+    osp_trace_end("walk", walkTrace, workingPath);
+    uint64_t walkNs = get_time_ns(CLOCK_MONOTONIC) - walkStart;
+
+    // Process all the collected assets, possibly in parallel, and write
+    // them to the bundle in the same order they were found.
+    build_context_t context =
+    {
+        .keepOutputs = watch,
+        .numThreads = numThreads,
+        .legacyTable = legacyTable,
+        .outputPath = outputPath,
+        .cache = osp_cache_open(cachePath),
+        .compression = compression,
+        .statsPath = statsPath,
+        .walkNs = walkNs
+    };
+    int result = build_bundle(&context, jobs);
+    if(context.cache != NULL)
+    {
+        printf("Loaded %zu of %zu assets from cache %s\n", context.cacheHits,
+               osp_dynarray_get_count(jobs), cachePath);
+        // Watch builds keep everything in memory, the cache is only
+        // useful for the initial one
+        osp_cache_close(context.cache);
+        context.cache = NULL;
+    }
+
+    if(result == 0 && watch)
+        result = watch_content(&context, jobs, workingPath);
+
+    // Kept outputs are freed here, the other ones once committed
+    if(watch)
+    {
+        asset_job_t *keptJobs = (asset_job_t *)osp_dynarray_get_data(jobs);
+        for(size_t iJob = 0; iJob < osp_dynarray_get_count(jobs); ++iJob)
+            free_asset_job(&(keptJobs[iJob]));
+    }
+    osp_dynarray_delete(jobs);
+    // Free the content table memory
+    free_content_table();
+    if(tracePath != NULL)
+        osp_trace_close();
+
+    return result;
+}
 
-    // Cache current position as real content table position
-    tablePos = ftell(writeFile);
-    // Write the content table
-    write_content_table(writeFile);
+int build_bundle(build_context_t *build, osp_dynarray_t jobs)
+{
+    uint64_t buildStart = get_time_ns(CLOCK_MONOTONIC);
+    uint64_t buildTrace = osp_trace_begin();
+
+    // Write to a temporary file first, so readers of the output bundle never
+    // see it half written
+    char tempPath[MAX_PATH + 8];
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", build->outputPath);
+
+    // Open output file for writing and reading
+    FILE* writeFile = fopen(tempPath, "wb+");
+    if(writeFile == NULL)
+    {
+        printf("Unable to open output bundle %s\n", tempPath);
+        return 1;
+    }
+    // Write placeholder content table position
+    osp_writer_t bundleWriter =
+        osp_writer_new_file(writeFile, BUNDLE_WRITER_BUFFER_SIZE);
+    uint64_t tablePos = 0;
+    osp_writer_put_u64(bundleWriter, tablePos);
+
+    size_t numJobs = osp_dynarray_get_count(jobs);
+    asset_job_t *jobsData = (asset_job_t *)osp_dynarray_get_data(jobs);
+    size_t numPending = 0;
+    for(size_t iJob = 0; iJob < numJobs; ++iJob)
+        numPending += !jobsData[iJob].processed;
+
+    clear_content_table();
+    build->jobs = jobsData;
+    build->writeFile = writeFile;
+    build->bundleWriter = bundleWriter;
+    build->cacheHits = 0;
+    build->payloads = osp_hashmap_new(numJobs);
+    build->dedupAssets = 0;
+    build->dedupBytes = 0;
+    build->compressedAssets = 0;
+    build->compressedRawBytes = 0;
+    build->compressedBytes = 0;
+    build->statsAssets = build->statsPath != NULL ? cJSON_CreateArray() : NULL;
+    build->processorStats = build->statsPath != NULL
+        ? calloc(NUM_PROCESSORS, sizeof(processor_stats_t))
+        : NULL;
+
+    // Processors running their own threads (LDtk levels) share the -j
+    // threads with the assets processed concurrently, so a build never runs
+    // more than -j threads at once
+    uint32_t assetThreads = numPending < build->numThreads
+        ? (uint32_t)numPending : build->numThreads;
+    map_params.num_threads = assetThreads > 1
+        ? build->numThreads / assetThreads : build->numThreads;
+
+    printf("Processing %zu of %zu assets with %u threads\n",
+           numPending, numJobs, build->numThreads);
+    uint64_t processStart = get_time_ns(CLOCK_MONOTONIC);
+    osp_parallel_run(numJobs,
+                     build->numThreads,
+                     process_asset_job,
+                     commit_asset_job,
+                     build);
+    build->processNs = get_time_ns(CLOCK_MONOTONIC) - processStart;
+    printf("Processed %u assets, %zu duplicated payloads shared, "
+           "%" PRIu64 " bytes saved\n",
+           content_table_count, build->dedupAssets, build->dedupBytes);
+    if(build->compression != COMPRESSION_NONE)
+        printf("Compressed %zu assets from %" PRIu64 " to %" PRIu64 " bytes\n",
+               build->compressedAssets, build->compressedRawBytes,
+               build->compressedBytes);
+    osp_hashmap_delete(build->payloads);
+    build->payloads = NULL;
+
+    // Write the content table, caching its real position
+    uint64_t tableStart = get_time_ns(CLOCK_MONOTONIC);
+    uint64_t tableTrace = osp_trace_begin();
+    tablePos = write_content_table(bundleWriter, build->legacyTable);
+    osp_trace_end("write_content_table", tableTrace, NULL);
+    build->tableNs = get_time_ns(CLOCK_MONOTONIC) - tableStart;
+    int result = osp_writer_flush(bundleWriter);
     // Write the real content table position at the start of
     // the file and close it.
     rewind(writeFile);
-    fwrite(&tablePos, sizeof(tablePos), 1, writeFile);
-    fclose(writeFile);
-    // Free the content table memory
-    free_content_table();
+    osp_writer_t headerWriter = osp_writer_new_file(writeFile, sizeof(tablePos));
+    osp_writer_put_u64(headerWriter, tablePos);
+    result |= osp_writer_flush(headerWriter);
+    osp_writer_delete(headerWriter);
+    osp_writer_delete(bundleWriter);
+    result |= fclose(writeFile);
+    build->writeFile = NULL;
+    build->bundleWriter = NULL;
 
-    // Go back to the initial directory
-    chdir(startingPath);
+    // Replace the output bundle only once completely written
+    if(result != 0 || rename(tempPath, build->outputPath) != 0)
+    {
+        printf("Unable to write output bundle %s\n", build->outputPath);
+        unlink(tempPath);
+        cJSON_Delete(build->statsAssets);
+        build->statsAssets = NULL;
+        free(build->processorStats);
+        build->processorStats = NULL;
+        return 1;
+    }
+    build->buildNs = get_time_ns(CLOCK_MONOTONIC) - buildStart;
+    osp_trace_end("build_bundle", buildTrace, build->outputPath);
+
+    if(build->statsAssets != NULL)
+    {
+        write_build_stats(build);
+        cJSON_Delete(build->statsAssets);
+        build->statsAssets = NULL;
+        free(build->processorStats);
+        build->processorStats = NULL;
+    }
 
     return 0;
 }
 
-void parse_directory(const char* path, char *prefix, FILE* writeFile)
+void watch_stop_handler(int signal)
 {
-    printf("Opening dir %s for parsing\n", path);
-    // Move to the directory to parse
-    if(chdir(path) != 0)
+    (void)signal;
+    watch_stop = 1;
+}
+
+int watch_content(build_context_t *build,
+                  osp_dynarray_t jobs,
+                  const char *root)
+{
+    int fd = inotify_init1(IN_CLOEXEC);
+    if(fd < 0)
     {
-        printf("\tUnable to move to directory %s\n", path);
-        return;
+        printf("Unable to watch %s\n", root);
+        return 1;
     }
+    osp_dynarray_t dirs = osp_dynarray_new(sizeof(watch_dir_t), 64, 64);
+    watch_add_tree(fd, dirs, root, "");
 
-    // Open directory to parse
-    DIR* directory = opendir(".");
-    if(directory == NULL)
+    // No SA_RESTART, so the signals interrupt poll
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = watch_stop_handler;
+    sigemptyset(&stopAction.sa_mask);
+    sigaction(SIGINT, &stopAction, NULL);
+    sigaction(SIGTERM, &stopAction, NULL);
+
+    printf("Watching %s for changes, Ctrl+C to stop\n", root);
+    char *buffer = malloc(WATCH_BUFFER_SIZE);
+    uint8_t pending = 0;
+    int result = 0;
+    while(!watch_stop)
+    {
+        // Wait for changes, then keep collecting them until they settle
+        struct pollfd pollFd = { .fd = fd, .events = POLLIN };
+        int ready = poll(&pollFd, 1, pending ? WATCH_DEBOUNCE_MS : -1);
+        if(ready < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            printf("Unable to wait for changes in %s\n", root);
+            result = 1;
+            break;
+        }
+
+        if(ready == 0)
+        {
+            // New assets were appended, put them back in path order so the
+            // bundle is the same as a fresh build of the tree
+            sort_asset_jobs(jobs);
+            if(build_bundle(build, jobs) == 0)
+                printf("Bundle %s built again in %.1f ms\n",
+                       build->outputPath, build->buildNs / 1e6);
+            pending = 0;
+            continue;
+        }
+
+        ssize_t length = read(fd, buffer, WATCH_BUFFER_SIZE);
+        if(length < 0)
+            continue;
+        for(ssize_t offset = 0; offset < length;)
+        {
+            struct inotify_event event;
+            memcpy(&event, buffer + offset, sizeof(event));
+            const char *name = buffer + offset + sizeof(event);
+            offset += sizeof(event) + event.len;
+
+            // Copy the name, events are not aligned in the buffer
+            struct inotify_event *namedEvent =
+                malloc(sizeof(event) + event.len + 1);
+            memcpy(namedEvent, &event, sizeof(event));
+            memcpy(namedEvent->name, name, event.len);
+            namedEvent->name[event.len] = '\0';
+            pending |= watch_handle_event(jobs, fd, dirs, root,
+                                          build->numThreads, namedEvent);
+            free(namedEvent);
+        }
+    }
+    printf("Stopped watching %s\n", root);
+
+    free(buffer);
+    for(size_t iDir = 0; iDir < osp_dynarray_get_count(dirs); ++iDir)
     {
-        printf("\tUnable to open %s\n", path);
+        watch_dir_t *dir = &(((watch_dir_t *)osp_dynarray_get_data(dirs))[iDir]);
+        free(dir->path);
+        free(dir->prefix);
+    }
+    osp_dynarray_delete(dirs);
+    close(fd);
+
+    return result;
+}
+
+void watch_add_tree(int fd,
+                    osp_dynarray_t dirs,
+                    const char *path,
+                    const char *prefix)
+{
+    int wd = inotify_add_watch(fd, path, IN_CLOSE_WRITE | IN_MOVED_TO |
+                                         IN_MOVED_FROM | IN_CREATE |
+                                         IN_DELETE | IN_ONLYDIR);
+    if(wd < 0)
+    {
+        printf("\tUnable to watch directory %s\n", path);
         return;
     }
 
-    printf("\tParsing directory with prefix %s\n", prefix);
+    watch_dir_t dir =
+    {
+        .wd = wd,
+        .path = strdup(path),
+        .prefix = strdup(prefix)
+    };
+    osp_dynarray_add(dirs, &dir);
+
+    DIR *directory = opendir(path);
+    if(directory == NULL)
+        return;
 
     struct dirent *entry;
-    struct stat entry_stat;
-    // Cycle all current directory entries
     while((entry = readdir(directory)))
     {
-        // Find info about the current directory
-        stat(entry->d_name, &entry_stat);
-        // If the current entry is a subdirectory
-        if(S_ISDIR(entry_stat.st_mode))
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        char childPath[MAX_PATH];
+        snprintf(childPath, MAX_PATH, "%s/%s", path, entry->d_name);
+        if(entry->d_type == DT_UNKNOWN)
         {
-            // Exclude the special "." and ".." directories
-            if(strncmp(entry->d_name, ".", 8) != 0 &&
-               strncmp(entry->d_name, "..", 8) != 0)
-            {
-                // Add the current subdirectory name to the asset prefix
-                char prefixBuffer[MAX_PATH];
-                strcpy(prefixBuffer, prefix);
-                strncat(prefixBuffer, entry->d_name, 128);
-                // Don't forget the trailing slash
-                strncat(prefixBuffer, "/", 4);
-                // Recursively parse the subdirectory
-                parse_directory(entry->d_name, prefixBuffer, writeFile);
-            }
+            struct stat entryStat;
+            if(stat(childPath, &entryStat) != 0 || !S_ISDIR(entryStat.st_mode))
+                continue;
+        }
+        else if(entry->d_type != DT_DIR)
+            continue;
+
+        char childPrefix[MAX_PATH];
+        snprintf(childPrefix, MAX_PATH, "%s%s/", prefix, entry->d_name);
+        watch_add_tree(fd, dirs, childPath, childPrefix);
+    }
+    closedir(directory);
+}
+
+void watch_remove_tree(int fd, osp_dynarray_t dirs, const char *path)
+{
+    size_t pathLength = strlen(path);
+    for(size_t iDir = osp_dynarray_get_count(dirs); iDir > 0; --iDir)
+    {
+        watch_dir_t *dir = &(((watch_dir_t *)osp_dynarray_get_data(dirs))[iDir - 1]);
+        if(strncmp(dir->path, path, pathLength) != 0 ||
+           (dir->path[pathLength] != '\0' && dir->path[pathLength] != '/'))
+            continue;
+
+        // Deleted directories are no longer watched already, this only
+        // matters for moved ones
+        inotify_rm_watch(fd, dir->wd);
+        free(dir->path);
+        free(dir->prefix);
+        osp_dynarray_remove_at(dirs, iDir - 1, NULL);
+    }
+}
+
+uint8_t watch_dependency_changed(osp_dynarray_t jobs, const char *path)
+{
+    uint8_t changed = 0;
+    asset_job_t *jobsData = (asset_job_t *)osp_dynarray_get_data(jobs);
+    for(size_t iJob = 0; iJob < osp_dynarray_get_count(jobs); ++iJob)
+    {
+        asset_job_t *job = &(jobsData[iJob]);
+        size_t numDependencies = job->dependencies != NULL
+            ? osp_dynarray_get_count(job->dependencies) : 0;
+        osp_input_dependency_t *dependencies = numDependencies > 0
+            ? (osp_input_dependency_t *)osp_dynarray_get_data(job->dependencies)
+            : NULL;
+        for(size_t iDependency = 0; iDependency < numDependencies; ++iDependency)
+        {
+            if(strcmp(dependencies[iDependency].path, path) != 0)
+                continue;
+
+            // Drop the output to process the asset again
+            printf("Changed %s, used by %s\n", path, job->path);
+            free(job->data);
+            job->data = NULL;
+            job->size = 0;
+            job->processed = 0;
+            job->result = -1;
+            changed = 1;
+            break;
         }
-        else if(S_ISREG(entry_stat.st_mode))
+    }
+
+    return changed;
+}
+
+uint8_t watch_handle_event(osp_dynarray_t jobs,
+                           int fd,
+                           osp_dynarray_t dirs,
+                           const char *root,
+                           uint32_t numThreads,
+                           const struct inotify_event *event)
+{
+    if(event->mask & IN_Q_OVERFLOW)
+    {
+        // Changes were lost, everything has to be processed again
+        printf("Too many changes, parsing %s again\n", root);
+        asset_job_t *jobsData = (asset_job_t *)osp_dynarray_get_data(jobs);
+        for(size_t iJob = 0; iJob < osp_dynarray_get_count(jobs); ++iJob)
+            free_asset_job(&(jobsData[iJob]));
+        osp_dynarray_clear(jobs);
+        parse_directory(root, "", numThreads, jobs);
+
+        watch_remove_tree(fd, dirs, root);
+        watch_add_tree(fd, dirs, root, "");
+        return 1;
+    }
+
+    // Find the directory the event happened in
+    watch_dir_t *dir = NULL;
+    size_t dirIdx = 0;
+    for(; dirIdx < osp_dynarray_get_count(dirs); ++dirIdx)
+    {
+        dir = &(((watch_dir_t *)osp_dynarray_get_data(dirs))[dirIdx]);
+        if(dir->wd == event->wd)
+            break;
+    }
+    if(dirIdx == osp_dynarray_get_count(dirs))
+        return 0;
+
+    if(event->mask & IN_IGNORED)
+    {
+        // The watch is gone, with its directory
+        free(dir->path);
+        free(dir->prefix);
+        osp_dynarray_remove_at(dirs, dirIdx, NULL);
+        return 0;
+    }
+    if(event->len == 0)
+        return 0;
+
+    char path[MAX_PATH];
+    snprintf(path, MAX_PATH, "%s/%s", dir->path, event->name);
+
+    if(event->mask & IN_ISDIR)
+    {
+        if(event->mask & (IN_CREATE | IN_MOVED_TO))
         {
-            // This is a file, let's see if its something we can process
-            printf("Trying to process file %s\n", entry->d_name);
-            
-            char fileName[MAX_FILENAME];
-            char extension[MAX_EXTENSION];
-            char assetName[MAX_PATH];
-
-            // Find the postition of last dot to the right in the filename
-            char *lastDot = rindex(entry->d_name, '.');
-            int nameLength = 0;
-            if(lastDot == NULL) // This file has no extension
-            {
-                nameLength = strlen(entry->d_name);
-                extension[0] = '\0';
-            }
-            else
-            {
-                // Find the file name length without extension...
-                nameLength = lastDot - entry->d_name;
-                // ...and the extension length
-                int extensionLength = strlen(entry->d_name) - nameLength - 1;
-                // Save the extension separately
-                strncpy(extension, lastDot + 1, extensionLength);
-                extension[extensionLength] = '\0';
-            }
-            // Save the file name without extension
-            strncpy(fileName, entry->d_name, nameLength);
-            fileName[nameLength] = '\0';
-            // Save the asset name prefixing the file name with the path
-            // relative to the root.
-            strncpy(assetName, prefix, MAX_PATH - 1);
-            strncat(assetName, fileName, MAX_PATH - 1);
-
-            printf("\tFile name: %s\n", fileName);
-            printf("\tExtension: %s\n", extension);
-            printf("\tAsset name: %s\n", assetName);
-
-            // Check if this extension is in the supported types array
-            int32_t supported_type_idx = find_supported_type(extension);
-            if(supported_type_idx < 0)
-            {
-                printf("\tUnsupported file type %s, skipping\n", extension);
-            }
-            else // Supported asset type, let's process it
+            // A new subdirectory: watch it and queue all of its assets
+            char prefix[MAX_PATH];
+            snprintf(prefix, MAX_PATH, "%s%s/", dir->prefix, event->name);
+            watch_add_tree(fd, dirs, path, prefix);
+            size_t numJobs = osp_dynarray_get_count(jobs);
+            parse_directory(root, prefix, numThreads, jobs);
+            return osp_dynarray_get_count(jobs) > numJobs;
+        }
+        if(event->mask & (IN_DELETE | IN_MOVED_FROM))
+        {
+            // A subdirectory is gone, with all of its assets
+            watch_remove_tree(fd, dirs, path);
+            size_t pathLength = strlen(path);
+            uint8_t removed = 0;
+            for(size_t iJob = osp_dynarray_get_count(jobs); iJob > 0; --iJob)
             {
-                // Open the input asset file
-                FILE* readFile = fopen(entry->d_name, "rb");
-                // Save the current write file position for the content table
-                uint64_t start = ftell(writeFile);
-                // Call the supported processor
-                if(supported_processors[supported_type_idx].processor(readFile,
-                   writeFile, NULL) == 0)
+                asset_job_t *job =
+                    &(((asset_job_t *)osp_dynarray_get_data(jobs))[iJob - 1]);
+                if(strncmp(job->path, path, pathLength) == 0 &&
+                   job->path[pathLength] == '/')
                 {
-                    // Processing went fine, check how much data was written
-                    uint64_t size = ftell(writeFile) - start;
-                    // Save all the data into the content table
-                    add_content_table_entry(assetName,
-                        supported_processors[supported_type_idx].outputType,
-                        start, size);
+                    free_asset_job(job);
+                    osp_dynarray_remove_at(jobs, iJob - 1, NULL);
+                    removed = 1;
                 }
-
-                // We can close the input asset file, now
-                fclose(readFile);
             }
+            return removed;
         }
+        return 0;
     }
 
-    // Done with the current subdirectory, let's go back up one level
-    chdir("..");
-    // Close the open subdirectory
-    closedir(directory);
+    // Files other assets are made of, like LDtk external levels
+    if((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE |
+                       IN_MOVED_FROM)) &&
+       watch_dependency_changed(jobs, path))
+        return 1;
+
+    // Only files of supported types matter, this skips the output bundle too
+    const char *lastDot = rindex(event->name, '.');
+    if(lastDot == NULL || find_supported_type(lastDot + 1) < 0)
+        return 0;
+
+    int64_t jobIdx = find_asset_job(jobs, path);
+    if(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+    {
+        if(jobIdx < 0)
+        {
+            // A new asset
+            add_asset_job(root, dir->prefix, event->name, jobs);
+            return 1;
+        }
+
+        // A changed asset, drop its output to process it again
+        asset_job_t *job = &(((asset_job_t *)osp_dynarray_get_data(jobs))[jobIdx]);
+        printf("Changed %s\n", job->path);
+        free(job->data);
+        job->data = NULL;
+        job->size = 0;
+        job->processed = 0;
+        job->result = -1;
+        job->cached = 0;
+        return 1;
+    }
+    if((event->mask & (IN_DELETE | IN_MOVED_FROM)) && jobIdx >= 0)
+    {
+        // A removed asset
+        printf("Removed %s\n", path);
+        free_asset_job(&(((asset_job_t *)osp_dynarray_get_data(jobs))[jobIdx]));
+        osp_dynarray_remove_at(jobs, jobIdx, NULL);
+        return 1;
+    }
+
+    return 0;
+}
+
+int compare_asset_jobs(const void *a, const void *b)
+{
+    return strcmp(((const asset_job_t *)a)->path, ((const asset_job_t *)b)->path);
+}
+
+void sort_asset_jobs(osp_dynarray_t jobs)
+{
+    qsort(osp_dynarray_get_data(jobs), osp_dynarray_get_count(jobs),
+          sizeof(asset_job_t), compare_asset_jobs);
+}
+
+int64_t find_asset_job(osp_dynarray_t jobs, const char *path)
+{
+    asset_job_t *jobsData = (asset_job_t *)osp_dynarray_get_data(jobs);
+    for(size_t iJob = 0; iJob < osp_dynarray_get_count(jobs); ++iJob)
+        if(strcmp(jobsData[iJob].path, path) == 0)
+            return iJob;
+
+    return -1;
+}
+
+void parse_directory(const char* root,
+                     const char* prefix,
+                     uint32_t numThreads,
+                     osp_dynarray_t jobs)
+{
+    printf("Opening dir %s%s for parsing\n", root, prefix);
+    osp_dynarray_t files = osp_walk(root, prefix, numThreads);
+    if(files == NULL)
+    {
+        printf("\tUnable to open %s\n", root);
+        return;
+    }
+
+    char **paths = (char **)osp_dynarray_get_data(files);
+    for(size_t iFile = 0; iFile < osp_dynarray_get_count(files); ++iFile)
+    {
+        // Split the path relative to root into asset prefix and file name
+        char filePrefix[MAX_PATH];
+        const char *lastSlash = rindex(paths[iFile], '/');
+        const char *file = lastSlash != NULL ? lastSlash + 1 : paths[iFile];
+        size_t prefixLength = file - paths[iFile];
+        if(prefixLength >= MAX_PATH)
+            continue;
+        memcpy(filePrefix, paths[iFile], prefixLength);
+        filePrefix[prefixLength] = '\0';
+
+        add_asset_job(root, filePrefix, file, jobs);
+    }
+
+    osp_walk_free(files);
+}
+
+void add_asset_job(const char *root,
+                   const char *prefix,
+                   const char *file,
+                   osp_dynarray_t jobs)
+{
+    printf("Trying to process file %s\n", file);
+
+    char fileName[MAX_FILENAME];
+    char extension[MAX_EXTENSION];
+    char assetName[MAX_PATH];
+
+    // Find the postition of last dot to the right in the filename
+    const char *lastDot = rindex(file, '.');
+    int nameLength = 0;
+    if(lastDot == NULL) // This file has no extension
+    {
+        nameLength = strlen(file);
+        extension[0] = '\0';
+    }
+    else
+    {
+        // Find the file name length without extension...
+        nameLength = lastDot - file;
+        // ...and the extension length
+        int extensionLength = strlen(file) - nameLength - 1;
+        // Save the extension separately
+        strncpy(extension, lastDot + 1, extensionLength);
+        extension[extensionLength] = '\0';
+    }
+    // Save the file name without extension
+    strncpy(fileName, file, nameLength);
+    fileName[nameLength] = '\0';
+    // Save the asset name prefixing the file name with the path
+    // relative to the root.
+    strncpy(assetName, prefix, MAX_PATH - 1);
+    strncat(assetName, fileName, MAX_PATH - 1);
+
+    printf("\tFile name: %s\n", fileName);
+    printf("\tExtension: %s\n", extension);
+    printf("\tAsset name: %s\n", assetName);
+
+    // Check if this extension is in the supported types array
+    int32_t supported_type_idx = find_supported_type(extension);
+    if(supported_type_idx < 0)
+    {
+        printf("\tUnsupported file type %s, skipping\n", extension);
+        return;
+    }
+
+    // Supported asset type, let's queue it for processing. The input path
+    // is the root plus the asset prefix, so it stays valid once we are back
+    // to the starting directory.
+    size_t pathLength = strlen(root) + strlen(prefix) + strlen(file) + 2;
+    asset_job_t job =
+    {
+        .path = malloc(pathLength),
+        .name = strdup(assetName),
+        .processor_idx = supported_type_idx,
+        .processed = 0,
+        .result = -1,
+        .data = NULL,
+        .size = 0,
+        .cached = 0
+    };
+    snprintf(job.path, pathLength, "%s/%s%s", root, prefix, file);
+    osp_dynarray_add(jobs, &job);
+}
+
+void process_asset_job(void *context, size_t index)
+{
+    build_context_t *build = (build_context_t *)context;
+    asset_job_t *job = &(build->jobs[index]);
+
+    // Kept output of an unchanged asset
+    job->kept = job->processed;
+    if(job->processed)
+        return;
+    job->processed = 1;
+
+    // Measure the whole job, this thread runs nothing else meanwhile
+    uint64_t wallStart = get_time_ns(CLOCK_MONOTONIC);
+    uint64_t cpuStart = get_time_ns(CLOCK_THREAD_CPUTIME_ID);
+    int64_t memMark = osp_mem_mark();
+    run_asset_job(build, job);
+    job->peak_alloc = osp_mem_peak(memMark);
+    job->cpu_ns = get_time_ns(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+    job->wall_ns = get_time_ns(CLOCK_MONOTONIC) - wallStart;
+}
+
+void run_asset_job(build_context_t *build, asset_job_t *job)
+{
+    supported_processor_t *processor =
+        &(supported_processors[job->processor_idx]);
+
+    // Open (map) the input asset file
+    osp_input_t input;
+    if(osp_input_open(&input, job->path) != 0)
+    {
+        printf("\tUnable to open %s, skipping\n", job->path);
+        osp_input_close(&input);
+        return;
+    }
+
+    job->input_size = input.size;
+    if(build->cache != NULL)
+    {
+        // Only hash the input content if it changed since the last build
+        job->input_mtime = input.mtime;
+        if(!osp_cache_find_content_hash(build->cache, job->path,
+                                        job->input_size, job->input_mtime,
+                                        &(job->content_hash)))
+            job->content_hash = osp_hash64(input.data, input.size, 0);
+
+        // Same input, same processor and parameters: reuse the previous
+        // output
+        job->cache_key = osp_cache_key(job->path, job->content_hash,
+                                       processor->extension,
+                                       processor->version,
+                                       processor->params,
+                                       processor->paramsSize);
+        uint64_t cacheTrace = osp_trace_begin();
+        osp_input_free_dependencies(job->dependencies);
+        uint8_t loaded = osp_cache_load(build->cache, job->cache_key,
+                                        &(job->data), &(job->size),
+                                        &(job->dependencies));
+        osp_trace_end("cache_load", cacheTrace, job->path);
+        if(loaded)
+        {
+            job->result = 0;
+            job->cached = 1;
+            osp_input_close(&input);
+            compress_asset_job(build, job);
+            return;
+        }
+    }
+
+    // Every processor writes to its own memory buffer, so any number of
+    // them can run at the same time.
+    osp_writer_t writer = osp_writer_new(ASSET_WRITER_CAPACITY);
+    // Call the supported processor, its span is named after the extension
+    uint64_t processorTrace = osp_trace_begin();
+    job->result = processor->processor(&input, writer, processor->params);
+    osp_trace_end(processor->extension, processorTrace, job->path);
+    // Keep the output buffer, the committer will free it
+    job->data = osp_writer_detach(writer, &(job->size));
+    osp_writer_delete(writer);
+
+    // Keep the other files the processor read, a change to any of them
+    // means processing the input again
+    osp_input_free_dependencies(job->dependencies);
+    job->dependencies = input.dependencies;
+    input.dependencies = NULL;
+
+    // We can release the input asset file, now
+    osp_input_close(&input);
+
+    if(job->result != 0)
+        return;
+
+    // The cache holds the uncompressed output, independent of -z
+    if(build->cache != NULL)
+        osp_cache_store(build->cache, job->cache_key, job->data, job->size,
+                        job->dependencies);
+    compress_asset_job(build, job);
+}
+
+void compress_asset_job(build_context_t *build, asset_job_t *job)
+{
+    job->codec = OSP_CNT_CODEC_NONE;
+    job->raw_size = job->size;
+
+    if(build->compression != COMPRESSION_NONE && job->size > 0)
+    {
+        uint64_t compressTrace = osp_trace_begin();
+        size_t capacity = osp_lz4_compress_bound(job->size);
+        char *compressed = osp_mem_malloc(capacity);
+        size_t compressedSize = build->compression == COMPRESSION_HIGH
+            ? osp_lz4_compress_high(job->data, job->size, compressed, capacity)
+            : osp_lz4_compress_fast(job->data, job->size, compressed, capacity);
+
+        // Keep the compressed output only if it pays
+        if(compressedSize > 0 && compressedSize <
+           job->size - (job->size >> MIN_COMPRESSION_SAVING_SHIFT))
+        {
+            osp_mem_free(job->data);
+            job->data = compressed;
+            job->size = compressedSize;
+            job->codec = OSP_CNT_CODEC_LZ4;
+        }
+        else
+            osp_mem_free(compressed);
+        osp_trace_end("compress", compressTrace, job->path);
+    }
+
+    // Hash the stored output here, so the committer only has to look it up
+    job->data_hash = osp_hash64(job->data, job->size, 0);
+}
+
+void commit_asset_job(void *context, size_t index)
+{
+    build_context_t *build = (build_context_t *)context;
+    asset_job_t *job = &(build->jobs[index]);
+
+    if(job->result == 0)
+    {
+        int64_t payloadIdx = find_committed_payload(build, job->data,
+                                                    job->size, job->data_hash,
+                                                    job->codec);
+        uint64_t start;
+        if(payloadIdx >= 0)
+        {
+            // The same data is already in the bundle, just point to it
+            start = content_table[payloadIdx].start;
+            build->dedupAssets++;
+            build->dedupBytes += job->size;
+        }
+        else
+        {
+            // Processing went fine, append the output to the bundle
+            start = osp_writer_tell(build->bundleWriter);
+            osp_writer_put_bytes(build->bundleWriter, job->data, job->size);
+            osp_hashmap_insert(build->payloads, job->data_hash,
+                               content_table_count);
+        }
+        // Save all the data into the content table
+        add_content_table_entry(job->name,
+            supported_processors[job->processor_idx].outputType,
+            start, job->size, job->codec, job->raw_size);
+        if(job->codec != OSP_CNT_CODEC_NONE)
+        {
+            build->compressedAssets++;
+            build->compressedRawBytes += job->raw_size;
+            build->compressedBytes += job->size;
+        }
+
+        // Remember this input for the next incremental build
+        osp_cache_record(build->cache, job->path, job->input_size,
+                         job->input_mtime, job->content_hash, job->cache_key);
+        build->cacheHits += job->cached;
+        if(build->statsAssets != NULL)
+        {
+            add_asset_stats(build, job, payloadIdx >= 0);
+
+            // Per processor totals, the peak allocation is the highest one
+            processor_stats_t *processorStats =
+                &(build->processorStats[job->processor_idx]);
+            processorStats->assets++;
+            processorStats->wall_ns += job->wall_ns;
+            processorStats->cpu_ns += job->cpu_ns;
+            processorStats->input_bytes += job->input_size;
+            processorStats->output_bytes += job->raw_size;
+            processorStats->stored_bytes += job->size;
+            if(job->peak_alloc > processorStats->peak_alloc)
+                processorStats->peak_alloc = job->peak_alloc;
+        }
+    }
+
+    // The job is over, we don't need its data anymore
+    if(!build->keepOutputs)
+        free_asset_job(job);
+}
+
+void free_asset_job(asset_job_t *job)
+{
+    free(job->data);
+    free(job->path);
+    free(job->name);
+    osp_input_free_dependencies(job->dependencies);
+    job->data = NULL;
+    job->path = NULL;
+    job->name = NULL;
+    job->dependencies = NULL;
+}
+
+void add_asset_stats(build_context_t *build, asset_job_t *job, uint8_t shared)
+{
+    // Times are reported in milliseconds, with microsecond resolution
+    cJSON *asset = cJSON_CreateObject();
+    cJSON_AddStringToObject(asset, "name", job->name);
+    cJSON_AddStringToObject(asset, "path", job->path);
+    cJSON_AddStringToObject(asset, "processor",
+        supported_processors[job->processor_idx].extension);
+    cJSON_AddBoolToObject(asset, "cached", job->cached);
+    cJSON_AddBoolToObject(asset, "kept", job->kept);
+    cJSON_AddBoolToObject(asset, "shared", shared);
+    cJSON_AddNumberToObject(asset, "wall_ms", (job->wall_ns / 1000) / 1e3);
+    cJSON_AddNumberToObject(asset, "cpu_ms", (job->cpu_ns / 1000) / 1e3);
+    cJSON_AddNumberToObject(asset, "input_bytes", job->input_size);
+    cJSON_AddNumberToObject(asset, "output_bytes", job->raw_size);
+    cJSON_AddNumberToObject(asset, "stored_bytes", job->size);
+    cJSON_AddNumberToObject(asset, "peak_alloc_bytes", job->peak_alloc);
+    cJSON_AddItemToArray(build->statsAssets, asset);
+}
+
+int write_build_stats(build_context_t *build)
+{
+    cJSON *stats = cJSON_CreateObject();
+    cJSON_AddNumberToObject(stats, "threads", build->numThreads);
+    cJSON_AddNumberToObject(stats, "num_assets",
+                            cJSON_GetArraySize(build->statsAssets));
+    cJSON_AddNumberToObject(stats, "walk_ms", (build->walkNs / 1000) / 1e3);
+    cJSON_AddNumberToObject(stats, "process_ms",
+                            (build->processNs / 1000) / 1e3);
+    cJSON_AddNumberToObject(stats, "table_write_ms",
+                            (build->tableNs / 1000) / 1e3);
+    cJSON_AddNumberToObject(stats, "build_ms", (build->buildNs / 1000) / 1e3);
+
+    cJSON *totals = cJSON_AddObjectToObject(stats, "processors");
+    for(int iProcessor = 0; iProcessor < NUM_PROCESSORS; ++iProcessor)
+    {
+        const processor_stats_t *processorStats =
+            &(build->processorStats[iProcessor]);
+        cJSON *total = cJSON_AddObjectToObject(
+            totals, supported_processors[iProcessor].extension);
+        cJSON_AddNumberToObject(total, "assets", processorStats->assets);
+        cJSON_AddNumberToObject(total, "wall_ms",
+                                (processorStats->wall_ns / 1000) / 1e3);
+        cJSON_AddNumberToObject(total, "cpu_ms",
+                                (processorStats->cpu_ns / 1000) / 1e3);
+        cJSON_AddNumberToObject(total, "input_bytes",
+                                processorStats->input_bytes);
+        cJSON_AddNumberToObject(total, "output_bytes",
+                                processorStats->output_bytes);
+        cJSON_AddNumberToObject(total, "stored_bytes",
+                                processorStats->stored_bytes);
+        cJSON_AddNumberToObject(total, "peak_alloc_bytes",
+                                processorStats->peak_alloc);
+    }
+
+    // The assets array is still owned by the build context
+    cJSON_AddItemReferenceToObject(stats, "assets", build->statsAssets);
+    char *text = cJSON_Print(stats);
+    cJSON_Delete(stats);
+
+    int result = 1;
+    FILE *file = fopen(build->statsPath, "w");
+    if(file != NULL)
+    {
+        result = fputs(text, file) < 0;
+        result |= fputc('\n', file) == EOF;
+        result |= fclose(file);
+    }
+    if(result != 0)
+        printf("Unable to write build stats %s\n", build->statsPath);
+    cJSON_free(text);
+
+    return result;
+}
+
+uint64_t get_time_ns(clockid_t clock)
+{
+    struct timespec time;
+    clock_gettime(clock, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + time.tv_nsec;
 }
 
 void add_content_table_entry(const char *name,
                              uint8_t type,
                              uint64_t start,
-                             uint64_t size)
+                             uint64_t size,
+                             uint8_t codec,
+                             uint64_t rawSize)
 {
     if(name == NULL)
         return;
@@ -293,11 +1442,49 @@ void add_content_table_entry(const char *name,
     content_table[content_table_count].type = type;
     content_table[content_table_count].start = start;
     content_table[content_table_count].size = size;
+    content_table[content_table_count].codec = codec;
+    content_table[content_table_count].raw_size = rawSize;
 
     // Increase the entries count
     ++content_table_count;
 }
 
+int64_t find_committed_payload(build_context_t *build,
+                               const char *data,
+                               size_t size,
+                               uint64_t hash,
+                               uint8_t codec)
+{
+    size_t cursor = 0;
+    uint64_t entryIdx;
+    char *committedData = NULL;
+    int64_t found = -1;
+
+    // Iterate all the committed payloads with the same hash
+    while(found < 0 &&
+          osp_hashmap_find(build->payloads, hash, &cursor, &entryIdx))
+    {
+        if(content_table[entryIdx].size != size ||
+           content_table[entryIdx].codec != codec)
+            continue;
+
+        // Read the committed payload back from the bundle, so a hash
+        // collision can never make two different assets share data.
+        if(committedData == NULL)
+        {
+            committedData = malloc(size > 0 ? size : 1);
+            osp_writer_flush(build->bundleWriter);
+        }
+        if(pread(fileno(build->writeFile), committedData, size,
+                 content_table[entryIdx].start) == (ssize_t)size &&
+           memcmp(committedData, data, size) == 0)
+            found = entryIdx;
+    }
+
+    free(committedData);
+    return found;
+}
+
 void realloc_content_table()
 {
     // Let's double the capacity
@@ -320,25 +1507,23 @@ void free_content_table()
     free(content_table);
 }
 
-void write_content_table(FILE* writeFile)
+void clear_content_table()
 {
-    // Write the content table size, only the actually used entries,
-    // not the table capacity
-    fwrite(&content_table_count, sizeof(content_table_count), 1, writeFile);
-    // Write each entry sequentially
-    for(int iEntry = 0; iEntry < content_table_count; ++iEntry)
-    {
-        size_t nameLength = strlen(content_table[iEntry].name);
-        fwrite(&nameLength, sizeof(nameLength), 1, writeFile);
-        fwrite(content_table[iEntry].name,
-            sizeof(unsigned char), nameLength, writeFile);
-        fwrite(&(content_table[iEntry].type),
-            sizeof(content_table[iEntry].type), 1, writeFile);
-        fwrite(&(content_table[iEntry].start),
-            sizeof(content_table[iEntry].start), 1, writeFile);
-        fwrite(&(content_table[iEntry].size),
-            sizeof(content_table[iEntry].size), 1, writeFile);
-    }
+    // Free the memory allocated for every asset name string
+    for(uint32_t iEntry = 0; iEntry < content_table_count; ++iEntry)
+        free(content_table[iEntry].name);
+
+    content_table_count = 0;
+}
+
+uint64_t write_content_table(osp_writer_t writer, uint8_t legacy)
+{
+    // Write only the actually used entries, not the table capacity
+    if(legacy)
+        return osp_cnt_write_legacy_table(writer, content_table,
+                                          content_table_count);
+
+    return osp_cnt_write_table(writer, content_table, content_table_count);
 }
 
 int32_t find_supported_type(const char* extension)
@@ -0,0 +1,77 @@
+#include "mem.h"
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bytes allocated minus bytes freed by this thread. It can go negative when
+// a thread frees blocks allocated by another one.
+static __thread int64_t mem_current = 0;
+// Highest mem_current since the last mark
+static __thread int64_t mem_highest = 0;
+
+static void mem_track(int64_t delta)
+{
+    mem_current += delta;
+    if(mem_current > mem_highest)
+        mem_highest = mem_current;
+}
+
+void *osp_mem_malloc(size_t size)
+{
+    void *ptr = malloc(size);
+    if(ptr != NULL)
+        mem_track(malloc_usable_size(ptr));
+
+    return ptr;
+}
+
+void *osp_mem_calloc(size_t count, size_t size)
+{
+    void *ptr = calloc(count, size);
+    if(ptr != NULL)
+        mem_track(malloc_usable_size(ptr));
+
+    return ptr;
+}
+
+void *osp_mem_realloc(void *ptr, size_t size)
+{
+    int64_t previous = ptr != NULL ? (int64_t)malloc_usable_size(ptr) : 0;
+    void *new_ptr = realloc(ptr, size);
+    if(new_ptr != NULL)
+        mem_track((int64_t)malloc_usable_size(new_ptr) - previous);
+    else if(size == 0)
+        mem_track(-previous);
+
+    return new_ptr;
+}
+
+char *osp_mem_strdup(const char *string)
+{
+    size_t size = strlen(string) + 1;
+    char *copy = osp_mem_malloc(size);
+    if(copy != NULL)
+        memcpy(copy, string, size);
+
+    return copy;
+}
+
+void osp_mem_free(void *ptr)
+{
+    if(ptr == NULL)
+        return;
+
+    mem_track(-(int64_t)malloc_usable_size(ptr));
+    free(ptr);
+}
+
+int64_t osp_mem_mark()
+{
+    mem_highest = mem_current;
+    return mem_current;
+}
+
+uint64_t osp_mem_peak(int64_t mark)
+{
+    return mem_highest > mark ? (uint64_t)(mem_highest - mark) : 0;
+}
@@ -0,0 +1,140 @@
+#include "parallel.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Workers never run further ahead of the committer than this many tasks
+// per thread, so finished but uncommitted results can't pile up in memory.
+#define TASKS_AHEAD_PER_THREAD 4
+
+struct parallel_run
+{
+    pthread_mutex_t mutex;
+    // Signalled by workers when a task is finished
+    pthread_cond_t task_done;
+    // Signalled by the committer when the commit window moves forward
+    pthread_cond_t window_moved;
+    size_t count;
+    size_t next_task;
+    size_t next_commit;
+    size_t window;
+    uint8_t *done;
+    osp_task_fn task;
+    void *context;
+};
+
+void *parallel_worker(void *arg)
+{
+    struct parallel_run *run = (struct parallel_run *)arg;
+
+    for(;;)
+    {
+        pthread_mutex_lock(&run->mutex);
+        // Wait until the next task fits in the commit window
+        while(run->next_task < run->count &&
+              run->next_task >= run->next_commit + run->window)
+            pthread_cond_wait(&run->window_moved, &run->mutex);
+
+        if(run->next_task >= run->count)
+        {
+            pthread_mutex_unlock(&run->mutex);
+            break;
+        }
+
+        size_t index = run->next_task++;
+        pthread_mutex_unlock(&run->mutex);
+
+        run->task(run->context, index);
+
+        pthread_mutex_lock(&run->mutex);
+        run->done[index] = 1;
+        pthread_cond_signal(&run->task_done);
+        pthread_mutex_unlock(&run->mutex);
+    }
+
+    return NULL;
+}
+
+void parallel_run_serial(size_t count,
+                         osp_task_fn task,
+                         osp_commit_fn commit,
+                         void *context)
+{
+    for(size_t index = 0; index < count; ++index)
+    {
+        task(context, index);
+        if(commit != NULL)
+            commit(context, index);
+    }
+}
+
+void osp_parallel_run(size_t count,
+                      uint32_t num_threads,
+                      osp_task_fn task,
+                      osp_commit_fn commit,
+                      void *context)
+{
+    if(task == NULL || count == 0)
+        return;
+
+    // Nothing to parallelize, just run everything in order
+    if(num_threads <= 1 || count == 1)
+    {
+        parallel_run_serial(count, task, commit, context);
+        return;
+    }
+
+    if(num_threads > count)
+        num_threads = count;
+
+    struct parallel_run run;
+    pthread_mutex_init(&run.mutex, NULL);
+    pthread_cond_init(&run.task_done, NULL);
+    pthread_cond_init(&run.window_moved, NULL);
+    run.count = count;
+    run.next_task = 0;
+    run.next_commit = 0;
+    run.window = (size_t)num_threads * TASKS_AHEAD_PER_THREAD;
+    run.done = calloc(count, sizeof(uint8_t));
+    run.task = task;
+    run.context = context;
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+    uint32_t num_started = 0;
+    for(uint32_t i_thread = 0; i_thread < num_threads; ++i_thread)
+        if(pthread_create(&threads[num_started], NULL, parallel_worker, &run) == 0)
+            ++num_started;
+
+    // If no thread could be started, the calling thread does all the work
+    if(num_started == 0)
+        parallel_run_serial(count, task, commit, context);
+
+    // Commit the results in order as soon as they are available
+    for(size_t index = 0; num_started > 0 && index < count; ++index)
+    {
+        pthread_mutex_lock(&run.mutex);
+        while(!run.done[index])
+            pthread_cond_wait(&run.task_done, &run.mutex);
+        run.next_commit = index + 1;
+        pthread_cond_broadcast(&run.window_moved);
+        pthread_mutex_unlock(&run.mutex);
+
+        if(commit != NULL)
+            commit(context, index);
+    }
+
+    for(uint32_t i_thread = 0; i_thread < num_started; ++i_thread)
+        pthread_join(threads[i_thread], NULL);
+
+    free(threads);
+    free(run.done);
+    pthread_cond_destroy(&run.window_moved);
+    pthread_cond_destroy(&run.task_done);
+    pthread_mutex_destroy(&run.mutex);
+}
+
+uint32_t osp_parallel_num_cpus()
+{
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return num_cpus > 0 ? (uint32_t)num_cpus : 1;
+}
@@ -5,6 +5,7 @@
 #include <strings.h>
 #include <ctype.h>
 #include "dynarray.h"
+#include "mem.h"
 #include <errno.h>
 
 /// @brief Frame rectangle data structure
@@ -39,9 +40,7 @@ struct parser_state
     int32_t column;
 
     uint8_t state;
-} g_parser_state;
-
-#define MAX_LINE 1024
+};
 
 #define LINE_STATE_START        0
 #define LINE_STATE_FWIDTH       1
@@ -64,9 +63,9 @@ uint8_t starts_with(const char *prefix, const char *string)
     return strncmp(prefix, string, strlen(prefix)) == 0;
 }
 
-void skip_prefix(char *prefix, char **string)
+void skip_prefix(const char *prefix, const char **string)
 {
-    while(*prefix == **string)
+    while(*prefix != '\0' && *prefix == **string)
     {
         ++prefix;
         ++(*string);
@@ -75,31 +74,44 @@ void skip_prefix(char *prefix, char **string)
 
 //#define SKIP_LINE while(*c != '\n' && *c != '\0' && c < end) ++c
 
-int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
+int fst_to_fst(const osp_input_t* input, osp_writer_t writer, void* params)
 {
     osp_dynarray_t sequences_array = osp_dynarray_new(sizeof(frame_sequence_t), 16, 16);
     osp_dynarray_t frames_array = osp_dynarray_new(sizeof(frame_rect_t), 16, 16);
 
-    frame_sequence_t current_sequence;
-    frame_rect_t current_frame;
-
-    g_parser_state.frame_width = -1;
-    g_parser_state.frame_height = -1;
-    g_parser_state.grid_width = -1;
-    g_parser_state.grid_height = -1;
-    g_parser_state.row_offset = 0;
-    g_parser_state.column_offset = 0;
-    g_parser_state.row = -1;
-    g_parser_state.column = -1;
-
-    char line[1024];
+    // Zero them, so partially specified frames are always written the same
+    frame_sequence_t current_sequence = { 0 };
+    frame_rect_t current_frame = { 0 };
+
+    // The parser state is local, so any number of files can be parsed
+    // at the same time.
+    struct parser_state parser_state;
+    parser_state.frame_width = -1;
+    parser_state.frame_height = -1;
+    parser_state.grid_width = -1;
+    parser_state.grid_height = -1;
+    parser_state.row_offset = 0;
+    parser_state.column_offset = 0;
+    parser_state.row = -1;
+    parser_state.column = -1;
+
+    // Parse the input in place, line by line
+    const char *line = input->data;
+    const char *input_end = input->data + input->size;
     uint32_t line_num = 0;
-    while(fgets(line, MAX_LINE, read_file))
+    while(line < input_end)
     {
-        g_parser_state.state = LINE_STATE_START;
-        int32_t line_len = MAX_LINE;
-        char *c = line;
-        char *end = line + MAX_LINE;
+        // Find where this line ends. The parser always sees a new line and
+        // a zero terminator after the line content, whatever the input
+        // really holds there.
+        const char *line_end = memchr(line, '\n', input_end - line);
+        if(line_end == NULL)
+            line_end = input_end;
+        const char *end = line_end + 2;
+
+        parser_state.state = LINE_STATE_START;
+        int32_t line_len = line_end - line;
+        const char *c = line;
         char *after_conv = NULL;
         uint8_t line_over = 0;
         
@@ -108,14 +120,16 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
             if(line_over)
                 break;
 
-            switch(g_parser_state.state)
+            const char ch = c < line_end ? *c : (c == line_end ? '\n' : '\0');
+
+            switch(parser_state.state)
             {
                 case LINE_STATE_START:
-                if(isspace(*c))
+                if(isspace(ch))
                 {
                     --line_len;
                 }
-                else if(*c == '.' || isdigit(*c))
+                else if(ch == '.' || isdigit(ch))
                 {
                     osp_dynarray_clear(frames_array);
                     current_sequence.frames = NULL;
@@ -130,67 +144,67 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
                     else
                     {
                         c = after_conv;
-                        if(g_parser_state.frame_width > 0)
+                        if(parser_state.frame_width > 0)
                         {
-                            current_frame.w = g_parser_state.frame_width;
-                            if(g_parser_state.grid_width > 0)
-                                current_frame.w *= g_parser_state.grid_width;
+                            current_frame.w = parser_state.frame_width;
+                            if(parser_state.grid_width > 0)
+                                current_frame.w *= parser_state.grid_width;
                         }
-                        if(g_parser_state.frame_height > 0)
+                        if(parser_state.frame_height > 0)
                         {
-                            current_frame.h = g_parser_state.frame_height;
-                            if(g_parser_state.grid_height > 0)
-                                current_frame.h *= g_parser_state.grid_height;
+                            current_frame.h = parser_state.frame_height;
+                            if(parser_state.grid_height > 0)
+                                current_frame.h *= parser_state.grid_height;
                         }
-                        if(g_parser_state.column >= 0)
+                        if(parser_state.column >= 0)
                         {
-                            current_frame.x = g_parser_state.column;
-                            if(g_parser_state.grid_width > 0)
-                                current_frame.x *= g_parser_state.grid_width;
+                            current_frame.x = parser_state.column;
+                            if(parser_state.grid_width > 0)
+                                current_frame.x *= parser_state.grid_width;
                         }
-                        else if(g_parser_state.row >= 0)
+                        else if(parser_state.row >= 0)
                         {
-                            current_frame.y = g_parser_state.row;
-                            if(g_parser_state.grid_height > 0)
-                                current_frame.y *= g_parser_state.grid_height;
+                            current_frame.y = parser_state.row;
+                            if(parser_state.grid_height > 0)
+                                current_frame.y *= parser_state.grid_height;
                         }
-                        g_parser_state.state = LINE_STATE_SEQ;
+                        parser_state.state = LINE_STATE_SEQ;
                     }
                 }
                 else if(starts_with(WIDTH_CMD, c))
                 {
                     skip_prefix(WIDTH_CMD, &c);
-                    g_parser_state.state = LINE_STATE_FWIDTH;
+                    parser_state.state = LINE_STATE_FWIDTH;
                 }
                 else if(starts_with(HEIGHT_CMD, c))
                 {
                     skip_prefix(HEIGHT_CMD, &c);
-                    g_parser_state.state = LINE_STATE_FHEIGHT;
+                    parser_state.state = LINE_STATE_FHEIGHT;
                 }
                 else if(starts_with(ROW_CMD, c))
                 {
                     skip_prefix(ROW_CMD, &c);
-                    g_parser_state.state = LINE_STATE_ROW;
+                    parser_state.state = LINE_STATE_ROW;
                 }
                 else if(starts_with(COLUMN_CMD, c))
                 {
                     skip_prefix(COLUMN_CMD, &c);
-                    g_parser_state.state = LINE_STATE_COL;
+                    parser_state.state = LINE_STATE_COL;
                 }
                 else if(starts_with(GRID_CMD, c))
                 {
                     skip_prefix(GRID_CMD, &c);
-                    g_parser_state.state = LINE_STATE_GRID_W;
+                    parser_state.state = LINE_STATE_GRID_W;
                 }
                 else if(starts_with(ROW_OFFSET_CMD, c))
                 {
                     skip_prefix(ROW_OFFSET_CMD, &c);
-                    g_parser_state.state = LINE_STATE_ROW_OFFSET;
+                    parser_state.state = LINE_STATE_ROW_OFFSET;
                 }
                 else if(starts_with(COLUMN_OFFSET_CMD, c))
                 {
                     skip_prefix(COLUMN_OFFSET_CMD, &c);
-                    g_parser_state.state = LINE_STATE_COL_OFFSET;
+                    parser_state.state = LINE_STATE_COL_OFFSET;
                 }
                 else
                 {
@@ -199,149 +213,149 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
                 }
                 break;
                 case LINE_STATE_FWIDTH:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
-                    int32_t prev_fwidth = g_parser_state.frame_width;
-                    g_parser_state.frame_width = strtol(c, &after_conv, 10);
+                    int32_t prev_fwidth = parser_state.frame_width;
+                    parser_state.frame_width = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.frame_width = prev_fwidth;
+                        parser_state.frame_width = prev_fwidth;
                         printf("Error converting frame width on line %d. Skipping line.\n", line_num);
                     }
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_FHEIGHT:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
-                    int32_t prev_fheight = g_parser_state.frame_height;
-                    g_parser_state.frame_height = strtol(c, &after_conv, 10);
+                    int32_t prev_fheight = parser_state.frame_height;
+                    parser_state.frame_height = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.frame_height = prev_fheight;
+                        parser_state.frame_height = prev_fheight;
                         printf("Error converting frame height on line %d. Skipping line.\n", line_num);
                     }
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_GRID_W:
-                if(isdigit(*c) || *c == '-')
+                if(isdigit(ch) || ch == '-')
                 {
                     errno = 0;
-                    int32_t prev_grid_w = g_parser_state.grid_width;
-                    g_parser_state.grid_width = strtol(c, &after_conv, 10);
+                    int32_t prev_grid_w = parser_state.grid_width;
+                    parser_state.grid_width = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.grid_width = prev_grid_w;
+                        parser_state.grid_width = prev_grid_w;
                         printf("Error converting grid width on line %d. Skipping line.\n", line_num);
                         line_over = 1;
                     }
                     else
                     {
                         c = after_conv;
-                        g_parser_state.state = LINE_STATE_GRID_H;
+                        parser_state.state = LINE_STATE_GRID_H;
                     }
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_GRID_H:
-                if(isdigit(*c) || *c == '-')
+                if(isdigit(ch) || ch == '-')
                 {
                     errno = 0;
-                    int32_t prev_grid_h = g_parser_state.grid_height;
-                    g_parser_state.grid_height = strtol(c, &after_conv, 10);
+                    int32_t prev_grid_h = parser_state.grid_height;
+                    parser_state.grid_height = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.grid_height = prev_grid_h;
+                        parser_state.grid_height = prev_grid_h;
                         printf("Error converting grid height on line %d. Skipping line.\n", line_num);
                     }
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_ROW_OFFSET:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
-                    int32_t prev_row = g_parser_state.row_offset;
-                    g_parser_state.row_offset = strtol(c, &after_conv, 10);
+                    int32_t prev_row = parser_state.row_offset;
+                    parser_state.row_offset = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.row_offset = prev_row;
+                        parser_state.row_offset = prev_row;
                         printf("Error converting row offset on line %d. Skipping line.\n", line_num);
                     }
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_COL_OFFSET:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
-                    int32_t prev_col = g_parser_state.column_offset;
-                    g_parser_state.column_offset = strtol(c, &after_conv, 10);
+                    int32_t prev_col = parser_state.column_offset;
+                    parser_state.column_offset = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.column_offset = prev_col;
+                        parser_state.column_offset = prev_col;
                         printf("Error converting column offset on line %d. Skipping line.\n", line_num);
                     }
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_ROW:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
-                    int32_t prev_row = g_parser_state.row;
-                    g_parser_state.row = strtol(c, &after_conv, 10);
+                    int32_t prev_row = parser_state.row;
+                    parser_state.row = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.row = prev_row;
+                        parser_state.row = prev_row;
                         printf("Error converting row on line %d. Skipping line.\n", line_num);
                     }
                     else
-                        g_parser_state.column = -1;
+                        parser_state.column = -1;
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_COL:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
-                    int32_t prev_col = g_parser_state.column;
-                    g_parser_state.column = strtol(c, &after_conv, 10);
+                    int32_t prev_col = parser_state.column;
+                    parser_state.column = strtol(c, &after_conv, 10);
                     if (errno != 0)
                     {
-                        g_parser_state.column = prev_col;
+                        parser_state.column = prev_col;
                         printf("Error converting column on line %d. Skipping line.\n", line_num);
                     }
                     else
-                        g_parser_state.row = -1;
+                        parser_state.row = -1;
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_SEQ:
                 // If all these parser states are set, the frame sequence is specified by single values, for the
                 // x or y position of the frame.
-                if(g_parser_state.frame_width > 0 && g_parser_state.frame_height > 0 && 
-                   (g_parser_state.column >= 0 || g_parser_state.row >= 0))
+                if(parser_state.frame_width > 0 && parser_state.frame_height > 0 && 
+                   (parser_state.column >= 0 || parser_state.row >= 0))
                 {
-                    if(isdigit(*c))
+                    if(isdigit(ch))
                     {
                         errno = 0;
                         uint32_t frame_val = strtol(c, &after_conv, 10);
@@ -355,56 +369,57 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
                             c = after_conv;
     
                             // If the current column (x pos) is set, the number is the y frame position.
-                            if(g_parser_state.column >= 0)
+                            if(parser_state.column >= 0)
                             {
-                                current_frame.y = frame_val + g_parser_state.row_offset;
-                                if(g_parser_state.grid_height > 0)
-                                    current_frame.y *= g_parser_state.grid_height;
+                                current_frame.y = frame_val + parser_state.row_offset;
+                                if(parser_state.grid_height > 0)
+                                    current_frame.y *= parser_state.grid_height;
                             }
                             else // This must be the frame x position.
                             {
-                                current_frame.x = frame_val + g_parser_state.column_offset;
-                                if(g_parser_state.grid_width > 0)
-                                    current_frame.x *= g_parser_state.grid_width;
+                                current_frame.x = frame_val + parser_state.column_offset;
+                                if(parser_state.grid_width > 0)
+                                    current_frame.x *= parser_state.grid_width;
                             }
 
                             osp_dynarray_add(frames_array, &current_frame);
                         }
                     }
-                    else if(*c == '\n' || *c == '\0')
+                    else if(ch == '\n' || ch == '\0')
                     {
                         // Sequence is over, add to the array
                         current_sequence.num_frames = osp_dynarray_get_count(frames_array);
-                        current_sequence.frames = calloc(current_sequence.num_frames, sizeof(frame_rect_t));
+                        current_sequence.frames = osp_mem_calloc(current_sequence.num_frames, sizeof(frame_rect_t));
                         memcpy(current_sequence.frames, osp_dynarray_get_data(frames_array), current_sequence.num_frames * sizeof(frame_rect_t));
                         osp_dynarray_clear(frames_array);
 
                         osp_dynarray_add(sequences_array, &current_sequence);
                         line_over = 1;
                     }
-                    else if(!isspace(*c))
+                    else if(!isspace(ch))
                     {
-                        printf("Invalid character %c on line %d. Skipping line.\n", *c, line_num);
+                        printf("Invalid character %c on line %d. Skipping line.\n", ch, line_num);
                         line_over = 1;
                     }
                 }
-                else if(*c == '(')
+                else if(ch == '(')
                 {
-                    g_parser_state.state = LINE_STATE_SEQ_FRAME_1;
+                    parser_state.state = LINE_STATE_SEQ_FRAME_1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                 {
                     // Sequence is over, add to the array
                     current_sequence.num_frames = osp_dynarray_get_count(frames_array);
-                    current_sequence.frames = calloc(current_sequence.num_frames, sizeof(frame_rect_t));
-                    memcpy(current_sequence.frames, osp_dynarray_get_data(frames_array), current_sequence.num_frames);
+                    current_sequence.frames = osp_mem_calloc(current_sequence.num_frames, sizeof(frame_rect_t));
+                    memcpy(current_sequence.frames, osp_dynarray_get_data(frames_array), current_sequence.num_frames * sizeof(frame_rect_t));
                     osp_dynarray_clear(frames_array);
 
                     osp_dynarray_add(sequences_array, &current_sequence);
+                    line_over = 1;
                 }
                 break;
                 case LINE_STATE_SEQ_FRAME_1:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
                     uint32_t frame_val = strtol(c, &after_conv, 10);
@@ -418,44 +433,44 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
                         c = after_conv;
 
                         // If the current column (x pos) is set, the first number is the y frame position.
-                        if(g_parser_state.column >= 0)
+                        if(parser_state.column >= 0)
                         {
-                            current_frame.y = frame_val + g_parser_state.row_offset;
-                            if(g_parser_state.grid_height > 0)
-                                current_frame.y *= g_parser_state.grid_height;
+                            current_frame.y = frame_val + parser_state.row_offset;
+                            if(parser_state.grid_height > 0)
+                                current_frame.y *= parser_state.grid_height;
 
                             // If both width and height are set, we're done here.
-                            if(g_parser_state.frame_width > 0 && g_parser_state.frame_height > 0)
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                            if(parser_state.frame_width > 0 && parser_state.frame_height > 0)
+                                parser_state.state = LINE_STATE_SEQ_FRAME_C;
                             else
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_2;
+                                parser_state.state = LINE_STATE_SEQ_FRAME_2;
                         }
                         else // This must be the frame x position.
                         {
-                            current_frame.x = frame_val + g_parser_state.column_offset;
-                            if(g_parser_state.grid_width > 0)
-                                current_frame.x *= g_parser_state.grid_width;
+                            current_frame.x = frame_val + parser_state.column_offset;
+                            if(parser_state.grid_width > 0)
+                                current_frame.x *= parser_state.grid_width;
 
                             // If row and both width and height are set, we're done here.
-                            if(g_parser_state.row >= 0 &&
-                               g_parser_state.frame_width > 0 &&
-                               g_parser_state.frame_height > 0)
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                            if(parser_state.row >= 0 &&
+                               parser_state.frame_width > 0 &&
+                               parser_state.frame_height > 0)
+                                parser_state.state = LINE_STATE_SEQ_FRAME_C;
                             else
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_2;
+                                parser_state.state = LINE_STATE_SEQ_FRAME_2;
                         }
                     }
                 }
-                else if(*c == ')')
+                else if(ch == ')')
                 {
                     printf("Early closed parentheses on line %d. Skipping line.\n", line_num);
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_SEQ_FRAME_2:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
                     uint32_t frame_val = strtol(c, &after_conv, 10);
@@ -470,55 +485,55 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
 
                         // If the current column (x pos) or row (y pos) is set,
                         // the second number is the frame width or height.
-                        if(g_parser_state.column >= 0 || g_parser_state.row >= 0)
+                        if(parser_state.column >= 0 || parser_state.row >= 0)
                         {
                             // If the frame width is set, this must be the frame height.
-                            if(g_parser_state.frame_width > 0)
+                            if(parser_state.frame_width > 0)
                             {
                                 current_frame.h = frame_val;
-                                if(g_parser_state.grid_height > 0)
-                                    current_frame.h *= g_parser_state.grid_height;
+                                if(parser_state.grid_height > 0)
+                                    current_frame.h *= parser_state.grid_height;
 
                                 // After setting the height, we're done. Look for a closed parentheses.
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                                parser_state.state = LINE_STATE_SEQ_FRAME_C;
                             }
                             else
                             {
                                 current_frame.w = frame_val;
-                                if(g_parser_state.grid_width > 0)
-                                    current_frame.w *= g_parser_state.grid_width;
+                                if(parser_state.grid_width > 0)
+                                    current_frame.w *= parser_state.grid_width;
 
                                 // If the frame height is already set, we're done here.
-                                if(g_parser_state.frame_height > 0)
-                                    g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                                if(parser_state.frame_height > 0)
+                                    parser_state.state = LINE_STATE_SEQ_FRAME_C;
                                 else
-                                    g_parser_state.state = LINE_STATE_SEQ_FRAME_3;
+                                    parser_state.state = LINE_STATE_SEQ_FRAME_3;
                             }
                         }
                         else // This must be the frame y position.
                         {
-                            current_frame.y = frame_val + g_parser_state.row_offset;
-                            if(g_parser_state.grid_height > 0)
-                                current_frame.y *= g_parser_state.grid_height;
+                            current_frame.y = frame_val + parser_state.row_offset;
+                            if(parser_state.grid_height > 0)
+                                current_frame.y *= parser_state.grid_height;
 
                             // If both frame width and height are set, we're done here.
-                            if(g_parser_state.frame_width > 0 && g_parser_state.frame_height > 0)
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                            if(parser_state.frame_width > 0 && parser_state.frame_height > 0)
+                                parser_state.state = LINE_STATE_SEQ_FRAME_C;
                             else
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_3;
+                                parser_state.state = LINE_STATE_SEQ_FRAME_3;
                         }
                     }
                 }
-                else if(*c == ')')
+                else if(ch == ')')
                 {
                     printf("Early closed parentheses on line %d. Skipping line.\n", line_num);
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_SEQ_FRAME_3:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
                     uint32_t frame_val = strtol(c, &after_conv, 10);
@@ -532,39 +547,39 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
                         c = after_conv;
 
                         // If the frame width is set, this must be the frame height.
-                        if(g_parser_state.frame_width > 0)
+                        if(parser_state.frame_width > 0)
                         {
                             current_frame.h = frame_val;
-                            if(g_parser_state.grid_height > 0)
-                                current_frame.h *= g_parser_state.grid_height;
+                            if(parser_state.grid_height > 0)
+                                current_frame.h *= parser_state.grid_height;
 
                             // After setting the height, we're done. Look for a closed parentheses.
-                            g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                            parser_state.state = LINE_STATE_SEQ_FRAME_C;
                         }
                         else
                         {
                             current_frame.w = frame_val;
-                            if(g_parser_state.grid_width > 0)
-                                current_frame.w *= g_parser_state.grid_width;
+                            if(parser_state.grid_width > 0)
+                                current_frame.w *= parser_state.grid_width;
 
                             // If the frame heigth is set, we're done here.
-                            if(g_parser_state.frame_height > 0)
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                            if(parser_state.frame_height > 0)
+                                parser_state.state = LINE_STATE_SEQ_FRAME_C;
                             else
-                                g_parser_state.state = LINE_STATE_SEQ_FRAME_4;
+                                parser_state.state = LINE_STATE_SEQ_FRAME_4;
                         }
                     }
                 }
-                else if(*c == ')')
+                else if(ch == ')')
                 {
                     printf("Early closed parentheses on line %d. Skipping line.\n", line_num);
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_SEQ_FRAME_4:
-                if(isdigit(*c))
+                if(isdigit(ch))
                 {
                     errno = 0;
                     uint32_t frame_val = strtol(c, &after_conv, 10);
@@ -578,61 +593,57 @@ int fst_to_fst(FILE* read_file, FILE* write_file, void* params)
                         c = after_conv;
 
                         current_frame.h = frame_val;
-                        if(g_parser_state.grid_height > 0)
-                            current_frame.h *= g_parser_state.grid_height;
+                        if(parser_state.grid_height > 0)
+                            current_frame.h *= parser_state.grid_height;
 
                         // After setting the height, we're done. Look for a closed parentheses.
-                        g_parser_state.state = LINE_STATE_SEQ_FRAME_C;
+                        parser_state.state = LINE_STATE_SEQ_FRAME_C;
                     }
                 }
-                else if(*c == ')')
+                else if(ch == ')')
                 {
                     printf("Early closed parentheses on line %d. Skipping line.\n", line_num);
                     line_over = 1;
                 }
-                else if(*c == '\n' || *c == '\0')
+                else if(ch == '\n' || ch == '\0')
                     line_over = 1;
                 break;
                 case LINE_STATE_SEQ_FRAME_C:
-                if(!isspace(*c) && *c != ')')
+                if(!isspace(ch) && ch != ')')
                 {
                     printf(
                         "Invalid character %c while looking for closed parentheses on line %d. Skipping line.\n",
-                        *c,
+                        ch,
                         line_num
                         );
                     line_over = 1;
                 }
-                else if(*c == ')')
+                else if(ch == ')')
                 {
                     osp_dynarray_add(frames_array, &current_frame);
-                    g_parser_state.state = LINE_STATE_SEQ;
+                    parser_state.state = LINE_STATE_SEQ;
                 }                
                 break;
             }
         }
 
+        line = line_end + 1;
         ++line_num;
     }
 
     size_t num_elements = osp_dynarray_get_count(sequences_array);
-    fwrite(&num_elements, sizeof(num_elements), 1, write_file);
+    osp_writer_put_u64(writer, num_elements);
     for(
         frame_sequence_t *sequence = (frame_sequence_t *)osp_dynarray_fwd_iter_start(sequences_array);
         osp_dynarray_iter_check(sequences_array);
         osp_dynarray_fwd_iter_next(sequences_array, (void **)&sequence)
     )
     {
-        fwrite(&(sequence->duration), sizeof(sequence->duration), 1, write_file);
-        fwrite(&(sequence->num_frames), sizeof(sequence->num_frames), 1, write_file);
-        for(int i_frame = 0; i_frame < sequence->num_frames; ++i_frame)
-        {
-            fwrite(&(sequence->frames[i_frame].x), sizeof(sequence->frames[i_frame].x), 1, write_file);
-            fwrite(&(sequence->frames[i_frame].y), sizeof(sequence->frames[i_frame].y), 1, write_file);
-            fwrite(&(sequence->frames[i_frame].w), sizeof(sequence->frames[i_frame].w), 1, write_file);
-            fwrite(&(sequence->frames[i_frame].h), sizeof(sequence->frames[i_frame].h), 1, write_file);
-        }
-        free(sequence->frames);
+        osp_writer_put_f32(writer, sequence->duration);
+        osp_writer_put_u32(writer, sequence->num_frames);
+        // Frames are four packed uint32_t each: x, y, w and h
+        osp_writer_put_u32_array(writer, (const uint32_t *)sequence->frames, sequence->num_frames * 4);
+        osp_mem_free(sequence->frames);
     }
 
     osp_dynarray_delete(sequences_array);
@@ -1,19 +1,28 @@
 #include "processors/ldtk_to_map.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include "cJSON.h"
+#include "hash.h"
+#include "hashmap.h"
+#include "ldtk_to_map_internal.h"
+#include "parallel.h"
+#include "mem.h"
+#include "trace.h"
 
 // WARNING: this parser is very rough and WIP, it just extrapolates minimal
 //          map data without much care for check or processing.
 
-// Number of valid map tile layers supported
-const int MAX_VALID_TILE_LAYERS = 16;
-// Number of valid map collision layers supported
-const int MAX_VALID_COLLISION_LAYERS = 16;
-// Number of valid map entities layers supported
-const int MAX_VALID_ENTITIES_LAYERS = 16;
+// Number of valid map layers of each kind supported, MAP assets store the
+// layer counts in a byte
+const int MAX_VALID_LAYERS = UINT8_MAX;
+// Chunked layers write buffer initial capacity
+const size_t ASSET_CHUNKS_CAPACITY = 65536;
+// Smallest json arena block, the trees of bigger files get blocks of their
+// size
+const size_t JSON_ARENA_BLOCK_SIZE = 65536;
 
 // We'll need this structure to save valid layers
 // info before data retrieval.
@@ -23,26 +32,6 @@ struct valid_layer
     uint16_t order;
 };
 
-void register_collision_rectangle(
-    collisions_layer_t *layer,
-    uint32_t x,
-    uint32_t y,
-    uint32_t w,
-    uint16_t h,
-    uint32_t tile_size
-)
-{
-    if(layer->num_rectangles >= MAX_DEFINABLE_COLLISION_RECTS - 1)
-        return;
-
-    layer->rectangles[layer->num_rectangles].x = x * tile_size;
-    layer->rectangles[layer->num_rectangles].y = y * tile_size;
-    layer->rectangles[layer->num_rectangles].w = w * tile_size;
-    layer->rectangles[layer->num_rectangles].h = h * tile_size;
-
-    layer->num_rectangles++;
-}
-
 uint8_t validate_collisions_layer(
     cJSON *layer_instance,
     uint32_t width,
@@ -75,32 +64,16 @@ uint8_t validate_collisions_layer(
     return 0;
 }
 
-uint8_t validate_tiles_layer(
-    cJSON *layer_instance,
+uint8_t accept_tiles_layer(
+    uint32_t this_width,
+    uint32_t this_height,
+    uint32_t this_grid_size,
+    const char *tileset_file_name,
     uint32_t *width,
     uint32_t *height,
     uint32_t *grid_size,
     char **tile_set)
 {
-    // Let's fetch width and height in tiles and the grid
-    // size in pixels (only square tiles)
-    cJSON *width_element = cJSON_GetObjectItemCaseSensitive(
-        layer_instance,
-        "__cWid");
-    cJSON *height_element = cJSON_GetObjectItemCaseSensitive(
-        layer_instance,
-        "__cHei");
-    cJSON *grid_size_element = cJSON_GetObjectItemCaseSensitive(
-        layer_instance,
-        "__gridSize");
-    // Fetch the tileset path, too
-    cJSON *tileset_element = cJSON_GetObjectItemCaseSensitive(
-        layer_instance,
-        "__tilesetRelPath");
-
-    uint32_t this_width = (uint32_t)cJSON_GetNumberValue(width_element);
-    uint32_t this_height = (uint32_t)cJSON_GetNumberValue(height_element);
-    uint32_t this_grid_size = (uint32_t)cJSON_GetNumberValue(grid_size_element);
     // We only allow same size layers at the moment, so
     // did we already set the map width, height and grid size?
     if(*width > 0)
@@ -130,15 +103,13 @@ uint8_t validate_tiles_layer(
             // Let's save the tileset name, we will use it
             // to fetch a corresponding image from the bundle.
             // Just one tileset for the whole map, for now.
-            char *tileset_file_name =
-                cJSON_GetStringValue(tileset_element);
             char *last_dot = rindex(tileset_file_name, '.');
             int tile_set_len = 0;
             if(last_dot == NULL)
                 tile_set_len = strlen(tileset_file_name);
             else
                 tile_set_len = last_dot - tileset_file_name;
-            *tile_set = malloc(tile_set_len + 1);
+            *tile_set = osp_mem_malloc(tile_set_len + 1);
             strncpy(*tile_set, tileset_file_name, tile_set_len);
             (*tile_set)[tile_set_len] = '\0';
 
@@ -147,29 +118,260 @@ uint8_t validate_tiles_layer(
     }
 }
 
-cJSON *map_json = NULL;
+uint8_t validate_tiles_layer(
+    cJSON *layer_instance,
+    uint32_t *width,
+    uint32_t *height,
+    uint32_t *grid_size,
+    char **tile_set)
+{
+    // Let's fetch width and height in tiles and the grid
+    // size in pixels (only square tiles)
+    cJSON *width_element = cJSON_GetObjectItemCaseSensitive(
+        layer_instance,
+        "__cWid");
+    cJSON *height_element = cJSON_GetObjectItemCaseSensitive(
+        layer_instance,
+        "__cHei");
+    cJSON *grid_size_element = cJSON_GetObjectItemCaseSensitive(
+        layer_instance,
+        "__gridSize");
+    // Fetch the tileset path, too
+    cJSON *tileset_element = cJSON_GetObjectItemCaseSensitive(
+        layer_instance,
+        "__tilesetRelPath");
+
+    return accept_tiles_layer(
+        (uint32_t)cJSON_GetNumberValue(width_element),
+        (uint32_t)cJSON_GetNumberValue(height_element),
+        (uint32_t)cJSON_GetNumberValue(grid_size_element),
+        cJSON_GetStringValue(tileset_element),
+        width,
+        height,
+        grid_size,
+        tile_set);
+}
+
+// Every json tree is parsed in an arena of its own, so no tree is built (or
+// freed) node by node and trees can be parsed at the same time
+cJSON *parse_json_in_arena(const osp_input_t *input, cJSON_Arena **arena)
+{
+    *arena = cJSON_CreateArena(input->size > JSON_ARENA_BLOCK_SIZE
+                                   ? input->size
+                                   : JSON_ARENA_BLOCK_SIZE);
+
+    uint64_t parse_trace = osp_trace_begin();
+    cJSON *root = cJSON_ParseWithArena(input->data, input->size, *arena);
+    osp_trace_end("cJSON_Parse", parse_trace, input->path);
+
+    return root;
+}
+
+cJSON *parse_ldtk_file_for_levels(
+    const osp_input_t *input,
+    cJSON **map_json,
+    osp_dynarray_t json_arenas
+    )
+{
+    // Let cJSON parse the input directly and build a json tree
+    cJSON_Arena *arena;
+    *map_json = parse_json_in_arena(input, &arena);
+    osp_dynarray_add(json_arenas, &arena);
+
+    return cJSON_GetObjectItemCaseSensitive(*map_json, "levels");
+}
+
+// LDtk external levels ("externalLevels": true) are saved in their own
+// .ldtkl files, the project only keeps their header and externalRelPath
+struct external_levels
+{
+    osp_input_t *inputs;
+    cJSON **roots;
+    cJSON_Arena **arenas;
+};
+
+void parse_external_level(void *context, size_t index)
+{
+    struct external_levels *levels = (struct external_levels *)context;
+
+    levels->roots[index] = parse_json_in_arena(&(levels->inputs[index]),
+                                               &(levels->arenas[index]));
+}
+
+void load_external_levels(
+    const osp_input_t *input,
+    cJSON *levels_json,
+    uint32_t num_levels,
+    uint32_t num_threads,
+    osp_dynarray_t json_arenas
+    )
+{
+    cJSON **external_levels = osp_mem_malloc(sizeof(cJSON *) * (num_levels + 1));
+    struct external_levels levels =
+    {
+        .inputs = osp_mem_malloc(sizeof(osp_input_t) * (num_levels + 1)),
+        .roots = osp_mem_calloc(num_levels + 1, sizeof(cJSON *)),
+        .arenas = osp_mem_calloc(num_levels + 1, sizeof(cJSON_Arena *))
+    };
+
+    // Open the level files first, this records them as input dependencies
+    uint32_t num_external_levels = 0;
+    uint32_t i_level = 0;
+    cJSON *level_json;
+    cJSON_ArrayForEach(level_json, levels_json)
+    {
+        if(i_level++ >= num_levels)
+            break;
+
+        const char *external_path = cJSON_GetStringValue(
+            cJSON_GetObjectItemCaseSensitive(level_json, "externalRelPath"));
+        if(external_path == NULL || cJSON_IsArray(
+            cJSON_GetObjectItemCaseSensitive(level_json, "layerInstances")))
+            continue;
+
+        if(osp_input_open_dependency(input, &(levels.inputs[num_external_levels]),
+                                     external_path) != 0)
+        {
+            printf("\tUnable to open level %s of %s\n",
+                   external_path, input->path);
+            osp_input_close(&(levels.inputs[num_external_levels]));
+            continue;
+        }
+        external_levels[num_external_levels++] = level_json;
+    }
+
+    // Level files are independent json trees, parse them all at once
+    osp_parallel_run(num_external_levels, num_threads, &parse_external_level,
+                     NULL, &levels);
+
+    // Then put the parsed levels in the project tree, in place of their
+    // header
+    for(i_level = 0; i_level < num_external_levels; ++i_level)
+    {
+        if(levels.roots[i_level] != NULL)
+        {
+            cJSON_ReplaceItemViaPointer(levels_json, external_levels[i_level],
+                                        levels.roots[i_level]);
+            osp_dynarray_add(json_arenas, &(levels.arenas[i_level]));
+        }
+        else
+        {
+            printf("\tInvalid level %s\n", levels.inputs[i_level].path);
+            cJSON_DeleteArena(levels.arenas[i_level]);
+        }
+        osp_input_close(&(levels.inputs[i_level]));
+    }
+
+    osp_mem_free(external_levels);
+    osp_mem_free(levels.inputs);
+    osp_mem_free(levels.roots);
+    osp_mem_free(levels.arenas);
+}
+
+uint8_t complete_tileset_layout(
+    struct tileset_layout *layout,
+    uint32_t image_width
+)
+{
+    // Use the image width if the columns are missing
+    if(layout->columns == 0 && layout->tile_size > 0)
+        layout->columns = (image_width - 2 * layout->padding +
+                           layout->spacing) /
+                          (layout->tile_size + layout->spacing);
+
+    return layout->columns > 0 && layout->tile_size > 0;
+}
+
+uint8_t find_tileset_layout(
+    cJSON *map_json,
+    cJSON *layer_instance,
+    struct tileset_layout *layout
+)
+{
+    // The layer references its tileset definition by uid
+    cJSON *uid_element =
+        cJSON_GetObjectItemCaseSensitive(layer_instance, "__tilesetDefUid");
+    if(!cJSON_IsNumber(uid_element))
+        return 0;
+
+    cJSON *tilesets_element = cJSON_GetObjectItemCaseSensitive(
+        cJSON_GetObjectItemCaseSensitive(map_json, "defs"),
+        "tilesets");
+    cJSON *tileset_element;
+    cJSON_ArrayForEach(tileset_element, tilesets_element)
+    {
+        if(cJSON_GetNumberValue(
+               cJSON_GetObjectItemCaseSensitive(tileset_element, "uid")) !=
+           cJSON_GetNumberValue(uid_element))
+            continue;
+
+        layout->tile_size = (uint32_t)cJSON_GetNumberValue(
+            cJSON_GetObjectItemCaseSensitive(tileset_element, "tileGridSize"));
+        layout->spacing = (uint32_t)cJSON_GetNumberValue(
+            cJSON_GetObjectItemCaseSensitive(tileset_element, "spacing"));
+        layout->padding = (uint32_t)cJSON_GetNumberValue(
+            cJSON_GetObjectItemCaseSensitive(tileset_element, "padding"));
+        layout->columns = (uint32_t)cJSON_GetNumberValue(
+            cJSON_GetObjectItemCaseSensitive(tileset_element, "__cWid"));
+
+        return complete_tileset_layout(layout, (uint32_t)cJSON_GetNumberValue(
+            cJSON_GetObjectItemCaseSensitive(tileset_element, "pxWid")));
+    }
+
+    return 0;
+}
 
-cJSON *parse_ldtk_file_for_levels(FILE *read_file)
+void free_json_data(osp_dynarray_t json_arenas)
 {
-    // Calculate the file size
-    fseek(read_file, 0, SEEK_END);
-    long size = ftell(read_file);
-    // Read the whole file into memory
-    char* file_content = (char*)malloc(size);
-    rewind(read_file);
-    fread(file_content, 1, size, read_file);
-
-    // Let cJSON parse the file and build a json tree
-    map_json = cJSON_Parse(file_content);
-    // We don't need the file in memory anymore
-    free(file_content);
-
-    return cJSON_GetObjectItemCaseSensitive(map_json, "levels");
+    // The trees go with their arenas, level trees included
+    cJSON_Arena **arenas = osp_dynarray_get_data(json_arenas);
+    for(size_t i_arena = 0;
+        i_arena < osp_dynarray_get_count(json_arenas);
+        ++i_arena)
+        cJSON_DeleteArena(arenas[i_arena]);
+    osp_dynarray_delete(json_arenas);
 }
 
-void free_json_data()
+void set_layer_tile(
+    tiles_layer_t *layer,
+    uint32_t num_tile,
+    uint32_t tile_x,
+    uint32_t tile_y,
+    uint32_t source_x,
+    uint32_t source_y,
+    uint32_t tile_size,
+    uint32_t map_width,
+    uint32_t map_height,
+    const struct tileset_layout *tileset
+    )
 {
-    cJSON_Delete(map_json);
+    // The tile being defined is the one indexed by its
+    // position in pixels divided by tile size, to get
+    // the tile position in grig elements.
+    layer->tiles[num_tile].tile_idx =
+        ((tile_y / tile_size) * map_width) + (tile_x / tile_size);
+    layer->tiles[num_tile].source_x = source_x;
+    layer->tiles[num_tile].source_y = source_y;
+
+    if(layer->tile_ids != NULL &&
+       tile_x / tile_size < map_width &&
+       tile_y / tile_size < map_height)
+    {
+        // Turn the source back into the tileset index, stored + 1 so 0
+        // is an empty cell. An index too big for 16 bits drops the grid.
+        uint32_t stride = tileset->tile_size + tileset->spacing;
+        uint32_t tileset_idx =
+            (source_y - tileset->padding) / stride * tileset->columns +
+            (source_x - tileset->padding) / stride;
+        if(tileset_idx < UINT16_MAX)
+            layer->tile_ids[layer->tiles[num_tile].tile_idx] =
+                (uint16_t)(tileset_idx + 1);
+        else
+        {
+            osp_mem_free(layer->tile_ids);
+            layer->tile_ids = NULL;
+        }
+    }
 }
 
 void read_tiles_layer(
@@ -177,7 +379,9 @@ void read_tiles_layer(
     cJSON *layer_instance,
     uint16_t layer_order,
     uint32_t tile_size,
-    uint32_t map_width
+    uint32_t map_width,
+    uint32_t map_height,
+    const struct tileset_layout *tileset
     )
 {
     // Fetch the tiles data
@@ -186,10 +390,18 @@ void read_tiles_layer(
     
     // Alloc enough space to store them
     layer->num_tiles = cJSON_GetArraySize(tiles_element);    
-    layer->tiles = malloc(sizeof(tile_source_t) * layer->num_tiles);
+    layer->tiles = osp_mem_malloc(sizeof(tile_source_t) * layer->num_tiles);
 
     layer->order = layer_order;
 
+    // The tileset index grid, if requested
+    layer->tile_ids = NULL;
+    if(tileset != NULL)
+        layer->tile_ids = osp_mem_calloc((size_t)map_width * map_height > 0
+                                             ? (size_t)map_width * map_height
+                                             : 1,
+                                         sizeof(uint16_t));
+
     cJSON* tile_element;
     cJSON* src_element;
     cJSON* px_element;
@@ -197,42 +409,250 @@ void read_tiles_layer(
     // Iterate all tiles
     cJSON_ArrayForEach(tile_element, tiles_element)
     {
-        // Fetch the tile position in pixels
+        // Fetch the tile position in pixels and the X and Y position of the
+        // tile image in the tileset
         px_element = cJSON_GetObjectItemCaseSensitive(tile_element, "px");
-        uint32_t tile_x = 
-            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(px_element, 0));
-        uint32_t tile_y = 
-            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(px_element, 1));
-
-        // The tile being defined is the one indexed by its
-        // position in pixels divided by tile size, to get
-        // the tile position in grig elements.
-        layer->tiles[num_tile].tile_idx = 
-            ((tile_y / tile_size) * map_width) + (tile_x / tile_size);
-
-        // Fetch the tile source
         src_element = cJSON_GetObjectItemCaseSensitive(tile_element, "src");
-        // And then the X and Y position of the tile image in
-        // the tileset
-        layer->tiles[num_tile].source_x = 
-            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(src_element, 0));
-
-        layer->tiles[num_tile].source_y =
-            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(src_element, 1));
+        set_layer_tile(
+            layer,
+            num_tile,
+            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(px_element, 0)),
+            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(px_element, 1)),
+            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(src_element, 0)),
+            (uint32_t)cJSON_GetNumberValue(cJSON_GetArrayItem(src_element, 1)),
+            tile_size,
+            map_width,
+            map_height,
+            tileset);
 
         ++num_tile;
     }
 }
 
-#define REGISTER_CURRENT_RECT register_collision_rectangle(                    \
-                                    layer,                                     \
-                                    current_rect_x,                            \
-                                    current_rect_y,                            \
-                                    current_rect_w,                            \
-                                    current_rect_h,                            \
-                                    tile_size                                  \
-                                );
+// First set bit at or after from in a grid row, width if none
+static inline uint32_t find_set_bit(const uint64_t *row, uint32_t from, uint32_t width)
+{
+    uint32_t i_word = from / 64;
+    uint64_t word = from % 64 ? row[i_word] & (~0ull << (from % 64)) : row[i_word];
+    uint32_t num_words = (width + 63) / 64;
+    while(word == 0)
+    {
+        if(++i_word >= num_words)
+            return width;
+        word = row[i_word];
+    }
+    return i_word * 64 + __builtin_ctzll(word);
+}
+
+// First clear bit at or after from in a grid row, width if none
+static inline uint32_t find_clear_bit(const uint64_t *row, uint32_t from, uint32_t width)
+{
+    uint32_t i_word = from / 64;
+    uint64_t word = ~row[i_word] & (~0ull << (from % 64));
+    uint32_t num_words = (width + 63) / 64;
+    while(word == 0)
+    {
+        if(++i_word >= num_words)
+            return width;
+        word = ~row[i_word];
+    }
+    uint32_t bit = i_word * 64 + __builtin_ctzll(word);
+    return bit < width ? bit : width;
+}
+
+// Mask of the bits of word i_word in [x, x + w)
+static inline uint64_t range_mask(uint32_t i_word, uint32_t x, uint32_t w)
+{
+    uint32_t first = i_word * 64 > x ? 0 : x - i_word * 64;
+    uint32_t last = (x + w) - i_word * 64 >= 64 ? 64 : (x + w) - i_word * 64;
+    uint64_t mask = last == 64 ? ~0ull : (1ull << last) - 1;
+    return mask & (~0ull << first);
+}
+
+uint32_t extract_collision_rectangles(
+    uint64_t *grid,
+    uint32_t width,
+    uint32_t height,
+    collision_rect_t **rectangles
+)
+{
+    size_t words_per_row = ((size_t)width + 63) / 64;
+    uint32_t num_rectangles = 0;
+    uint32_t capacity = 64;
+    *rectangles = osp_mem_malloc(sizeof(collision_rect_t) * capacity);
+
+    // Rectangles are found in row major order of their upper left corner,
+    // so once one is registered the scan resumes right after its first line:
+    // everything before is either empty or already covered. Every solid
+    // cell is cleared once and every failed downward extension costs at
+    // most the rectangle width, so the whole scan is linear in the cells,
+    // and runs 64 cells at a time.
+    for(uint32_t y = 0; y < height; ++y)
+    {
+        uint64_t *row = grid + (size_t)y * words_per_row;
+        uint32_t x = find_set_bit(row, 0, width);
+        while(x < width)
+        {
+            // The first line goes on as long as the cells are solid, up to
+            // the right edge included. It is cleared with the other lines so
+            // its cells are not included in any other rectangle.
+            uint32_t rect_x = x;
+            uint32_t rect_w = find_clear_bit(row, x, width) - rect_x;
+            uint32_t first_word = rect_x / 64;
+            uint32_t last_word = (rect_x + rect_w - 1) / 64;
+
+            // Add the lines below as long as they are solid for the whole
+            // rectangle width
+            uint32_t rect_h = 1;
+            for(; y + rect_h < height; ++rect_h)
+            {
+                const uint64_t *next_row = row + rect_h * words_per_row;
+                uint32_t i_word = first_word;
+                for(; i_word <= last_word; ++i_word)
+                {
+                    uint64_t mask = range_mask(i_word, rect_x, rect_w);
+                    if((next_row[i_word] & mask) != mask)
+                        break;
+                }
+                if(i_word <= last_word)
+                    break;
+            }
+            for(uint32_t i_line = 0; i_line < rect_h; ++i_line)
+                for(uint32_t i_word = first_word; i_word <= last_word; ++i_word)
+                    row[i_line * words_per_row + i_word] &=
+                        ~range_mask(i_word, rect_x, rect_w);
+
+            if(num_rectangles == capacity)
+            {
+                capacity *= 2;
+                *rectangles = osp_mem_realloc(*rectangles,
+                                              sizeof(collision_rect_t) * capacity);
+            }
+            (*rectangles)[num_rectangles++] = (collision_rect_t)
+            {
+                .x = rect_x,
+                .y = y,
+                .w = rect_w,
+                .h = rect_h
+            };
+
+            x = rect_x + rect_w < width
+                ? find_set_bit(row, rect_x + rect_w, width)
+                : width;
+        }
+    }
+
+    // Shrink the array to the rectangles found
+    if(num_rectangles > 0 && num_rectangles < capacity)
+        *rectangles = osp_mem_realloc(*rectangles,
+                                      sizeof(collision_rect_t) * num_rectangles);
+
+    return num_rectangles;
+}
+
+void build_collision_index(
+    collision_index_t *index,
+    const collision_rect_t *rectangles,
+    uint32_t num_rectangles,
+    uint32_t width,
+    uint32_t height,
+    uint32_t cell_size
+)
+{
+    index->cell_size = cell_size;
+    index->columns = (width + cell_size - 1) / cell_size;
+    index->rows = (height + cell_size - 1) / cell_size;
+    size_t num_cells = (size_t)index->columns * index->rows;
+    index->offsets = osp_mem_calloc(num_cells + 1, sizeof(uint32_t));
+
+    // Count the rectangles of every cell first, shifted by one so the prefix
+    // sum leaves every cell start in place...
+    for(uint32_t i_rect = 0; i_rect < num_rectangles; ++i_rect)
+    {
+        const collision_rect_t *rect = &(rectangles[i_rect]);
+        for(uint32_t row = rect->y / cell_size;
+            row <= (rect->y + rect->h - 1) / cell_size;
+            ++row)
+            for(uint32_t column = rect->x / cell_size;
+                column <= (rect->x + rect->w - 1) / cell_size;
+                ++column)
+                index->offsets[(size_t)row * index->columns + column + 1]++;
+    }
+    for(size_t i_cell = 0; i_cell < num_cells; ++i_cell)
+        index->offsets[i_cell + 1] += index->offsets[i_cell];
+
+    // ...then fill them, in rectangle order, using a copy of the starts as
+    // write cursors.
+    uint32_t *cursors = osp_mem_malloc(sizeof(uint32_t) * (num_cells + 1));
+    memcpy(cursors, index->offsets, sizeof(uint32_t) * (num_cells + 1));
+    index->rect_indices =
+        osp_mem_malloc(sizeof(uint32_t) *
+                       (index->offsets[num_cells] > 0 ? index->offsets[num_cells] : 1));
+    for(uint32_t i_rect = 0; i_rect < num_rectangles; ++i_rect)
+    {
+        const collision_rect_t *rect = &(rectangles[i_rect]);
+        for(uint32_t row = rect->y / cell_size;
+            row <= (rect->y + rect->h - 1) / cell_size;
+            ++row)
+            for(uint32_t column = rect->x / cell_size;
+                column <= (rect->x + rect->w - 1) / cell_size;
+                ++column)
+                index->rect_indices[cursors[(size_t)row * index->columns + column]++] =
+                    i_rect;
+    }
+    osp_mem_free(cursors);
+}
+
+void build_collisions_layer(
+    collisions_layer_t *layer,
+    uint64_t *collision_grid,
+    uint16_t layer_order,
+    uint32_t width,
+    uint32_t height,
+    uint32_t tile_size,
+    uint8_t keep_grid,
+    uint32_t index_cell
+)
+{
+    size_t words_per_row = ((size_t)width + 63) / 64;
+    layer->order = layer_order;
+    layer->grid = NULL;
+    layer->index = (collision_index_t){ 0 };
+
+    // The merge clears the grid, so keep a copy if it is written too
+    if(keep_grid)
+    {
+        layer->grid = osp_mem_malloc(sizeof(uint64_t) * words_per_row * height);
+        memcpy(layer->grid, collision_grid,
+               sizeof(uint64_t) * words_per_row * height);
+    }
+
+    // Merge the solid cells into rectangles, in tiles, then scale them to
+    // pixels.
+    layer->num_rectangles = extract_collision_rectangles(
+        collision_grid,
+        width,
+        height,
+        &(layer->rectangles)
+    );
+    osp_mem_free(collision_grid);
+    for(uint32_t i_rect = 0; i_rect < layer->num_rectangles; ++i_rect)
+    {
+        layer->rectangles[i_rect].x *= tile_size;
+        layer->rectangles[i_rect].y *= tile_size;
+        layer->rectangles[i_rect].w *= tile_size;
+        layer->rectangles[i_rect].h *= tile_size;
+    }
 
+    // Bucket them if an index was requested
+    if(index_cell > 0)
+        build_collision_index(&(layer->index),
+                              layer->rectangles,
+                              layer->num_rectangles,
+                              width * tile_size,
+                              height * tile_size,
+                              index_cell * tile_size);
+}
 
 void read_collisions_layer(
     collisions_layer_t *layer,
@@ -240,29 +660,35 @@ void read_collisions_layer(
     uint16_t layer_order,
     uint32_t width,
     uint32_t height,
-    uint32_t tile_size
+    uint32_t tile_size,
+    uint8_t keep_grid,
+    uint32_t index_cell
 )
 {
-    layer->order = layer_order;
+    uint64_t scan_trace = osp_trace_begin();
 
     // ...and then the collisions data
     cJSON *int_grid_element =
         cJSON_GetObjectItemCaseSensitive(layer_instance, "intGridCsv");
 
-    // And reset the number of rectangles found
-    layer->num_rectangles = 0;
+    // Now read and parse the CSV collision grid to build collision
+    // rectangles, row by row as LDTK stores it. Only solid or empty matters,
+    // so the grid is a bitset with every row starting on a new word.
+    size_t words_per_row = ((size_t)width + 63) / 64;
+    uint64_t *collision_grid =
+        osp_mem_calloc(words_per_row * height > 0 ? words_per_row * height : 1,
+                       sizeof(uint64_t));
 
-    // Now read and parse the CSV collision grid to build
-    // collision rectangles.
-    int32_t collision_matrix[width][height];
-    
     cJSON* val_element;
-    int x = 0;
-    int y = 0;
-    // Iterate all the csv values and populate the matrix
+    uint32_t x = 0;
+    uint32_t y = 0;
+    // Iterate all the csv values and populate the grid
     cJSON_ArrayForEach(val_element, int_grid_element)
     {
-        collision_matrix[x][y] = (int32_t)cJSON_GetNumberValue(val_element);
+        if (y >= height)
+            break;
+        if (cJSON_GetNumberValue(val_element) > 0)
+            collision_grid[y * words_per_row + x / 64] |= 1ull << (x % 64);
         ++x;
         if (x >= width)
         {
@@ -271,273 +697,114 @@ void read_collisions_layer(
         }
     }
 
-    // Let's scan the matrix and build rectangles
-    uint32_t num_rectangles = 0;
-    // The currently scanned rectangle origin and size in tiles
-    uint32_t current_rect_x;
-    uint32_t current_rect_y;
-    uint32_t current_rect_w;
-    uint32_t current_rect_h;
-    uint32_t current_scan_line;
-    // This is the scan state:
-    //  0 - looking for a upper left corner
-    //  1 - looking for a upper right corner
-    //  2 - looking for current rectangle next line downwards
-    //  3 - expanding current rectangle next line downwards
-    uint8_t scan_state = 0;
-    // If we have already found too many rectangles we stop.
-    while(num_rectangles < MAX_DEFINABLE_COLLISION_RECTS)
+    build_collisions_layer(layer, collision_grid, layer_order, width, height,
+                           tile_size, keep_grid, index_cell);
+    osp_trace_end("read_collisions_layer", scan_trace, NULL);
+}
+
+uint8_t is_decor_tag(const char *tag)
+{
+    return strncmp(tag, "decor", strlen("decor")) == 0;
+}
+
+uint8_t is_decor_entity(cJSON *entity_element)
+{
+    // Decor entities are tagged as such
+    cJSON *tag_item;
+    cJSON_ArrayForEach(tag_item,
+        cJSON_GetObjectItemCaseSensitive(entity_element, "__tags"))
     {
-// Skip here if we have found a rectangle and we want to quickly restart
-// and search for the next one.
-scan_restart:
-        scan_state = 0; // Let's start by looking for the upper left corner.
-        // Scan the matrix row by row from left to right.
-        for(int y = 0; y < height; ++y)
-        {
-            for(int x = 0; x < width; ++x)
-            {
-                switch(scan_state)
-                {
-                    // Looking for the upper left corner of a rectangle
-                    case 0:
-                    // Found it (the collision value is != 0)
-                    if (collision_matrix[x][y] > 0)
-                    {
-                        // Reset the collision to 0, so we don't include this
-                        // tile in the next scans.
-                        collision_matrix[x][y] = 0;
-                        // Save the rectangle upper left corner position
-                        current_rect_x = x;
-                        current_rect_y = y;
-                        // Change state to continue scanning the first line
-                        scan_state = 1;
-                    }
-                    break;
-                    // Scanning the first rectangle line
-                    case 1:
-                    // As long as the collision is still != 0
-                    if (collision_matrix[x][y] > 0)
-                    {
-                        // We clear the collision matrix, since the first line
-                        // is always valid and we don't want to include it in
-                        // the next scans.
-                        collision_matrix[x][y] = 0;
-                    }
-                    else // If the collision ends, we have finished first line
-                    {
-                        // The rectangle width is defined and we save it.
-                        current_rect_w = x - current_rect_x;
-                        // If this is the last line, the rectangle can only
-                        // end here vertically.
-                        if (y == height - 1)
-                        {
-                            // So it's height must be 1 tile.
-                            current_rect_h = 1;
-                            // We can save the current rectangle and start
-                            // scanning again.
-                            REGISTER_CURRENT_RECT;
-                            goto scan_restart;
-                        }
-                        else
-                        {
-                            // Otherwise, we start checking if there is a 
-                            // contiguous collision line just below this one.
-                            // Save the next scan line to check.
-                            current_scan_line = y + 1;
-                            // Change state to look for the start of the next
-                            // scan line.
-                            scan_state = 2;
-                        }
-                    }
-                    break;
-                    case 2:
-                    // We went over the scan line we were checking without
-                    // finding the collision start we were looking for.
-                    if (y > current_scan_line)
-                    {
-                        // The rectangle height is set to the previous valid
-                        // line.
-                        current_rect_h = current_scan_line - current_rect_y;
-                        // We can save the current rectangle and start
-                        // scanning again.
-                        REGISTER_CURRENT_RECT;
-                        goto scan_restart;
-                    }
-                    // If we are on the current scan line and at the left
-                    // edge of the current rectangle...
-                    else if (y == current_scan_line && x == current_rect_x)
-                    {
-                        // ...and there is a valid collision
-                        if (collision_matrix[x][y] > 0)
-                        {
-                            // Then there is a possible collision line to add
-                            // to the rectangle. Let's move to the next state
-                            // to check if it's contiguous until the right
-                            // rectangle edge.
-                            scan_state = 3;
-                        }
-                        else // Otherwise, this scan line can't be added.
-                        {
-                            // The rectangle height is set to the previous
-                            // valid line.
-                            current_rect_h = current_scan_line - current_rect_y;
-                            // We can save the current rectangle and start
-                            // scanning again.
-                            REGISTER_CURRENT_RECT;
-                            goto scan_restart;
-                        }
-                    }
-                    break;
-                    case 3:
-                    // We are only interested in checking the current scan line
-                    // from the left rectangle edge onwards.
-                    if (y == current_scan_line && x >= current_rect_x)
-                    {
-                        // If we are still inside the rectangle...
-                        if (x < (current_rect_x + current_rect_w))
-                        {
-                            // ...and there is a hole in the collision
-                            if (collision_matrix[x][y] <= 0)
-                            {
-                                // This line is not contiguous and can't be
-                                // added to the current rectangle.
-                                // The rectangle height is set to the previous
-                                // valid line.
-                                current_rect_h = 
-                                    current_scan_line - current_rect_y;
-                                // We can save the current rectangle and start
-                                // scanning again.
-                                REGISTER_CURRENT_RECT;
-                                goto scan_restart;
-                            }
-                        }
-                        else // If we got over the right edge
-                        {
-                            // The collision is contiguous and we can add this
-                            // line to the rectangle.
-                            // Let's clear it so it's not checked in the next
-                            // scan.
-                            for (int next_x = current_rect_x;
-                                 next_x < x;
-                                 ++next_x)
-                            {
-                                collision_matrix[next_x][current_scan_line]
-                                    = 0;
-                            }
-
-                            // If this is the last line, the rectangle can only
-                            // end here vertically.
-                            if (y == height - 1)
-                            {
-                                // The rectangle height is set to the current
-                                // valid line.
-                                current_rect_h =
-                                    current_scan_line - current_rect_y + 1;
-                                // We can save the current rectangle and
-                                // start scanning again.
-                                REGISTER_CURRENT_RECT;
-                                goto scan_restart;
-                            }
-                            else // Otherwise we can check for another line...
-                            {
-                                // Let's move to the next possible valid line
-                                current_scan_line = y + 1;
-                                // And start again checking for the line start
-                                scan_state = 2;
-                            }
-                        }
-                    }
-                    break;
-                }
-            }
+        if(is_decor_tag(cJSON_GetStringValue(tag_item)))
+            return 1;
+    }
 
-            // If we are here, we are finished scanning a line
-            // of the collision matrix. 
-            // Let's see if we can continue scanning.
+    return 0;
+}
 
-            switch(scan_state)
-            {
-                // If the line ended and we are still scanning the first
-                // rectangle line, then the line can validly end here.
-                case 1:
-                // We set the width of the rectangle to end at the border
-                // of the matrix.
-                current_rect_w = width - current_rect_x - 1;
-                // If this is the last line, the rectangle can only end here.
-                if (y == height - 1)
-                {
-                    // We set the rectangle height to 1 tile.
-                    current_rect_h = 1;
-                    // We can save the current rectangle and start
-                    // scanning again.
-                    REGISTER_CURRENT_RECT;
-                    goto scan_restart;
-                }
-                else
-                {
-                    // Otherwise, we start checking for the next possibly
-                    // valid line to add...
-                    current_scan_line = y + 1;
-                    scan_state = 2;
-                }
-                break;
-                // If the line ended and we were looking for the start of
-                // the next rectangle scan line, means we can stop at
-                // the previous line.
-                case 2:
-                // This makes sense only if we are on the scan line we are
-                // checking, otherwise we might be still going
-                // after the state change.
-                if (y == current_scan_line)
-                {
-                    // The rectangle height is set to the previous valid
-                    // scan line.
-                    current_rect_h = current_scan_line - current_rect_y;
-                    // We can save the current rectangle and start
-                    // scanning again.
-                    REGISTER_CURRENT_RECT;
-                    goto scan_restart;
-                }
+void build_entity_index(struct entity_index *index, cJSON *levels_json)
+{
+    // Count all the entities first...
+    index->num_handles = 0;
+    cJSON *level_element;
+    cJSON *layer_instance;
+    cJSON_ArrayForEach(level_element, levels_json)
+        cJSON_ArrayForEach(layer_instance,
+            cJSON_GetObjectItemCaseSensitive(level_element, "layerInstances"))
+            index->num_handles += cJSON_GetArraySize(
+                cJSON_GetObjectItemCaseSensitive(layer_instance,
+                                                 "entityInstances"));
+
+    // ...then index them as they are numbered when read: every entities
+    // layer of a level is valid, and decor and other entities are numbered
+    // apart.
+    index->handles = osp_mem_malloc(sizeof(struct entity_handle) *
+                                    (index->num_handles + 1));
+    index->map = osp_hashmap_new(index->num_handles);
+    size_t num_handles = 0;
+    uint32_t level = 0;
+    cJSON_ArrayForEach(level_element, levels_json)
+    {
+        uint32_t layer = 0;
+        cJSON_ArrayForEach(layer_instance,
+            cJSON_GetObjectItemCaseSensitive(level_element, "layerInstances"))
+        {
+            char *type = cJSON_GetStringValue(
+                cJSON_GetObjectItemCaseSensitive(layer_instance, "__type"));
+            if(type == NULL || strncmp(type, "Entities", 9) != 0)
+                continue;
+            if(layer >= MAX_VALID_LAYERS)
                 break;
-                // If the line ended and we were checking if the current line
-                // to add was contiguous, it means this line can be considered
-                // valid and added to the rectangle.
-                case 3:
-                if (y == current_scan_line)
-                {
-                    // Let's clear it so it's not included in the next scans.
-                    for (int next_x = current_rect_x; next_x < x; ++next_x)
-                        collision_matrix[next_x][current_scan_line] = 0;
 
-                    // If this is the last line, this rectangle can only end
-                    // here vertically.
-                    if (y == height - 1)
-                    {
-                        // The height is set to the current valid scan line.
-                        current_rect_h = current_scan_line - current_rect_y + 1;
-                        // We can save the current rectangle and start
-                        // scanning again.
-                        REGISTER_CURRENT_RECT;
-                        goto scan_restart;
-                    }
-                    else
-                    {
-                        // Otherwise we start checking if the next possibly
-                        // valid scan line is contigous and can be added to the
-                        // rectangle.
-                        current_scan_line = y + 1;
-                        scan_state = 2;
-                    }
-                }
-                break;
+            uint32_t num_decor_entities = 0;
+            uint32_t num_entities = 0;
+            cJSON *entity_element;
+            cJSON_ArrayForEach(entity_element,
+                cJSON_GetObjectItemCaseSensitive(layer_instance,
+                                                 "entityInstances"))
+            {
+                struct entity_handle *handle = &(index->handles[num_handles]);
+                handle->iid = cJSON_GetStringValue(
+                    cJSON_GetObjectItemCaseSensitive(entity_element, "iid"));
+                handle->level = level;
+                handle->layer = (uint8_t)layer;
+                handle->is_decor = is_decor_entity(entity_element);
+                handle->number = handle->is_decor ? num_decor_entities++
+                                                  : num_entities++;
+                if(handle->iid != NULL)
+                    osp_hashmap_insert(index->map,
+                                       osp_hash64_string(handle->iid, 0),
+                                       num_handles);
+                ++num_handles;
             }
+            ++layer;
         }
-        // If the scan ended without finding any collision, our job is done and
-        // we can break the cycle.
-        if (scan_state == 0)
-            break;
+        ++level;
+    }
+    index->num_handles = num_handles;
+}
+
+const struct entity_handle *find_entity(const struct entity_index *index,
+                                        const char *iid)
+{
+    if(iid == NULL)
+        return NULL;
+
+    size_t cursor = 0;
+    uint64_t handle_idx;
+    while(osp_hashmap_find(index->map, osp_hash64_string(iid, 0),
+                           &cursor, &handle_idx))
+    {
+        if(strcmp(index->handles[handle_idx].iid, iid) == 0)
+            return &(index->handles[handle_idx]);
     }
+
+    return NULL;
+}
+
+void free_entity_index(struct entity_index *index)
+{
+    osp_hashmap_delete(index->map);
+    osp_mem_free(index->handles);
 }
 
 void read_decor_entity(cJSON* entity_element, decor_entity_t *entity)
@@ -561,24 +828,59 @@ void read_decor_entity(cJSON* entity_element, decor_entity_t *entity)
         cJSON_GetObjectItemCaseSensitive(tile_element, "y"));
 }
 
-void read_other_entity_data(
-    cJSON *extra_data_element,
+entity_data_type_t find_entity_data_type(const char *data_type)
+{
+    if (strncmp(data_type, "Int", 10) == 0)
+        return ENTITY_DATA_INT;
+    else if (strncmp(data_type, "Float", 10) == 0)
+        return ENTITY_DATA_FLOAT;
+    else if (strncmp(data_type, "String", 10) == 0)
+        return ENTITY_DATA_STRING;
+    else if (strncmp(data_type, "EntityRef", 10) == 0)
+        return ENTITY_DATA_ENTITY;
+
+    return ENTITY_DATA_UNKNOWN;
+}
+
+void resolve_entity_reference(
     entity_data_t *data,
-    int num_entities,
-    uint8_t *is_decor_values,
-    char **entity_iids,
-    uint32_t *entity_to_decor_idx,
-    uint32_t *entity_to_other_idx
+    const struct entity_index *index,
+    const char *iid,
+    uint32_t level,
+    uint8_t layer
 )
 {
-    // Copy the data name
+    // References to other layers or levels keep where they point
+    const struct entity_handle *handle = find_entity(index, iid);
+    if (handle == NULL)
+        data->type = ENTITY_DATA_UNKNOWN;
+    else
+    {
+        data->entity_is_decor = handle->is_decor;
+        data->entity_number = handle->number;
+        data->entity_level = handle->level;
+        data->entity_layer = handle->layer;
+        if (handle->level != level || handle->layer != layer)
+            data->type = ENTITY_DATA_FOREIGN_ENTITY;
+    }
+}
+
+void read_other_entity_data(
+    cJSON *extra_data_element,
+    entity_data_t *data,
+    const struct entity_index *index,
+    uint32_t level,
+    uint8_t layer
+)
+{
+    // Copy the data name
     char *data_name = cJSON_GetStringValue(
         cJSON_GetObjectItemCaseSensitive(
             extra_data_element,
             "__identifier")
         );
     size_t name_len = strlen(data_name);           
-    data->name = malloc(name_len + 1);
+    data->name = osp_mem_malloc(name_len + 1);
     strncpy(data->name, data_name, name_len);
     data->name[name_len] = '\0';
 
@@ -589,16 +891,8 @@ void read_other_entity_data(
             "__type")
         );
 
-    data->type = ENTITY_DATA_UNKNOWN;
+    data->type = find_entity_data_type(data_type);
     data->string_data = NULL;
-    if (strncmp(data_type, "Int", 10) == 0)
-        data->type = ENTITY_DATA_INT;
-    else if (strncmp(data_type, "Float", 10) == 0)
-        data->type = ENTITY_DATA_FLOAT;
-    else if (strncmp(data_type, "String", 10) == 0)
-        data->type = ENTITY_DATA_STRING;
-    else if (strncmp(data_type, "EntityRef", 10) == 0)
-        data->type = ENTITY_DATA_ENTITY;
 
     // Fetch the data value
     cJSON* data_value_element =
@@ -615,13 +909,13 @@ void read_other_entity_data(
             char *data_value = cJSON_GetStringValue(data_value_element);
             if (data_value == NULL)
             {
-                data->string_data = malloc(1);
+                data->string_data = osp_mem_malloc(1);
                 data->string_data[0] = '\0';
             }
             else
             {
                 size_t value_len = strlen(data_value);           
-                data->string_data = malloc(value_len + 1);
+                data->string_data = osp_mem_malloc(value_len + 1);
                 strncpy(data->string_data, data_value, value_len);
                 data->string_data[value_len] = '\0';
             }
@@ -633,17 +927,9 @@ void read_other_entity_data(
                     "entityIid")
             );
 
-            for (int i_entity = 0; i_entity < num_entities; ++i_entity)
-            {
-                if (strncmp(entity_iid, entity_iids[i_entity], 40) == 0)
-                {
-                    data->entity_is_decor = is_decor_values[i_entity];
-                    if (data->entity_is_decor)
-                        data->entity_number = entity_to_decor_idx[i_entity];
-                    else
-                        data->entity_number = entity_to_other_idx[i_entity];
-                }
-            }
+            resolve_entity_reference(data, index, entity_iid, level, layer);
+        break;
+        default:
         break;
     }
 }
@@ -651,11 +937,9 @@ void read_other_entity_data(
 void read_other_entity(
     cJSON* entity_element,
     entity_t *entity,
-    int num_entities,
-    uint8_t *is_decor_values,
-    char **entity_iids,
-    uint32_t *entity_to_decor_idx,
-    uint32_t *entity_to_other_idx
+    const struct entity_index *index,
+    uint32_t level,
+    uint8_t layer
 )
 {
     // Fetch the entity position and size in pixels
@@ -673,7 +957,7 @@ void read_other_entity(
     char *entity_type = cJSON_GetStringValue(
         cJSON_GetObjectItemCaseSensitive(entity_element,"__identifier"));
     size_t type_len = strlen(entity_type);           
-    entity->type = malloc(type_len + 1);
+    entity->type = osp_mem_malloc(type_len + 1);
     strncpy(entity->type, entity_type, type_len);
     entity->type[type_len] = '\0';
 
@@ -684,7 +968,7 @@ void read_other_entity(
     entity->num_data = cJSON_GetArraySize(extra_data_array_element);
     if (entity->num_data > 0)
     {
-        entity->data = malloc(sizeof(entity_data_t) * entity->num_data);
+        entity->data = osp_mem_malloc(sizeof(entity_data_t) * entity->num_data);
         int data_idx = 0;
         cJSON* extra_data_element;
         cJSON_ArrayForEach(extra_data_element, extra_data_array_element)
@@ -692,11 +976,9 @@ void read_other_entity(
             read_other_entity_data(
                 extra_data_element,
                 &(entity->data[data_idx]),
-                num_entities,
-                is_decor_values,
-                entity_iids,
-                entity_to_decor_idx,
-                entity_to_other_idx);
+                index,
+                level,
+                layer);
             ++data_idx;
         }
     }
@@ -707,71 +989,40 @@ void read_other_entity(
 void read_entities_layer(
     entities_layer_t *layer,
     cJSON *layer_instance,
-    uint16_t layer_order
+    uint16_t layer_order,
+    const struct entity_index *index,
+    uint32_t level,
+    uint8_t layer_number
     )
 {
     // Fetch the entities data
     cJSON *entities_element =
         cJSON_GetObjectItemCaseSensitive(layer_instance, "entityInstances");
-    
+
     cJSON* entity_element;
-    cJSON* tags_item;
-    cJSON* tag_item;
-    cJSON* iid_item;
-    int num_entities = cJSON_GetArraySize(entities_element);
-    uint8_t is_decor_values[num_entities];
-    uint32_t entity_to_decor_idx[num_entities];
-    uint32_t entity_to_other_idx[num_entities];
-    char* entity_iids[num_entities];
-    int num_entity = 0;
     layer->num_decor_entities = 0;
     layer->num_entities = 0;
-    // Count decor and other entities and fetch iids
+    // Count decor and other entities
     cJSON_ArrayForEach(entity_element, entities_element)
     {
-        // Fetch the entity tags
-        tags_item = cJSON_GetObjectItemCaseSensitive(entity_element, "__tags");
-        is_decor_values[num_entity] = 0;
-        cJSON_ArrayForEach(tag_item, tags_item)
-        {
-            if(strncmp(cJSON_GetStringValue(tag_item), "decor", strlen("decor")) 
-                == 0)
-            {
-                is_decor_values[num_entity] = 1;
-            }
-        }
-
-        if(is_decor_values[num_entity])
-        {
-            entity_to_decor_idx[num_entity] = layer->num_decor_entities;
+        if(is_decor_entity(entity_element))
             ++layer->num_decor_entities;
-        }
         else
-        {
-            entity_to_other_idx[num_entity] = layer->num_entities;
             ++layer->num_entities;
-        }
-
-        // Fetch the entity iid
-        iid_item = cJSON_GetObjectItemCaseSensitive(entity_element, "iid");
-        entity_iids[num_entity] = cJSON_GetStringValue(iid_item);
-
-        ++num_entity;
     }
 
     // Alloc enough space for storing them
-    layer->entities = malloc(sizeof(entity_t) * layer->num_entities);
+    layer->entities = osp_mem_malloc(sizeof(entity_t) * layer->num_entities);
     layer->decor_entities = 
-        malloc(sizeof(decor_entity_t) * layer->num_decor_entities);
+        osp_mem_malloc(sizeof(decor_entity_t) * layer->num_decor_entities);
     layer->order = layer_order;
 
-    num_entity = 0;
     int decor_entity_idx = 0;
     int other_entity_idx = 0;
-    // Iterate all entities
+    // Iterate all entities, references are resolved with the project index
     cJSON_ArrayForEach(entity_element, entities_element)
     {
-        if(is_decor_values[num_entity])
+        if(is_decor_entity(entity_element))
         {
             read_decor_entity(
                 entity_element,
@@ -784,451 +1035,1124 @@ void read_entities_layer(
             read_other_entity(
                 entity_element,
                 &(layer->entities[other_entity_idx]),
-                num_entities,
-                is_decor_values,
-                entity_iids,
-                entity_to_decor_idx,
-                entity_to_other_idx
+                index,
+                level,
+                layer_number
             );
             ++other_entity_idx;
         }
+    }
+}
 
-        ++num_entity;
+void write_tile_ids_rle(const uint16_t *tile_ids,
+                        size_t num_cells,
+                        osp_writer_t writer)
+{
+    // Count the runs first, they are at most UINT16_MAX cells long...
+    uint32_t num_runs = 0;
+    for(size_t i_cell = 0; i_cell < num_cells; ++num_runs)
+    {
+        size_t run_end = i_cell + 1;
+        while(run_end < num_cells &&
+              run_end - i_cell < UINT16_MAX &&
+              tile_ids[run_end] == tile_ids[i_cell])
+            ++run_end;
+        i_cell = run_end;
+    }
+    osp_writer_put_u32(writer, num_runs);
+
+    // ...then write them
+    for(size_t i_cell = 0; i_cell < num_cells;)
+    {
+        size_t run_end = i_cell + 1;
+        while(run_end < num_cells &&
+              run_end - i_cell < UINT16_MAX &&
+              tile_ids[run_end] == tile_ids[i_cell])
+            ++run_end;
+        osp_writer_put_u16(writer, (uint16_t)(run_end - i_cell));
+        osp_writer_put_u16(writer, tile_ids[i_cell]);
+        i_cell = run_end;
     }
 }
 
-int ldtk_to_map(FILE* read_file, FILE* write_file, void* params)
+void write_tiles_layer(tiles_layer_t *layer,
+                       uint32_t flags,
+                       size_t num_cells,
+                       osp_writer_t writer)
 {
-    // Our map structure to fill with the data from the LDTK file
-    tilemap_data_t tile_map;
+    // Write the layer order
+    osp_writer_put_u16(writer, layer->order);
 
-    // Let's find the json levels array element
-    cJSON *levels_json = parse_ldtk_file_for_levels(read_file);
-    // If there is at least one level, we only read the first, for now.
-    if(cJSON_GetArraySize(levels_json) > 0)
+    // Write the tileset index grid, if requested
+    if(flags & MAP_FLAG_TILES_DENSE)
+    {
+        osp_writer_put_u16_array(writer, layer->tile_ids, num_cells);
+        return;
+    }
+    if(flags & MAP_FLAG_TILES_RLE)
     {
-        // Let's find this level's layers
-        cJSON *layer_instances_json =
-            cJSON_GetObjectItemCaseSensitive(levels_json->child,
-                                             "layerInstances");
-        int numLayerInstances = cJSON_GetArraySize(layer_instances_json);
-        if(numLayerInstances > 0)
+        write_tile_ids_rle(layer->tile_ids, num_cells, writer);
+        return;
+    }
+
+    // Write the number of defined tiles for this layer
+    osp_writer_put_u32(writer, layer->num_tiles);
+    // and for every tile the tile idx and the X, Y source couple, which are
+    // three packed uint32_t in tile_source_t.
+    osp_writer_put_u32_array(writer,
+                             (const uint32_t *)layer->tiles,
+                             (size_t)layer->num_tiles * 3);
+}
+
+void write_collisions_layer(collisions_layer_t *layer,
+                            size_t num_grid_words,
+                            osp_writer_t writer)
+{
+    // Write the layer order
+    osp_writer_put_u16(writer, layer->order);
+    // Write the number of collision rectangles for this layer
+    osp_writer_put_u32(writer, layer->num_rectangles);
+    // and for every rectangle its position and size, which are four packed
+    // uint32_t in collision_rect_t.
+    osp_writer_put_u32_array(writer,
+                             (const uint32_t *)layer->rectangles,
+                             (size_t)layer->num_rectangles * 4);
+    // and the collision grid, if requested
+    if(layer->grid != NULL)
+        osp_writer_put_u64_array(writer, layer->grid, num_grid_words);
+
+    // and the rectangles index, if requested
+    collision_index_t *index = &(layer->index);
+    if(index->offsets != NULL)
+    {
+        size_t num_cells = (size_t)index->columns * index->rows;
+        osp_writer_put_u32(writer, index->cell_size);
+        osp_writer_put_u32(writer, index->columns);
+        osp_writer_put_u32(writer, index->rows);
+        osp_writer_put_u32_array(writer, index->offsets, num_cells + 1);
+        osp_writer_put_u32_array(writer,
+                                 index->rect_indices,
+                                 index->offsets[num_cells]);
+    }
+}
+
+void write_entity_data(entity_data_t *data, osp_writer_t writer)
+{
+    // Write the data name
+    osp_writer_put_string(writer, data->name);
+    // Write the data type
+    osp_writer_put_u32(writer, (uint32_t)data->type);
+
+    // Write the data value if known
+    switch(data->type)
+    {
+        case ENTITY_DATA_INT:
+        osp_writer_put_i32(writer, data->int_data);
+        break;
+        case ENTITY_DATA_FLOAT:
+        osp_writer_put_f32(writer, data->float_data);
+        break;
+        case ENTITY_DATA_STRING:
+        osp_writer_put_string(writer, data->string_data);
+        break;
+        case ENTITY_DATA_ENTITY:
+        osp_writer_put_u8(writer, data->entity_is_decor);
+        osp_writer_put_u32(writer, data->entity_number);
+        break;
+        case ENTITY_DATA_FOREIGN_ENTITY:
+        osp_writer_put_u32(writer, data->entity_level);
+        osp_writer_put_u8(writer, data->entity_layer);
+        osp_writer_put_u8(writer, data->entity_is_decor);
+        osp_writer_put_u32(writer, data->entity_number);
+        break;
+        default:
+        break;
+    }
+}
+
+void write_entities_layer(entities_layer_t *layer,
+                          uint32_t flags,
+                          osp_writer_t writer)
+{
+    // Write the layer order
+    osp_writer_put_u16(writer, layer->order);
+
+    // Chunks write where their entities start in the layer numbering
+    if(flags & MAP_FLAG_CHUNKS)
+    {
+        osp_writer_put_u32(writer, layer->first_decor_entity);
+        osp_writer_put_u32(writer, layer->first_entity);
+    }
+
+    // Write the number of decor entities for this layer
+    osp_writer_put_u32(writer, layer->num_decor_entities);
+    // and for every decor entity its source position, position and size,
+    // which are six packed uint32_t in decor_entity_t.
+    osp_writer_put_u32_array(writer,
+                             (const uint32_t *)layer->decor_entities,
+                             (size_t)layer->num_decor_entities * 6);
+
+    // Write the number of entities for this layer
+    osp_writer_put_u32(writer, layer->num_entities);
+    // and for every entity
+    for(uint32_t i_entity = 0; i_entity < layer->num_entities; ++i_entity)
+    {
+        entity_t *entity = &(layer->entities[i_entity]);
+
+        // Write the entity type
+        osp_writer_put_string(writer, entity->type);
+
+        // Write the entity position and size
+        osp_writer_put_u32(writer, entity->x);
+        osp_writer_put_u32(writer, entity->y);
+        osp_writer_put_u32(writer, entity->w);
+        osp_writer_put_u32(writer, entity->h);
+
+        // Write the entity extra data if present
+        osp_writer_put_u32(writer, entity->num_data);
+        for(uint32_t i_data = 0; i_data < entity->num_data; ++i_data)
+            write_entity_data(&(entity->data[i_data]), writer);
+    }
+}
+
+void write_tilemap_layers(tilemap_data_t *tile_map, osp_writer_t writer)
+{
+    // First the number of tile layers
+    osp_writer_put_u8(writer, tile_map->num_tile_layers);
+    // Now write all tile layers data
+    for(int i_layer = 0; i_layer < tile_map->num_tile_layers; ++i_layer)
+        write_tiles_layer(&(tile_map->tile_layers[i_layer]),
+                          tile_map->flags,
+                          (size_t)tile_map->width * tile_map->height,
+                          writer);
+
+    // Then the number of collision layers
+    osp_writer_put_u8(writer, tile_map->num_collision_layers);
+    // Now write all collisions layers data
+    for(int i_layer = 0; i_layer < tile_map->num_collision_layers; ++i_layer)
+        write_collisions_layer(&(tile_map->collision_layers[i_layer]),
+                               ((size_t)tile_map->width + 63) / 64 *
+                               tile_map->height,
+                               writer);
+
+    // Finally the number of entity layers
+    osp_writer_put_u8(writer, tile_map->num_entity_layers);
+    // Now write all entity layers data
+    for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
+        write_entities_layer(&(tile_map->entity_layers[i_layer]),
+                             tile_map->flags,
+                             writer);
+}
+
+// Chunk of a position in pixels, clamped to the map
+static inline uint32_t find_chunk(uint32_t x,
+                                  uint32_t y,
+                                  uint32_t chunk_pixels,
+                                  uint32_t columns,
+                                  uint32_t rows)
+{
+    uint32_t column = x / chunk_pixels < columns ? x / chunk_pixels : columns - 1;
+    uint32_t row = y / chunk_pixels < rows ? y / chunk_pixels : rows - 1;
+    return row * columns + column;
+}
+
+// A layer's elements sorted by chunk, with every chunk start
+struct chunked_elements
+{
+    void *elements;
+    uint32_t *starts;
+};
+
+// Chunks of the decor entities, or of the other entities, of a layer
+void find_entity_chunks(const tilemap_data_t *tile_map,
+                        const entities_layer_t *layer,
+                        uint8_t decor,
+                        uint32_t *chunk_of)
+{
+    uint32_t chunk_size = tile_map->chunk_size;
+    uint32_t chunk_pixels = chunk_size * tile_map->tile_size;
+    uint32_t columns = (tile_map->width + chunk_size - 1) / chunk_size;
+    uint32_t rows = (tile_map->height + chunk_size - 1) / chunk_size;
+    if(decor)
+        for(uint32_t i_decor = 0; i_decor < layer->num_decor_entities; ++i_decor)
+            chunk_of[i_decor] = find_chunk(layer->decor_entities[i_decor].x,
+                                           layer->decor_entities[i_decor].y,
+                                           chunk_pixels, columns, rows);
+    else
+        for(uint32_t i_entity = 0; i_entity < layer->num_entities; ++i_entity)
+            chunk_of[i_entity] = find_chunk(layer->entities[i_entity].x,
+                                            layer->entities[i_entity].y,
+                                            chunk_pixels, columns, rows);
+}
+
+// Stable counting sort by chunk of num_elements elements, chunk_of holds the
+// chunk of every element. starts is filled with the num_chunks + 1 chunk
+// starts and positions with the sorted position of every element.
+void sort_chunk_positions(uint32_t *starts,
+                          uint32_t *positions,
+                          const uint32_t *chunk_of,
+                          uint32_t num_elements,
+                          uint32_t num_chunks)
+{
+    memset(starts, 0, sizeof(uint32_t) * ((size_t)num_chunks + 1));
+    for(uint32_t i_element = 0; i_element < num_elements; ++i_element)
+        starts[chunk_of[i_element] + 1]++;
+    for(uint32_t i_chunk = 0; i_chunk < num_chunks; ++i_chunk)
+        starts[i_chunk + 1] += starts[i_chunk];
+
+    uint32_t *cursors = osp_mem_malloc(sizeof(uint32_t) * ((size_t)num_chunks + 1));
+    memcpy(cursors, starts, sizeof(uint32_t) * ((size_t)num_chunks + 1));
+    for(uint32_t i_element = 0; i_element < num_elements; ++i_element)
+        positions[i_element] = cursors[chunk_of[i_element]]++;
+    osp_mem_free(cursors);
+}
+
+// Counting sort of num_elements elements of element_size bytes by chunk,
+// chunk_of holds the chunk of every element.
+void sort_by_chunk(struct chunked_elements *sorted,
+                   const void *elements,
+                   size_t element_size,
+                   uint32_t num_elements,
+                   const uint32_t *chunk_of,
+                   uint32_t num_chunks)
+{
+    sorted->starts = osp_mem_malloc(sizeof(uint32_t) * ((size_t)num_chunks + 1));
+    uint32_t *positions = osp_mem_malloc(sizeof(uint32_t) * (num_elements + 1));
+    sort_chunk_positions(sorted->starts, positions, chunk_of, num_elements,
+                         num_chunks);
+    sorted->elements = osp_mem_malloc(element_size *
+                                      (num_elements > 0 ? num_elements : 1));
+    for(uint32_t i_element = 0; i_element < num_elements; ++i_element)
+        memcpy((char *)sorted->elements + element_size * positions[i_element],
+               (const char *)elements + element_size * i_element,
+               element_size);
+    osp_mem_free(positions);
+}
+
+// Sorted positions of the entities of a chunked entities layer
+struct chunked_layer_remap
+{
+    uint32_t *decors;
+    uint32_t *entities;
+};
+
+void remap_chunked_references(tilemap_data_t *tile_maps, uint32_t num_levels)
+{
+    // Where every entity of the chunked levels goes once sorted by chunk, the
+    // levels that aren't chunked keep their numbers
+    struct chunked_layer_remap **remaps =
+        osp_mem_calloc(num_levels + 1, sizeof(struct chunked_layer_remap *));
+    for(uint32_t i_level = 0; i_level < num_levels; ++i_level)
+    {
+        tilemap_data_t *tile_map = &(tile_maps[i_level]);
+        if(!(tile_map->flags & MAP_FLAG_CHUNKS) || tile_map->chunk_size == 0 ||
+           tile_map->width == 0 || tile_map->height == 0)
+            continue;
+        uint32_t chunk_size = tile_map->chunk_size;
+        uint32_t num_chunks = ((tile_map->width + chunk_size - 1) / chunk_size) *
+                              ((tile_map->height + chunk_size - 1) / chunk_size);
+        uint32_t *starts =
+            osp_mem_malloc(sizeof(uint32_t) * ((size_t)num_chunks + 1));
+
+        remaps[i_level] =
+            osp_mem_malloc(sizeof(struct chunked_layer_remap) *
+                           (tile_map->num_entity_layers + 1));
+        for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
+        {
+            entities_layer_t *layer = &(tile_map->entity_layers[i_layer]);
+            struct chunked_layer_remap *remap = &(remaps[i_level][i_layer]);
+            uint32_t num_elements = layer->num_decor_entities > layer->num_entities
+                ? layer->num_decor_entities
+                : layer->num_entities;
+            uint32_t *chunk_of =
+                osp_mem_malloc(sizeof(uint32_t) * (num_elements + 1));
+
+            remap->decors = osp_mem_malloc(sizeof(uint32_t) *
+                                           (layer->num_decor_entities + 1));
+            find_entity_chunks(tile_map, layer, 1, chunk_of);
+            sort_chunk_positions(starts, remap->decors, chunk_of,
+                                 layer->num_decor_entities, num_chunks);
+
+            remap->entities = osp_mem_malloc(sizeof(uint32_t) *
+                                             (layer->num_entities + 1));
+            find_entity_chunks(tile_map, layer, 0, chunk_of);
+            sort_chunk_positions(starts, remap->entities, chunk_of,
+                                 layer->num_entities, num_chunks);
+
+            osp_mem_free(chunk_of);
+        }
+        osp_mem_free(starts);
+    }
+
+    // Then every reference takes the number of its entity in the level it
+    // points to. The data is shared with the chunks, so it's done in place.
+    for(uint32_t i_level = 0; i_level < num_levels; ++i_level)
+    {
+        tilemap_data_t *tile_map = &(tile_maps[i_level]);
+        for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
         {
-            uint32_t width = 0;
-            uint32_t height = 0;
-            uint32_t grid_size = 0;
-            uint8_t num_valid_tile_layers = 0;
-            uint8_t num_valid_collision_layers = 0;
-            uint8_t num_valid_entities_layers = 0;
-            uint16_t layer_index = 0;
-            uint16_t total_layers = 0;
-            struct valid_layer
-                valid_tile_layers[MAX_VALID_TILE_LAYERS];
-            struct valid_layer
-                valid_collision_layers[MAX_VALID_COLLISION_LAYERS];
-            struct valid_layer
-                valid_entities_layers[MAX_VALID_ENTITIES_LAYERS];
-            cJSON* layer_instance;
-            cJSON* typeElement;
-            // Iterate all layers
-            cJSON_ArrayForEach(layer_instance, layer_instances_json)
+            entities_layer_t *layer = &(tile_map->entity_layers[i_layer]);
+            for(uint32_t i_entity = 0; i_entity < layer->num_entities; ++i_entity)
             {
-                // Wich kind of layer is this?
-                typeElement =
-                    cJSON_GetObjectItemCaseSensitive(layer_instance, "__type");
-                // This is a tiles layer
-                if(strncmp(cJSON_GetStringValue(typeElement),
-                           "Tiles",
-                           10) == 0)
+                entity_t *entity = &(layer->entities[i_entity]);
+                for(uint32_t i_data = 0; i_data < entity->num_data; ++i_data)
                 {
-                    // If this is a valid layer let's cache its index for
-                    // later data retrieval
-                    if(validate_tiles_layer(
-                        layer_instance,
-                        &width,
-                        &height,
-                        &grid_size,
-                        &(tile_map.tile_set)))
+                    entity_data_t *data = &(entity->data[i_data]);
+                    uint32_t target_level = i_level;
+                    uint32_t target = i_layer;
+                    if(data->type == ENTITY_DATA_FOREIGN_ENTITY)
                     {
-                        valid_tile_layers[num_valid_tile_layers++] =
-                            (struct valid_layer)
-                            {
-                                .index = layer_index,
-                                .order = total_layers++
-                            };
-                    }
-                } // This is an entities layer
-                else if(strncmp(cJSON_GetStringValue(typeElement),
-                                "Entities",
-                                10) == 0)
-                {
-                    // Entity layers should always be valid, so let's cache
-                    // its index for later data retrieval
-                    valid_entities_layers[num_valid_entities_layers++] = 
-                        (struct valid_layer)
-                        {
-                            .index = layer_index,
-                            .order = total_layers++
-                        };
-                } // This is an int grid layer, could be a collision layer
-                else if(strncmp(cJSON_GetStringValue(typeElement),
-                                "IntGrid",
-                                10) == 0)
-                {
-                    // If this is a valid layer let's cache its index for
-                    // later data retrieval
-                    if(validate_collisions_layer(layer_instance, width, height))
-                    {
-                        valid_collision_layers[num_valid_collision_layers++] =
-                            (struct valid_layer)
-                            {
-                                .index = layer_index,
-                                .order = total_layers++
-                            };
+                        target_level = data->entity_level;
+                        target = data->entity_layer;
                     }
+                    else if(data->type != ENTITY_DATA_ENTITY)
+                        continue;
+                    if(target_level >= num_levels ||
+                       remaps[target_level] == NULL ||
+                       target >= tile_maps[target_level].num_entity_layers)
+                        continue;
+
+                    entities_layer_t *target_layer =
+                        &(tile_maps[target_level].entity_layers[target]);
+                    struct chunked_layer_remap *remap =
+                        &(remaps[target_level][target]);
+                    if(data->entity_is_decor &&
+                       data->entity_number < target_layer->num_decor_entities)
+                        data->entity_number = remap->decors[data->entity_number];
+                    else if(!data->entity_is_decor &&
+                            data->entity_number < target_layer->num_entities)
+                        data->entity_number =
+                            remap->entities[data->entity_number];
                 }
-                
-                ++layer_index;
             }
+        }
+    }
 
-            tile_map.width = width;
-            tile_map.height = height;
-            tile_map.tile_size = grid_size;
+    for(uint32_t i_level = 0; i_level < num_levels; ++i_level)
+    {
+        if(remaps[i_level] == NULL)
+            continue;
+        for(int i_layer = 0; i_layer < tile_maps[i_level].num_entity_layers; ++i_layer)
+        {
+            osp_mem_free(remaps[i_level][i_layer].decors);
+            osp_mem_free(remaps[i_level][i_layer].entities);
+        }
+        osp_mem_free(remaps[i_level]);
+    }
+    osp_mem_free(remaps);
+}
 
-            // Did we find at least one valid tile layer?
-            if(num_valid_tile_layers > 0)
-            {
-                tile_map.num_tile_layers = num_valid_tile_layers;
+void write_tilemap_chunks(tilemap_data_t *tile_map, osp_writer_t writer)
+{
+    uint32_t chunk_size = tile_map->chunk_size;
+    uint32_t chunk_pixels = chunk_size * tile_map->tile_size;
+    uint32_t columns = (tile_map->width + chunk_size - 1) / chunk_size;
+    uint32_t rows = (tile_map->height + chunk_size - 1) / chunk_size;
+    uint32_t num_chunks = columns * rows;
+    osp_writer_put_u32(writer, chunk_size);
+    osp_writer_put_u32(writer, columns);
+    osp_writer_put_u32(writer, rows);
+    if(num_chunks == 0)
+        return;
 
-                // Alloc space for the layers array
-                tile_map.tile_layers =
-                    (tiles_layer_t *)malloc(sizeof(tiles_layer_t) * 
-                                            num_valid_tile_layers);
+    // Tiles sorted by chunk, with their cell made relative to it
+    struct chunked_elements *tiles =
+        osp_mem_malloc(sizeof(struct chunked_elements) *
+                       (tile_map->num_tile_layers + 1));
+    for(int i_layer = 0; i_layer < tile_map->num_tile_layers; ++i_layer)
+    {
+        tiles_layer_t *layer = &(tile_map->tile_layers[i_layer]);
+        uint32_t *chunk_of =
+            osp_mem_malloc(sizeof(uint32_t) * (layer->num_tiles + 1));
+        for(uint32_t i_tile = 0; i_tile < layer->num_tiles; ++i_tile)
+        {
+            uint32_t x = layer->tiles[i_tile].tile_idx % tile_map->width;
+            uint32_t y = layer->tiles[i_tile].tile_idx / tile_map->width;
+            chunk_of[i_tile] = find_chunk(x * tile_map->tile_size,
+                                          y * tile_map->tile_size,
+                                          chunk_pixels, columns, rows);
+        }
+        sort_by_chunk(&(tiles[i_layer]), layer->tiles, sizeof(tile_source_t),
+                      layer->num_tiles, chunk_of, num_chunks);
+        osp_mem_free(chunk_of);
 
-                // Let's iterate all valid layers again
-                for(int i_layer = 0; i_layer < num_valid_tile_layers; ++i_layer)
-                {
-                    // Read this layer's data
-                    read_tiles_layer(
-                        &(tile_map.tile_layers[i_layer]),
-                        cJSON_GetArrayItem(layer_instances_json,
-                                           valid_tile_layers[i_layer].index),
-                        total_layers - valid_tile_layers[i_layer].order - 1,
-                        tile_map.tile_size,
-                        tile_map.width
-                    );
-                }
-            }
+        tile_source_t *sorted = (tile_source_t *)tiles[i_layer].elements;
+        for(uint32_t i_tile = 0; i_tile < layer->num_tiles; ++i_tile)
+        {
+            uint32_t x = sorted[i_tile].tile_idx % tile_map->width;
+            uint32_t y = sorted[i_tile].tile_idx / tile_map->width;
+            uint32_t chunk_width = tile_map->width - x / chunk_size * chunk_size;
+            chunk_width = chunk_width < chunk_size ? chunk_width : chunk_size;
+            sorted[i_tile].tile_idx =
+                (y % chunk_size) * chunk_width + x % chunk_size;
+        }
+    }
 
-            // Did we find at least one valid collision layer?
-            if(num_valid_collision_layers > 0)
-            {
-                tile_map.num_collision_layers = num_valid_collision_layers;
+    // Collision rectangles bucketed by the chunks they overlap
+    collision_index_t *rect_chunks =
+        osp_mem_malloc(sizeof(collision_index_t) *
+                       (tile_map->num_collision_layers + 1));
+    for(int i_layer = 0; i_layer < tile_map->num_collision_layers; ++i_layer)
+        build_collision_index(&(rect_chunks[i_layer]),
+                              tile_map->collision_layers[i_layer].rectangles,
+                              tile_map->collision_layers[i_layer].num_rectangles,
+                              tile_map->width * tile_map->tile_size,
+                              tile_map->height * tile_map->tile_size,
+                              chunk_pixels);
+
+    // Entities sorted by chunk, with their position made relative to it.
+    // Their references were renumbered by remap_chunked_references already.
+    struct chunked_elements *decors =
+        osp_mem_malloc(sizeof(struct chunked_elements) *
+                       (tile_map->num_entity_layers + 1));
+    struct chunked_elements *entities =
+        osp_mem_malloc(sizeof(struct chunked_elements) *
+                       (tile_map->num_entity_layers + 1));
+    for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
+    {
+        entities_layer_t *layer = &(tile_map->entity_layers[i_layer]);
+        uint32_t num_elements = layer->num_decor_entities > layer->num_entities
+            ? layer->num_decor_entities
+            : layer->num_entities;
+        uint32_t *chunk_of = osp_mem_malloc(sizeof(uint32_t) * (num_elements + 1));
+
+        find_entity_chunks(tile_map, layer, 1, chunk_of);
+        sort_by_chunk(&(decors[i_layer]), layer->decor_entities,
+                      sizeof(decor_entity_t), layer->num_decor_entities,
+                      chunk_of, num_chunks);
+        decor_entity_t *sorted_decors = (decor_entity_t *)decors[i_layer].elements;
+        for(uint32_t i_decor = 0; i_decor < layer->num_decor_entities; ++i_decor)
+        {
+            decor_entity_t *decor = &(sorted_decors[i_decor]);
+            uint32_t chunk = find_chunk(decor->x, decor->y, chunk_pixels,
+                                        columns, rows);
+            decor->x -= chunk % columns * chunk_pixels;
+            decor->y -= chunk / columns * chunk_pixels;
+        }
 
-                // Alloc space for the layers array
-                tile_map.collision_layers =
-                    (collisions_layer_t *)malloc(sizeof(collisions_layer_t) * 
-                                            num_valid_collision_layers);
+        find_entity_chunks(tile_map, layer, 0, chunk_of);
+        sort_by_chunk(&(entities[i_layer]), layer->entities,
+                      sizeof(entity_t), layer->num_entities,
+                      chunk_of, num_chunks);
+        entity_t *sorted_entities = (entity_t *)entities[i_layer].elements;
+        for(uint32_t i_entity = 0; i_entity < layer->num_entities; ++i_entity)
+        {
+            entity_t *entity = &(sorted_entities[i_entity]);
+            uint32_t chunk = find_chunk(entity->x, entity->y, chunk_pixels,
+                                        columns, rows);
+            entity->x -= chunk % columns * chunk_pixels;
+            entity->y -= chunk / columns * chunk_pixels;
+        }
+
+        osp_mem_free(chunk_of);
+    }
+
+    // Every chunk is written to its own buffer first, the directory needs
+    // their sizes
+    osp_writer_t chunks_writer = osp_writer_new(ASSET_CHUNKS_CAPACITY);
+    uint64_t *directory = osp_mem_malloc(sizeof(uint64_t) * 2 * num_chunks);
+    tilemap_data_t chunk =
+    {
+        .flags = tile_map->flags,
+        .tile_size = tile_map->tile_size,
+        .num_tile_layers = tile_map->num_tile_layers,
+        .tile_layers = osp_mem_calloc(tile_map->num_tile_layers + 1,
+                                      sizeof(tiles_layer_t)),
+        .num_collision_layers = tile_map->num_collision_layers,
+        .collision_layers = osp_mem_calloc(tile_map->num_collision_layers + 1,
+                                           sizeof(collisions_layer_t)),
+        .num_entity_layers = tile_map->num_entity_layers,
+        .entity_layers = osp_mem_calloc(tile_map->num_entity_layers + 1,
+                                        sizeof(entities_layer_t))
+    };
+    for(uint32_t i_chunk = 0; i_chunk < num_chunks; ++i_chunk)
+    {
+        uint32_t chunk_x = i_chunk % columns * chunk_size;
+        uint32_t chunk_y = i_chunk / columns * chunk_size;
+        chunk.width = tile_map->width - chunk_x < chunk_size
+            ? tile_map->width - chunk_x
+            : chunk_size;
+        chunk.height = tile_map->height - chunk_y < chunk_size
+            ? tile_map->height - chunk_y
+            : chunk_size;
+
+        for(int i_layer = 0; i_layer < tile_map->num_tile_layers; ++i_layer)
+        {
+            tiles_layer_t *layer = &(tile_map->tile_layers[i_layer]);
+            tiles_layer_t *chunk_layer = &(chunk.tile_layers[i_layer]);
+            chunk_layer->order = layer->order;
+            chunk_layer->num_tiles = tiles[i_layer].starts[i_chunk + 1] -
+                                     tiles[i_layer].starts[i_chunk];
+            chunk_layer->tiles = (tile_source_t *)tiles[i_layer].elements +
+                                 tiles[i_layer].starts[i_chunk];
+            if(layer->tile_ids != NULL)
+            {
+                chunk_layer->tile_ids =
+                    osp_mem_malloc(sizeof(uint16_t) * chunk.width * chunk.height);
+                for(uint32_t y = 0; y < chunk.height; ++y)
+                    memcpy(chunk_layer->tile_ids + (size_t)y * chunk.width,
+                           layer->tile_ids +
+                               (size_t)(chunk_y + y) * tile_map->width + chunk_x,
+                           sizeof(uint16_t) * chunk.width);
+            }
+        }
 
-                // Let's iterate all valid layers again
-                for(int i_layer = 0;
-                    i_layer < num_valid_collision_layers;
-                    ++i_layer)
+        for(int i_layer = 0; i_layer < tile_map->num_collision_layers; ++i_layer)
+        {
+            collisions_layer_t *layer = &(tile_map->collision_layers[i_layer]);
+            collisions_layer_t *chunk_layer = &(chunk.collision_layers[i_layer]);
+            collision_index_t *bucket = &(rect_chunks[i_layer]);
+            uint32_t first = bucket->offsets[i_chunk];
+            chunk_layer->order = layer->order;
+            chunk_layer->num_rectangles = bucket->offsets[i_chunk + 1] - first;
+            chunk_layer->rectangles =
+                osp_mem_malloc(sizeof(collision_rect_t) *
+                               (chunk_layer->num_rectangles + 1));
+            uint32_t left = chunk_x * tile_map->tile_size;
+            uint32_t top = chunk_y * tile_map->tile_size;
+            uint32_t right = left + chunk.width * tile_map->tile_size;
+            uint32_t bottom = top + chunk.height * tile_map->tile_size;
+            for(uint32_t i_rect = 0; i_rect < chunk_layer->num_rectangles; ++i_rect)
+            {
+                const collision_rect_t *rect =
+                    &(layer->rectangles[bucket->rect_indices[first + i_rect]]);
+                uint32_t x0 = rect->x > left ? rect->x : left;
+                uint32_t y0 = rect->y > top ? rect->y : top;
+                uint32_t x1 = rect->x + rect->w < right ? rect->x + rect->w : right;
+                uint32_t y1 = rect->y + rect->h < bottom ? rect->y + rect->h : bottom;
+                chunk_layer->rectangles[i_rect] = (collision_rect_t)
                 {
-                    // Read the layer's data
-                    read_collisions_layer(
-                        &(tile_map.collision_layers[i_layer]),
-                        cJSON_GetArrayItem(layer_instances_json,
-                                        valid_collision_layers[i_layer].index),
-                        total_layers-valid_collision_layers[i_layer].order-1,
-                        tile_map.width,
-                        tile_map.height,
-                        tile_map.tile_size
-                    );
-                }
+                    .x = x0 - left,
+                    .y = y0 - top,
+                    .w = x1 - x0,
+                    .h = y1 - y0
+                };
             }
 
-            // Did we find at least one valid entities layer?
-            if(num_valid_entities_layers > 0)
+            if(layer->grid != NULL)
             {
-                tile_map.num_entity_layers = num_valid_entities_layers;
-
-                // Alloc space for the layers array
-                tile_map.entity_layers =
-                    (entities_layer_t *)malloc(sizeof(entities_layer_t) * 
-                                            num_valid_entities_layers);
-
-                // Let's iterate all valid layers again
-                cJSON *entitiesElement;
-                for(int i_layer = 0;
-                    i_layer < num_valid_entities_layers;
-                    ++i_layer)
+                size_t words_per_row = ((size_t)tile_map->width + 63) / 64;
+                size_t chunk_words_per_row = ((size_t)chunk.width + 63) / 64;
+                chunk_layer->grid =
+                    osp_mem_calloc(chunk_words_per_row * chunk.height + 1,
+                                   sizeof(uint64_t));
+                for(uint32_t y = 0; y < chunk.height; ++y)
                 {
-                    // Read this layer's data.
-                    read_entities_layer(
-                        &(tile_map.entity_layers[i_layer]),
-                        cJSON_GetArrayItem(layer_instances_json,
-                                        valid_entities_layers[i_layer].index),
-                        total_layers - valid_entities_layers[i_layer].order - 1
-                    );
+                    const uint64_t *row = layer->grid +
+                                          (chunk_y + y) * words_per_row;
+                    uint64_t *chunk_row = chunk_layer->grid +
+                                          y * chunk_words_per_row;
+                    for(uint32_t x = 0; x < chunk.width; ++x)
+                        if(row[(chunk_x + x) / 64] >> ((chunk_x + x) % 64) & 1)
+                            chunk_row[x / 64] |= 1ull << (x % 64);
                 }
             }
+
+            if(layer->index.offsets != NULL)
+                build_collision_index(&(chunk_layer->index),
+                                      chunk_layer->rectangles,
+                                      chunk_layer->num_rectangles,
+                                      chunk.width * tile_map->tile_size,
+                                      chunk.height * tile_map->tile_size,
+                                      layer->index.cell_size);
+        }
+
+        for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
+        {
+            entities_layer_t *chunk_layer = &(chunk.entity_layers[i_layer]);
+            chunk_layer->order = tile_map->entity_layers[i_layer].order;
+            chunk_layer->first_decor_entity = decors[i_layer].starts[i_chunk];
+            chunk_layer->num_decor_entities =
+                decors[i_layer].starts[i_chunk + 1] - chunk_layer->first_decor_entity;
+            chunk_layer->decor_entities =
+                (decor_entity_t *)decors[i_layer].elements +
+                chunk_layer->first_decor_entity;
+            chunk_layer->first_entity = entities[i_layer].starts[i_chunk];
+            chunk_layer->num_entities =
+                entities[i_layer].starts[i_chunk + 1] - chunk_layer->first_entity;
+            chunk_layer->entities = (entity_t *)entities[i_layer].elements +
+                                    chunk_layer->first_entity;
+        }
+
+        directory[i_chunk * 2] = osp_writer_get_size(chunks_writer);
+        write_tilemap_layers(&chunk, chunks_writer);
+        directory[i_chunk * 2 + 1] =
+            osp_writer_get_size(chunks_writer) - directory[i_chunk * 2];
+
+        // Only the chunk's own copies are freed, the rest is shared
+        for(int i_layer = 0; i_layer < tile_map->num_tile_layers; ++i_layer)
+            osp_mem_free(chunk.tile_layers[i_layer].tile_ids);
+        for(int i_layer = 0; i_layer < tile_map->num_collision_layers; ++i_layer)
+        {
+            osp_mem_free(chunk.collision_layers[i_layer].rectangles);
+            osp_mem_free(chunk.collision_layers[i_layer].grid);
+            osp_mem_free(chunk.collision_layers[i_layer].index.offsets);
+            osp_mem_free(chunk.collision_layers[i_layer].index.rect_indices);
         }
     }
 
-    // We are done, free the json tree memory.
-    free_json_data();
+    // Now the directory and all the chunks
+    osp_writer_put_u64_array(writer, directory, (size_t)num_chunks * 2);
+    size_t chunks_size = 0;
+    char *chunks_data = osp_writer_detach(chunks_writer, &chunks_size);
+    osp_writer_put_bytes(writer, chunks_data, chunks_size);
+    free(chunks_data);
+    osp_writer_delete(chunks_writer);
+    osp_mem_free(directory);
+
+    osp_mem_free(chunk.tile_layers);
+    osp_mem_free(chunk.collision_layers);
+    osp_mem_free(chunk.entity_layers);
+    for(int i_layer = 0; i_layer < tile_map->num_tile_layers; ++i_layer)
+    {
+        osp_mem_free(tiles[i_layer].elements);
+        osp_mem_free(tiles[i_layer].starts);
+    }
+    osp_mem_free(tiles);
+    for(int i_layer = 0; i_layer < tile_map->num_collision_layers; ++i_layer)
+    {
+        osp_mem_free(rect_chunks[i_layer].offsets);
+        osp_mem_free(rect_chunks[i_layer].rect_indices);
+    }
+    osp_mem_free(rect_chunks);
+    for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
+    {
+        osp_mem_free(decors[i_layer].elements);
+        osp_mem_free(decors[i_layer].starts);
+        osp_mem_free(entities[i_layer].elements);
+        osp_mem_free(entities[i_layer].starts);
+    }
+    osp_mem_free(decors);
+    osp_mem_free(entities);
+}
 
-    // Now write the tilemap data to file
+void write_tilemap(tilemap_data_t *tile_map, osp_writer_t writer)
+{
+    // The extended header only if there are flags, so the default output is
+    // readable by older readers
+    if(tile_map->flags != 0)
+    {
+        osp_writer_put_u64(writer, MAP_EXTENDED_HEADER);
+        osp_writer_put_u32(writer, tile_map->flags);
+    }
 
     // First the tileset name
-    size_t tilesetLength = strlen(tile_map.tile_set);
-    fwrite(&tilesetLength, sizeof(tilesetLength), 1, write_file);
-    fwrite(tile_map.tile_set, 1, tilesetLength, write_file);
+    osp_writer_put_string(writer, tile_map->tile_set);
 
     // Then the tile size in pixels
-    fwrite(&(tile_map.tile_size), sizeof(tile_map.tile_size), 1, write_file);
+    osp_writer_put_u32(writer, tile_map->tile_size);
     // Then map width and height in tiles
-    fwrite(&(tile_map.width), sizeof(tile_map.width), 1, write_file);
-    fwrite(&(tile_map.height), sizeof(tile_map.height), 1, write_file);
-
-    // Finally the number of tile layers
-    fwrite(&(tile_map.num_tile_layers), sizeof(tile_map.num_tile_layers),
-           1, write_file);    
-    // Now write all tile layers data: for each layer
-    for(int i_layer = 0; i_layer < tile_map.num_tile_layers; ++i_layer)
+    osp_writer_put_u32(writer, tile_map->width);
+    osp_writer_put_u32(writer, tile_map->height);
+
+    // Finally all layers, whole or in chunks
+    if(tile_map->flags & MAP_FLAG_CHUNKS)
+        write_tilemap_chunks(tile_map, writer);
+    else
+        write_tilemap_layers(tile_map, writer);
+}
+
+void read_level(
+    tilemap_data_t *tile_map,
+    cJSON *map_json,
+    cJSON *level_json,
+    const struct entity_index *entity_index,
+    const ldtk_to_map_params_t *map_params,
+    const char *path
+    )
+{
+    uint32_t tiles_flags = MAP_FLAG_TILES_DENSE | MAP_FLAG_TILES_RLE;
+    // Let's find this level's layers
+    cJSON *layer_instances_json =
+        cJSON_GetObjectItemCaseSensitive(level_json, "layerInstances");
+    int numLayerInstances = cJSON_GetArraySize(layer_instances_json);
+    if(numLayerInstances > 0)
     {
-        // Write the layer order
-        fwrite(&(tile_map.tile_layers[i_layer].order),
-                sizeof(tile_map.tile_layers[i_layer].order),
-                1,
-                write_file);
-        // Write the number of defined tiles for this layer
-        fwrite(&(tile_map.tile_layers[i_layer].num_tiles),
-                sizeof(tile_map.tile_layers[i_layer].num_tiles),
-                1,
-                write_file);
-        // and for every tile
-        for(int i_tile = 0;
-            i_tile < tile_map.tile_layers[i_layer].num_tiles;
-            ++i_tile)
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t grid_size = 0;
+        uint8_t num_valid_tile_layers = 0;
+        uint8_t num_valid_collision_layers = 0;
+        uint8_t num_valid_entities_layers = 0;
+        uint16_t layer_index = 0;
+        uint16_t total_layers = 0;
+        struct valid_layer *valid_tile_layers =
+            osp_mem_malloc(sizeof(struct valid_layer) * numLayerInstances);
+        struct valid_layer *valid_collision_layers =
+            osp_mem_malloc(sizeof(struct valid_layer) * numLayerInstances);
+        struct valid_layer *valid_entities_layers =
+            osp_mem_malloc(sizeof(struct valid_layer) * numLayerInstances);
+        cJSON* layer_instance;
+        cJSON* typeElement;
+        // Iterate all layers
+        cJSON_ArrayForEach(layer_instance, layer_instances_json)
         {
-            // Write the tile idx
-            fwrite(&(tile_map.tile_layers[i_layer].tiles[i_tile].tile_idx),
-                   sizeof(tile_map.tile_layers[i_layer].tiles[i_tile].tile_idx),
-                   1,
-                   write_file);
-            // Write the X, Y couple
-            fwrite(&(tile_map.tile_layers[i_layer].tiles[i_tile].source_x),
-                   sizeof(tile_map.tile_layers[i_layer].tiles[i_tile].source_x),
-                   1,
-                   write_file);
-            fwrite(&(tile_map.tile_layers[i_layer].tiles[i_tile].source_y),
-                   sizeof(tile_map.tile_layers[i_layer].tiles[i_tile].source_y),
-                   1,
-                   write_file);
+            // Wich kind of layer is this?
+            typeElement =
+                cJSON_GetObjectItemCaseSensitive(layer_instance, "__type");
+            // This is a tiles layer
+            if(strncmp(cJSON_GetStringValue(typeElement),
+                       "Tiles",
+                       10) == 0)
+            {
+                // If this is a valid layer let's cache its index for
+                // later data retrieval
+                if(num_valid_tile_layers < MAX_VALID_LAYERS &&
+                   validate_tiles_layer(
+                    layer_instance,
+                    &width,
+                    &height,
+                    &grid_size,
+                    &(tile_map->tile_set)))
+                {
+                    valid_tile_layers[num_valid_tile_layers++] =
+                        (struct valid_layer)
+                        {
+                            .index = layer_index,
+                            .order = total_layers++
+                        };
+                }
+            } // This is an entities layer
+            else if(strncmp(cJSON_GetStringValue(typeElement),
+                            "Entities",
+                            10) == 0)
+            {
+                // Entity layers should always be valid, so let's cache
+                // its index for later data retrieval
+                if(num_valid_entities_layers < MAX_VALID_LAYERS)
+                    valid_entities_layers[num_valid_entities_layers++] =
+                        (struct valid_layer)
+                        {
+                            .index = layer_index,
+                            .order = total_layers++
+                        };
+            } // This is an int grid layer, could be a collision layer
+            else if(strncmp(cJSON_GetStringValue(typeElement),
+                            "IntGrid",
+                            10) == 0)
+            {
+                // If this is a valid layer let's cache its index for
+                // later data retrieval
+                if(num_valid_collision_layers < MAX_VALID_LAYERS &&
+                   validate_collisions_layer(layer_instance, width, height))
+                {
+                    valid_collision_layers[num_valid_collision_layers++] =
+                        (struct valid_layer)
+                        {
+                            .index = layer_index,
+                            .order = total_layers++
+                        };
+                }
+            }
+            
+            ++layer_index;
         }
-    }
 
-    // Finally the number of collision layers
-    fwrite(&(tile_map.num_collision_layers),
-           sizeof(tile_map.num_collision_layers),
-           1, write_file);    
-    // Now write all collisions layers data: for each layer
-    for(int i_layer = 0; i_layer < tile_map.num_collision_layers; ++i_layer)
-    {
-        // Write the layer order
-        fwrite(&(tile_map.collision_layers[i_layer].order),
-                sizeof(tile_map.collision_layers[i_layer].order),
-                1,
-                write_file);
-        // Write the number of collision rectangles for this layer
-        fwrite(&(tile_map.collision_layers[i_layer].num_rectangles),
-                sizeof(tile_map.collision_layers[i_layer].num_rectangles),
-                1,
-                write_file);
-        // and for every rectangle
-        for(int i_rect = 0;
-            i_rect < tile_map.collision_layers[i_layer].num_rectangles;
-            ++i_rect)
+        tile_map->width = width;
+        tile_map->height = height;
+        tile_map->tile_size = grid_size;
+
+        // Did we find at least one valid tile layer?
+        if(num_valid_tile_layers > 0)
         {
-            // Write the rectangle position and size
-            fwrite(
-                &(tile_map.collision_layers[i_layer].rectangles[i_rect].x),
-                sizeof(tile_map.collision_layers[i_layer].rectangles[i_rect].x),
-                1, write_file);
-            fwrite(
-                &(tile_map.collision_layers[i_layer].rectangles[i_rect].y),
-                sizeof(tile_map.collision_layers[i_layer].rectangles[i_rect].y),
-                1, write_file);
-            fwrite(
-                &(tile_map.collision_layers[i_layer].rectangles[i_rect].w),
-                sizeof(tile_map.collision_layers[i_layer].rectangles[i_rect].w),
-                1, write_file);
-            fwrite(
-                &(tile_map.collision_layers[i_layer].rectangles[i_rect].h),
-                sizeof(tile_map.collision_layers[i_layer].rectangles[i_rect].h),
-                1, write_file);
+            tile_map->num_tile_layers = num_valid_tile_layers;
+
+            // Alloc space for the layers array
+            tile_map->tile_layers =
+                (tiles_layer_t *)osp_mem_malloc(sizeof(tiles_layer_t) * 
+                                        num_valid_tile_layers);
+
+            // Let's iterate all valid layers again
+            for(int i_layer = 0; i_layer < num_valid_tile_layers; ++i_layer)
+            {
+                cJSON *tiles_layer_instance =
+                    cJSON_GetArrayItem(layer_instances_json,
+                                       valid_tile_layers[i_layer].index);
+                // Tileset index grids need the tileset layout
+                struct tileset_layout tileset;
+                uint8_t has_tileset = (tile_map->flags & tiles_flags) &&
+                    find_tileset_layout(map_json,
+                                        tiles_layer_instance,
+                                        &tileset);
+
+                // Read this layer's data
+                read_tiles_layer(
+                    &(tile_map->tile_layers[i_layer]),
+                    tiles_layer_instance,
+                    total_layers - valid_tile_layers[i_layer].order - 1,
+                    tile_map->tile_size,
+                    tile_map->width,
+                    tile_map->height,
+                    has_tileset ? &tileset : NULL
+                );
+
+                // Every layer needs its grid, or none is written
+                if((tile_map->flags & tiles_flags) &&
+                   tile_map->tile_layers[i_layer].tile_ids == NULL)
+                {
+                    printf("\t%s: tileset indices unavailable, writing "
+                           "tile sources\n", path);
+                    tile_map->flags &= ~tiles_flags;
+                }
+            }
         }
-    }
 
-    // Finally the number of entity layers
-    fwrite(&(tile_map.num_entity_layers), sizeof(tile_map.num_entity_layers),
-           1, write_file);    
-    // Now write all entity layers data: for each layer
-    for(int i_layer = 0; i_layer < tile_map.num_entity_layers; ++i_layer)
-    {
-        entities_layer_t *layer = &(tile_map.entity_layers[i_layer]);
-
-        // Write the layer order
-        fwrite(&(layer->order), sizeof(layer->order), 1, write_file);
-
-        // Write the number of decor entities for this layer
-        fwrite(&(layer->num_decor_entities),
-                sizeof(layer->num_decor_entities),
-                1,
-                write_file);
-        // and for every decor entity
-        for(int i_entity = 0;
-            i_entity < layer->num_decor_entities;
-            ++i_entity)
+        // Did we find at least one valid collision layer?
+        if(num_valid_collision_layers > 0)
         {
-            // Write the entity source position
-            fwrite(
-                &(layer->decor_entities[i_entity].source_x),
-                sizeof(layer->decor_entities[i_entity].source_x),
-                1,
-                write_file);
-            fwrite(
-                &(layer->decor_entities[i_entity].source_y),
-                sizeof(layer->decor_entities[i_entity].source_y),
-                1,
-                write_file);
-
-            // Write the entity position and size
-            fwrite(
-                &(layer->decor_entities[i_entity].x),
-                sizeof(layer->decor_entities[i_entity].x),
-                1,
-                write_file);
-            fwrite(&(layer->decor_entities[i_entity].y),
-                   sizeof(layer->decor_entities[i_entity].y),
-                   1,
-                   write_file);
-            fwrite(&(layer->decor_entities[i_entity].w),
-                   sizeof(layer->decor_entities[i_entity].w),
-                   1,
-                   write_file);
-            fwrite(&(layer->decor_entities[i_entity].h),
-                   sizeof(layer->decor_entities[i_entity].h),
-                   1,
-                   write_file);
+            tile_map->num_collision_layers = num_valid_collision_layers;
+
+            // Alloc space for the layers array
+            tile_map->collision_layers =
+                (collisions_layer_t *)osp_mem_malloc(sizeof(collisions_layer_t) * 
+                                        num_valid_collision_layers);
+
+            // Let's iterate all valid layers again
+            for(int i_layer = 0;
+                i_layer < num_valid_collision_layers;
+                ++i_layer)
+            {
+                // Read the layer's data
+                read_collisions_layer(
+                    &(tile_map->collision_layers[i_layer]),
+                    cJSON_GetArrayItem(layer_instances_json,
+                                    valid_collision_layers[i_layer].index),
+                    total_layers-valid_collision_layers[i_layer].order-1,
+                    tile_map->width,
+                    tile_map->height,
+                    tile_map->tile_size,
+                    (tile_map->flags & MAP_FLAG_COLLISION_GRID) != 0,
+                    (tile_map->flags & MAP_FLAG_COLLISION_INDEX) != 0
+                        ? map_params->collision_index_cell
+                        : 0
+                );
+            }
         }
 
-        // Write the number of entities for this layer
-        fwrite(&(layer->num_entities),
-                sizeof(layer->num_entities),
-                1,
-                write_file);
-        // and for every entity
-        for(int i_entity = 0;
-            i_entity < layer->num_entities;
-            ++i_entity)
+        // Did we find at least one valid entities layer?
+        if(num_valid_entities_layers > 0)
         {
-            // Write the entity type
-            size_t typeLength = 
-                strlen(layer->entities[i_entity].type);
-            fwrite(&typeLength, sizeof(typeLength), 1, write_file);
-            fwrite(layer->entities[i_entity].type,
-                1, typeLength, write_file);
-
-            // Write the entity position and size
-            fwrite(&(layer->entities[i_entity].x),
-                   sizeof(layer->entities[i_entity].x),
-                   1,
-                   write_file);
-            fwrite(&(layer->entities[i_entity].y),
-                   sizeof(layer->entities[i_entity].y),
-                   1,
-                   write_file);
-            fwrite(&(layer->entities[i_entity].w),
-                   sizeof(layer->entities[i_entity].w),
-                   1,
-                   write_file);
-            fwrite(&(layer->entities[i_entity].h),
-                   sizeof(layer->entities[i_entity].h),
-                   1,
-                   write_file);
-
-            // Write the entity extra data if present
-            fwrite(&(layer->entities[i_entity].num_data),
-                   sizeof(layer->entities[i_entity].num_data),
-                   1,
-                   write_file);
-
-            for(int i_data = 0;
-                i_data < layer->entities[i_entity].num_data;
-                ++i_data)
+            tile_map->num_entity_layers = num_valid_entities_layers;
+
+            // Alloc space for the layers array
+            tile_map->entity_layers =
+                (entities_layer_t *)osp_mem_malloc(sizeof(entities_layer_t) * 
+                                        num_valid_entities_layers);
+
+            // Let's iterate all valid layers again
+            for(int i_layer = 0;
+                i_layer < num_valid_entities_layers;
+                ++i_layer)
             {
-                // Write the data name
-                size_t name_length = 
-                    strlen(layer->entities[i_entity].data[i_data].name);
-                fwrite(&name_length, sizeof(name_length), 1, write_file);
-                fwrite(layer->entities[i_entity].data[i_data].name,
-                    1, name_length, write_file);
-                
-                // Write the data type
-                fwrite(&(layer->entities[i_entity].data[i_data].type),
-                    sizeof(layer->entities[i_entity].data[i_data].type),
-                    1,
-                    write_file);
-
-                // Write the data value if known
-                switch(layer->entities[i_entity].data[i_data].type)
-                {
-                    case ENTITY_DATA_INT:
-                    fwrite(&(layer->entities[i_entity].data[i_data].int_data),
-                        sizeof(layer->entities[i_entity].data[i_data].int_data),
-                        1,
-                        write_file);
-                    break;
-                    case ENTITY_DATA_FLOAT:
-                    fwrite(&(layer->entities[i_entity].data[i_data].float_data),
-                        sizeof(
-                            layer->entities[i_entity].data[i_data].float_data),
-                        1,
-                        write_file);
-                    break;
-                    case ENTITY_DATA_STRING:
-                    size_t data_length = 
-                        strlen(
-                            layer->entities[i_entity].data[i_data].string_data);
-                    fwrite(&data_length, sizeof(data_length), 1, write_file);
-                    fwrite(layer->entities[i_entity].data[i_data].string_data,
-                        1, data_length, write_file);
-                    break;
-                    case ENTITY_DATA_ENTITY:
-                    fwrite(
-                        &(layer->entities[i_entity].data[i_data].entity_is_decor),
-                        sizeof(
-                            layer->entities[i_entity].data[i_data].entity_is_decor),
-                        1,
-                        write_file);
-                    fwrite(
-                        &(layer->entities[i_entity].data[i_data].entity_number),
-                        sizeof(
-                            layer->entities[i_entity].data[i_data].entity_number),
-                        1,
-                        write_file);
-                    break;
-                }
+                // Read this layer's data.
+                read_entities_layer(
+                    &(tile_map->entity_layers[i_layer]),
+                    cJSON_GetArrayItem(layer_instances_json,
+                                    valid_entities_layers[i_layer].index),
+                    total_layers - valid_entities_layers[i_layer].order - 1,
+                    entity_index,
+                    tile_map->level,
+                    (uint8_t)i_layer
+                );
             }
         }
+
+        osp_mem_free(valid_tile_layers);
+        osp_mem_free(valid_collision_layers);
+        osp_mem_free(valid_entities_layers);
+    }
+}
+
+// A multi level conversion, every level is read then written on its own
+struct levels_conversion
+{
+    cJSON *map_json;
+    cJSON **levels;
+    const struct entity_index *entity_index;
+    const ldtk_to_map_params_t *map_params;
+    uint32_t flags;
+    const char *path;
+    tilemap_data_t *tile_maps;
+    char **outputs;
+    size_t *output_sizes;
+};
+
+void convert_level(void *context, size_t index)
+{
+    struct levels_conversion *conversion = (struct levels_conversion *)context;
+
+    tilemap_data_t *tile_map = &(conversion->tile_maps[index]);
+    *tile_map = (tilemap_data_t)
+    {
+        .flags = conversion->flags,
+        .level = (uint32_t)index
+    };
+    if(conversion->map_params != NULL)
+        tile_map->chunk_size = conversion->map_params->chunk_size;
+    read_level(tile_map, conversion->map_json, conversion->levels[index],
+               conversion->entity_index, conversion->map_params,
+               conversion->path);
+}
+
+void write_level(void *context, size_t index)
+{
+    struct levels_conversion *conversion = (struct levels_conversion *)context;
+    tilemap_data_t *tile_map = &(conversion->tile_maps[index]);
+
+    // Every level is the level identifier followed by a MAP of its own
+    osp_writer_t writer = osp_writer_new(ASSET_CHUNKS_CAPACITY);
+    osp_writer_put_string(writer, cJSON_GetStringValue(
+        cJSON_GetObjectItemCaseSensitive(conversion->levels[index],
+                                         "identifier")));
+    write_tilemap(tile_map, writer);
+    conversion->outputs[index] =
+        osp_writer_detach(writer, &(conversion->output_sizes[index]));
+    osp_writer_delete(writer);
+
+    osp_mem_free((void *)(tile_map->tile_set));
+    free_tilemap_layers(tile_map);
+}
+
+void write_levels_directory(
+    uint32_t num_levels,
+    char **outputs,
+    const size_t *output_sizes,
+    osp_writer_t writer
+    )
+{
+    // The levels header and directory, then every level
+    osp_writer_put_u64(writer, MAP_EXTENDED_HEADER);
+    osp_writer_put_u32(writer, MAP_FLAG_LEVELS);
+    osp_writer_put_u32(writer, num_levels);
+    uint64_t offset = 0;
+    for(uint32_t i_level = 0; i_level < num_levels; ++i_level)
+    {
+        osp_writer_put_u64(writer, offset);
+        osp_writer_put_u64(writer, output_sizes[i_level]);
+        offset += output_sizes[i_level];
+    }
+    for(uint32_t i_level = 0; i_level < num_levels; ++i_level)
+    {
+        osp_writer_put_bytes(writer, outputs[i_level], output_sizes[i_level]);
+        free(outputs[i_level]);
     }
+}
+
+void write_levels(
+    cJSON *map_json,
+    cJSON *levels_json,
+    const struct entity_index *entity_index,
+    const ldtk_to_map_params_t *map_params,
+    uint32_t flags,
+    const char *path,
+    osp_writer_t writer
+    )
+{
+    uint32_t num_levels = (uint32_t)cJSON_GetArraySize(levels_json);
+    struct levels_conversion conversion =
+    {
+        .map_json = map_json,
+        .levels = osp_mem_malloc(sizeof(cJSON *) * (num_levels + 1)),
+        .entity_index = entity_index,
+        .map_params = map_params,
+        .flags = flags,
+        .path = path,
+        .tile_maps = osp_mem_calloc(num_levels + 1, sizeof(tilemap_data_t)),
+        .outputs = osp_mem_calloc(num_levels + 1, sizeof(char *)),
+        .output_sizes = osp_mem_calloc(num_levels + 1, sizeof(size_t))
+    };
+    uint32_t i_level = 0;
+    cJSON *level_json;
+    cJSON_ArrayForEach(level_json, levels_json)
+        conversion.levels[i_level++] = level_json;
+
+    // The json tree and the entity index are only read from now on, so all
+    // levels can be converted at the same time. Chunked levels number their
+    // entities by chunk and references point into any level, so they are all
+    // read before any is written.
+    osp_parallel_run(num_levels, map_params->num_threads, &convert_level,
+                     NULL, &conversion);
+    remap_chunked_references(conversion.tile_maps, num_levels);
+    osp_parallel_run(num_levels, map_params->num_threads, &write_level,
+                     NULL, &conversion);
+    write_levels_directory(num_levels, conversion.outputs,
+                           conversion.output_sizes, writer);
+
+    osp_mem_free(conversion.levels);
+    osp_mem_free(conversion.tile_maps);
+    osp_mem_free(conversion.outputs);
+    osp_mem_free(conversion.output_sizes);
+}
+
+int ldtk_to_map(const osp_input_t* input, osp_writer_t writer, void* params)
+{
+    // Our map structure to fill with the data from the LDTK file, zeroed so
+    // missing layers are written as empty instead of stack garbage.
+    tilemap_data_t tile_map = { 0 };
+    ldtk_to_map_params_t *map_params = (ldtk_to_map_params_t *)params;
+    if(map_params != NULL && map_params->collision_grid)
+        tile_map.flags |= MAP_FLAG_COLLISION_GRID;
+    if(map_params != NULL && map_params->collision_index_cell > 0)
+        tile_map.flags |= MAP_FLAG_COLLISION_INDEX;
+    if(map_params != NULL && map_params->tiles_encoding == MAP_TILES_DENSE)
+        tile_map.flags |= MAP_FLAG_TILES_DENSE;
+    else if(map_params != NULL && map_params->tiles_encoding == MAP_TILES_RLE)
+        tile_map.flags |= MAP_FLAG_TILES_RLE;
+    if(map_params != NULL && map_params->chunk_size > 0)
+    {
+        tile_map.flags |= MAP_FLAG_CHUNKS;
+        tile_map.chunk_size = map_params->chunk_size;
+    }
+
+    // The streaming reader writes the same map without the json tree
+    if(map_params != NULL && map_params->streaming)
+        return stream_ldtk_to_map(input, tile_map.flags, map_params, writer);
+
+    // Let's find the json levels array element, the json trees and their
+    // arenas are local to this call so any number of maps can be converted at
+    // the same time.
+    cJSON *map_json = NULL;
+    osp_dynarray_t json_arenas =
+        osp_dynarray_new(sizeof(cJSON_Arena *), 4, 4);
+    cJSON *levels_json =
+        parse_ldtk_file_for_levels(input, &map_json, json_arenas);
+    // Load the external level files of the levels to convert, and only them
+    uint8_t all_levels = map_params != NULL && map_params->all_levels;
+    load_external_levels(input, levels_json,
+                         all_levels ? (uint32_t)cJSON_GetArraySize(levels_json)
+                                    : 1,
+                         map_params != NULL ? map_params->num_threads : 1,
+                         json_arenas);
+    // Entity references are resolved by iid across all layers and levels
+    struct entity_index entity_index;
+    build_entity_index(&entity_index, levels_json);
+
+    // Every level at once if requested...
+    if(all_levels)
+    {
+        write_levels(map_json, levels_json, &entity_index, map_params,
+                     tile_map.flags, input->path, writer);
+        free_entity_index(&entity_index);
+        free_json_data(json_arenas);
+        return 0;
+    }
+
+    // ...or only the first one, if there is at least one level
+    if(cJSON_GetArraySize(levels_json) > 0)
+        read_level(&tile_map, map_json, levels_json->child, &entity_index,
+                   map_params, input->path);
+
+    // We are done, free the json tree memory.
+    free_entity_index(&entity_index);
+    free_json_data(json_arenas);
+
+    // Now write the tilemap data
+    remap_chunked_references(&tile_map, 1);
+    write_tilemap(&tile_map, writer);
 
     // All data written to file, we can free the memory used:
     // First the tileset name
-    free((void *)(tile_map.tile_set));
+    osp_mem_free((void *)(tile_map.tile_set));
     // Then the rest of the layers data
     free_tilemap_layers(&tile_map);
 
@@ -1242,14 +2166,14 @@ void free_tilemap_entity(entity_t *entity)
         for (int i_data = 0; i_data < entity->num_data; ++i_data)
         {
             if (entity->data[i_data].string_data != NULL)
-                free(entity->data[i_data].string_data);
-            free(entity->data[i_data].name);
+                osp_mem_free(entity->data[i_data].string_data);
+            osp_mem_free(entity->data[i_data].name);
         }
 
-        free(entity->data);
+        osp_mem_free(entity->data);
     }
 
-    free(entity->type);
+    osp_mem_free(entity->type);
 }
 
 void free_tilemap_entities_layer(entities_layer_t *layer)
@@ -1259,24 +2183,35 @@ void free_tilemap_entities_layer(entities_layer_t *layer)
         free_tilemap_entity(&(layer->entities[i_entity]));
     }
 
-    free(layer->entities);
-    free(layer->decor_entities);
+    osp_mem_free(layer->entities);
+    osp_mem_free(layer->decor_entities);
 }
 
 void free_tilemap_layers(tilemap_data_t* tile_map)
 {
     // Free all tiles data for every layer
     for(int i_layer = 0; i_layer < tile_map->num_tile_layers; ++i_layer)
-        free(tile_map->tile_layers[i_layer].tiles);
+    {
+        osp_mem_free(tile_map->tile_layers[i_layer].tiles);
+        osp_mem_free(tile_map->tile_layers[i_layer].tile_ids);
+    }
 
     // Free the tile layers array
     tile_map->num_tile_layers = 0;    
-    free(tile_map->tile_layers);
+    osp_mem_free(tile_map->tile_layers);
+
+    // Free all rectangles data for every collision layer
+    for(int i_layer = 0; i_layer < tile_map->num_collision_layers; ++i_layer)
+    {
+        osp_mem_free(tile_map->collision_layers[i_layer].rectangles);
+        osp_mem_free(tile_map->collision_layers[i_layer].grid);
+        osp_mem_free(tile_map->collision_layers[i_layer].index.offsets);
+        osp_mem_free(tile_map->collision_layers[i_layer].index.rect_indices);
+    }
 
-    // Free the collision layers array (layer data is not dynamically allocated
-    // in this case).
+    // Free the collision layers array
     tile_map->num_collision_layers = 0;
-    free(tile_map->collision_layers);
+    osp_mem_free(tile_map->collision_layers);
 
     // Free all entities data for every layer
     for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
@@ -1284,5 +2219,5 @@ void free_tilemap_layers(tilemap_data_t* tile_map)
 
     // Free the entity layers array
     tile_map->num_entity_layers = 0;    
-    free(tile_map->entity_layers);
+    osp_mem_free(tile_map->entity_layers);
 }
\ No newline at end of file
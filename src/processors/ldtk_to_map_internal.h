@@ -0,0 +1,175 @@
+#ifndef LDTK_TO_MAP_INTERNAL_H
+#define LDTK_TO_MAP_INTERNAL_H
+
+// Converter internals shared by the json tree conversion of ldtk_to_map.c and
+// the streaming one of ldtk_to_map_stream.c, not part of the processor API.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hashmap.h"
+#include "input.h"
+#include "writer.h"
+#include "processors/ldtk_to_map.h"
+
+/// @brief Number of valid map layers of each kind supported, MAP assets store
+///        the layer counts in a byte
+extern const int MAX_VALID_LAYERS;
+/// @brief Chunked layers write buffer initial capacity
+extern const size_t ASSET_CHUNKS_CAPACITY;
+
+/// @brief Tileset image layout, to turn tile sources into tileset indices
+struct tileset_layout
+{
+    uint32_t columns;
+    uint32_t tile_size;
+    uint32_t spacing;
+    uint32_t padding;
+};
+
+/// @brief Where an entity iid resolves to
+struct entity_handle
+{
+    const char *iid;
+    uint32_t level;
+    uint8_t layer;
+    uint8_t is_decor;
+    uint32_t number;
+};
+
+/// @brief All the entities of a project by iid hash
+struct entity_index
+{
+    osp_hashmap_t map;
+    struct entity_handle *handles;
+    size_t num_handles;
+};
+
+/// @brief Checks a tiles layer against the map size, the first valid layer
+///        sets the map size and tileset name.
+/// @param this_width Layer width in tiles
+/// @param this_height Layer height in tiles
+/// @param this_grid_size Layer tile size in pixels
+/// @param tileset_file_name Layer tileset image path
+/// @param width Map width in tiles, 0 if not set yet
+/// @param height Map height in tiles
+/// @param grid_size Map tile size in pixels
+/// @param tile_set Returned tileset name, without its extension
+/// @return 1 if the layer is valid, 0 otherwise
+uint8_t accept_tiles_layer(
+    uint32_t this_width,
+    uint32_t this_height,
+    uint32_t this_grid_size,
+    const char *tileset_file_name,
+    uint32_t *width,
+    uint32_t *height,
+    uint32_t *grid_size,
+    char **tile_set);
+/// @brief Completes a tileset layout with its image width
+/// @param layout Layout with its tile size, spacing and padding set
+/// @param image_width Tileset image width in pixels
+/// @return 1 if the layout is usable, 0 otherwise
+uint8_t complete_tileset_layout(
+    struct tileset_layout *layout,
+    uint32_t image_width
+);
+/// @brief Sets a tile of a tiles layer, and its tileset index if requested
+/// @param layer Tiles layer
+/// @param num_tile Tile number in the layer
+/// @param tile_x Tile x in pixels
+/// @param tile_y Tile y in pixels
+/// @param source_x Tileset source x in pixels
+/// @param source_y Tileset source y in pixels
+/// @param tile_size Tile size in pixels
+/// @param map_width Map width in tiles
+/// @param map_height Map height in tiles
+/// @param tileset Tileset layout, only read if the layer has tile_ids
+void set_layer_tile(
+    tiles_layer_t *layer,
+    uint32_t num_tile,
+    uint32_t tile_x,
+    uint32_t tile_y,
+    uint32_t source_x,
+    uint32_t source_y,
+    uint32_t tile_size,
+    uint32_t map_width,
+    uint32_t map_height,
+    const struct tileset_layout *tileset
+    );
+/// @brief Fills a collisions layer from its collision grid
+/// @param layer Collisions layer to fill
+/// @param collision_grid Row aligned collision bitset, taken by the layer if
+///        keep_grid is set, freed otherwise
+/// @param layer_order Layer order
+/// @param width Map width in tiles
+/// @param height Map height in tiles
+/// @param tile_size Tile size in pixels
+/// @param keep_grid Whether the grid is kept (MAP_FLAG_COLLISION_GRID)
+/// @param index_cell Collision index cell size in tiles, 0 for no index
+void build_collisions_layer(
+    collisions_layer_t *layer,
+    uint64_t *collision_grid,
+    uint16_t layer_order,
+    uint32_t width,
+    uint32_t height,
+    uint32_t tile_size,
+    uint8_t keep_grid,
+    uint32_t index_cell
+);
+/// @brief Tells if an entity tag marks it as decor
+/// @param tag Entity tag
+/// @return 1 for decor tags, 0 otherwise
+uint8_t is_decor_tag(const char *tag);
+/// @brief Entity data type of an LDtk field type
+/// @param data_type LDtk field __type
+/// @return Entity data type, ENTITY_DATA_UNKNOWN if not supported
+entity_data_type_t find_entity_data_type(const char *data_type);
+/// @brief Resolves an entity reference field to the entity it points to
+/// @param data Entity reference field to resolve
+/// @param index Entities of the project
+/// @param iid Referenced entity iid
+/// @param level Level number of the referencing entity
+/// @param layer Entities layer number of the referencing entity
+void resolve_entity_reference(
+    entity_data_t *data,
+    const struct entity_index *index,
+    const char *iid,
+    uint32_t level,
+    uint8_t layer
+);
+/// @brief Writes a MAP_FLAG_LEVELS asset out of the converted levels
+/// @param num_levels Number of levels
+/// @param outputs Level outputs, freed once written
+/// @param output_sizes Level output sizes
+/// @param writer Output sink to write asset data to
+void write_levels_directory(
+    uint32_t num_levels,
+    char **outputs,
+    const size_t *output_sizes,
+    osp_writer_t writer
+    );
+/// @brief Renumbers the entity references of chunked levels, whose entities
+///        are written sorted by chunk. References can point into any level,
+///        so every level is read before and written after.
+/// @param tile_maps Levels, tile_maps[i] being level i
+/// @param num_levels Number of levels
+void remap_chunked_references(tilemap_data_t *tile_maps, uint32_t num_levels);
+/// @brief Writes a tilemap as a MAP asset
+/// @param tile_map Tilemap to write
+/// @param writer Output sink to write asset data to
+void write_tilemap(tilemap_data_t *tile_map, osp_writer_t writer);
+/// @brief LDTK tile map file to tile map MAP asset streaming converter, reads
+///        the project with the pull json reader instead of building a tree.
+///        Writes the very same asset as ldtk_to_map.
+/// @param input Input containing the LDTK map
+/// @param flags MAP_FLAG_* flags of the tilemap
+/// @param map_params Converter parameters, NULL for the defaults
+/// @param writer Output sink to write asset data to
+/// @return 0 on successful conversion, error value otherwise
+int stream_ldtk_to_map(
+    const osp_input_t *input,
+    uint32_t flags,
+    const ldtk_to_map_params_t *map_params,
+    osp_writer_t writer
+    );
+
+#endif
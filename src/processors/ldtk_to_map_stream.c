@@ -0,0 +1,1202 @@
+#include "ldtk_to_map_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash.h"
+#include "hashmap.h"
+#include "json_reader.h"
+#include "parallel.h"
+#include "mem.h"
+#include "trace.h"
+
+// Streaming conversion: the project is read with a pull parser straight into
+// the tilemap structures, skipping everything else, so no json tree is ever
+// built and the memory used follows the output size instead of the project
+// size. It writes the very same MAP as the json tree conversion of
+// ldtk_to_map.c.
+
+// Tileset definition, as read from defs.tilesets
+struct stream_tileset
+{
+    double uid;
+    struct tileset_layout layout;
+    uint32_t image_width;
+};
+
+// Tile of a gridTiles array, as read
+struct stream_tile
+{
+    uint32_t x;
+    uint32_t y;
+    uint32_t source_x;
+    uint32_t source_y;
+};
+
+// Layer instance kinds the converter cares about
+enum stream_layer_kind
+{
+    STREAM_LAYER_OTHER,
+    STREAM_LAYER_TILES,
+    STREAM_LAYER_ENTITIES,
+    STREAM_LAYER_INT_GRID
+};
+
+// Layer instance being read. Its fields come in any order, so they are kept
+// until the layer is over. The buffers are reused for every layer.
+struct stream_layer
+{
+    enum stream_layer_kind kind;
+    uint8_t is_collision;
+    uint32_t width;
+    uint32_t height;
+    uint32_t grid_size;
+    uint8_t has_tileset_uid;
+    double tileset_uid;
+    char *tileset_path;
+    struct stream_tile *tiles;
+    size_t num_tiles;
+    size_t tiles_capacity;
+    // intGridCsv, 1 bit per value set if solid
+    uint64_t *values;
+    size_t num_values;
+    size_t values_capacity;
+    decor_entity_t *decor_entities;
+    uint32_t num_decor_entities;
+    uint32_t decor_entities_capacity;
+    entity_t *entities;
+    uint32_t num_entities;
+    uint32_t entities_capacity;
+    // First entity handle of the layer, and the entities numbered so far
+    size_t first_handle;
+    uint32_t decor_number;
+    uint32_t entity_number;
+};
+
+// Level being read
+struct stream_level
+{
+    // Level number in the project
+    uint32_t level;
+    // Converted level, NULL if its entities are only indexed
+    tilemap_data_t *tile_map;
+    // Map size and grid size, set by the first valid tiles layer
+    uint32_t width;
+    uint32_t height;
+    uint32_t grid_size;
+    // Valid layers read so far
+    uint16_t total_layers;
+    // Entities layers read so far, valid or not as all are indexed
+    uint32_t num_entities_layers;
+    // External level file, if any
+    char *external_path;
+    uint8_t has_layers;
+};
+
+// Streaming conversion of a whole project
+struct stream_conversion
+{
+    const osp_input_t *input;
+    const ldtk_to_map_params_t *map_params;
+    uint32_t flags;
+    // Levels to convert, the others are only indexed
+    uint32_t num_converted_levels;
+    struct stream_tileset *tilesets;
+    uint32_t num_tilesets;
+    // Converted levels and their names
+    tilemap_data_t *tile_maps;
+    char **level_names;
+    uint32_t num_tile_maps;
+    // Every entity of the project, references are resolved at the end
+    struct entity_handle *handles;
+    size_t num_handles;
+    size_t handles_capacity;
+    // Written levels, in all levels mode
+    char **outputs;
+    size_t *output_sizes;
+    struct stream_layer layer;
+};
+
+// Next token of a container, 0 once it is over or on error
+static inline uint8_t stream_next_in(osp_json_reader_t reader,
+                                     osp_json_token_t end,
+                                     osp_json_token_t *token)
+{
+    *token = osp_json_reader_next(reader);
+    return *token != end && *token != OSP_JSON_ERROR && *token != OSP_JSON_END;
+}
+
+void stream_skip_value(osp_json_reader_t reader)
+{
+    osp_json_reader_next(reader);
+    osp_json_reader_skip(reader);
+}
+
+// A number value, NAN if it is something else as cJSON_GetNumberValue
+double stream_read_number(osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) == OSP_JSON_NUMBER)
+        return osp_json_reader_get_number(reader);
+
+    osp_json_reader_skip(reader);
+    return NAN;
+}
+
+// A copy of a string value, NULL if it is something else
+char *stream_read_string(osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_STRING)
+    {
+        osp_json_reader_skip(reader);
+        return NULL;
+    }
+
+    size_t length;
+    const char *string = osp_json_reader_get_string(reader, &length);
+    char *copy = osp_mem_malloc(length + 1);
+    memcpy(copy, string, length + 1);
+
+    return copy;
+}
+
+// The first two numbers of an array value, like px and src
+void stream_read_pair(osp_json_reader_t reader, uint32_t *x, uint32_t *y)
+{
+    *x = 0;
+    *y = 0;
+    if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    uint32_t i_item = 0;
+    while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+    {
+        if(token == OSP_JSON_NUMBER && i_item == 0)
+            *x = (uint32_t)osp_json_reader_get_number(reader);
+        else if(token == OSP_JSON_NUMBER && i_item == 1)
+            *y = (uint32_t)osp_json_reader_get_number(reader);
+        osp_json_reader_skip(reader);
+        ++i_item;
+    }
+}
+
+void stream_read_tilesets(struct stream_conversion *conversion,
+                          osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    uint32_t capacity = 0;
+    while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+    {
+        if(token != OSP_JSON_OBJECT)
+        {
+            osp_json_reader_skip(reader);
+            continue;
+        }
+
+        struct stream_tileset tileset = { .uid = NAN };
+        while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+        {
+            if(osp_json_reader_string_equals(reader, "uid"))
+                tileset.uid = stream_read_number(reader);
+            else if(osp_json_reader_string_equals(reader, "tileGridSize"))
+                tileset.layout.tile_size =
+                    (uint32_t)stream_read_number(reader);
+            else if(osp_json_reader_string_equals(reader, "spacing"))
+                tileset.layout.spacing = (uint32_t)stream_read_number(reader);
+            else if(osp_json_reader_string_equals(reader, "padding"))
+                tileset.layout.padding = (uint32_t)stream_read_number(reader);
+            else if(osp_json_reader_string_equals(reader, "__cWid"))
+                tileset.layout.columns = (uint32_t)stream_read_number(reader);
+            else if(osp_json_reader_string_equals(reader, "pxWid"))
+                tileset.image_width = (uint32_t)stream_read_number(reader);
+            else
+                stream_skip_value(reader);
+        }
+
+        if(conversion->num_tilesets == capacity)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 8;
+            conversion->tilesets = osp_mem_realloc(
+                conversion->tilesets, sizeof(struct stream_tileset) * capacity);
+        }
+        conversion->tilesets[conversion->num_tilesets++] = tileset;
+    }
+}
+
+void stream_read_defs(struct stream_conversion *conversion,
+                      osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_OBJECT)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+    {
+        if(osp_json_reader_string_equals(reader, "tilesets"))
+            stream_read_tilesets(conversion, reader);
+        else
+            stream_skip_value(reader);
+    }
+}
+
+uint8_t stream_find_tileset_layout(struct stream_conversion *conversion,
+                                   struct stream_layer *layer,
+                                   struct tileset_layout *layout)
+{
+    if(!layer->has_tileset_uid)
+        return 0;
+
+    for(uint32_t i_tileset = 0;
+        i_tileset < conversion->num_tilesets;
+        ++i_tileset)
+    {
+        if(conversion->tilesets[i_tileset].uid != layer->tileset_uid)
+            continue;
+
+        *layout = conversion->tilesets[i_tileset].layout;
+        return complete_tileset_layout(
+            layout, conversion->tilesets[i_tileset].image_width);
+    }
+
+    return 0;
+}
+
+void stream_read_grid_tiles(struct stream_layer *layer,
+                            osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+    {
+        // Every item is a tile, one that is not an object is at 0
+        struct stream_tile tile = { 0 };
+        if(token != OSP_JSON_OBJECT)
+            osp_json_reader_skip(reader);
+        else while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+        {
+            if(osp_json_reader_string_equals(reader, "px"))
+                stream_read_pair(reader, &(tile.x), &(tile.y));
+            else if(osp_json_reader_string_equals(reader, "src"))
+                stream_read_pair(reader, &(tile.source_x), &(tile.source_y));
+            else
+                stream_skip_value(reader);
+        }
+
+        if(layer->num_tiles == layer->tiles_capacity)
+        {
+            layer->tiles_capacity = layer->tiles_capacity > 0
+                ? layer->tiles_capacity * 2 : 256;
+            layer->tiles = osp_mem_realloc(
+                layer->tiles, sizeof(struct stream_tile) * layer->tiles_capacity);
+        }
+        layer->tiles[layer->num_tiles++] = tile;
+    }
+}
+
+void stream_read_int_grid(struct stream_layer *layer,
+                          osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+    {
+        if(layer->num_values == layer->values_capacity * 64)
+        {
+            size_t capacity = layer->values_capacity > 0
+                ? layer->values_capacity * 2 : 64;
+            layer->values = osp_mem_realloc(layer->values,
+                                            sizeof(uint64_t) * capacity);
+            memset(layer->values + layer->values_capacity, 0,
+                   sizeof(uint64_t) * (capacity - layer->values_capacity));
+            layer->values_capacity = capacity;
+        }
+        // Only solid or empty matters
+        if(token == OSP_JSON_NUMBER && osp_json_reader_get_number(reader) > 0)
+            layer->values[layer->num_values / 64] |=
+                1ull << (layer->num_values % 64);
+        osp_json_reader_skip(reader);
+        ++layer->num_values;
+    }
+}
+
+void stream_read_entity_data(entity_data_t *data, osp_json_reader_t reader)
+{
+    char *type = NULL;
+    char *string_value = NULL;
+    char *entity_iid = NULL;
+    double number_value = NAN;
+    data->name = NULL;
+
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+    {
+        if(osp_json_reader_string_equals(reader, "__identifier"))
+        {
+            osp_mem_free(data->name);
+            data->name = stream_read_string(reader);
+        }
+        else if(osp_json_reader_string_equals(reader, "__type"))
+        {
+            osp_mem_free(type);
+            type = stream_read_string(reader);
+        }
+        else if(osp_json_reader_string_equals(reader, "__value"))
+        {
+            // Keep the value as it is, its type might come later
+            token = osp_json_reader_next(reader);
+            if(token == OSP_JSON_NUMBER)
+                number_value = osp_json_reader_get_number(reader);
+            else if(token == OSP_JSON_STRING)
+            {
+                size_t length;
+                const char *string =
+                    osp_json_reader_get_string(reader, &length);
+                osp_mem_free(string_value);
+                string_value = osp_mem_malloc(length + 1);
+                memcpy(string_value, string, length + 1);
+            }
+            else if(token == OSP_JSON_OBJECT)
+            {
+                while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+                {
+                    if(osp_json_reader_string_equals(reader, "entityIid"))
+                    {
+                        osp_mem_free(entity_iid);
+                        entity_iid = stream_read_string(reader);
+                    }
+                    else
+                        stream_skip_value(reader);
+                }
+            }
+            else
+                osp_json_reader_skip(reader);
+        }
+        else
+            stream_skip_value(reader);
+    }
+
+    if(data->name == NULL)
+        data->name = osp_mem_calloc(1, 1);
+    data->type = type != NULL ? find_entity_data_type(type)
+                              : ENTITY_DATA_UNKNOWN;
+    data->string_data = NULL;
+    switch(data->type)
+    {
+        case ENTITY_DATA_INT:
+            data->int_data = (int32_t)number_value;
+        break;
+        case ENTITY_DATA_FLOAT:
+            data->float_data = (float)number_value;
+        break;
+        case ENTITY_DATA_STRING:
+            data->string_data = string_value != NULL ? string_value
+                                                     : osp_mem_calloc(1, 1);
+            string_value = NULL;
+        break;
+        case ENTITY_DATA_ENTITY:
+            // Resolved once all entities are known, keep the iid meanwhile
+            data->string_data = entity_iid;
+            entity_iid = NULL;
+            if(data->string_data == NULL)
+                data->type = ENTITY_DATA_UNKNOWN;
+        break;
+        default:
+        break;
+    }
+
+    osp_mem_free(type);
+    osp_mem_free(string_value);
+    osp_mem_free(entity_iid);
+}
+
+void stream_read_entity_fields(entity_t *entity, osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    uint32_t capacity = 0;
+    while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+    {
+        if(token != OSP_JSON_OBJECT)
+        {
+            osp_json_reader_skip(reader);
+            continue;
+        }
+
+        if(entity->num_data == capacity)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 4;
+            entity->data = osp_mem_realloc(entity->data,
+                                           sizeof(entity_data_t) * capacity);
+        }
+        stream_read_entity_data(&(entity->data[entity->num_data++]), reader);
+    }
+}
+
+void stream_read_entity(struct stream_conversion *conversion,
+                        struct stream_level *level,
+                        osp_json_reader_t reader)
+{
+    struct stream_layer *layer = &(conversion->layer);
+    struct entity_handle handle = { .level = level->level };
+    entity_t entity = { 0 };
+    decor_entity_t decor_entity = { 0 };
+
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+    {
+        if(osp_json_reader_string_equals(reader, "iid"))
+        {
+            osp_mem_free((void *)handle.iid);
+            handle.iid = stream_read_string(reader);
+        }
+        else if(osp_json_reader_string_equals(reader, "__tags"))
+        {
+            if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+            {
+                osp_json_reader_skip(reader);
+                continue;
+            }
+            while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+            {
+                if(token == OSP_JSON_STRING &&
+                   is_decor_tag(osp_json_reader_get_string(reader, NULL)))
+                    handle.is_decor = 1;
+                osp_json_reader_skip(reader);
+            }
+        }
+        else if(level->tile_map == NULL)
+            stream_skip_value(reader);
+        else if(osp_json_reader_string_equals(reader, "px"))
+            stream_read_pair(reader, &(entity.x), &(entity.y));
+        else if(osp_json_reader_string_equals(reader, "width"))
+            entity.w = (uint32_t)stream_read_number(reader);
+        else if(osp_json_reader_string_equals(reader, "height"))
+            entity.h = (uint32_t)stream_read_number(reader);
+        else if(osp_json_reader_string_equals(reader, "__identifier"))
+        {
+            osp_mem_free(entity.type);
+            entity.type = stream_read_string(reader);
+        }
+        else if(osp_json_reader_string_equals(reader, "__tile"))
+        {
+            if(osp_json_reader_next(reader) != OSP_JSON_OBJECT)
+            {
+                osp_json_reader_skip(reader);
+                continue;
+            }
+            while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+            {
+                if(osp_json_reader_string_equals(reader, "x"))
+                    decor_entity.source_x =
+                        (uint32_t)stream_read_number(reader);
+                else if(osp_json_reader_string_equals(reader, "y"))
+                    decor_entity.source_y =
+                        (uint32_t)stream_read_number(reader);
+                else
+                    stream_skip_value(reader);
+            }
+        }
+        else if(osp_json_reader_string_equals(reader, "fieldInstances"))
+            stream_read_entity_fields(&entity, reader);
+        else
+            stream_skip_value(reader);
+    }
+
+    // Index the entity, decor and other entities are numbered apart
+    handle.number = handle.is_decor ? layer->decor_number++
+                                    : layer->entity_number++;
+    if(conversion->num_handles == conversion->handles_capacity)
+    {
+        conversion->handles_capacity = conversion->handles_capacity > 0
+            ? conversion->handles_capacity * 2 : 256;
+        conversion->handles = osp_mem_realloc(
+            conversion->handles,
+            sizeof(struct entity_handle) * conversion->handles_capacity);
+    }
+    conversion->handles[conversion->num_handles++] = handle;
+
+    if(level->tile_map == NULL)
+        return;
+
+    if(handle.is_decor)
+    {
+        decor_entity.x = entity.x;
+        decor_entity.y = entity.y;
+        decor_entity.w = entity.w;
+        decor_entity.h = entity.h;
+        if(layer->num_decor_entities == layer->decor_entities_capacity)
+        {
+            layer->decor_entities_capacity = layer->decor_entities_capacity > 0
+                ? layer->decor_entities_capacity * 2 : 64;
+            layer->decor_entities = osp_mem_realloc(
+                layer->decor_entities,
+                sizeof(decor_entity_t) * layer->decor_entities_capacity);
+        }
+        layer->decor_entities[layer->num_decor_entities++] = decor_entity;
+        free_tilemap_entity(&entity);
+        return;
+    }
+
+    if(entity.type == NULL)
+        entity.type = osp_mem_calloc(1, 1);
+    if(layer->num_entities == layer->entities_capacity)
+    {
+        layer->entities_capacity = layer->entities_capacity > 0
+            ? layer->entities_capacity * 2 : 64;
+        layer->entities = osp_mem_realloc(
+            layer->entities, sizeof(entity_t) * layer->entities_capacity);
+    }
+    layer->entities[layer->num_entities++] = entity;
+}
+
+void stream_read_entities(struct stream_conversion *conversion,
+                          struct stream_level *level,
+                          osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+    {
+        if(token == OSP_JSON_OBJECT)
+            stream_read_entity(conversion, level, reader);
+        else
+            osp_json_reader_skip(reader);
+    }
+}
+
+// Forget the entities indexed from first_handle on
+void stream_drop_handles(struct stream_conversion *conversion,
+                         size_t first_handle)
+{
+    for(size_t i_handle = first_handle;
+        i_handle < conversion->num_handles;
+        ++i_handle)
+        osp_mem_free((void *)(conversion->handles[i_handle].iid));
+    conversion->num_handles = first_handle;
+}
+
+void stream_clear_layer(struct stream_layer *layer)
+{
+    for(uint32_t i_entity = 0; i_entity < layer->num_entities; ++i_entity)
+        free_tilemap_entity(&(layer->entities[i_entity]));
+    osp_mem_free(layer->tileset_path);
+    if(layer->num_values > 0)
+        memset(layer->values, 0,
+               sizeof(uint64_t) * ((layer->num_values + 63) / 64));
+
+    layer->kind = STREAM_LAYER_OTHER;
+    layer->is_collision = 0;
+    layer->width = 0;
+    layer->height = 0;
+    layer->grid_size = 0;
+    layer->has_tileset_uid = 0;
+    layer->tileset_path = NULL;
+    layer->num_tiles = 0;
+    layer->num_values = 0;
+    layer->num_decor_entities = 0;
+    layer->num_entities = 0;
+    layer->decor_number = 0;
+    layer->entity_number = 0;
+}
+
+void stream_add_tiles_layer(struct stream_conversion *conversion,
+                            struct stream_level *level)
+{
+    struct stream_layer *layer = &(conversion->layer);
+    tilemap_data_t *tile_map = level->tile_map;
+    uint32_t tiles_flags = MAP_FLAG_TILES_DENSE | MAP_FLAG_TILES_RLE;
+    if(tile_map->num_tile_layers >= MAX_VALID_LAYERS ||
+       !accept_tiles_layer(layer->width, layer->height, layer->grid_size,
+                           layer->tileset_path != NULL ? layer->tileset_path
+                                                       : "",
+                           &(level->width), &(level->height),
+                           &(level->grid_size), &(tile_map->tile_set)))
+        return;
+
+    tile_map->width = level->width;
+    tile_map->height = level->height;
+    tile_map->tile_size = level->grid_size;
+    tile_map->tile_layers = osp_mem_realloc(
+        tile_map->tile_layers,
+        sizeof(tiles_layer_t) * (tile_map->num_tile_layers + 1));
+    tiles_layer_t *tiles_layer =
+        &(tile_map->tile_layers[tile_map->num_tile_layers++]);
+
+    // Tileset index grids need the tileset layout
+    struct tileset_layout tileset;
+    uint8_t has_tileset = (tile_map->flags & tiles_flags) &&
+        stream_find_tileset_layout(conversion, layer, &tileset);
+
+    // The order is reversed once the level is over, like read_level
+    tiles_layer->order = level->total_layers++;
+    tiles_layer->num_tiles = layer->num_tiles;
+    tiles_layer->tiles = osp_mem_malloc(sizeof(tile_source_t) * layer->num_tiles);
+    tiles_layer->tile_ids = NULL;
+    if(has_tileset)
+        tiles_layer->tile_ids = osp_mem_calloc(
+            (size_t)tile_map->width * tile_map->height > 0
+                ? (size_t)tile_map->width * tile_map->height
+                : 1,
+            sizeof(uint16_t));
+    for(size_t i_tile = 0; i_tile < layer->num_tiles; ++i_tile)
+        set_layer_tile(tiles_layer, i_tile,
+                       layer->tiles[i_tile].x, layer->tiles[i_tile].y,
+                       layer->tiles[i_tile].source_x,
+                       layer->tiles[i_tile].source_y,
+                       tile_map->tile_size, tile_map->width, tile_map->height,
+                       has_tileset ? &tileset : NULL);
+
+    // Every layer needs its grid, or none is written
+    if((tile_map->flags & tiles_flags) && tiles_layer->tile_ids == NULL)
+    {
+        printf("\t%s: tileset indices unavailable, writing tile sources\n",
+               conversion->input->path);
+        tile_map->flags &= ~tiles_flags;
+    }
+}
+
+void stream_add_collisions_layer(struct stream_conversion *conversion,
+                                 struct stream_level *level)
+{
+    struct stream_layer *layer = &(conversion->layer);
+    tilemap_data_t *tile_map = level->tile_map;
+    if(tile_map->num_collision_layers >= MAX_VALID_LAYERS ||
+       !layer->is_collision ||
+       layer->width != level->width ||
+       layer->height != level->height)
+        return;
+
+    uint64_t scan_trace = osp_trace_begin();
+    tile_map->collision_layers = osp_mem_realloc(
+        tile_map->collision_layers,
+        sizeof(collisions_layer_t) * (tile_map->num_collision_layers + 1));
+    collisions_layer_t *collisions_layer =
+        &(tile_map->collision_layers[tile_map->num_collision_layers++]);
+
+    // Lay the values out in rows, as read_collisions_layer
+    size_t words_per_row = ((size_t)level->width + 63) / 64;
+    uint64_t *collision_grid = osp_mem_calloc(
+        words_per_row * level->height > 0 ? words_per_row * level->height : 1,
+        sizeof(uint64_t));
+    size_t num_cells = (size_t)level->width * level->height;
+    size_t num_values = layer->num_values < num_cells ? layer->num_values
+                                                      : num_cells;
+    for(size_t i_word = 0; i_word < (num_values + 63) / 64; ++i_word)
+    {
+        uint64_t word = layer->values[i_word];
+        while(word != 0)
+        {
+            size_t i_value = i_word * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+            if(i_value >= num_values)
+                break;
+            size_t x = i_value % level->width;
+            size_t y = i_value / level->width;
+            collision_grid[y * words_per_row + x / 64] |= 1ull << (x % 64);
+        }
+    }
+
+    build_collisions_layer(collisions_layer, collision_grid,
+                           level->total_layers++, level->width, level->height,
+                           level->grid_size,
+                           (tile_map->flags & MAP_FLAG_COLLISION_GRID) != 0,
+                           (tile_map->flags & MAP_FLAG_COLLISION_INDEX) != 0
+                               ? conversion->map_params->collision_index_cell
+                               : 0);
+    osp_trace_end("read_collisions_layer", scan_trace, NULL);
+}
+
+void stream_add_entities_layer(struct stream_conversion *conversion,
+                               struct stream_level *level)
+{
+    struct stream_layer *layer = &(conversion->layer);
+    tilemap_data_t *tile_map = level->tile_map;
+    tile_map->entity_layers = osp_mem_realloc(
+        tile_map->entity_layers,
+        sizeof(entities_layer_t) * (tile_map->num_entity_layers + 1));
+    entities_layer_t *entities_layer =
+        &(tile_map->entity_layers[tile_map->num_entity_layers++]);
+
+    // The entities move to the map layer, the next layer starts empty
+    *entities_layer = (entities_layer_t)
+    {
+        .order = level->total_layers++,
+        .num_decor_entities = layer->num_decor_entities,
+        .decor_entities = layer->decor_entities,
+        .num_entities = layer->num_entities,
+        .entities = layer->entities
+    };
+    layer->decor_entities = NULL;
+    layer->num_decor_entities = 0;
+    layer->decor_entities_capacity = 0;
+    layer->entities = NULL;
+    layer->num_entities = 0;
+    layer->entities_capacity = 0;
+}
+
+void stream_read_layer(struct stream_conversion *conversion,
+                       struct stream_level *level,
+                       osp_json_reader_t reader)
+{
+    struct stream_layer *layer = &(conversion->layer);
+    stream_clear_layer(layer);
+    layer->first_handle = conversion->num_handles;
+
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+    {
+        if(osp_json_reader_string_equals(reader, "__type"))
+        {
+            if(osp_json_reader_next(reader) != OSP_JSON_STRING)
+                continue;
+            if(osp_json_reader_string_equals(reader, "Tiles"))
+                layer->kind = STREAM_LAYER_TILES;
+            else if(osp_json_reader_string_equals(reader, "Entities"))
+                layer->kind = STREAM_LAYER_ENTITIES;
+            else if(osp_json_reader_string_equals(reader, "IntGrid"))
+                layer->kind = STREAM_LAYER_INT_GRID;
+        }
+        else if(osp_json_reader_string_equals(reader, "entityInstances"))
+            stream_read_entities(conversion, level, reader);
+        else if(level->tile_map == NULL)
+            stream_skip_value(reader);
+        else if(osp_json_reader_string_equals(reader, "__identifier"))
+        {
+            if(osp_json_reader_next(reader) == OSP_JSON_STRING)
+                layer->is_collision = strncmp(
+                    "Collision", osp_json_reader_get_string(reader, NULL),
+                    9) == 0;
+        }
+        else if(osp_json_reader_string_equals(reader, "__cWid"))
+            layer->width = (uint32_t)stream_read_number(reader);
+        else if(osp_json_reader_string_equals(reader, "__cHei"))
+            layer->height = (uint32_t)stream_read_number(reader);
+        else if(osp_json_reader_string_equals(reader, "__gridSize"))
+            layer->grid_size = (uint32_t)stream_read_number(reader);
+        else if(osp_json_reader_string_equals(reader, "__tilesetDefUid"))
+        {
+            layer->tileset_uid = stream_read_number(reader);
+            layer->has_tileset_uid = !isnan(layer->tileset_uid);
+        }
+        else if(osp_json_reader_string_equals(reader, "__tilesetRelPath"))
+        {
+            osp_mem_free(layer->tileset_path);
+            layer->tileset_path = stream_read_string(reader);
+        }
+        else if(osp_json_reader_string_equals(reader, "gridTiles"))
+            stream_read_grid_tiles(layer, reader);
+        else if(osp_json_reader_string_equals(reader, "intGridCsv"))
+            stream_read_int_grid(layer, reader);
+        else
+            stream_skip_value(reader);
+    }
+
+    // Only the entities of entities layers are indexed, numbered by layer
+    // as build_entity_index
+    if(layer->kind != STREAM_LAYER_ENTITIES ||
+       level->num_entities_layers >= (uint32_t)MAX_VALID_LAYERS)
+        stream_drop_handles(conversion, layer->first_handle);
+    else
+    {
+        for(size_t i_handle = layer->first_handle;
+            i_handle < conversion->num_handles;
+            ++i_handle)
+            conversion->handles[i_handle].layer =
+                (uint8_t)level->num_entities_layers;
+        ++level->num_entities_layers;
+    }
+
+    if(level->tile_map == NULL)
+        return;
+
+    // Now the layer is complete, it can be validated like read_level does
+    if(layer->kind == STREAM_LAYER_TILES)
+        stream_add_tiles_layer(conversion, level);
+    else if(layer->kind == STREAM_LAYER_ENTITIES &&
+            level->tile_map->num_entity_layers < MAX_VALID_LAYERS)
+        stream_add_entities_layer(conversion, level);
+    else if(layer->kind == STREAM_LAYER_INT_GRID)
+        stream_add_collisions_layer(conversion, level);
+}
+
+uint8_t stream_read_level_object(struct stream_conversion *conversion,
+                                 struct stream_level *level,
+                                 osp_json_reader_t reader)
+{
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+    {
+        if(osp_json_reader_string_equals(reader, "identifier") &&
+           level->tile_map != NULL)
+        {
+            osp_mem_free(conversion->level_names[level->level]);
+            conversion->level_names[level->level] = stream_read_string(reader);
+        }
+        else if(osp_json_reader_string_equals(reader, "externalRelPath"))
+        {
+            osp_mem_free(level->external_path);
+            level->external_path = stream_read_string(reader);
+        }
+        else if(osp_json_reader_string_equals(reader, "layerInstances"))
+        {
+            if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+            {
+                osp_json_reader_skip(reader);
+                continue;
+            }
+            level->has_layers = 1;
+            while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+            {
+                if(token == OSP_JSON_OBJECT)
+                    stream_read_layer(conversion, level, reader);
+                else
+                    osp_json_reader_skip(reader);
+            }
+        }
+        else
+            stream_skip_value(reader);
+    }
+
+    return token == OSP_JSON_OBJECT_END;
+}
+
+void stream_read_external_level(struct stream_conversion *conversion,
+                                struct stream_level *level)
+{
+    osp_input_t level_input;
+    if(osp_input_open_dependency(conversion->input, &level_input,
+                                 level->external_path) != 0)
+    {
+        printf("\tUnable to open level %s of %s\n",
+               level->external_path, conversion->input->path);
+        osp_input_close(&level_input);
+        return;
+    }
+
+    // The level file replaces the level header, name included
+    uint64_t parse_trace = osp_trace_begin();
+    char *header_name = conversion->level_names[level->level];
+    conversion->level_names[level->level] = NULL;
+    size_t first_handle = conversion->num_handles;
+    osp_json_reader_t reader =
+        osp_json_reader_new(level_input.data, level_input.size);
+    osp_json_token_t token = osp_json_reader_next(reader);
+    uint8_t valid = token != OSP_JSON_ERROR && token != OSP_JSON_END;
+    if(token == OSP_JSON_OBJECT)
+        valid = stream_read_level_object(conversion, level, reader);
+    else
+        osp_json_reader_skip(reader);
+    if(valid)
+        osp_mem_free(header_name);
+    else
+    {
+        // Like a level file cJSON can't parse, the header stays: an empty
+        // level
+        printf("\tInvalid level %s\n", level_input.path);
+        osp_mem_free(conversion->level_names[level->level]);
+        conversion->level_names[level->level] = header_name;
+        osp_mem_free((void *)(level->tile_map->tile_set));
+        free_tilemap_layers(level->tile_map);
+        *(level->tile_map) = (tilemap_data_t)
+        {
+            .flags = conversion->flags,
+            .chunk_size = level->tile_map->chunk_size,
+            .level = level->level
+        };
+        stream_drop_handles(conversion, first_handle);
+    }
+    osp_json_reader_delete(reader);
+    osp_trace_end("stream_level", parse_trace, level_input.path);
+    osp_input_close(&level_input);
+}
+
+void stream_read_levels(struct stream_conversion *conversion,
+                        osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_ARRAY)
+    {
+        osp_json_reader_skip(reader);
+        return;
+    }
+
+    osp_json_token_t token;
+    uint32_t num_levels = 0;
+    uint32_t capacity = 0;
+    while(stream_next_in(reader, OSP_JSON_ARRAY_END, &token))
+    {
+        // Every item is a level, one that is not an object is empty
+        struct stream_level level = { .level = num_levels++ };
+        if(level.level < conversion->num_converted_levels)
+        {
+            if(conversion->num_tile_maps == capacity)
+            {
+                capacity = capacity > 0 ? capacity * 2 : 8;
+                conversion->tile_maps = osp_mem_realloc(
+                    conversion->tile_maps, sizeof(tilemap_data_t) * capacity);
+                conversion->level_names = osp_mem_realloc(
+                    conversion->level_names, sizeof(char *) * capacity);
+            }
+            level.tile_map = &(conversion->tile_maps[conversion->num_tile_maps]);
+            *(level.tile_map) = (tilemap_data_t)
+            {
+                .flags = conversion->flags,
+                .level = level.level
+            };
+            if(conversion->map_params != NULL)
+                level.tile_map->chunk_size = conversion->map_params->chunk_size;
+            conversion->level_names[conversion->num_tile_maps++] = NULL;
+        }
+
+        if(token == OSP_JSON_OBJECT)
+            stream_read_level_object(conversion, &level, reader);
+        else
+            osp_json_reader_skip(reader);
+
+        // External level files are only read for the converted levels
+        if(level.tile_map != NULL && !level.has_layers &&
+           level.external_path != NULL)
+            stream_read_external_level(conversion, &level);
+        osp_mem_free(level.external_path);
+
+        // Layers are written in reverse order
+        if(level.tile_map != NULL)
+        {
+            tilemap_data_t *tile_map = level.tile_map;
+            for(int i_layer = 0; i_layer < tile_map->num_tile_layers; ++i_layer)
+                tile_map->tile_layers[i_layer].order =
+                    level.total_layers - tile_map->tile_layers[i_layer].order - 1;
+            for(int i_layer = 0; i_layer < tile_map->num_collision_layers; ++i_layer)
+                tile_map->collision_layers[i_layer].order =
+                    level.total_layers - tile_map->collision_layers[i_layer].order - 1;
+            for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
+                tile_map->entity_layers[i_layer].order =
+                    level.total_layers - tile_map->entity_layers[i_layer].order - 1;
+        }
+    }
+}
+
+uint8_t stream_read_project(struct stream_conversion *conversion,
+                            osp_json_reader_t reader)
+{
+    if(osp_json_reader_next(reader) != OSP_JSON_OBJECT)
+        return 0;
+
+    // Tileset index grids need the tileset definitions, LDtk writes them
+    // before the levels but if they come after, the levels are read again
+    // once they are known
+    uint8_t need_defs =
+        (conversion->flags & (MAP_FLAG_TILES_DENSE | MAP_FLAG_TILES_RLE)) != 0;
+    uint8_t has_defs = 0;
+    uint8_t has_levels = 0;
+    size_t levels_start = 0;
+    size_t levels_end = 0;
+    osp_json_token_t token;
+    while(stream_next_in(reader, OSP_JSON_OBJECT_END, &token))
+    {
+        // Only the first of duplicated keys counts, as cJSON
+        if(osp_json_reader_string_equals(reader, "defs") && !has_defs)
+        {
+            stream_read_defs(conversion, reader);
+            has_defs = 1;
+        }
+        else if(osp_json_reader_string_equals(reader, "levels") && !has_levels)
+        {
+            has_levels = 1;
+            if(has_defs || !need_defs)
+                stream_read_levels(conversion, reader);
+            else
+            {
+                levels_start = osp_json_reader_tell(reader);
+                stream_skip_value(reader);
+                levels_end = osp_json_reader_tell(reader);
+            }
+        }
+        else
+            stream_skip_value(reader);
+    }
+    if(token != OSP_JSON_OBJECT_END)
+        return 0;
+
+    if(levels_end > levels_start)
+    {
+        osp_json_reader_t levels_reader = osp_json_reader_new(
+            conversion->input->data + levels_start, levels_end - levels_start);
+        stream_read_levels(conversion, levels_reader);
+        uint8_t valid = osp_json_reader_next(levels_reader) == OSP_JSON_END;
+        osp_json_reader_delete(levels_reader);
+        return valid;
+    }
+
+    return 1;
+}
+
+void stream_resolve_references(struct stream_conversion *conversion)
+{
+    // The same index as build_entity_index, its iids are copies
+    struct entity_index index =
+    {
+        .map = osp_hashmap_new(conversion->num_handles),
+        .handles = conversion->handles,
+        .num_handles = conversion->num_handles
+    };
+    for(size_t i_handle = 0; i_handle < conversion->num_handles; ++i_handle)
+        if(conversion->handles[i_handle].iid != NULL)
+            osp_hashmap_insert(
+                index.map,
+                osp_hash64_string(conversion->handles[i_handle].iid, 0),
+                i_handle);
+
+    for(uint32_t i_map = 0; i_map < conversion->num_tile_maps; ++i_map)
+    {
+        tilemap_data_t *tile_map = &(conversion->tile_maps[i_map]);
+        for(int i_layer = 0; i_layer < tile_map->num_entity_layers; ++i_layer)
+        {
+            entities_layer_t *layer = &(tile_map->entity_layers[i_layer]);
+            for(uint32_t i_entity = 0; i_entity < layer->num_entities; ++i_entity)
+            {
+                entity_t *entity = &(layer->entities[i_entity]);
+                for(uint32_t i_data = 0; i_data < entity->num_data; ++i_data)
+                {
+                    entity_data_t *data = &(entity->data[i_data]);
+                    if(data->type != ENTITY_DATA_ENTITY)
+                        continue;
+                    resolve_entity_reference(data, &index, data->string_data,
+                                             tile_map->level, (uint8_t)i_layer);
+                    osp_mem_free(data->string_data);
+                    data->string_data = NULL;
+                }
+            }
+        }
+    }
+
+    osp_hashmap_delete(index.map);
+}
+
+// Every converted level is written on its own, as write_level
+void write_stream_level(void *context, size_t index)
+{
+    struct stream_conversion *conversion = (struct stream_conversion *)context;
+
+    osp_writer_t writer = osp_writer_new(ASSET_CHUNKS_CAPACITY);
+    osp_writer_put_string(writer, conversion->level_names[index]);
+    write_tilemap(&(conversion->tile_maps[index]), writer);
+    conversion->outputs[index] =
+        osp_writer_detach(writer, &(conversion->output_sizes[index]));
+    osp_writer_delete(writer);
+}
+
+void free_stream_conversion(struct stream_conversion *conversion)
+{
+    for(uint32_t i_map = 0; i_map < conversion->num_tile_maps; ++i_map)
+    {
+        osp_mem_free((void *)(conversion->tile_maps[i_map].tile_set));
+        free_tilemap_layers(&(conversion->tile_maps[i_map]));
+        osp_mem_free(conversion->level_names[i_map]);
+    }
+    osp_mem_free(conversion->tile_maps);
+    osp_mem_free(conversion->level_names);
+    conversion->tile_maps = NULL;
+    conversion->level_names = NULL;
+    conversion->num_tile_maps = 0;
+
+    stream_drop_handles(conversion, 0);
+    osp_mem_free(conversion->handles);
+    conversion->handles = NULL;
+    conversion->num_handles = 0;
+}
+
+int stream_ldtk_to_map(
+    const osp_input_t *input,
+    uint32_t flags,
+    const ldtk_to_map_params_t *map_params,
+    osp_writer_t writer
+    )
+{
+    uint8_t all_levels = map_params != NULL && map_params->all_levels;
+    struct stream_conversion conversion =
+    {
+        .input = input,
+        .map_params = map_params,
+        .flags = flags,
+        .num_converted_levels = all_levels ? UINT32_MAX : 1
+    };
+
+    uint64_t parse_trace = osp_trace_begin();
+    osp_json_reader_t reader = osp_json_reader_new(input->data, input->size);
+    uint8_t valid = stream_read_project(&conversion, reader);
+    osp_json_reader_delete(reader);
+    osp_trace_end("stream_project", parse_trace, input->path);
+
+    // An invalid project gives no level, as cJSON failing to parse it
+    if(!valid)
+        free_stream_conversion(&conversion);
+    stream_resolve_references(&conversion);
+    remap_chunked_references(conversion.tile_maps, conversion.num_tile_maps);
+
+    if(all_levels)
+    {
+        // The levels are complete and only read from now on, write them all
+        // at once
+        conversion.outputs =
+            osp_mem_calloc(conversion.num_tile_maps + 1, sizeof(char *));
+        conversion.output_sizes =
+            osp_mem_calloc(conversion.num_tile_maps + 1, sizeof(size_t));
+        osp_parallel_run(conversion.num_tile_maps, map_params->num_threads,
+                         &write_stream_level, NULL, &conversion);
+        write_levels_directory(conversion.num_tile_maps, conversion.outputs,
+                               conversion.output_sizes, writer);
+        osp_mem_free(conversion.outputs);
+        osp_mem_free(conversion.output_sizes);
+    }
+    else if(conversion.num_tile_maps > 0)
+        write_tilemap(&(conversion.tile_maps[0]), writer);
+    else
+    {
+        tilemap_data_t tile_map = { .flags = flags };
+        if(map_params != NULL)
+            tile_map.chunk_size = map_params->chunk_size;
+        write_tilemap(&tile_map, writer);
+    }
+
+    stream_clear_layer(&(conversion.layer));
+    osp_mem_free(conversion.layer.tiles);
+    osp_mem_free(conversion.layer.values);
+    osp_mem_free(conversion.layer.decor_entities);
+    osp_mem_free(conversion.layer.entities);
+    osp_mem_free(conversion.tilesets);
+    free_stream_conversion(&conversion);
+
+    return 0;
+}
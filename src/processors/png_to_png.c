@@ -4,16 +4,9 @@
 
 // Simply copy the png block to the content bundle,
 // we don't need any processing here
-int png_to_png(FILE* readFile, FILE* writeFile, void* params)
+int png_to_png(const osp_input_t* input, osp_writer_t writer, void* params)
 {
-    fseek(readFile, 0, SEEK_END);
-    long size = ftell(readFile);
-    rewind(readFile);
-
-    unsigned char *buffer = malloc(size);
-    fread(buffer, 1, size, readFile);
-    fwrite(buffer, 1, size, writeFile);
-    free(buffer);
+    osp_writer_put_bytes(writer, input->data, input->size);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "trace.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// A single recorded span
+typedef struct _trace_event
+{
+    // Span name, a string literal
+    const char *name;
+    // Optional span detail, owned
+    char *detail;
+    // Track ID of the recording thread
+    uint32_t tid;
+    // Start time and duration in nanoseconds, relative to the trace start
+    uint64_t start;
+    uint64_t duration;
+} trace_event_t;
+
+static uint8_t trace_enabled = 0;
+static char *trace_path = NULL;
+static uint64_t trace_origin = 0;
+// Recorded spans, a plain realloc'ed array so tracing doesn't show up in the
+// osp_mem allocation stats
+static trace_event_t *trace_events = NULL;
+static size_t trace_num_events = 0;
+static size_t trace_capacity = 0;
+static uint32_t trace_num_tids = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Track ID of the calling thread, 0 until it records its first span
+static __thread uint32_t trace_tid = 0;
+
+static uint64_t trace_now()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+// Write a JSON string, escaping quotes, backslashes and control characters
+static void trace_write_string(FILE *file, const char *string)
+{
+    fputc('"', file);
+    for(const unsigned char *c = (const unsigned char *)string; *c; ++c)
+    {
+        if(*c == '"' || *c == '\\')
+            fprintf(file, "\\%c", *c);
+        else if(*c < 0x20)
+            fprintf(file, "\\u%04x", *c);
+        else
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+int osp_trace_open(const char *path)
+{
+    if(trace_enabled)
+        return 1;
+
+    trace_path = strdup(path);
+    trace_num_events = 0;
+    // The opening thread gets the first track
+    trace_num_tids = 1;
+    trace_tid = 1;
+    trace_origin = trace_now();
+    trace_enabled = 1;
+
+    return 0;
+}
+
+int osp_trace_close()
+{
+    if(!trace_enabled)
+        return 1;
+    trace_enabled = 0;
+
+    int result = 1;
+    FILE *file = fopen(trace_path, "w");
+    if(file != NULL)
+    {
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        // Name the tracks, the first one belongs to the opening thread
+        for(uint32_t tid = 1; tid <= trace_num_tids; ++tid)
+        {
+            fprintf(file, "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                    "\"name\":\"thread_name\",\"args\":{\"name\":",
+                    tid > 1 ? "," : "", tid);
+            if(tid == 1)
+                fprintf(file, "\"main\"}}");
+            else
+                fprintf(file, "\"worker %u\"}}", tid - 1);
+        }
+
+        // Chrome traces use microseconds
+        for(size_t i_event = 0; i_event < trace_num_events; ++i_event)
+        {
+            trace_event_t *event = &(trace_events[i_event]);
+            fprintf(file, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":",
+                    event->tid);
+            trace_write_string(file, event->name);
+            fprintf(file, ",\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u",
+                    event->start / 1000, (unsigned)(event->start % 1000),
+                    event->duration / 1000, (unsigned)(event->duration % 1000));
+            if(event->detail != NULL)
+            {
+                fprintf(file, ",\"args\":{\"detail\":");
+                trace_write_string(file, event->detail);
+                fputc('}', file);
+            }
+            fputc('}', file);
+        }
+        fprintf(file, "\n]}\n");
+        result = ferror(file) != 0;
+        result |= fclose(file);
+    }
+    if(result != 0)
+        printf("Unable to write trace %s\n", trace_path);
+
+    for(size_t i_event = 0; i_event < trace_num_events; ++i_event)
+        free(trace_events[i_event].detail);
+    free(trace_events);
+    trace_events = NULL;
+    trace_num_events = 0;
+    trace_capacity = 0;
+    free(trace_path);
+    trace_path = NULL;
+
+    return result;
+}
+
+uint64_t osp_trace_begin()
+{
+    return trace_enabled ? trace_now() : 0;
+}
+
+void osp_trace_end(const char *name, uint64_t start, const char *detail)
+{
+    if(!trace_enabled)
+        return;
+
+    uint64_t end = trace_now();
+    trace_event_t event =
+    {
+        .name = name,
+        .detail = detail != NULL ? strdup(detail) : NULL,
+        .start = start - trace_origin,
+        .duration = end - start
+    };
+
+    pthread_mutex_lock(&trace_mutex);
+    if(trace_tid == 0)
+        trace_tid = ++trace_num_tids;
+    event.tid = trace_tid;
+    if(trace_num_events == trace_capacity)
+    {
+        trace_capacity = trace_capacity > 0 ? trace_capacity * 2 : 1024;
+        trace_events = realloc(trace_events, trace_capacity * sizeof(trace_event_t));
+    }
+    trace_events[trace_num_events++] = event;
+    pthread_mutex_unlock(&trace_mutex);
+}
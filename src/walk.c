@@ -0,0 +1,187 @@
+#include "walk.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Entries found in a single directory
+typedef struct _walk_dir
+{
+    // Directory path relative to root, "" or ending in '/'
+    char *prefix;
+    // Subdirectory prefixes, char*
+    osp_dynarray_t subdirs;
+    // File paths relative to root, char*
+    osp_dynarray_t files;
+} walk_dir_t;
+
+// Shared state for scanning one directory level
+typedef struct _walk_context
+{
+    int root_fd;
+    // Directories of the current level
+    walk_dir_t *dirs;
+    // Directory prefixes of the next level, char*
+    osp_dynarray_t next_level;
+    // All the files found so far, char*
+    osp_dynarray_t files;
+} walk_context_t;
+
+// Concatenate prefix and name, plus an optional suffix
+static char *walk_join(const char *prefix, const char *name, const char *suffix)
+{
+    size_t prefix_length = strlen(prefix);
+    size_t name_length = strlen(name);
+    size_t suffix_length = strlen(suffix);
+    char *path = malloc(prefix_length + name_length + suffix_length + 1);
+    memcpy(path, prefix, prefix_length);
+    memcpy(path + prefix_length, name, name_length);
+    memcpy(path + prefix_length + name_length, suffix, suffix_length + 1);
+    return path;
+}
+
+static void walk_scan_dir(void *context, size_t index)
+{
+    walk_context_t *walk = (walk_context_t *)context;
+    walk_dir_t *dir = &(walk->dirs[index]);
+    dir->subdirs = osp_dynarray_new(sizeof(char *), 16, 16);
+    dir->files = osp_dynarray_new(sizeof(char *), 16, 16);
+
+    // Open the directory relative to root, dropping the trailing '/'
+    size_t prefix_length = strlen(dir->prefix);
+    int fd;
+    if(prefix_length == 0)
+        fd = openat(walk->root_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    else
+    {
+        dir->prefix[prefix_length - 1] = '\0';
+        fd = openat(walk->root_fd, dir->prefix,
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        dir->prefix[prefix_length - 1] = '/';
+    }
+    if(fd < 0)
+    {
+        printf("\tUnable to open directory %s\n", dir->prefix);
+        return;
+    }
+    DIR *directory = fdopendir(fd);
+    if(directory == NULL)
+    {
+        close(fd);
+        printf("\tUnable to open directory %s\n", dir->prefix);
+        return;
+    }
+
+    struct dirent *entry;
+    while((entry = readdir(directory)))
+    {
+        // Exclude the special "." and ".." directories
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        // Symbolic links are followed, like stat does
+        unsigned char type = entry->d_type;
+        if(type == DT_UNKNOWN || type == DT_LNK)
+        {
+            struct stat entry_stat;
+            if(fstatat(fd, entry->d_name, &entry_stat, 0) != 0)
+                continue;
+            type = S_ISDIR(entry_stat.st_mode) ? DT_DIR
+                 : S_ISREG(entry_stat.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if(type == DT_DIR)
+        {
+            char *subdir = walk_join(dir->prefix, entry->d_name, "/");
+            osp_dynarray_add(dir->subdirs, &subdir);
+        }
+        else if(type == DT_REG)
+        {
+            char *file = walk_join(dir->prefix, entry->d_name, "");
+            osp_dynarray_add(dir->files, &file);
+        }
+    }
+    closedir(directory);
+}
+
+static void walk_commit_dir(void *context, size_t index)
+{
+    walk_context_t *walk = (walk_context_t *)context;
+    walk_dir_t *dir = &(walk->dirs[index]);
+
+    char **subdirs = (char **)osp_dynarray_get_data(dir->subdirs);
+    for(size_t i_subdir = 0; i_subdir < osp_dynarray_get_count(dir->subdirs); ++i_subdir)
+        osp_dynarray_add(walk->next_level, &(subdirs[i_subdir]));
+    char **files = (char **)osp_dynarray_get_data(dir->files);
+    for(size_t i_file = 0; i_file < osp_dynarray_get_count(dir->files); ++i_file)
+        osp_dynarray_add(walk->files, &(files[i_file]));
+
+    osp_dynarray_delete(dir->subdirs);
+    osp_dynarray_delete(dir->files);
+    free(dir->prefix);
+}
+
+static int walk_compare(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+osp_dynarray_t osp_walk(const char *root, const char *prefix, uint32_t num_threads)
+{
+    int root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(root_fd < 0)
+        return NULL;
+
+    walk_context_t walk =
+    {
+        .root_fd = root_fd,
+        .dirs = NULL,
+        .next_level = osp_dynarray_new(sizeof(char *), 16, 16),
+        .files = osp_dynarray_new(sizeof(char *), 256, 256)
+    };
+    char *first = strdup(prefix);
+    osp_dynarray_add(walk.next_level, &first);
+
+    // Breadth first, every directory of a level is a parallel task
+    osp_dynarray_t level = osp_dynarray_new(sizeof(char *), 16, 16);
+    while(osp_dynarray_get_count(walk.next_level) > 0)
+    {
+        osp_dynarray_t swap = level;
+        level = walk.next_level;
+        walk.next_level = swap;
+        osp_dynarray_clear(walk.next_level);
+
+        size_t num_dirs = osp_dynarray_get_count(level);
+        char **prefixes = (char **)osp_dynarray_get_data(level);
+        walk.dirs = malloc(sizeof(walk_dir_t) * num_dirs);
+        for(size_t i_dir = 0; i_dir < num_dirs; ++i_dir)
+            walk.dirs[i_dir].prefix = prefixes[i_dir];
+
+        osp_parallel_run(num_dirs, num_threads, walk_scan_dir,
+                         walk_commit_dir, &walk);
+        free(walk.dirs);
+    }
+    osp_dynarray_delete(level);
+    osp_dynarray_delete(walk.next_level);
+    close(root_fd);
+
+    // Sorted, so the order doesn't depend on the file system or threads
+    qsort(osp_dynarray_get_data(walk.files), osp_dynarray_get_count(walk.files),
+          sizeof(char *), walk_compare);
+    return walk.files;
+}
+
+void osp_walk_free(osp_dynarray_t files)
+{
+    if(files == NULL)
+        return;
+
+    char **paths = (char **)osp_dynarray_get_data(files);
+    for(size_t i_file = 0; i_file < osp_dynarray_get_count(files); ++i_file)
+        free(paths[i_file]);
+    osp_dynarray_delete(files);
+}
@@ -0,0 +1,238 @@
+#include "writer.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct _osp_writer
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+    // Output file for file writers, NULL for memory writers
+    FILE *file;
+    // Bytes already flushed to the file, so tell works for both kinds
+    uint64_t flushed;
+    // Set when a file write failed, reported by osp_writer_flush
+    uint8_t failed;
+};
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define OSP_WRITER_SWAP_BYTES 1
+#else
+#define OSP_WRITER_SWAP_BYTES 0
+#endif
+
+void osp_writer_grow(osp_writer_t writer, size_t needed)
+{
+    size_t new_capacity = writer->capacity;
+    while(new_capacity < needed)
+        new_capacity *= 2;
+
+    writer->data = osp_mem_realloc(writer->data, new_capacity);
+    writer->capacity = new_capacity;
+}
+
+// Make room for size more bytes, returns the write position
+static inline char *osp_writer_reserve(osp_writer_t writer, size_t size)
+{
+    if(writer->size + size > writer->capacity)
+    {
+        if(writer->file != NULL)
+            osp_writer_flush(writer);
+        if(writer->size + size > writer->capacity)
+            osp_writer_grow(writer, writer->size + size);
+    }
+
+    char *position = writer->data + writer->size;
+    writer->size += size;
+    return position;
+}
+
+osp_writer_t osp_writer_new(const size_t initial_capacity)
+{
+    osp_writer_t writer = (osp_writer_t)osp_mem_calloc(1, sizeof(struct _osp_writer));
+    writer->capacity = initial_capacity > 0 ? initial_capacity : 64;
+    writer->data = osp_mem_malloc(writer->capacity);
+
+    return writer;
+}
+
+osp_writer_t osp_writer_new_file(FILE *file, const size_t buffer_size)
+{
+    if(file == NULL)
+        return NULL;
+
+    osp_writer_t writer = osp_writer_new(buffer_size);
+    writer->file = file;
+    writer->flushed = ftell(file);
+
+    return writer;
+}
+
+void osp_writer_put_u8(osp_writer_t writer, uint8_t value)
+{
+    *osp_writer_reserve(writer, 1) = (char)value;
+}
+
+void osp_writer_put_u16(osp_writer_t writer, uint16_t value)
+{
+#if OSP_WRITER_SWAP_BYTES
+    value = __builtin_bswap16(value);
+#endif
+    memcpy(osp_writer_reserve(writer, sizeof(value)), &value, sizeof(value));
+}
+
+void osp_writer_put_u32(osp_writer_t writer, uint32_t value)
+{
+#if OSP_WRITER_SWAP_BYTES
+    value = __builtin_bswap32(value);
+#endif
+    memcpy(osp_writer_reserve(writer, sizeof(value)), &value, sizeof(value));
+}
+
+void osp_writer_put_u64(osp_writer_t writer, uint64_t value)
+{
+#if OSP_WRITER_SWAP_BYTES
+    value = __builtin_bswap64(value);
+#endif
+    memcpy(osp_writer_reserve(writer, sizeof(value)), &value, sizeof(value));
+}
+
+void osp_writer_put_i32(osp_writer_t writer, int32_t value)
+{
+    osp_writer_put_u32(writer, (uint32_t)value);
+}
+
+void osp_writer_put_f32(osp_writer_t writer, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    osp_writer_put_u32(writer, bits);
+}
+
+void osp_writer_put_u16_array(osp_writer_t writer, const uint16_t *values, size_t count)
+{
+#if OSP_WRITER_SWAP_BYTES
+    for(size_t i_value = 0; i_value < count; ++i_value)
+        osp_writer_put_u16(writer, values[i_value]);
+#else
+    osp_writer_put_bytes(writer, values, count * sizeof(uint16_t));
+#endif
+}
+
+void osp_writer_put_u32_array(osp_writer_t writer, const uint32_t *values, size_t count)
+{
+#if OSP_WRITER_SWAP_BYTES
+    for(size_t i_value = 0; i_value < count; ++i_value)
+        osp_writer_put_u32(writer, values[i_value]);
+#else
+    osp_writer_put_bytes(writer, values, count * sizeof(uint32_t));
+#endif
+}
+
+void osp_writer_put_u64_array(osp_writer_t writer, const uint64_t *values, size_t count)
+{
+#if OSP_WRITER_SWAP_BYTES
+    for(size_t i_value = 0; i_value < count; ++i_value)
+        osp_writer_put_u64(writer, values[i_value]);
+#else
+    osp_writer_put_bytes(writer, values, count * sizeof(uint64_t));
+#endif
+}
+
+void osp_writer_put_bytes(osp_writer_t writer, const void *data, size_t size)
+{
+    if(size == 0)
+        return;
+
+    // Big blocks skip the file writer buffer altogether
+    if(writer->file != NULL && size >= writer->capacity)
+    {
+        osp_writer_flush(writer);
+        if(fwrite(data, 1, size, writer->file) != size)
+            writer->failed = 1;
+        writer->flushed += size;
+        return;
+    }
+
+    memcpy(osp_writer_reserve(writer, size), data, size);
+}
+
+void osp_writer_put_string(osp_writer_t writer, const char *string)
+{
+    uint64_t length = string != NULL ? strlen(string) : 0;
+    osp_writer_put_u64(writer, length);
+    osp_writer_put_bytes(writer, string, length);
+}
+
+void osp_writer_put_zeros(osp_writer_t writer, size_t count)
+{
+    while(count > 0)
+    {
+        size_t chunk = count < writer->capacity ? count : writer->capacity;
+        memset(osp_writer_reserve(writer, chunk), 0, chunk);
+        count -= chunk;
+    }
+}
+
+uint64_t osp_writer_tell(osp_writer_t writer)
+{
+    return writer->flushed + writer->size;
+}
+
+const char *osp_writer_get_data(osp_writer_t writer)
+{
+    return writer->data;
+}
+
+size_t osp_writer_get_size(osp_writer_t writer)
+{
+    return writer->size;
+}
+
+char *osp_writer_detach(osp_writer_t writer, size_t *size)
+{
+    char *data = writer->data;
+    if(size != NULL)
+        *size = writer->size;
+
+    // The writer can still be used, with a fresh buffer
+    writer->data = osp_mem_malloc(writer->capacity);
+    writer->size = 0;
+
+    return data;
+}
+
+void osp_writer_clear(osp_writer_t writer)
+{
+    writer->size = 0;
+}
+
+int osp_writer_flush(osp_writer_t writer)
+{
+    if(writer->file == NULL)
+        return 0;
+
+    if(writer->size > 0)
+    {
+        if(fwrite(writer->data, 1, writer->size, writer->file) != writer->size)
+            writer->failed = 1;
+        writer->flushed += writer->size;
+        writer->size = 0;
+    }
+
+    if(fflush(writer->file) != 0)
+        writer->failed = 1;
+
+    return writer->failed ? -1 : 0;
+}
+
+void osp_writer_delete(osp_writer_t writer)
+{
+    if(writer == NULL)
+        return;
+
+    osp_writer_flush(writer);
+    osp_mem_free(writer->data);
+    osp_mem_free(writer);
+}